@@ -58,6 +58,7 @@ public:
     CtUpdateAmbassador(const shared_ptr<ITetheringOffloadCallback>& /* cb */);
     /* ------------------- CONNTRACK TIMEOUT UPDATER ------------------------ */
     void updateTimeout(IpaNatTimeoutUpdate /* update */);
+    void updateTimeouts(const std::vector<IpaNatTimeoutUpdate>& /* updates */);
 private:
     static bool translate(IpaNatTimeoutUpdate /* in */, AIDLNatTimeoutUpdate& /* out */);
     static bool translate(IpaIpAddrPortPair /* in */, AIDLIpAddrPortPair& /* out */);
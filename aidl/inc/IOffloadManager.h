@@ -31,6 +31,7 @@
 
 /* External Includes */
 #include <sys/types.h>
+#include <vector>
 
 /* Internal Includes */
 #include "OffloadStatistics.h"
@@ -165,6 +166,11 @@ public:
         } natTimeoutUpdate_t;
         virtual ~ConntrackTimeoutUpdater(){}
         virtual void updateTimeout(NatTimeoutUpdate /* update */) {}
+        /* all updates collected during one timestamp sweep */
+        virtual void updateTimeouts(const std::vector<NatTimeoutUpdate>& updates) {
+            for (const NatTimeoutUpdate& update : updates)
+                updateTimeout(update);
+        }
     }; /* ConntrackTimeoutUpdater */
 
     /**
@@ -90,6 +90,31 @@ void CtUpdateAmbassador::updateTimeout(IpaNatTimeoutUpdate in) {
     }
 } /* updateTimeout */
 
+void CtUpdateAmbassador::updateTimeouts(const std::vector<IpaNatTimeoutUpdate>& in) {
+    /* The framework callback only takes a single update, so the batch is
+     * translated and forwarded in one pass with one summary error log.
+     */
+    AIDLNatTimeoutUpdate out;
+    size_t failed = 0;
+
+    if (DBG) {
+        ALOGD("updateTimeouts(%zu)", in.size());
+    }
+    for (const IpaNatTimeoutUpdate& update : in) {
+        if (!translate(update, out)) {
+            failed++;
+            continue;
+        }
+        auto ret = mFramework->updateTimeout(out);
+        if (!ret.isOk()) {
+            failed++;
+        }
+    }
+    if (failed > 0) {
+        ALOGE("Failed to forward %zu of %zu timeout events", failed, in.size());
+    }
+} /* updateTimeouts */
+
 bool CtUpdateAmbassador::translate(IpaNatTimeoutUpdate in, AIDLNatTimeoutUpdate &out) {
     return translate(in.src, out.src)
             && translate(in.dst, out.dst)
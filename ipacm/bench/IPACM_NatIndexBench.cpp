@@ -0,0 +1,351 @@
+/*
+Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause-Clear
+*/
+/*!
+	@file
+	IPACM_NatIndexBench.cpp
+
+	@brief
+	Micro-benchmark of the NAT cache 5-tuple index against the linear
+	cache scan it replaced, standalone, no IPA driver needed
+
+	usage: ipacm_nat_bench [ops]
+
+	@Author
+
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "IPACM_Conntrack_NatIndex.h"
+
+#define BENCH_DEF_OPS   20000
+#define BENCH_FILL_DIV  4   /* cache filled to 3/4, the rest is churn room */
+
+static const int bench_sizes[] = { 512, 4096, 16384 };
+
+typedef struct _bench_cache
+{
+	nat_table_entry *cache;
+	int max_entries;
+	/* hash side only */
+	int *index;
+	uint32_t mask;
+	int tombstones;
+	int *free_slots;
+	int num_free;
+}bench_cache;
+
+typedef struct _bench_result
+{
+	double add_ns;
+	double hit_ns;
+	double miss_ns;
+	double del_ns;
+}bench_result;
+
+static uint32_t bench_seed;
+
+static uint32_t BenchRand(void)
+{
+	bench_seed ^= bench_seed << 13;
+	bench_seed ^= bench_seed >> 17;
+	bench_seed ^= bench_seed << 5;
+	return bench_seed;
+}
+
+static uint64_t GetTimeNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void RandTuple(nat_table_entry *rule)
+{
+	memset(rule, 0, sizeof(*rule));
+	rule->private_ip = 0xC0A80000 | (BenchRand() & 0xFFFF);
+	rule->target_ip = BenchRand() | 1;
+	rule->private_port = (BenchRand() & 0xFFFF) | 1;
+	rule->target_port = (BenchRand() & 0xFFFF) | 1;
+	rule->protocol = (BenchRand() & 1) ? 6 : 17;
+}
+
+static bool IsFree(const nat_table_entry *entry)
+{
+	return (entry->private_ip == 0 && entry->target_ip == 0 &&
+		entry->private_port == 0 && entry->target_port == 0 &&
+		entry->protocol == 0);
+}
+
+/* the scan ChkForDup, AddEntry and DeleteEntry used before the index */
+static int LinearFind(const bench_cache *bc, const nat_table_entry *rule)
+{
+	int cnt;
+
+	for(cnt = 0; cnt < bc->max_entries; cnt++)
+	{
+		if(SameTuple(&bc->cache[cnt], rule))
+		{
+			return cnt;
+		}
+	}
+	return -1;
+}
+
+static int LinearAdd(bench_cache *bc, const nat_table_entry *rule)
+{
+	int cnt;
+
+	if(LinearFind(bc, rule) >= 0)
+	{
+		return -1;
+	}
+	for(cnt = 0; cnt < bc->max_entries; cnt++)
+	{
+		if(IsFree(&bc->cache[cnt]))
+		{
+			bc->cache[cnt] = *rule;
+			return cnt;
+		}
+	}
+	return -1;
+}
+
+static int LinearDel(bench_cache *bc, const nat_table_entry *rule)
+{
+	int cnt;
+
+	cnt = LinearFind(bc, rule);
+	if(cnt >= 0)
+	{
+		memset(&bc->cache[cnt], 0, sizeof(bc->cache[cnt]));
+	}
+	return cnt;
+}
+
+/* same bookkeeping as NatApp::AllocEntry, FreeEntry and RebuildIndex */
+static void HashRebuild(bench_cache *bc)
+{
+	int cnt;
+
+	memset(bc->index, 0xff, sizeof(int) * (bc->mask + 1));
+	bc->tombstones = 0;
+	for(cnt = 0; cnt < bc->max_entries; cnt++)
+	{
+		if(!IsFree(&bc->cache[cnt]))
+		{
+			NatIndexInsert(bc->index, bc->mask, &bc->cache[cnt], cnt);
+		}
+	}
+}
+
+static int HashAdd(bench_cache *bc, const nat_table_entry *rule)
+{
+	int slot;
+
+	if(NatIndexFind(bc->index, bc->mask, bc->cache, rule) >= 0 || bc->num_free == 0)
+	{
+		return -1;
+	}
+	slot = bc->free_slots[--bc->num_free];
+	bc->cache[slot] = *rule;
+	if(NatIndexInsert(bc->index, bc->mask, rule, slot))
+	{
+		bc->tombstones--;
+	}
+	return slot;
+}
+
+static int HashDel(bench_cache *bc, const nat_table_entry *rule)
+{
+	int slot;
+
+	slot = NatIndexFind(bc->index, bc->mask, bc->cache, rule);
+	if(slot < 0)
+	{
+		return -1;
+	}
+	if(NatIndexRemove(bc->index, bc->mask, &bc->cache[slot], slot))
+	{
+		bc->tombstones++;
+	}
+	memset(&bc->cache[slot], 0, sizeof(bc->cache[slot]));
+	bc->free_slots[bc->num_free++] = slot;
+	if(bc->tombstones > (int)((bc->mask + 1) / 4))
+	{
+		HashRebuild(bc);
+	}
+	return slot;
+}
+
+static int BenchInit(bench_cache *bc, int max_entries)
+{
+	uint32_t size = 1;
+	int cnt;
+
+	while(size < (uint32_t)max_entries * 2)
+	{
+		size <<= 1;
+	}
+
+	memset(bc, 0, sizeof(*bc));
+	bc->max_entries = max_entries;
+	bc->mask = size - 1;
+	bc->cache = (nat_table_entry *)calloc(max_entries, sizeof(nat_table_entry));
+	bc->index = (int *)malloc(sizeof(int) * size);
+	bc->free_slots = (int *)malloc(sizeof(int) * max_entries);
+	if(bc->cache == NULL || bc->index == NULL || bc->free_slots == NULL)
+	{
+		return -1;
+	}
+
+	memset(bc->index, 0xff, sizeof(int) * size);
+	for(cnt = max_entries - 1; cnt >= 0; cnt--)
+	{
+		bc->free_slots[bc->num_free++] = cnt;
+	}
+	return 0;
+}
+
+static void BenchFree(bench_cache *bc)
+{
+	free(bc->cache);
+	free(bc->index);
+	free(bc->free_slots);
+}
+
+/* Run the same add / hit / miss / delete sequence on one cache, live holds
+   the tuples currently cached. Returns the number of wrong lookup results,
+   -1 if out of memory */
+static int BenchRun(int max_entries, int ops, bool hashed, bench_result *res)
+{
+	bench_cache bc;
+	nat_table_entry *live, *miss, rule;
+	int num_live, fill, cnt, pick, slot, errors = 0, ret = -1;
+	uint64_t start;
+
+	if(BenchInit(&bc, max_entries))
+	{
+		BenchFree(&bc);
+		return -1;
+	}
+	live = (nat_table_entry *)malloc(sizeof(nat_table_entry) * max_entries);
+	miss = (nat_table_entry *)malloc(sizeof(nat_table_entry) * ops);
+	if(live == NULL || miss == NULL)
+	{
+		goto fail;
+	}
+
+	bench_seed = 0x1234567 + max_entries;
+	fill = max_entries - max_entries / BENCH_FILL_DIV;
+	for(num_live = 0; num_live < fill; )
+	{
+		RandTuple(&rule);
+		if((hashed ? HashAdd(&bc, &rule) : LinearAdd(&bc, &rule)) >= 0)
+		{
+			live[num_live++] = rule;
+		}
+	}
+	for(cnt = 0; cnt < ops; cnt++)
+	{
+		RandTuple(&miss[cnt]);
+		miss[cnt].protocol = 1; /* never cached */
+	}
+
+	start = GetTimeNs();
+	for(cnt = 0; cnt < ops; cnt++)
+	{
+		pick = BenchRand() % num_live;
+		slot = hashed ? NatIndexFind(bc.index, bc.mask, bc.cache, &live[pick]) :
+			LinearFind(&bc, &live[pick]);
+		errors += (slot < 0);
+	}
+	res->hit_ns = (double)(GetTimeNs() - start) / ops;
+
+	start = GetTimeNs();
+	for(cnt = 0; cnt < ops; cnt++)
+	{
+		slot = hashed ? NatIndexFind(bc.index, bc.mask, bc.cache, &miss[cnt]) :
+			LinearFind(&bc, &miss[cnt]);
+		errors += (slot >= 0);
+	}
+	res->miss_ns = (double)(GetTimeNs() - start) / ops;
+
+	/* connection churn, one close and one open per op */
+	res->del_ns = 0;
+	res->add_ns = 0;
+	for(cnt = 0; cnt < ops; cnt++)
+	{
+		pick = BenchRand() % num_live;
+		start = GetTimeNs();
+		slot = hashed ? HashDel(&bc, &live[pick]) : LinearDel(&bc, &live[pick]);
+		res->del_ns += GetTimeNs() - start;
+		errors += (slot < 0);
+
+		/* a random tuple may already be cached, the rejected add is timed too */
+		do
+		{
+			RandTuple(&rule);
+			start = GetTimeNs();
+			slot = hashed ? HashAdd(&bc, &rule) : LinearAdd(&bc, &rule);
+			res->add_ns += GetTimeNs() - start;
+		} while(slot < 0);
+		live[pick] = rule;
+	}
+	res->del_ns /= ops;
+	res->add_ns /= ops;
+	ret = errors;
+
+fail:
+	free(live);
+	free(miss);
+	BenchFree(&bc);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	bench_result lin, hash;
+	int ops = BENCH_DEF_OPS, lin_err, hash_err;
+	unsigned int cnt;
+
+	if(argc > 1)
+	{
+		ops = atoi(argv[1]);
+		if(ops <= 0)
+		{
+			fprintf(stderr, "usage: %s [ops]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	printf("%-8s %-7s %10s %10s %10s %10s\n", "entries", "lookup", "add ns", "hit ns", "miss ns", "del ns");
+	for(cnt = 0; cnt < sizeof(bench_sizes) / sizeof(bench_sizes[0]); cnt++)
+	{
+		lin_err = BenchRun(bench_sizes[cnt], ops, false, &lin);
+		hash_err = BenchRun(bench_sizes[cnt], ops, true, &hash);
+		if(lin_err < 0 || hash_err < 0)
+		{
+			fprintf(stderr, "out of memory at %d entries\n", bench_sizes[cnt]);
+			return 1;
+		}
+		if(lin_err > 0 || hash_err > 0)
+		{
+			fprintf(stderr, "%d entries: %d wrong linear and %d wrong hash lookups\n",
+				bench_sizes[cnt], lin_err, hash_err);
+			return 1;
+		}
+		printf("%-8d %-7s %10.1f %10.1f %10.1f %10.1f\n", bench_sizes[cnt], "linear",
+			lin.add_ns, lin.hit_ns, lin.miss_ns, lin.del_ns);
+		printf("%-8d %-7s %10.1f %10.1f %10.1f %10.1f\n", bench_sizes[cnt], "hash",
+			hash.add_ns, hash.hit_ns, hash.miss_ns, hash.del_ns);
+	}
+
+	return 0;
+}
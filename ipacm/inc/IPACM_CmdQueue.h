@@ -40,9 +40,11 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define IPA_CONNTRACK_MESSAGE_H
 
 #include <pthread.h>
+#include <atomic>
 #include "IPACM_Defs.h"
 
-
+/* number of preallocated slots per queue, must be a power of 2 */
+#define IPA_CMD_QUEUE_RING_SIZE 1024
 
 /*---------------------------------------------------------------------------
 	 Event data required by IPA_CM
@@ -66,11 +68,14 @@ private:
 	Message *m_next;
 
 public:
+	/* ring slot sequence, producers and consumer hand the slot over on it */
+	std::atomic<uint32_t> seq;
 	cmd_t evt;
 
 	Message()
 	{
 		m_next = NULL;
+		seq.store(0, std::memory_order_relaxed);
 		evt.callback_ptr = NULL;
 	}
 	~Message() { }
@@ -78,28 +83,64 @@ public:
 	Message* getnext()       { return m_next; }
 };
 
+/* Bounded lock-free multi-producer/single-consumer queue. Producers
+ * claim a preallocated slot with a CAS on enq_pos, the only consumer is
+ * MessageQueue::Process. When the ring is full, events spill to a
+ * mutex protected overflow list so that no event is ever dropped. */
 class MessageQueue
 {
 
 private:
+	Message *ring;
+	uint32_t ring_mask;
+	std::atomic<uint32_t> enq_pos;
+	std::atomic<uint32_t> deq_pos;
+
+	/* overflow list, only used while the ring is full */
+	pthread_mutex_t ovf_lock;
 	Message *Head;
 	Message *Tail;
-	Message* dequeue(void);
+	std::atomic<bool> overflowed;
+
+	/* statistics */
+	std::atomic<uint32_t> high_water;
+	std::atomic<uint32_t> num_enqueued;
+	std::atomic<uint32_t> num_overflow;
+
+	bool dequeue(cmd_t *evt);
+	bool ring_enqueue(const cmd_t *evt);
+	int overflow_enqueue(const cmd_t *evt);
+	bool overflow_dequeue(cmd_t *evt);
+
 	static MessageQueue *inst_internal;
 	static MessageQueue *inst_external;
 
-	MessageQueue()
-	{
-		Head = NULL;
-		Tail = NULL;
-	}
+	/* eventfd shared by both queues to wake up the consumer */
+	static int wake_fd;
+	static std::atomic<bool> consumer_waiting;
+	static pthread_once_t init_once;
+	static void (*idle_hook)(void);
+	static void init_instances(void);
+	static void wakeup(void);
+
+	MessageQueue(uint32_t size);
 
 public:
 
-	~MessageQueue() { }
-	void enqueue(Message *item);
+	~MessageQueue();
+	int enqueue(const cmd_t *evt);
+
+	/* number of events currently queued in the ring */
+	uint32_t getOccupancy(void);
+	/* highest ring occupancy seen so far */
+	uint32_t getHighWater(void) { return high_water.load(std::memory_order_relaxed); }
+	/* number of events spilled to the overflow list */
+	uint32_t getOverflowCount(void) { return num_overflow.load(std::memory_order_relaxed); }
+	uint32_t getEnqueueCount(void) { return num_enqueued.load(std::memory_order_relaxed); }
 
 	static void* Process(void *);
+	/* called on the consumer thread each time both queues are drained */
+	static void setIdleHook(void (*hook)(void)) { idle_hook = hook; }
 	static MessageQueue* getInstanceInternal();
 	static MessageQueue* getInstanceExternal();
 
@@ -114,6 +114,11 @@ public:
 
 	const char* ipa_nat_memtype;
 	int ipa_nat_max_entries;
+	int ipa_nat_batch_size;
+	int ipa_nat_sram_hot_flows;
+	int ipa_nat_ct_cache_entries;
+	int ipa_nat_pending_flows;
+	int ipa_neighbor_clients;
 
 	bool ipacm_odu_router_mode;
 
@@ -235,6 +240,31 @@ public:
 		return ipa_nat_memtype;
 	}
 
+	inline int GetNatBatchSize(void)
+	{
+		return ipa_nat_batch_size;
+	}
+
+	inline int GetNatSramHotFlows(void)
+	{
+		return ipa_nat_sram_hot_flows;
+	}
+
+	inline int GetNatCtCacheEntries(void)
+	{
+		return ipa_nat_ct_cache_entries;
+	}
+
+	inline int GetNatPendingFlows(void)
+	{
+		return ipa_nat_pending_flows;
+	}
+
+	inline int GetNeighborClients(void)
+	{
+		return ipa_neighbor_clients;
+	}
+
 	inline int GetNatIfacesCnt()
 	{
 		return ipa_nat_iface_entries;
@@ -374,6 +404,11 @@ private:
 
 	static const int DEFAULT_IPV6CT_MAX_ENTRIES = 500;
 	const char* DEFAULT_NAT_MEMTYPE = "DDR";
+	static const int DEFAULT_NAT_BATCH_SIZE = 16;
+	static const int DEFAULT_NAT_SRAM_HOT_FLOWS = 128;
+	static const int DEFAULT_NAT_CT_CACHE_ENTRIES = 512;
+	static const int DEFAULT_NAT_PENDING_FLOWS = 256;
+	static const int DEFAULT_NEIGHBOR_CLIENTS = 128;
 
 	enum ipa_hw_type ver;
 	static IPACM_Config *pInstance;
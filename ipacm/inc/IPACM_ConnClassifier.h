@@ -0,0 +1,109 @@
+/*
+Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause-Clear
+*/
+/*!
+	@file
+	IPACM_ConnClassifier.h
+
+	@brief
+	This file implements the IPACM connection classifier definitions
+
+	@Author
+
+*/
+#ifndef IPACM_CONNCLASSIFIER_H
+#define IPACM_CONNCLASSIFIER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+#include "IPACM_Defs.h"
+#include "IPACM_Xml.h"
+
+/* address lists fed by the conntrack listener */
+enum
+{
+	CONN_CLS_LIST_NAT_IFACE = 0,
+	CONN_CLS_LIST_NONNAT_IFACE,
+	CONN_CLS_LIST_STA_CLNT,
+	CONN_CLS_LISTS
+};
+
+/* verdict bits returned by Classify */
+#define CONN_CLS_NAT_IFACE       (1 << CONN_CLS_LIST_NAT_IFACE)
+#define CONN_CLS_NONNAT_IFACE    (1 << CONN_CLS_LIST_NONNAT_IFACE)
+#define CONN_CLS_STA_CLNT        (1 << CONN_CLS_LIST_STA_CLNT)
+#define CONN_CLS_PRIVATE_SUBNET  (1 << CONN_CLS_LISTS)
+
+#define CONN_CLS_LIST_MAX        64
+/* open addressing slots, at most half full with every list at its max */
+#define CONN_CLS_ADDR_SLOTS      512
+#define CONN_CLS_MAX_SUBNETS     (IPA_MAX_PRIVATE_SUBNET_ENTRIES + IPA_MAX_MTU_ENTRIES)
+#define CONN_CLS_TRIE_NODES      (32 * CONN_CLS_MAX_SUBNETS + 1)
+#define CONN_CLS_MAX_ALG_PORTS   256
+
+typedef struct _conn_cls_trie_node
+{
+	int16_t child[2];
+	bool match;
+}conn_cls_trie_node;
+
+/* compiled, read only lookup tables */
+typedef struct _conn_cls_tbl
+{
+	/* ip address -> verdict bits, key 0 marks a free slot */
+	uint32_t addr_key[CONN_CLS_ADDR_SLOTS];
+	uint8_t addr_cls[CONN_CLS_ADDR_SLOTS];
+
+	/* private subnets as a binary prefix trie, node 0 is the root */
+	conn_cls_trie_node trie[CONN_CLS_TRIE_NODES];
+	int num_nodes;
+	/* subnets whose mask is not a plain prefix */
+	ipa_private_subnet odd_subnet[CONN_CLS_MAX_SUBNETS];
+	int num_odd;
+
+	/* one bit per port for tcp and udp */
+	uint8_t alg_tcp[65536 / 8];
+	uint8_t alg_udp[65536 / 8];
+}conn_cls_tbl;
+
+/* Compiles the nat/non nat/STA address lists, the private subnets and
+ * the ALG ports into one table consulted per conntrack event. Every
+ * change rebuilds the table off line and publishes it with one pointer
+ * swap. Lookups and rebuilds all run on the cmd queue thread, so the
+ * replaced table is freed right away; a lookup from another thread would
+ * need a real grace period first. */
+class IPACM_ConnClassifier
+{
+public:
+	static IPACM_ConnClassifier* GetInstance();
+
+	void SetAddrList(int list, const uint32_t *addr, int cnt);
+	void SetAlgPorts(const ipacm_alg *ports, int cnt);
+	void Rebuild();
+
+	uint8_t Classify(uint32_t ip_addr);
+	bool isAlgPort(uint8_t proto, uint16_t port);
+
+private:
+	static IPACM_ConnClassifier *pInstance;
+
+	pthread_mutex_t lock;
+	std::atomic<conn_cls_tbl *> active;
+
+	uint32_t addrs[CONN_CLS_LISTS][CONN_CLS_LIST_MAX];
+	int num_addrs[CONN_CLS_LISTS];
+	ipacm_alg alg_ports[CONN_CLS_MAX_ALG_PORTS];
+	int num_alg_ports;
+	uint32_t rebuilds;
+
+	IPACM_ConnClassifier();
+
+	static void AddAddr(conn_cls_tbl *, uint32_t, uint8_t);
+	static void AddSubnet(conn_cls_tbl *, uint32_t, uint32_t);
+	static bool MatchSubnet(const conn_cls_tbl *, uint32_t);
+};
+
+#endif /* IPACM_CONNCLASSIFIER_H */
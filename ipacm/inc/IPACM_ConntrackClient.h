@@ -54,12 +54,63 @@ extern "C"
 {
 #include <libnetfilter_conntrack/libnetfilter_conntrack.h>
 #include <libnetfilter_conntrack/libnetfilter_conntrack_tcp.h>
+#include <libnfnetlink/libnfnetlink.h>
 #include <sys/inotify.h>
 }
 
-#define UDP_TIMEOUT_UPDATE 20
 #define BROADCAST_IPV4_ADDR 0xFFFFFFFF
 
+/* conntrack reactor: epoll slots, datagrams read per fd per wakeup and
+   the receive buffer requested for the event sockets */
+#define CT_REACTOR_MAX_EVENTS   4
+#define CT_REACTOR_DRAIN_BUDGET 16
+#define CT_REACTOR_RCVBUF       (1024 * 1024)
+
+/* addresses kept out of user space by the socket filters, the kernel
+   takes at most 127 per direction; filter stats are logged every
+   CT_FILTER_STATS_EVENTS events */
+#define CT_FILTER_MAX_ADDRS     96
+#define CT_FILTER_STATS_EVENTS  4096
+/* open addressing slots of the filter snapshot, a power of 2 well above
+   CT_FILTER_MAX_ADDRS */
+#define CT_FILTER_SNAP_SLOTS    256
+
+/* conntrack events staged per reactor wakeup so that later events of a
+   flow replace earlier ones before they are queued */
+#define CT_COALESCE_MAX         256
+#define CT_COALESCE_BUCKETS     512
+
+typedef struct
+{
+	ipacm_ct_evt_data *data;
+	uint32_t hash;
+	/* the first event of the flow in this window was NEW */
+	bool created;
+	int next;
+}ct_stage_slot;
+
+typedef struct
+{
+	/* owner, the entry goes away with it; "" for permanent entries */
+	char ifname[IPA_IFACE_NAME_LEN];
+	uint32_t addr;
+	/* broadcast addresses only ever show up as destination */
+	bool dst_only;
+}ct_filter_addr;
+
+#define CT_FILTER_MATCH_DST 0x1
+#define CT_FILTER_MATCH_SRC 0x2
+
+/* read only copy of the address set for the reactor, published by
+   RegenerateFilters; addr 0 marks a free slot */
+typedef struct
+{
+	uint32_t gen;
+	uint64_t start_us;
+	uint32_t addr[CT_FILTER_SNAP_SLOTS];
+	uint8_t match[CT_FILTER_SNAP_SLOTS];
+}ct_filter_snap;
+
 class IPACM_ConntrackClient
 {
 
@@ -70,24 +121,64 @@ private:
    struct nfct_handle *udp_hdl;
    struct nfct_filter *tcp_filter;
    struct nfct_filter *udp_filter;
-   static int IPA_Conntrack_Filters_Ignore_Local_Addrs(struct nfct_filter *filter);
-   static int IPA_Conntrack_Filters_Ignore_Bridge_Addrs(struct nfct_filter *filter);
-   static int IPA_Conntrack_Filters_Ignore_Local_Iface(struct nfct_filter *, ipacm_event_iface_up *);
    IPACM_ConntrackClient();
 
+   /* managed filter address set, regenerated into both socket filters on
+      every change */
+   pthread_mutex_t filter_lock;
+   ct_filter_addr filter_addrs[CT_FILTER_MAX_ADDRS];
+   int num_filter_addrs;
+   uint32_t filter_gen;
+   bool SetFilterAddrs(const char *, const uint32_t *, const bool *, int);
+   int BuildFilter(struct nfct_filter *, uint8_t);
+   int RegenerateFilters(void);
+   void PublishFilterSnap(uint64_t);
+
+   /* the reactor checks events against the current snapshot without
+      taking filter_lock, the other one is rebuilt on the next change */
+   ct_filter_snap filter_snap[2];
+   std::atomic<int> filter_snap_cur;
+   /* reactor thread only, the counters cover the snapshot generation */
+   uint32_t stat_gen;
+   uint32_t filter_events;
+   uint32_t filter_leaked;
+   uint64_t filter_start_us;
+   void CountFilterEvent(const ipacm_ct_record *);
+
+   /* single thread serving both conntrack sockets and the sweep timer */
+   int epoll_fd;
+   int timer_fd;
+   bool reactor_started;
+   uint32_t enobufs_tcp;
+   uint32_t enobufs_udp;
+   static void* ConntrackReactor(void *);
+   static int AddToReactor(int fd);
+   static void SetCTRcvBuf(int fd);
+   static void DrainConnTrack(struct nfct_handle *, unsigned int, uint32_t *, const char *);
+   static void PostCTEvent(const struct nlmsghdr *, unsigned int);
+
+   /* per flow coalescing window, only touched by the reactor thread */
+   ct_stage_slot stage[CT_COALESCE_MAX];
+   int stage_bucket[CT_COALESCE_BUCKETS];
+   int num_staged;
+   uint32_t coalesce_in;
+   uint32_t coalesce_posted;
+   uint32_t coalesce_superseded;
+   uint32_t coalesce_cancelled;
+   uint32_t coalesce_logged;
+   void StageCTEvent(ipacm_ct_evt_data *);
+   void FlushCTEvents(void);
+
 public:
-   static int IPAConntrackEventCB(enum nf_conntrack_msg_type type,
-                                  struct nf_conntrack *ct,
-                                  void *data);
-
-   static int IPA_Conntrack_UDP_Filter_Init(void);
-   static int IPA_Conntrack_TCP_Filter_Init(void);
-   static void* TCPRegisterWithConnTrack(void *);
-   static void* UDPRegisterWithConnTrack(void *);
-   static void* UDPConnTimeoutUpdate(void *);
-
-   static void UpdateUDPFilters(void *, bool);
-   static void UpdateTCPFilters(void *, bool);
+   static int ParseCTRecord(const struct nlmsghdr *, ipacm_ct_record *);
+
+   static int StartReactor(void);
+   static int TCPRegisterWithConnTrack(void);
+   static int UDPRegisterWithConnTrack(void);
+   static void ArmSweepTimer(void);
+
+   static void AddIfaceFilter(const ipacm_event_iface_up *);
+   static void DelIfaceFilter(const char *);
    static void Read_TcpUdp_Timeout(char *in, int len);
 
    static IPACM_ConntrackClient* GetInstance();
@@ -47,26 +47,72 @@ typedef uint32_t in_addr_t;
 #include "IPACM_Listener.h"
 #ifdef CT_OPT
 #include "IPACM_LanToLan.h"
+#include "IPACM_Conntrack_V6Flow.h"
 #endif
 
 #define MAX_IFACE_ADDRESS 50
 #define MAX_STA_CLNT_IFACES 10
 #define STA_CLNT_SUBNET_MASK 0xFFFFFF00
 
+/* kernel ipv4 neighbor table, the client addresses restored from the
+   snapshot are dropped unless the kernel still resolves them */
+#define IPACM_ARP_FILE       "/proc/net/arp"
+#define IPACM_ARP_MAX_ADDRS  512
+
 typedef struct _nat_entry_bundle
 {
-	struct nf_conntrack *ct;
+	const ipacm_ct_record *ct;
 	enum nf_conntrack_msg_type type;
 	nat_table_entry *rule;
 	bool isTempEntry;
 
 }nat_entry_bundle;
 
+/* bootstrap conntrack dump, entries are not capped */
+#define CT_DUMP_RECV_BUFFER_SIZE (64 * 1024)
+#define CT_DUMP_INIT_ENTRIES     1024
+/* entries a classify thread takes at a time, smaller dumps stay serial */
+#define CT_DUMP_WORKER_BATCH     512
+#define CT_DUMP_MAX_WORKERS      4
+
+/* how a conntrack record maps onto the nat table */
+enum
+{
+	CT_CLASS_SKIP = 0,   /* loopback, unsupported or malformed */
+	CT_CLASS_NAT,        /* rule populated for the nat table */
+	CT_CLASS_NON_NAT,    /* neither side is the wan address */
+	CT_CLASS_V6          /* ipv6 connection, CT_OPT only */
+};
+
+typedef struct _ct_dump_class
+{
+	nat_table_entry rule;
+	int verdict;
+}ct_dump_class;
+
+class IPACM_ConntrackListener;
+
+/* dump classification shared by the classify threads */
+typedef struct _ct_dump_work
+{
+	IPACM_ConntrackListener *listener;
+	const ipacm_ct_evt_data *entries;
+	ct_dump_class *classes;
+	int num_entries;
+	std::atomic<int> next;
+}ct_dump_work;
+
+/* pre-WAN holding cache slot, chained in its hash bucket and on the LRU
+   list, a free slot has type NFCT_T_UNKNOWN and sits on the free list */
 typedef struct _ct_entry
 {
-	struct nf_conntrack *ct;
+	ipacm_ct_record ct;
 	u_int8_t  protocol;
 	enum nf_conntrack_msg_type type;
+	int hnext;
+	/* lprev points towards the most recently used end */
+	int lprev;
+	int lnext;
 }ct_entry;
 
 class IPACM_ConntrackListener : public IPACM_Listener
@@ -86,29 +132,62 @@ private:
 	uint32_t nonnat_iface_ipv4_addr[MAX_IFACE_ADDRESS];
 	uint32_t sta_clnt_ipv4_addr[MAX_STA_CLNT_IFACES];
 	IPACM_Config *pConfig;
-	ct_entry *ct_entries;
-	ct_entry ct_cache[MAX_CONNTRACK_ENTRIES];
+	IPACM_ConnClassifier *conn_cls;
+	ipacm_ct_evt_data *ct_entries;
+	int num_ct_entries;
+
+	/* connections seen while WAN is down, replayed on WAN up */
+	ct_entry *ct_cache;
+	int *ct_cache_bucket;
+	uint32_t ct_cache_mask;
+	int ct_cache_size;
+	int ct_cache_cnt;
+	int ct_cache_free;
+	int ct_cache_mru;
+	int ct_cache_lru;
+	uint32_t ct_cache_evictions;
+	uint32_t ct_cache_drops;
 #ifdef CT_OPT
 	IPACM_LanToLan *p_lan2lan;
+	V6FlowApp *v6_flows;
 #endif
 
 	void ProcessCTMessage(void *);
-	bool ProcessTCPorUDPMsg(struct nf_conntrack *,
+	bool ProcessTCPorUDPMsg(const ipacm_ct_record *,
 	enum nf_conntrack_msg_type, u_int8_t);
+	int ClassifyTCPorUDPMsg(const ipacm_ct_record *, nat_table_entry *);
+	bool CommitTCPorUDPMsg(const ipacm_ct_record *,
+	enum nf_conntrack_msg_type, int, nat_table_entry *);
+	void ClassifyDumpEntry(const ipacm_ct_evt_data *, ct_dump_class *);
+	void ClassifyDump(ct_dump_class *);
+	static void ClassifyDumpBatches(ct_dump_work *);
+	static void* ClassifyDumpWorker(void *);
 	void TriggerWANUp(void *);
 	void TriggerWANDown(uint32_t);
 	int  CreateNatThreads(void);
 	bool AddIface(nat_table_entry *, bool *);
 	void AddORDeleteNatEntry(const nat_entry_bundle *);
-	void PopulateTCPorUDPEntry(struct nf_conntrack *, uint32_t, nat_table_entry *);
+	void PopulateTCPorUDPEntry(const ipacm_ct_record *, uint32_t, nat_table_entry *);
 	void CheckSTAClient(const nat_table_entry *, bool *);
 	int CheckNatIface(ipacm_event_data_all *, bool *);
 	void HandleNonNatIPAddr(void *, bool);
 	void HandleNatTableMove(void *in_param);
+	void UpdateAddrList(int);
+	void RevalidateAddrList(int, uint32_t *, int, const uint32_t *, int);
+	void InitCTCache(int);
+	void ResetCTCache(void);
+	int FindCTCache(const ipacm_ct_record *, uint32_t);
+	int AllocCTCache(uint32_t);
+	void FreeCTCache(int);
+	void UnlinkCTCacheLRU(int);
+	void LinkCTCacheMRU(int);
 
 #ifdef CT_OPT
 	void ProcessCTV6Message(void *);
-	void HandleLan2Lan(struct nf_conntrack *,
+	void NotifyV6FlowDel(const v6_flow_entry *, int);
+	void ExpireV6Flows(void);
+	void HandleV6ClntDiscon(const ipacm_event_data_all *);
+	void HandleLan2Lan(const ipacm_ct_record *,
 		enum nf_conntrack_msg_type, nat_table_entry* );
 #endif
 
@@ -131,7 +210,7 @@ public:
 	int  CreateConnTrackThreads(void);
 	void readConntrack(int fd);
 	void processConntrack(void);
-	void CacheORDeleteConntrack(struct nf_conntrack *ct,
+	void CacheORDeleteConntrack(const ipacm_ct_record *ct,
 		enum nf_conntrack_msg_type type, u_int8_t protocol);
 	void processCacheConntrack(void);
 };
@@ -32,9 +32,22 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string.h>  /* for stderror */
 #include <stdlib.h>
 #include <cstdio>  /* for perror */
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <atomic>
 
 #include "IPACM_Config.h"
 #include "IPACM_Xml.h"
+#include "IPACM_NatSnapshot.h"
+#include "IPACM_ConnClassifier.h"
+#include "IPACM_Conntrack_NatIndex.h"
+#ifdef FEATURE_IPACM_AIDL
+#include <vector>
+#include "IPACM_OffloadManager.h"
+#endif
 
 extern "C"
 {
@@ -42,32 +55,109 @@ extern "C"
 #include <ipa_nat_drv.h>
 }
 
-#define MAX_TEMP_ENTRIES 25
-
 #define IPACM_TCP_FULL_FILE_NAME  "/proc/sys/net/ipv4/netfilter/ip_conntrack_tcp_timeout_established"
 #define IPACM_UDP_FULL_FILE_NAME   "/proc/sys/net/ipv4/netfilter/ip_conntrack_udp_timeout_stream"
 
-typedef struct _nat_table_entry
+/* per cache slot links chaining the entries of one client */
+typedef struct _nat_cache_link
+{
+	/* chain keyed on private_ip */
+	int pnext;
+	int pprev;
+	/* chain keyed on target_ip */
+	int tnext;
+	int tprev;
+}nat_cache_link;
+
+/* rule add/delete waiting for the next batch flush */
+typedef struct _nat_pending_op
+{
+	nat_table_entry rule;
+	bool add;
+}nat_pending_op;
+
+/* flow waiting for its client to be resolved, chained per private ip and
+   per target ip and kept on an age list, oldest first */
+typedef struct _nat_pending_flow
+{
+	nat_table_entry rule;
+	uint64_t added_us;
+	nat_cache_link link;
+	int anext;
+	int aprev;
+	bool used;
+}nat_pending_flow;
+
+/* pending flows older than this are dropped by the timestamp sweep */
+#define NAT_PFLOW_MAX_AGE_MS     300000
+
+/* number of private ip chains, must be a power of 2 */
+#define NAT_CLNT_BUCKETS 64
+
+/* timestamp sweep: slots per shard and bounds of a full cache pass */
+#define NAT_SWEEP_SHARD_SIZE     64
+#define NAT_SWEEP_MIN_PERIOD_MS  10000
+#define NAT_SWEEP_DEF_PERIOD_MS  20000
+#define NAT_SWEEP_MAX_PERIOD_MS  80000
+#define NAT_SWEEP_MIN_TICK_MS    100
+
+/* hot flow placement: score credited per sweep pass with traffic, a flow
+   turns hot at NAT_HEAT_HOT and only cools down again below NAT_HEAT_COLD */
+#define NAT_HEAT_HIT             64
+#define NAT_HEAT_HOT             96
+#define NAT_HEAT_COLD            48
+/* consecutive passes that must agree before the table changes tier */
+#define NAT_PLACE_HYST_PASSES    3
+
+typedef struct _nat_flow_heat
 {
-	uint32_t private_ip;
-	uint16_t private_port;
+	uint8_t score;
+	bool hot;
+}nat_flow_heat;
 
-	uint32_t target_ip;
-	uint16_t target_port;
+/* conntrack timeout updates sent per sendmsg and kept for ack matching */
+#define NAT_CT_MSG_SIZE          512
+#define NAT_CT_BATCH_MAX         32
+#define NAT_CT_INFLIGHT_MAX      128
 
-	uint32_t public_ip;
-	uint16_t public_port;
+/* sent conntrack update waiting for its netlink ack */
+typedef struct _nat_ct_inflight
+{
+	uint32_t seq;
+	nat_table_entry rule;
+}nat_ct_inflight;
 
-	u_int8_t  protocol;
-	uint32_t timestamp;
+/* regions of the warm restart snapshot */
+enum
+{
+	NAT_SNAP_CACHE = 0,      /* nat cache slots */
+	NAT_SNAP_TEMP,           /* pending flows */
+	NAT_SNAP_ADDRS,          /* conntrack listener address lists */
+	NAT_SNAP_META,           /* last public ip */
+	NAT_SNAP_REGIONS
+};
 
-	bool dst_nat;
-	bool enabled;
-	uint32_t rule_hdl;
+/* conntrack listener address lists kept in the snapshot */
+enum
+{
+	NAT_SNAP_NAT_IFACE = 0,
+	NAT_SNAP_NONNAT_IFACE,
+	NAT_SNAP_STA_CLNT,
+	NAT_SNAP_ADDR_LISTS
+};
 
-	/* used for pcie-modem */
-	uint32_t rule_id;
-}nat_table_entry;
+#define NAT_SNAP_ADDR_MAX 64
+
+typedef struct _nat_snap_addr_list
+{
+	uint32_t cnt;
+	uint32_t addr[NAT_SNAP_ADDR_MAX];
+}nat_snap_addr_list;
+
+typedef struct _nat_snap_meta
+{
+	uint32_t pub_ip;
+}nat_snap_meta;
 
 #define CHK_TBL_HDL()  if(nat_table_hdl == 0){ return -1; }
 
@@ -78,7 +168,6 @@ private:
 	static NatApp *pInstance;
 
 	nat_table_entry *cache;
-	nat_table_entry temp[MAX_TEMP_ENTRIES];
 	uint32_t pub_ip_addr;
 	uint32_t pub_ip_addr_pre;
 	uint32_t nat_table_hdl;
@@ -87,10 +176,81 @@ private:
 
 	int curCnt, max_entries;
 
+	/* open addressing index over cache, keyed on the 5-tuple */
+	int *hash_index;
+	uint32_t hash_mask;
+	int hash_tombstones;
+
+	/* stack of unused cache slots */
+	int *free_slots;
+	int num_free_slots;
+
+	/* restore order of cache slots used when the table is rebuilt */
+	int *rebuild_slots;
+
+	/* per client chains over cache, bucketed by ip hash */
+	nat_cache_link *links;
+	int pclnt_head[NAT_CLNT_BUCKETS];
+	int *tclnt_head;
+
 	const char* mem_type;
 
+	/* flows toward unresolved clients, keyed on private and target ip */
+	nat_pending_flow *pflow;
+	int pflow_size;
+	uint32_t pflow_mask;
+	int *pflow_phead;
+	int *pflow_thead;
+	int *pflow_free;
+	int pflow_num_free;
+	int pflow_oldest;
+	int pflow_newest;
+	uint32_t pflow_expired;
+	uint32_t pflow_evicted;
+
+	/* rule adds/deletes queued in arrival order, flushed when full or
+	   once the cmd queue is drained */
+	nat_pending_op *pending;
+	int num_pending;
+	int batch_size;
+	uint32_t batch_flushes;
+	uint32_t batch_ops;
+	uint32_t batch_merged;
+	uint32_t batch_cancelled;
+
+	/* incremental timestamp sweep, one shard per tick */
+	int sweep_cursor;
+	uint32_t sweep_period_ms;
+	std::atomic<uint32_t> sweep_tick_ms;
+	uint64_t sweep_start_us;
+	uint64_t sweep_vote_us;
+	uint32_t sweep_touched;
+	uint32_t sweep_changed;
+	uint32_t sweep_passes;
+
+	/* SRAM/DDR placement of the table driven by the hot flow count */
+	nat_flow_heat *heat;
+	int sram_hot_flows;
+	bool place_enabled;
+	bool place_modem_hold;
+	enum ipa3_nat_mem_in place_tier;
+	int place_votes;
+	uint32_t place_hot;
+	uint32_t place_hits;
+	uint32_t place_misses;
+	uint64_t place_total_hits;
+	uint64_t place_total_misses;
+	uint32_t place_switches;
+
+	/* warm restart snapshot, restored slots stay unconfirmed until the
+	   conntrack dump reports them again */
+	IPACM_NatSnapshot snap;
+	uint8_t *unconfirmed;
+	int num_unconfirmed;
+
 	ipacm_alg *pALGPorts;
 	uint16_t nALGPort;
+	IPACM_ConnClassifier *conn_cls;
 
 	uint32_t tcp_timeout;
 	uint32_t udp_timeout;
@@ -100,6 +260,20 @@ private:
 	struct nf_conntrack *ct;
 	struct nfct_handle *ct_hdl;
 
+	/* conntrack timeout updates batched over a sweep shard */
+#ifdef FEATURE_IPACM_AIDL
+	std::vector<natTimeoutUpdate_t> ct_updates;
+#else
+	char *ct_batch_buf;
+	int ct_batch_len;
+	int ct_batch_cnt;
+	uint32_t ct_seq;
+	nat_ct_inflight ct_inflight[NAT_CT_INFLIGHT_MAX];
+#endif
+	uint32_t ct_sends;
+	uint32_t ct_msgs;
+	uint32_t ct_nacks;
+
 	int m_fd_ipa;
 
 	NatApp();
@@ -107,11 +281,33 @@ private:
 	int Init();
 
 	void UpdateCTUdpTs(nat_table_entry *, uint32_t);
+	void SendCTUpdates();
+	void ProcessCTAcks();
 	bool ChkForDup(const nat_table_entry *);
+	int FindEntry(const nat_table_entry *);
+	int AllocEntry(const nat_table_entry *);
+	void FreeEntry(int);
+	void RebuildIndex();
+	uint32_t HashIp(uint32_t);
+	void LinkEntry(int);
+	void UnlinkEntry(int);
 	bool isAlgPort(uint8_t, uint16_t);
 	void Reset();
 	bool isPwrSaveIf(uint32_t);
 	uint32_t GenerateMetdata(uint8_t mux_id);
+	void EndSweepPass();
+	void RebuildTable(uint32_t);
+	void ScoreFlow(int, bool);
+	void PlaceTable();
+	void OpenSnapshot();
+	void RestoreSnapshot();
+	void SnapSlot(int);
+	void SnapTemp(int);
+	int FindPendingFlow(const nat_table_entry *);
+	int AddPendingFlow(const nat_table_entry *);
+	void FreePendingFlow(int);
+	void ExpirePendingFlows(uint64_t);
+	static void FlushOnIdle(void);
 
 public:
 	static NatApp* GetInstance();
@@ -124,10 +320,14 @@ public:
 	int AddEntry(const nat_table_entry *);
 	int DeleteEntry(const nat_table_entry *);
 
+	int QueueEntry(const nat_table_entry *, bool add);
+	void FlushBatch();
+
 	int AddConnection(const nat_table_entry *);
 	int DelConnection(const uint32_t);
 
 	void UpdateUDPTimeStamp();
+	uint32_t GetSweepTick();
 
 	int UpdatePwrSaveIf(uint32_t);
 	int ResetPwrSaveIf(uint32_t);
@@ -140,6 +340,10 @@ public:
 	void CacheEntry(const nat_table_entry *);
 	void DeleteTempEntry(const nat_table_entry *);
 	void FlushTempEntries(uint32_t, bool, bool isDummy = false);
+
+	void DropUnconfirmed();
+	void SaveAddrList(int, const uint32_t *, int);
+	int LoadAddrList(int, uint32_t *, int);
 };
 
 
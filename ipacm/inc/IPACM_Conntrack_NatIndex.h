@@ -0,0 +1,146 @@
+/*
+Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause-Clear
+*/
+/*!
+	@file
+	IPACM_Conntrack_NatIndex.h
+
+	@brief
+	This file implements the NAT cache entry and its 5-tuple index
+
+	@Author
+
+*/
+#ifndef IPACM_CONNTRACK_NATINDEX_H
+#define IPACM_CONNTRACK_NATINDEX_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+typedef struct _nat_table_entry
+{
+	uint32_t private_ip;
+	uint16_t private_port;
+
+	uint32_t target_ip;
+	uint16_t target_port;
+
+	uint32_t public_ip;
+	uint16_t public_port;
+
+	u_int8_t  protocol;
+	uint32_t timestamp;
+
+	bool dst_nat;
+	bool enabled;
+	uint32_t rule_hdl;
+
+	/* used for pcie-modem */
+	uint32_t rule_id;
+}nat_table_entry;
+
+/* hash index slot markers */
+#define NAT_HASH_EMPTY     (-1)
+#define NAT_HASH_TOMBSTONE (-2)
+
+static inline bool SameTuple(const nat_table_entry *a, const nat_table_entry *b)
+{
+	return (a->private_ip == b->private_ip &&
+		a->target_ip == b->target_ip &&
+		a->private_port == b->private_port &&
+		a->target_port == b->target_port &&
+		a->protocol == b->protocol);
+}
+
+static inline uint32_t NatHashTuple(const nat_table_entry *rule)
+{
+	uint32_t h;
+
+	h = rule->private_ip * 0x9E3779B1;
+	h ^= rule->target_ip + 0x7FEB352D + (h << 6) + (h >> 2);
+	h ^= (((uint32_t)rule->private_port << 16) | rule->target_port) + 0x846CA68B + (h << 6) + (h >> 2);
+	h ^= rule->protocol + (h << 6) + (h >> 2);
+
+	/* final avalanche so that the low bits used for the mask are well mixed */
+	h ^= h >> 16;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35;
+	h ^= h >> 16;
+	return h;
+}
+
+/* Open addressing index over a cache array, mask + 1 slots. The caller
+   keeps it at most half full so inserts always find a free slot. */
+
+/* Return the cache slot holding the 5-tuple of rule, -1 if not indexed */
+static inline int NatIndexFind(const int *index, uint32_t mask,
+	const nat_table_entry *cache, const nat_table_entry *rule)
+{
+	uint32_t idx, probe;
+	int slot;
+
+	idx = NatHashTuple(rule) & mask;
+	for(probe = 0; probe <= mask; probe++)
+	{
+		slot = index[idx];
+		if(slot == NAT_HASH_EMPTY)
+		{
+			break;
+		}
+		if(slot >= 0 && SameTuple(&cache[slot], rule))
+		{
+			return slot;
+		}
+		idx = (idx + 1) & mask;
+	}
+
+	return -1;
+}
+
+/* Index cache slot under the 5-tuple of rule, true if a tombstone was reused */
+static inline bool NatIndexInsert(int *index, uint32_t mask,
+	const nat_table_entry *rule, int slot)
+{
+	uint32_t idx;
+	bool reused;
+
+	idx = NatHashTuple(rule) & mask;
+	while(index[idx] >= 0)
+	{
+		idx = (idx + 1) & mask;
+	}
+	reused = (index[idx] == NAT_HASH_TOMBSTONE);
+	index[idx] = slot;
+
+	return reused;
+}
+
+/* Tombstone cache slot, entry holds its 5-tuple. False if it was not indexed */
+static inline bool NatIndexRemove(int *index, uint32_t mask,
+	const nat_table_entry *entry, int slot)
+{
+	uint32_t idx, probe;
+
+	idx = NatHashTuple(entry) & mask;
+	for(probe = 0; probe <= mask; probe++)
+	{
+		if(index[idx] == slot)
+		{
+			index[idx] = NAT_HASH_TOMBSTONE;
+			return true;
+		}
+		if(index[idx] == NAT_HASH_EMPTY)
+		{
+			break;
+		}
+		idx = (idx + 1) & mask;
+	}
+
+	return false;
+}
+
+#endif /* IPACM_CONNTRACK_NATINDEX_H */
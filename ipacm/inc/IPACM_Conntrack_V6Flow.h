@@ -0,0 +1,132 @@
+/*
+Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause-Clear
+*/
+/*!
+	@file
+	IPACM_Conntrack_V6Flow.h
+
+	@brief
+	This file implements the IPv6 routed flow table definitions
+
+	@Author
+
+*/
+#ifndef IPACM_CONNTRACK_V6FLOW_H
+#define IPACM_CONNTRACK_V6FLOW_H
+
+#include <stdint.h>
+#include <string.h>
+#include "IPACM_Defs.h"
+
+/* flow lifetime used when the conntrack event carries no timeout */
+#define V6_FLOW_DEF_TIMEOUT_S    300
+/* slots checked for expiry per sweep tick */
+#define V6_FLOW_SWEEP_SHARD_SIZE 64
+/* expired flows are only reclaimed once fewer than 1/N of the slots are free */
+#define V6_FLOW_RECLAIM_DIV      8
+
+/* routed ipv6 connection, addresses in host order */
+typedef struct _v6_flow_entry
+{
+	uint32_t src_ip[4];
+	uint32_t dst_ip[4];
+	uint16_t src_port;
+	uint16_t dst_port;
+	uint8_t protocol;
+
+	uint64_t added_us;
+	uint64_t expire_us;
+	uint32_t refreshes;
+}v6_flow_entry;
+
+static inline bool SameTuple(const v6_flow_entry *a, const v6_flow_entry *b)
+{
+	return (memcmp(a->src_ip, b->src_ip, sizeof(a->src_ip)) == 0 &&
+		memcmp(a->dst_ip, b->dst_ip, sizeof(a->dst_ip)) == 0 &&
+		a->src_port == b->src_port &&
+		a->dst_port == b->dst_port &&
+		a->protocol == b->protocol);
+}
+
+/* per slot links, tuple hash chain plus one chain per client side */
+typedef struct _v6_flow_link
+{
+	int hnext;
+	int snext;
+	int sprev;
+	int dnext;
+	int dprev;
+	bool used;
+}v6_flow_link;
+
+/* Mirror of the NatApp cache for routed ipv6 connections: flows are hashed
+ * on the full 128 bit tuple, chained per source and per destination
+ * address so a client leaving only walks its own flows, and carry the
+ * conntrack timeout so the sweep can reclaim the slots of flows whose
+ * events were lost. Udp flows get no update events and keep the short
+ * timeout of their NEW event, so a flow past its timeout may still be
+ * live: expiry only frees slots when the table runs short and is never
+ * reported as a connection delete. */
+class V6FlowApp
+{
+private:
+
+	static V6FlowApp *pInstance;
+
+	v6_flow_entry *flows;
+	v6_flow_link *links;
+	int max_entries;
+	int curCnt;
+
+	int *hash_head;
+	int *src_head;
+	int *dst_head;
+	uint32_t hash_mask;
+
+	/* stack of unused slots */
+	int *free_slots;
+	int num_free_slots;
+
+	int sweep_cursor;
+
+	uint32_t stat_adds;
+	uint32_t stat_dels;
+	uint32_t stat_refreshes;
+	uint32_t stat_expired;
+	uint32_t stat_drops;
+
+	/* flows reported to lan2lan while the table was full, their closes
+	   can not be matched and are reported without a tracked flow */
+	int num_untracked;
+
+	V6FlowApp();
+	int Init();
+
+	static uint32_t HashAddr(const uint32_t *);
+	uint32_t HashTuple(const v6_flow_entry *);
+	int FindFlow(const v6_flow_entry *);
+	void LinkFlow(int);
+	void UnlinkFlow(int);
+	void FreeFlow(int);
+
+public:
+	static V6FlowApp* GetInstance();
+
+	/* returns the slot, *isNew tells whether the flow was just added */
+	int AddFlow(const v6_flow_entry *, uint32_t timeout, bool *isNew);
+	bool RefreshFlow(const v6_flow_entry *, uint32_t timeout);
+	bool DeleteFlow(const v6_flow_entry *);
+	/* true if an untracked close has to be reported anyway */
+	bool ClaimUntracked(void);
+
+	/* flows removed are copied to out, which holds max entries */
+	int DelFlowsOnClntDiscon(const uint32_t *, v6_flow_entry *out, int max);
+	/* returns the number of slots reclaimed */
+	int ExpireFlows(void);
+
+	void PrintStats();
+};
+
+#endif /* IPACM_CONNTRACK_V6FLOW_H */
@@ -40,6 +40,8 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef IPA_CM_DEFS_H
 #define IPA_CM_DEFS_H
 
+#include <stdint.h>
+#include <time.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <linux/msm_ipa.h>
@@ -58,6 +60,15 @@ extern "C"
 #include <libnetfilter_conntrack/libnetfilter_conntrack_tcp.h>
 }
 
+/* monotonic clock in microseconds, for timeouts and stats */
+static inline uint64_t GetTimeUs()
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
 #define IF_NAME_LEN 16
 #define IPA_MAX_FILE_LEN  64
 #define IPA_IFACE_NAME_LEN 16
@@ -108,7 +119,6 @@ extern "C"
 #define NUM_IPV6_PREFIX_MTU_RULE 1
 
 #define MAX_CONNTRACK_ENTRIES 100
-#define CT_ENTRIES_BUFFER_SIZE 8096
 #define LOOPBACK_MASK 0xFF000000
 #define LOOPBACK_ADDR 0x7F000000
 
@@ -216,6 +226,7 @@ typedef enum
 	IPA_WIGIG_CLIENT_ADD_EVENT,               /* ipacm_event_data_mac_ep */
 	IPA_WIGIG_FST_SWITCH,                     /* ipacm_event_data_fst */
 	IPA_MOVE_NAT_TBL_EVENT,                   /* ipacm_event_move_nat */
+	IPA_NAT_TS_SWEEP_EVENT,                   /* NULL */
 	IPACM_EVENT_MAX
 } ipa_cm_event_id;
 
@@ -249,9 +260,35 @@ typedef enum
 	INTERNET
 } ipacm_wlan_access_mode;
 
+/* conntrack tuple, addresses and ports kept in network order as they
+   arrive in the netlink attributes; ipv4 only uses src_ip[0]/dst_ip[0] */
+typedef struct
+{
+	uint32_t src_ip[4];
+	uint32_t dst_ip[4];
+	uint16_t src_port;
+	uint16_t dst_port;
+}ipacm_ct_tuple;
+
+/* fixed size conntrack record decoded straight from the netlink message,
+   the orig/reply tuple pair carries the nat mapping */
+typedef struct
+{
+	ipacm_ct_tuple orig;
+	ipacm_ct_tuple repl;
+	uint32_t status;
+	uint32_t timeout;
+	uint32_t mark;
+	uint32_t id;
+	uint8_t l3proto;
+	uint8_t l4proto;
+	uint8_t tcp_state;
+	uint8_t tcp_flags;
+}ipacm_ct_record;
+
 typedef struct
 {
-	struct nf_conntrack *ct;
+	ipacm_ct_record ct;
 	enum nf_conntrack_msg_type type;
 }ipacm_ct_evt_data;
 
@@ -0,0 +1,74 @@
+/*
+Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause-Clear
+*/
+/*!
+	@file
+	IPACM_EvtDataPool.h
+
+	@brief
+	This file implements the IPACM event payload pool definitions
+
+	@Author
+
+*/
+#ifndef IPACM_EVTDATAPOOL_H
+#define IPACM_EVTDATAPOOL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "IPACM_Defs.h"
+
+/* fixed size event payloads served from the pool */
+typedef enum
+{
+	IPACM_EVT_DATA_FID = 0,    /* ipacm_event_data_fid */
+	IPACM_EVT_DATA_MAC,        /* ipacm_event_data_mac */
+	IPACM_EVT_DATA_IPTYPE,     /* ipacm_event_data_iptype */
+	IPACM_EVT_DATA_ADDR,       /* ipacm_event_data_addr */
+	IPACM_EVT_DATA_ALL,        /* ipacm_event_data_all */
+	IPACM_EVT_DATA_CT,         /* ipacm_ct_evt_data */
+	IPACM_EVT_DATA_MAX
+} ipacm_evt_data_type;
+
+typedef struct _ipacm_evt_pool_elem
+{
+	struct _ipacm_evt_pool_elem *next;
+} ipacm_evt_pool_elem;
+
+typedef struct
+{
+	pthread_mutex_t lock;
+	uint8_t *arena;
+	size_t elem_size;
+	uint32_t num_elems;
+	ipacm_evt_pool_elem *free_list;
+
+	/* statistics */
+	uint32_t num_alloc;
+	uint32_t num_free;
+	uint32_t num_fallback;
+	uint32_t in_use;
+	uint32_t high_water;
+} ipacm_evt_pool;
+
+/* Thread-safe pool for the fixed size ipacm_event_data_* payloads.
+ * Every pointer handed to PostEvt is released by ProcessEvt through
+ * release(), which returns pool memory to its free list and frees
+ * anything else with free(), so producers still using malloc keep working. */
+class IPACM_EvtDataPool
+{
+public:
+	static void* alloc(ipacm_evt_data_type type);
+	static void release(void *ptr);
+	static void dump_stats(void);
+
+private:
+	static ipacm_evt_pool pools[IPACM_EVT_DATA_MAX];
+	static pthread_once_t init_once;
+	static void init(void);
+	static int find_pool(void *ptr);
+};
+
+#endif /* IPACM_EVTDATAPOOL_H */
@@ -45,13 +45,17 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "IPACM_Defs.h"
 #include "IPACM_Listener.h"
 
-/* queue */
+/* initial number of listener slots per event */
+#define IPA_EVT_LISTENER_INIT_SIZE 4
+
+/* listeners registered for one event, in registration order. A NULL
+ * slot is a listener removed while an event was being dispatched. */
 typedef struct _cmd_evts
 {
-	ipa_cm_event_id event;
-	IPACM_Listener *obj;
-	//int ipa_interface_index;
-	_cmd_evts *next;
+	IPACM_Listener **obj;
+	uint16_t num;
+	uint16_t size;
+	bool has_holes;
 }  cmd_evts;
 
 
@@ -70,7 +74,15 @@ public:
 	static void ProcessEvt(ipacm_cmd_q_data *);
 
 private:
-	static cmd_evts *head;
+	/* listener table indexed by event id */
+	static cmd_evts listeners[IPACM_EVENT_MAX];
+	/* nesting level of ProcessEvt, slots are only compacted at level 0 */
+	static int dispatch_depth;
+	/* events that got holes during a dispatch, compacted at level 0 */
+	static int dirty[IPACM_EVENT_MAX];
+	static int num_dirty;
+
+	static void compact(cmd_evts *evts);
 };
 
 #endif /* IPACM_EvtDispatcher_H */
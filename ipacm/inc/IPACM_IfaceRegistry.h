@@ -0,0 +1,74 @@
+/*
+Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause-Clear
+*/
+/*!
+	@file
+	IPACM_IfaceRegistry.h
+
+	@brief
+	This file implements the IPACM interface registry definitions
+
+	@Author
+
+*/
+#ifndef IPACM_IFACEREGISTRY_H
+#define IPACM_IFACEREGISTRY_H
+
+#include <pthread.h>
+#include "IPACM_Defs.h"
+
+/* open addressing slots keyed on the kernel ifindex, must be a power of 2 */
+#define IFACE_REG_SLOTS 256
+
+typedef struct _iface_reg_entry
+{
+	int ifindex;            /* 0 marks a free slot */
+	char name[IF_NAME_LEN];
+	int ipa_index;          /* INVALID_IFACE (-1) when not in the iface table */
+	ipacm_iface_type category;
+	bool gone;              /* RTM_DELLINK seen, kept for events in flight */
+}iface_reg_entry;
+
+/* Kernel ifindex -> interface name, IPA iface index and category.
+ * Kept current from RTM_NEWLINK/RTM_DELLINK, an index that was never
+ * announced is resolved once with SIOCGIFNAME and cached. A deleted link
+ * still resolves until its slot is needed, the link down event posted for
+ * it is handled after the interface is gone from the kernel. */
+class IPACM_IfaceRegistry
+{
+public:
+	static IPACM_IfaceRegistry* GetInstance();
+
+	/* netlink link events */
+	void LinkAdd(int ifindex, const char *name);
+	void LinkDel(int ifindex);
+
+	/* the iface table was reloaded, map every entry again */
+	void Reindex();
+
+	int GetName(int ifindex, char *name);
+	int GetIpaIndex(int ifindex);
+	bool Lookup(int ifindex, iface_reg_entry *entry);
+
+private:
+	static IPACM_IfaceRegistry *pInstance;
+
+	pthread_rwlock_t lock;
+	iface_reg_entry slots[IFACE_REG_SLOTS];
+	int num_entries;
+	uint32_t hits;
+	uint32_t misses;
+
+	IPACM_IfaceRegistry();
+
+	int FindSlot(int ifindex);
+	void Insert(int ifindex, const char *name);
+	void Remove(int ifindex);
+	void Purge();
+	void Resolve(iface_reg_entry *entry);
+	bool Fill(int ifindex);
+};
+
+#endif /* IPACM_IFACEREGISTRY_H */
@@ -0,0 +1,76 @@
+/*
+Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause-Clear
+*/
+/*!
+	@file
+	IPACM_NatSnapshot.h
+
+	@brief
+	This file implements the NAT cache warm restart snapshot definitions
+
+	@Author
+
+*/
+#ifndef IPACM_NATSNAPSHOT_H
+#define IPACM_NATSNAPSHOT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define IPACM_NAT_SNAPSHOT_FILE "/data/vendor/ipa/nat_cache.snap"
+
+#define NAT_SNAP_MAGIC         0x534E5049 /* "IPNS" */
+#define NAT_SNAP_VERSION       1
+#define NAT_SNAP_MAX_REGIONS   8
+
+/* one array of fixed size records kept in the snapshot */
+typedef struct
+{
+	uint32_t count;
+	uint32_t size;
+} nat_snap_region;
+
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_regions;
+	nat_snap_region region[NAT_SNAP_MAX_REGIONS];
+	uint32_t checksum;
+} nat_snap_hdr;
+
+/* Versioned, memory mapped record store that survives an ipacm restart.
+ * The file holds a header describing the layout followed by every region's
+ * records, each record carries its own checksum so a single update is a
+ * plain store into the mapping and a record torn by a crash reads back as
+ * empty. A file whose layout does not match the one asked for is wiped. */
+class IPACM_NatSnapshot
+{
+public:
+	IPACM_NatSnapshot();
+	~IPACM_NatSnapshot();
+
+	int Open(const char *file, const nat_snap_region *regions, int num_regions);
+	void Close();
+
+	/* true when Open found a valid snapshot left by the previous run */
+	bool IsRestored() { return restored; }
+
+	/* rec == NULL clears the record */
+	void Save(int region, uint32_t idx, const void *rec);
+	bool Load(int region, uint32_t idx, void *rec);
+
+private:
+	uint8_t *base;
+	size_t len;
+	bool restored;
+	nat_snap_hdr layout;
+	size_t offset[NAT_SNAP_MAX_REGIONS];
+
+	uint8_t* RecPtr(int region, uint32_t idx);
+	static uint32_t Checksum(const void *data, size_t size);
+};
+
+#endif /* IPACM_NATSNAPSHOT_H */
@@ -0,0 +1,80 @@
+/*
+Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause-Clear
+*/
+/*!
+	@file
+	IPACM_NeighDebounce.h
+
+	@brief
+	This file implements the IPACM neighbor event debouncer definitions
+
+	@Author
+
+*/
+#ifndef IPACM_NEIGHDEBOUNCE_H
+#define IPACM_NEIGHDEBOUNCE_H
+
+#include <stdint.h>
+#include "IPACM_Defs.h"
+
+/* open addressing slots keyed on (ifindex, ip), must be a power of 2 */
+#define NEIGH_DB_SLOTS        1024
+/* an unchanged neighbor is still forwarded once per refresh period so a
+   client the iface handlers dropped in the meantime comes back */
+#define NEIGH_DB_REFRESH_MS   30000
+
+/* reachability classes, NUD states within a class are not forwarded */
+#define NEIGH_DB_REACH_NONE   0
+#define NEIGH_DB_REACH_VALID  1  /* REACHABLE, STALE, DELAY, PROBE, PERMANENT, NOARP */
+#define NEIGH_DB_REACH_PEND   2  /* INCOMPLETE */
+#define NEIGH_DB_REACH_FAILED 3
+
+typedef struct _neigh_db_entry
+{
+	int ifindex;          /* 0 marks a free slot */
+	uint8_t family;
+	uint8_t reach;
+	uint8_t mac[IPA_MAC_ADDR_SIZE];
+	uint32_t ip[4];       /* network order, ipv4 in ip[0] */
+	uint64_t fwd_us;      /* last time the binding was forwarded */
+}neigh_db_entry;
+
+/* Drops RTM_NEWNEIGH updates that neither change the IP/MAC binding of
+ * a known neighbor nor its reachability class, e.g. the NUD cycle
+ * REACHABLE->STALE->DELAY->REACHABLE. Only used on the netlink thread. */
+class IPACM_NeighDebounce
+{
+public:
+	static IPACM_NeighDebounce* GetInstance();
+
+	/* true if the RTM_NEWNEIGH should be posted */
+	bool Forward(int ifindex, int family, const uint32_t *ip, const uint8_t *mac, uint16_t state);
+	/* RTM_DELNEIGH */
+	void Forget(int ifindex, int family, const uint32_t *ip);
+	/* link or address change, the next update of every neighbor goes through */
+	void FlushIface(int ifindex);
+
+	uint32_t GetForwarded() { return forwarded; }
+	uint32_t GetSuppressed() { return suppressed; }
+	void PrintStats();
+
+private:
+	static IPACM_NeighDebounce *pInstance;
+
+	neigh_db_entry slots[NEIGH_DB_SLOTS];
+	int num_entries;
+
+	uint32_t forwarded;
+	uint32_t suppressed;
+	uint32_t untracked;
+
+	IPACM_NeighDebounce();
+
+	static uint32_t Hash(int ifindex, const uint32_t *ip);
+	int FindSlot(int ifindex, int family, const uint32_t *ip);
+	void RemoveSlot(int slot);
+};
+
+#endif /* IPACM_NEIGHDEBOUNCE_H */
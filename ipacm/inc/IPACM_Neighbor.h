@@ -41,6 +41,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define IPACM_NEIGHBOR_H
 
 #include <stdio.h>
+#include <time.h>
 #include <IPACM_CmdQueue.h>
 #include <linux/msm_ipa.h>
 #include "IPACM_Routing.h"
@@ -48,16 +49,34 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "IPACM_Listener.h"
 #include "IPACM_Iface.h"
 
-#define IPA_MAX_NUM_NEIGHBOR_CLIENTS  100
+/* addresses remembered per client, the oldest one is replaced */
+#define IPA_NEIGHBOR_MAX_V4_ADDR  4
+#define IPA_NEIGHBOR_MAX_V6_ADDR  8
+/* clients not heard of for this long are dropped when room is needed */
+#define IPA_NEIGHBOR_MAX_AGE_S    3600
+/* addresses not heard of for this long are not replayed any more */
+#define IPA_NEIGHBOR_ADDR_AGE_S   600
 
 struct ipa_neighbor_client
 {
 	uint8_t mac_addr[6];
 	int iface_index;
-	uint32_t v4_addr;
+	/* oldest first, with the time each address was last seen */
+	uint32_t v4_addr[IPA_NEIGHBOR_MAX_V4_ADDR];
+	time_t v4_seen[IPA_NEIGHBOR_MAX_V4_ADDR];
+	int num_v4_addr;
+	uint32_t v6_addr[IPA_NEIGHBOR_MAX_V6_ADDR][4];
+	time_t v6_seen[IPA_NEIGHBOR_MAX_V6_ADDR];
+	int num_v6_addr;
 	int ipa_if_num;
 	/* add support for handling L2TP clients which associated with eth0 vlan interface */
 	char iface_name[IPA_IFACE_NAME_LEN];
+
+	time_t last_seen;
+	int hnext;          /* MAC hash chain */
+	int lnext;          /* last seen list, most recent first */
+	int lprev;
+	bool used;
 };
 
 class IPACM_Neighbor : public IPACM_Listener
@@ -74,9 +93,39 @@ private:
 
 	int num_neighbor_client;
 
-	int circular_index;
+	int max_neighbor_client;
+
+	/* client table sized by the NeighborClients config */
+	ipa_neighbor_client *neighbor_client;
+
+	int *hash_head;
+	uint32_t hash_mask;
+
+	/* stack of unused entries */
+	int *free_client;
+	int num_free_client;
+
+	int lru_head;
+	int lru_tail;
+
+	uint32_t num_evicted;
+	uint32_t num_aged;
+
+	static uint32_t HashMac(const uint8_t *mac);
+	int FindClient(const uint8_t *mac);
+	int AddClient(const uint8_t *mac, int if_index, int ipa_if_num, const char *iface_name);
+	void DelClient(int idx);
+	void TouchClient(int idx);
+	void ExpireClients(time_t now);
+
+	void AddV4Addr(int idx, uint32_t addr);
+	void DelV4Addr(int idx, uint32_t addr);
+	void AddV6Addr(int idx, const uint32_t *addr);
+	void DelV6Addr(int idx, const uint32_t *addr);
+	void ExpireClientAddrs(int idx, time_t now);
 
-	ipa_neighbor_client neighbor_client[IPA_MAX_NUM_NEIGHBOR_CLIENTS];
+	void PostClientAddrs(int idx, ipa_cm_event_id event);
+	void LogClient(const char *msg, int idx);
 
 };
 
@@ -83,7 +83,7 @@ extern "C"
 #include <stdlib.h>
 #include <errno.h>
 #include <pthread.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <linux/socket.h>
 #include <linux/version.h>
@@ -98,7 +98,17 @@ extern "C"
 #include "IPACM_Defs.h"
 
 #define MAX_NUM_OF_FD 10
-#define IPA_NL_MSG_MAX_LEN (2048)
+/* one datagram, large enough for a RTM_NEWLINK carrying link stats */
+#define IPA_NL_MSG_MAX_LEN (8192)
+/* datagrams read by one recvmmsg, and batches read per wakeup so one
+   socket cannot starve the others */
+#define IPA_NL_RECV_BATCH  16
+#define IPA_NL_RECV_BUDGET 4
+/* netlink receive stats are logged every IPA_NL_STATS_MSGS messages */
+#define IPA_NL_STATS_MSGS  4096
+/* startup dumps: reply buffer, and how long a reply may take */
+#define IPA_NL_DUMP_BUF_LEN   (32768)
+#define IPA_NL_DUMP_TIMEOUT_S 2
 
 /*--------------------------------------------------------------------------- 
 	 Type representing enumeration of NetLink event indication messages
@@ -153,9 +163,8 @@ typedef struct
 typedef struct
 {
 	ipa_nl_sk_fd_map_info_t sk_fds[MAX_NUM_OF_FD];
-	fd_set fdset;
 	int num_fd;
-	int max_fd;
+	int epoll_fd;
 } ipa_nl_sk_fd_set_info_t;
 
 typedef struct
@@ -178,6 +187,7 @@ typedef struct ipa_nl_proto_info_s {
 typedef struct
 {
 	struct ifinfomsg  metainfo;                   /* from header */
+	char              name[IF_NAME_LEN];          /* IFLA_IFNAME, empty if absent */
 } ipa_nl_link_info_t;
 
 
@@ -249,6 +259,15 @@ int ipa_nl_listener_init
 	 ipa_sock_thrd_fd_read_f read_f
 	 );
 
+/* Wait for messages on the sockets added by ipa_nl_listener_init, does not return */
+int ipa_nl_listener_start
+(
+	 ipa_nl_sk_fd_set_info_t *sk_fd_set
+	 );
+
+/* Post the links, addresses, routes and neighbors already present */
+int ipa_nl_prime_state(void);
+
 /*  Virtual function registered to receive incoming messages over the NETLINK routing socket*/
 int ipa_nl_recv_msg(int fd);
 
@@ -192,10 +192,16 @@ if (!(a)) {                                                 \
 #define IPACMNat_TAG                         "IPACMNAT"
 #define NAT_MaxEntries_TAG                   "MaxNatEntries"
 #define NAT_TableType_TAG                    "NatTableType"
+#define NAT_BatchSize_TAG                    "NatBatchSize"
+#define NAT_SramHotFlows_TAG                 "NatSramHotFlows"
+#define NAT_CtCacheEntries_TAG               "NatCtCacheEntries"
+#define NAT_PendingFlows_TAG                 "NatPendingFlows"
 
 #define IP_PassthroughFlag_TAG               "IPPassthroughFlag"
 #define IP_PassthroughMode_TAG               "IPPassthroughMode"
 
+#define NeighborClients_TAG                  "NeighborClients"
+
 /*---------------------------------------------------------------------------
       IP protocol numbers - use in dss_socket() to identify protocols.
       Also contains the extension header types for IPv6.
@@ -306,6 +312,11 @@ typedef struct  _IPACM_conf_t
 	ipacm_alg_conf_t alg_config;
 	int nat_max_entries;
 	const char* nat_table_memtype;
+	int nat_batch_size;
+	int nat_sram_hot_flows;
+	int nat_ct_cache_entries;
+	int nat_pending_flows;
+	int neighbor_clients;
 	bool odu_enable;
 	bool router_mode_enable;
 	bool odu_embms_enable;
@@ -38,26 +38,79 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 */
 #include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/eventfd.h>
 #include "IPACM_CmdQueue.h"
 #include "IPACM_Log.h"
 #include "IPACM_Iface.h"
-
-pthread_mutex_t mutex    = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t  cond_var = PTHREAD_COND_INITIALIZER;
+#include "IPACM_EvtDataPool.h"
 
 MessageQueue* MessageQueue::inst_internal = NULL;
 MessageQueue* MessageQueue::inst_external = NULL;
+int MessageQueue::wake_fd = -1;
+std::atomic<bool> MessageQueue::consumer_waiting(false);
+pthread_once_t MessageQueue::init_once = PTHREAD_ONCE_INIT;
+void (*MessageQueue::idle_hook)(void) = NULL;
+
+MessageQueue::MessageQueue(uint32_t size)
+{
+	uint32_t i;
+
+	ring = new Message[size];
+	ring_mask = size - 1;
+	for(i = 0; i < size; i++)
+	{
+		ring[i].seq.store(i, std::memory_order_relaxed);
+	}
+	enq_pos.store(0, std::memory_order_relaxed);
+	deq_pos.store(0, std::memory_order_relaxed);
+
+	pthread_mutex_init(&ovf_lock, NULL);
+	Head = NULL;
+	Tail = NULL;
+	overflowed.store(false, std::memory_order_relaxed);
+
+	high_water.store(0, std::memory_order_relaxed);
+	num_enqueued.store(0, std::memory_order_relaxed);
+	num_overflow.store(0, std::memory_order_relaxed);
+}
+
+MessageQueue::~MessageQueue()
+{
+	Message *item;
+
+	while(Head != NULL)
+	{
+		item = Head;
+		Head = Head->getnext();
+		delete item;
+	}
+	pthread_mutex_destroy(&ovf_lock);
+	delete[] ring;
+}
+
+void MessageQueue::init_instances(void)
+{
+	wake_fd = eventfd(0, EFD_CLOEXEC);
+	if(wake_fd < 0)
+	{
+		IPACMERR("unable to create cmd queue eventfd: %d(%s)\n", errno, strerror(errno));
+		return;
+	}
+
+	inst_internal = new MessageQueue(IPA_CMD_QUEUE_RING_SIZE);
+	inst_external = new MessageQueue(IPA_CMD_QUEUE_RING_SIZE);
+	IPACMDBG_H("created cmd queues with %d slots each\n", IPA_CMD_QUEUE_RING_SIZE);
+}
 
 MessageQueue* MessageQueue::getInstanceInternal()
 {
+	pthread_once(&init_once, init_instances);
 	if(inst_internal == NULL)
 	{
-		inst_internal = new MessageQueue();
-		if(inst_internal == NULL)
-		{
-			IPACMERR("unable to create internal Message Queue instance\n");
-			return NULL;
-		}
+		IPACMERR("unable to create internal Message Queue instance\n");
+		return NULL;
 	}
 
 	return inst_internal;
@@ -65,55 +118,197 @@ MessageQueue* MessageQueue::getInstanceInternal()
 
 MessageQueue* MessageQueue::getInstanceExternal()
 {
+	pthread_once(&init_once, init_instances);
 	if(inst_external == NULL)
 	{
-		inst_external = new MessageQueue();
-		if(inst_external == NULL)
+		IPACMERR("unable to create external Message Queue instance\n");
+		return NULL;
+	}
+
+	return inst_external;
+}
+
+uint32_t MessageQueue::getOccupancy(void)
+{
+	return enq_pos.load(std::memory_order_relaxed) - deq_pos.load(std::memory_order_relaxed);
+}
+
+bool MessageQueue::ring_enqueue(const cmd_t *evt)
+{
+	Message *slot;
+	uint32_t pos, seq, occupancy, hw;
+	int32_t diff;
+
+	pos = enq_pos.load(std::memory_order_relaxed);
+	while(1)
+	{
+		slot = &ring[pos & ring_mask];
+		seq = slot->seq.load(std::memory_order_acquire);
+		diff = (int32_t)(seq - pos);
+		if(diff == 0)
+		{
+			/* slot is free, try to claim it */
+			if(enq_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				break;
+			}
+		}
+		else if(diff < 0)
 		{
-			IPACMERR("unable to create external Message Queue instance\n");
-			return NULL;
+			/* ring is full */
+			return false;
+		}
+		else
+		{
+			pos = enq_pos.load(std::memory_order_relaxed);
 		}
 	}
 
-	return inst_external;
+	slot->evt = *evt;
+	slot->seq.store(pos + 1, std::memory_order_release);
+
+	occupancy = pos + 1 - deq_pos.load(std::memory_order_relaxed);
+	hw = high_water.load(std::memory_order_relaxed);
+	while(occupancy > hw &&
+		!high_water.compare_exchange_weak(hw, occupancy, std::memory_order_relaxed))
+	{
+	}
+	return true;
 }
 
-void MessageQueue::enqueue(Message *item)
+int MessageQueue::overflow_enqueue(const cmd_t *evt)
 {
-	if(!Head)
+	Message *item;
+
+	item = new Message();
+	if(item == NULL)
+	{
+		IPACMERR("unable to create new message item\n");
+		return IPACM_FAILURE;
+	}
+	item->evt = *evt;
+
+	if(pthread_mutex_lock(&ovf_lock) != 0)
+	{
+		IPACMERR("unable to lock the mutex\n");
+		delete item;
+		return IPACM_FAILURE;
+	}
+
+	if(Tail == NULL)
 	{
-		Tail = item;
 		Head = item;
 	}
 	else
 	{
-		if(Tail == NULL)
+		Tail->setnext(item);
+	}
+	Tail = item;
+	overflowed.store(true, std::memory_order_release);
+
+	if(pthread_mutex_unlock(&ovf_lock) != 0)
+	{
+		IPACMERR("unable to unlock the mutex\n");
+		return IPACM_FAILURE;
+	}
+
+	num_overflow.fetch_add(1, std::memory_order_relaxed);
+	return IPACM_SUCCESS;
+}
+
+int MessageQueue::enqueue(const cmd_t *evt)
+{
+	/* once events spilled, keep using the overflow list until the
+	   consumer drained it so ordering is preserved */
+	if(overflowed.load(std::memory_order_acquire) || !ring_enqueue(evt))
+	{
+		if(overflow_enqueue(evt) != IPACM_SUCCESS)
 		{
-			IPACMDBG("Tail is null\n");
-			Head->setnext(item);
+			return IPACM_FAILURE;
 		}
-		else
+	}
+	num_enqueued.fetch_add(1, std::memory_order_relaxed);
+
+	wakeup();
+	return IPACM_SUCCESS;
+}
+
+void MessageQueue::wakeup(void)
+{
+	uint64_t val = 1;
+
+	/* pairs with the fence in Process() before re-checking the queues */
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if(consumer_waiting.load(std::memory_order_relaxed))
+	{
+		if(write(wake_fd, &val, sizeof(val)) < 0)
 		{
-			Tail->setnext(item);
+			IPACMERR("unable to wake up cmd queue: %d(%s)\n", errno, strerror(errno));
 		}
-		Tail = item;
 	}
 }
 
-
-Message* MessageQueue::dequeue(void)
+bool MessageQueue::overflow_dequeue(cmd_t *evt)
 {
+	Message *item;
+
+	if(!overflowed.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	if(pthread_mutex_lock(&ovf_lock) != 0)
+	{
+		IPACMERR("unable to lock the mutex\n");
+		return false;
+	}
+
+	item = Head;
+	if(item != NULL)
+	{
+		Head = item->getnext();
+		if(Head == NULL)
+		{
+			Tail = NULL;
+		}
+	}
 	if(Head == NULL)
 	{
-		return NULL;
+		overflowed.store(false, std::memory_order_release);
 	}
-	else
+
+	if(pthread_mutex_unlock(&ovf_lock) != 0)
 	{
-		Message *tmp = Head;
-		Head = Head->getnext();
+		IPACMERR("unable to unlock the mutex\n");
+	}
+
+	if(item == NULL)
+	{
+		return false;
+	}
+	*evt = item->evt;
+	delete item;
+	return true;
+}
 
-		return tmp;
+bool MessageQueue::dequeue(cmd_t *evt)
+{
+	Message *slot;
+	uint32_t pos;
+
+	pos = deq_pos.load(std::memory_order_relaxed);
+	slot = &ring[pos & ring_mask];
+	if((int32_t)(slot->seq.load(std::memory_order_acquire) - (pos + 1)) < 0)
+	{
+		/* ring is empty, everything spilled later sits in the overflow list */
+		return overflow_dequeue(evt);
 	}
+
+	*evt = slot->evt;
+	/* hand the slot back to the producers for the next lap */
+	slot->seq.store(pos + ring_mask + 1, std::memory_order_release);
+	deq_pos.store(pos + 1, std::memory_order_relaxed);
+	return true;
 }
 
 
@@ -122,7 +317,9 @@ void* MessageQueue::Process(void *param)
 	#pragma unused (param)
 	MessageQueue *MsgQueueInternal = NULL;
 	MessageQueue *MsgQueueExternal = NULL;
-	Message *item = NULL;
+	cmd_t item;
+	bool found;
+	uint64_t val;
 	const char *eventName = NULL;
 
 	IPACMDBG("MessageQueue::Process()\n");
@@ -143,19 +340,13 @@ void* MessageQueue::Process(void *param)
 
 	while(1)
 	{
-		if(pthread_mutex_lock(&mutex) != 0)
+		found = MsgQueueInternal->dequeue(&item);
+		if(found == false)
 		{
-			IPACMERR("unable to lock the mutex\n");
-			return NULL;
-		}
-
-		item = MsgQueueInternal->dequeue();
-		if(item == NULL)
-		{
-			item = MsgQueueExternal->dequeue();
-			if(item)
+			found = MsgQueueExternal->dequeue(&item);
+			if(found)
 			{
-				eventName = IPACM_Iface::ipacmcfg->getEventName(item->evt.data.event);
+				eventName = IPACM_Iface::ipacmcfg->getEventName(item.data.event);
 				if (eventName != NULL)
 				{
 					IPACMDBG("Get event %s from external queue.\n",
@@ -165,7 +356,7 @@ void* MessageQueue::Process(void *param)
 		}
 		else
 		{
-			eventName = IPACM_Iface::ipacmcfg->getEventName(item->evt.data.event);
+			eventName = IPACM_Iface::ipacmcfg->getEventName(item.data.event);
 			if (eventName != NULL)
 			{
 				IPACMDBG("Get event %s from internal queue.\n",
@@ -173,42 +364,40 @@ void* MessageQueue::Process(void *param)
 			}
 		}
 
-		if(item == NULL)
+		if(found == false)
 		{
-			IPACMDBG("Waiting for Message\n");
+			/* may post events, the re-check below picks them up */
+			if(idle_hook != NULL)
+			{
+				idle_hook();
+			}
+
+			consumer_waiting.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
 
-			if(pthread_cond_wait(&cond_var, &mutex) != 0)
+			/* re-check after announcing we are about to sleep */
+			if(MsgQueueInternal->getOccupancy() == 0 && MsgQueueExternal->getOccupancy() == 0 &&
+				!MsgQueueInternal->overflowed.load(std::memory_order_acquire) &&
+				!MsgQueueExternal->overflowed.load(std::memory_order_acquire))
 			{
-				IPACMERR("unable to lock the mutex\n");
+				IPACMDBG("Waiting for Message, high water internal %d external %d, overflow internal %d external %d\n",
+					MsgQueueInternal->getHighWater(), MsgQueueExternal->getHighWater(),
+					MsgQueueInternal->getOverflowCount(), MsgQueueExternal->getOverflowCount());
+				IPACM_EvtDataPool::dump_stats();
 
-				if(pthread_mutex_unlock(&mutex) != 0)
+				if(read(wake_fd, &val, sizeof(val)) < 0 && errno != EINTR)
 				{
-					IPACMERR("unable to unlock the mutex\n");
+					IPACMERR("unable to wait on cmd queue: %d(%s)\n", errno, strerror(errno));
+					consumer_waiting.store(false, std::memory_order_relaxed);
 					return NULL;
 				}
-
-				return NULL;
 			}
-
-			if(pthread_mutex_unlock(&mutex) != 0)
-			{
-				IPACMERR("unable to unlock the mutex\n");
-				return NULL;
-			}
-
+			consumer_waiting.store(false, std::memory_order_relaxed);
 		}
 		else
 		{
-			if(pthread_mutex_unlock(&mutex) != 0)
-			{
-				IPACMERR("unable to unlock the mutex\n");
-				return NULL;
-			}
-
-			IPACMDBG("Processing item %pK event ID: %d\n",item,item->evt.data.event);
-			item->evt.callback_ptr(&item->evt.data);
-			delete item;
-			item = NULL;
+			IPACMDBG("Processing event ID: %d\n", item.data.event);
+			item.callback_ptr(&item.data);
 		}
 
 	} /* Go forever until a termination indication is received */
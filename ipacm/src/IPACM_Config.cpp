@@ -131,6 +131,7 @@ const char *ipacm_event_name[] = {
 	__stringify(IPA_WIGIG_CLIENT_ADD_EVENT),               /* ipacm_event_data_mac_ep */
 	__stringify(IPA_WIGIG_FST_SWITCH),                     /* ipacm_event_data_fst */
 	__stringify(IPA_MOVE_NAT_TBL_EVENT),                   /* ipacm_event_move_nat */
+	__stringify(IPA_NAT_TS_SWEEP_EVENT),                   /* NULL */
 	__stringify(IPACM_EVENT_MAX)
 };
 
@@ -151,6 +152,11 @@ IPACM_Config::IPACM_Config()
 	ipa_num_alg_ports = 0;
 	ipa_nat_memtype = DEFAULT_NAT_MEMTYPE;
 	ipa_nat_max_entries = 0;
+	ipa_nat_batch_size = DEFAULT_NAT_BATCH_SIZE;
+	ipa_nat_sram_hot_flows = DEFAULT_NAT_SRAM_HOT_FLOWS;
+	ipa_nat_ct_cache_entries = DEFAULT_NAT_CT_CACHE_ENTRIES;
+	ipa_nat_pending_flows = DEFAULT_NAT_PENDING_FLOWS;
+	ipa_neighbor_clients = DEFAULT_NEIGHBOR_CLIENTS;
 	ipa_nat_iface_entries = 0;
 	ipa_sw_rt_enable = false;
 	ipa_bridge_enable = false;
@@ -324,6 +330,36 @@ int IPACM_Config::Init(void)
 		cfg->nat_table_memtype   : DEFAULT_NAT_MEMTYPE;
 	IPACMDBG_H("Nat Mem Type %s\n", ipa_nat_memtype);
 
+	/* a batch size of 1 applies every rule as soon as it is queued */
+	ipa_nat_batch_size =
+		(cfg->nat_batch_size > 0) ?
+		cfg->nat_batch_size : DEFAULT_NAT_BATCH_SIZE;
+	IPACMDBG_H("Nat batch size %d\n", ipa_nat_batch_size);
+
+	/* most active flows the table may carry and still be kept in SRAM */
+	ipa_nat_sram_hot_flows =
+		(cfg->nat_sram_hot_flows > 0) ?
+		cfg->nat_sram_hot_flows : DEFAULT_NAT_SRAM_HOT_FLOWS;
+	IPACMDBG_H("Nat SRAM hot flows %d\n", ipa_nat_sram_hot_flows);
+
+	/* connections held while WAN is down */
+	ipa_nat_ct_cache_entries =
+		(cfg->nat_ct_cache_entries > 0) ?
+		cfg->nat_ct_cache_entries : DEFAULT_NAT_CT_CACHE_ENTRIES;
+	IPACMDBG_H("Nat ct cache entries %d\n", ipa_nat_ct_cache_entries);
+
+	/* flows waiting for their client to be resolved */
+	ipa_nat_pending_flows =
+		(cfg->nat_pending_flows > 0) ?
+		cfg->nat_pending_flows : DEFAULT_NAT_PENDING_FLOWS;
+	IPACMDBG_H("Nat pending flows %d\n", ipa_nat_pending_flows);
+
+	/* clients remembered by the neighbor cache */
+	ipa_neighbor_clients =
+		(cfg->neighbor_clients > 0) ?
+		cfg->neighbor_clients : DEFAULT_NEIGHBOR_CLIENTS;
+	IPACMDBG_H("Neighbor clients %d\n", ipa_neighbor_clients);
+
 	/* Find ODU is either router mode or bridge mode*/
 	ipacm_odu_enable = cfg->odu_enable;
 	ipacm_odu_router_mode = cfg->router_mode_enable;
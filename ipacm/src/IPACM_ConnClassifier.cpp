@@ -0,0 +1,279 @@
+/*
+Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause-Clear
+*/
+/*!
+	@file
+	IPACM_ConnClassifier.cpp
+
+	@brief
+	This file implements the IPACM connection classifier functionality
+
+	@Author
+
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "IPACM_ConnClassifier.h"
+#include "IPACM_Config.h"
+#include "IPACM_Log.h"
+
+IPACM_ConnClassifier *IPACM_ConnClassifier::pInstance = NULL;
+
+IPACM_ConnClassifier::IPACM_ConnClassifier()
+{
+	pthread_mutex_init(&lock, NULL);
+	active = NULL;
+	memset(addrs, 0, sizeof(addrs));
+	memset(num_addrs, 0, sizeof(num_addrs));
+	memset(alg_ports, 0, sizeof(alg_ports));
+	num_alg_ports = 0;
+	rebuilds = 0;
+}
+
+IPACM_ConnClassifier* IPACM_ConnClassifier::GetInstance()
+{
+	if(pInstance == NULL)
+	{
+		pInstance = new IPACM_ConnClassifier();
+		pInstance->Rebuild();
+	}
+
+	return pInstance;
+}
+
+static inline uint32_t HashAddr(uint32_t ip)
+{
+	ip ^= ip >> 16;
+	ip *= 0x85EBCA6B;
+	ip ^= ip >> 13;
+	return ip;
+}
+
+void IPACM_ConnClassifier::AddAddr(conn_cls_tbl *tbl, uint32_t ip, uint8_t cls)
+{
+	uint32_t idx;
+
+	idx = HashAddr(ip) & (CONN_CLS_ADDR_SLOTS - 1);
+	while(tbl->addr_key[idx] != 0 && tbl->addr_key[idx] != ip)
+	{
+		idx = (idx + 1) & (CONN_CLS_ADDR_SLOTS - 1);
+	}
+	tbl->addr_key[idx] = ip;
+	tbl->addr_cls[idx] |= cls;
+}
+
+void IPACM_ConnClassifier::AddSubnet(conn_cls_tbl *tbl, uint32_t subnet, uint32_t mask)
+{
+	int bit, len, node = 0, dir;
+
+	/* a non prefix mask, or an address with host bits set, keeps the
+	   exact isPrivateSubnet semantics through the linear list */
+	if(((~mask) & (~mask + 1)) != 0 || (subnet & ~mask) != 0)
+	{
+		tbl->odd_subnet[tbl->num_odd].subnet_addr = subnet;
+		tbl->odd_subnet[tbl->num_odd].subnet_mask = mask;
+		tbl->num_odd++;
+		return;
+	}
+
+	len = __builtin_popcount(mask);
+	for(bit = 31; bit >= 32 - len; bit--)
+	{
+		dir = (subnet >> bit) & 1;
+		if(tbl->trie[node].child[dir] == 0)
+		{
+			tbl->trie[node].child[dir] = tbl->num_nodes++;
+		}
+		node = tbl->trie[node].child[dir];
+	}
+	tbl->trie[node].match = true;
+}
+
+bool IPACM_ConnClassifier::MatchSubnet(const conn_cls_tbl *tbl, uint32_t ip)
+{
+	int bit, node = 0, cnt;
+
+	for(bit = 31; ; bit--)
+	{
+		if(tbl->trie[node].match)
+		{
+			return true;
+		}
+		if(bit < 0)
+		{
+			break;
+		}
+		/* the root is never a child, 0 means no branch */
+		node = tbl->trie[node].child[(ip >> bit) & 1];
+		if(node == 0)
+		{
+			break;
+		}
+	}
+
+	for(cnt = 0; cnt < tbl->num_odd; cnt++)
+	{
+		if(tbl->odd_subnet[cnt].subnet_addr == (tbl->odd_subnet[cnt].subnet_mask & ip))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Compile the current sources into a new table and publish it */
+void IPACM_ConnClassifier::Rebuild()
+{
+	IPACM_Config *pConfig;
+	conn_cls_tbl *tbl, *old;
+	int list, cnt, num_subnet;
+
+	tbl = (conn_cls_tbl *)calloc(1, sizeof(conn_cls_tbl));
+	if(tbl == NULL)
+	{
+		IPACMERR("unable to allocate classifier table, keep the current one\n");
+		return;
+	}
+	tbl->num_nodes = 1;
+
+	pthread_mutex_lock(&lock);
+
+	for(list = 0; list < CONN_CLS_LISTS; list++)
+	{
+		for(cnt = 0; cnt < num_addrs[list]; cnt++)
+		{
+			if(addrs[list][cnt] != 0)
+			{
+				AddAddr(tbl, addrs[list][cnt], 1 << list);
+			}
+		}
+	}
+
+	pConfig = IPACM_Config::GetInstance();
+	if(pConfig != NULL)
+	{
+		num_subnet = pConfig->ipa_num_private_subnet;
+		if(num_subnet > CONN_CLS_MAX_SUBNETS)
+		{
+			num_subnet = CONN_CLS_MAX_SUBNETS;
+		}
+		for(cnt = 0; cnt < num_subnet; cnt++)
+		{
+			AddSubnet(tbl, pConfig->private_subnet_table[cnt].subnet_addr,
+				pConfig->private_subnet_table[cnt].subnet_mask);
+		}
+	}
+
+	for(cnt = 0; cnt < num_alg_ports; cnt++)
+	{
+		if(alg_ports[cnt].protocol == IPPROTO_TCP)
+		{
+			tbl->alg_tcp[alg_ports[cnt].port >> 3] |= 1 << (alg_ports[cnt].port & 7);
+		}
+		else if(alg_ports[cnt].protocol == IPPROTO_UDP)
+		{
+			tbl->alg_udp[alg_ports[cnt].port >> 3] |= 1 << (alg_ports[cnt].port & 7);
+		}
+	}
+
+	old = active.exchange(tbl);
+	free(old);
+	rebuilds++;
+
+	IPACMDBG_H("classifier rebuild %u: %d nat %d non nat %d sta addrs, %d trie nodes, %d alg ports\n",
+		rebuilds, num_addrs[CONN_CLS_LIST_NAT_IFACE], num_addrs[CONN_CLS_LIST_NONNAT_IFACE],
+		num_addrs[CONN_CLS_LIST_STA_CLNT], tbl->num_nodes, num_alg_ports);
+
+	pthread_mutex_unlock(&lock);
+}
+
+void IPACM_ConnClassifier::SetAddrList(int list, const uint32_t *addr, int cnt)
+{
+	if(list < 0 || list >= CONN_CLS_LISTS)
+	{
+		return;
+	}
+	if(cnt > CONN_CLS_LIST_MAX)
+	{
+		cnt = CONN_CLS_LIST_MAX;
+	}
+
+	pthread_mutex_lock(&lock);
+	memcpy(addrs[list], addr, sizeof(uint32_t) * cnt);
+	num_addrs[list] = cnt;
+	pthread_mutex_unlock(&lock);
+
+	Rebuild();
+}
+
+void IPACM_ConnClassifier::SetAlgPorts(const ipacm_alg *ports, int cnt)
+{
+	if(cnt > CONN_CLS_MAX_ALG_PORTS)
+	{
+		IPACMERR("%d alg ports, classifier keeps the first %d\n", cnt, CONN_CLS_MAX_ALG_PORTS);
+		cnt = CONN_CLS_MAX_ALG_PORTS;
+	}
+
+	pthread_mutex_lock(&lock);
+	memcpy(alg_ports, ports, sizeof(ipacm_alg) * cnt);
+	num_alg_ports = cnt;
+	pthread_mutex_unlock(&lock);
+
+	Rebuild();
+}
+
+/* Verdict bits for one address: the lists it is on and whether it is in
+   a private subnet */
+uint8_t IPACM_ConnClassifier::Classify(uint32_t ip_addr)
+{
+	const conn_cls_tbl *tbl = active.load();
+	uint8_t cls = 0;
+	uint32_t idx;
+
+	if(tbl == NULL)
+	{
+		return 0;
+	}
+
+	/* 0 is the free slot key, it is never on a list */
+	idx = HashAddr(ip_addr) & (CONN_CLS_ADDR_SLOTS - 1);
+	while(ip_addr != 0 && tbl->addr_key[idx] != 0)
+	{
+		if(tbl->addr_key[idx] == ip_addr)
+		{
+			cls = tbl->addr_cls[idx];
+			break;
+		}
+		idx = (idx + 1) & (CONN_CLS_ADDR_SLOTS - 1);
+	}
+
+	if(MatchSubnet(tbl, ip_addr))
+	{
+		cls |= CONN_CLS_PRIVATE_SUBNET;
+	}
+
+	return cls;
+}
+
+bool IPACM_ConnClassifier::isAlgPort(uint8_t proto, uint16_t port)
+{
+	const conn_cls_tbl *tbl = active.load();
+
+	if(tbl == NULL)
+	{
+		return false;
+	}
+	if(proto == IPPROTO_TCP)
+	{
+		return (tbl->alg_tcp[port >> 3] >> (port & 7)) & 1;
+	}
+	if(proto == IPPROTO_UDP)
+	{
+		return (tbl->alg_udp[port >> 3] >> (port & 7)) & 1;
+	}
+
+	return false;
+}
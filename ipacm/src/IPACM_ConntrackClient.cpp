@@ -48,20 +48,26 @@ typedef uint32_t in_addr_t;
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 #include <net/if.h>
 #include "IPACM_Iface.h"
 #include "IPACM_ConntrackListener.h"
 #include "IPACM_ConntrackClient.h"
 #include "IPACM_Log.h"
+#include "IPACM_EvtDataPool.h"
 
 #define LO_NAME "lo"
 
 extern IPACM_EvtDispatcher cm_dis;
-extern void ParseCTMessage(struct nf_conntrack *ct);
 
 IPACM_ConntrackClient *IPACM_ConntrackClient::pInstance = NULL;
 IPACM_ConntrackListener *CtList = NULL;
 
+/* serializes reactor start between the cmd queue and binder threads */
+static pthread_mutex_t reactor_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* ================================
 		 Local Function Definitions
 		 =================================
@@ -76,6 +82,29 @@ IPACM_ConntrackClient::IPACM_ConntrackClient()
 	udp_filter = NULL;
 	fd_tcp = -1;
 	fd_udp = -1;
+	epoll_fd = -1;
+	timer_fd = -1;
+	reactor_started = false;
+	enobufs_tcp = 0;
+	enobufs_udp = 0;
+	pthread_mutex_init(&filter_lock, NULL);
+	memset(filter_addrs, 0, sizeof(filter_addrs));
+	num_filter_addrs = 0;
+	filter_gen = 0;
+	memset(filter_snap, 0, sizeof(filter_snap));
+	filter_snap_cur.store(0, std::memory_order_relaxed);
+	stat_gen = 0;
+	filter_events = 0;
+	filter_leaked = 0;
+	filter_start_us = GetTimeUs();
+	memset(stage, 0, sizeof(stage));
+	memset(stage_bucket, 0xff, sizeof(stage_bucket));
+	num_staged = 0;
+	coalesce_in = 0;
+	coalesce_posted = 0;
+	coalesce_superseded = 0;
+	coalesce_cancelled = 0;
+	coalesce_logged = 0;
 	subscrips_tcp = NF_NETLINK_CONNTRACK_UPDATE | NF_NETLINK_CONNTRACK_DESTROY;
 	subscrips_udp = NF_NETLINK_CONNTRACK_NEW | NF_NETLINK_CONNTRACK_DESTROY;
 }
@@ -86,108 +115,372 @@ IPACM_ConntrackClient* IPACM_ConntrackClient::GetInstance()
 	{
 		pInstance = new IPACM_ConntrackClient();
 
-		pInstance->udp_filter = nfct_filter_create();
-		if(pInstance->udp_filter == NULL)
+		/* 255.255.255.255 is never of interest, in either direction */
+		uint32_t bc_addr = BROADCAST_IPV4_ADDR;
+		bool dst_only = false;
+		pInstance->SetFilterAddrs("", &bc_addr, &dst_only, 1);
+	}
+
+	return pInstance;
+}
+
+/* Copy a fixed size attribute payload, short attributes are skipped */
+static bool CTAttrGet(const struct nfattr *attr, void *out, int size)
+{
+	if((int)NFA_PAYLOAD(attr) < size)
+	{
+		return false;
+	}
+	memcpy(out, NFA_DATA(attr), size);
+	return true;
+}
+
+static void ParseCTTuple(const struct nfattr *attr, int len, ipacm_ct_tuple *tuple, uint8_t *l4proto)
+{
+	const struct nfattr *nest;
+	int nest_len;
+
+	for(; NFA_OK(attr, len); attr = NFA_NEXT(attr, len))
+	{
+		nest = (const struct nfattr *)NFA_DATA(attr);
+		nest_len = NFA_PAYLOAD(attr);
+
+		if(NFA_TYPE(attr) == CTA_TUPLE_IP)
+		{
+			for(; NFA_OK(nest, nest_len); nest = NFA_NEXT(nest, nest_len))
+			{
+				switch(NFA_TYPE(nest))
+				{
+				case CTA_IP_V4_SRC:
+					CTAttrGet(nest, &tuple->src_ip[0], sizeof(uint32_t));
+					break;
+				case CTA_IP_V4_DST:
+					CTAttrGet(nest, &tuple->dst_ip[0], sizeof(uint32_t));
+					break;
+				case CTA_IP_V6_SRC:
+					CTAttrGet(nest, tuple->src_ip, sizeof(tuple->src_ip));
+					break;
+				case CTA_IP_V6_DST:
+					CTAttrGet(nest, tuple->dst_ip, sizeof(tuple->dst_ip));
+					break;
+				default:
+					break;
+				}
+			}
+		}
+		else if(NFA_TYPE(attr) == CTA_TUPLE_PROTO)
 		{
-			IPACMERR("unable to create UDP filter\n");
-			delete pInstance;
-			return NULL;
+			for(; NFA_OK(nest, nest_len); nest = NFA_NEXT(nest, nest_len))
+			{
+				switch(NFA_TYPE(nest))
+				{
+				case CTA_PROTO_NUM:
+					CTAttrGet(nest, l4proto, sizeof(uint8_t));
+					break;
+				case CTA_PROTO_SRC_PORT:
+					CTAttrGet(nest, &tuple->src_port, sizeof(uint16_t));
+					break;
+				case CTA_PROTO_DST_PORT:
+					CTAttrGet(nest, &tuple->dst_port, sizeof(uint16_t));
+					break;
+				default:
+					break;
+				}
+			}
 		}
-		IPACMDBG("Created UDP filter\n");
+	}
+}
+
+static void ParseCTProtoInfo(const struct nfattr *attr, int len, ipacm_ct_record *rec)
+{
+	const struct nfattr *nest;
+	int nest_len;
+	uint8_t flags[2];
 
-		pInstance->tcp_filter = nfct_filter_create();
-		if(pInstance->tcp_filter == NULL)
+	for(; NFA_OK(attr, len); attr = NFA_NEXT(attr, len))
+	{
+		if(NFA_TYPE(attr) != CTA_PROTOINFO_TCP)
+		{
+			continue;
+		}
+
+		nest = (const struct nfattr *)NFA_DATA(attr);
+		nest_len = NFA_PAYLOAD(attr);
+		for(; NFA_OK(nest, nest_len); nest = NFA_NEXT(nest, nest_len))
 		{
-			IPACMERR("unable to create TCP filter\n");
-			delete pInstance;
-			return NULL;
+			if(NFA_TYPE(nest) == CTA_PROTOINFO_TCP_STATE)
+			{
+				CTAttrGet(nest, &rec->tcp_state, sizeof(uint8_t));
+			}
+			else if(NFA_TYPE(nest) == CTA_PROTOINFO_TCP_FLAGS_ORIGINAL &&
+				CTAttrGet(nest, flags, sizeof(flags)))
+			{
+				/* struct nf_ct_tcp_flags { flags; mask; } */
+				rec->tcp_flags = flags[0];
+			}
 		}
-		IPACMDBG("Created TCP filter\n");
 	}
+}
 
-	return pInstance;
+/* Decode one ctnetlink message into a fixed size record without going
+   through nfct_new()/nfct_parse_conntrack(). Addresses and ports stay in
+   network order like nfct_get_attr_u32/u16 return them, status and
+   timeout are converted to host order. Returns the nf_conntrack_msg_type
+   of the message or NFCT_T_UNKNOWN if it is not a conntrack event. */
+int IPACM_ConntrackClient::ParseCTRecord(const struct nlmsghdr *nlh, ipacm_ct_record *rec)
+{
+	const struct nfgenmsg *nfmsg;
+	const struct nfattr *attr;
+	uint32_t val;
+	int len, type;
+
+	if(NFNL_SUBSYS_ID(nlh->nlmsg_type) != NFNL_SUBSYS_CTNETLINK ||
+		 nlh->nlmsg_len < NLMSG_SPACE(sizeof(struct nfgenmsg)))
+	{
+		return NFCT_T_UNKNOWN;
+	}
+
+	switch(NFNL_MSG_TYPE(nlh->nlmsg_type))
+	{
+	case IPCTNL_MSG_CT_NEW:
+		type = (nlh->nlmsg_flags & (NLM_F_CREATE | NLM_F_EXCL)) ? NFCT_T_NEW : NFCT_T_UPDATE;
+		break;
+	case IPCTNL_MSG_CT_DELETE:
+		type = NFCT_T_DESTROY;
+		break;
+	default:
+		return NFCT_T_UNKNOWN;
+	}
+
+	memset(rec, 0, sizeof(*rec));
+	nfmsg = (const struct nfgenmsg *)NLMSG_DATA(nlh);
+	rec->l3proto = nfmsg->nfgen_family;
+
+	attr = NFM_NFA(nfmsg);
+	len = nlh->nlmsg_len - NLMSG_SPACE(sizeof(struct nfgenmsg));
+	for(; NFA_OK(attr, len); attr = NFA_NEXT(attr, len))
+	{
+		switch(NFA_TYPE(attr))
+		{
+		case CTA_TUPLE_ORIG:
+			ParseCTTuple((const struct nfattr *)NFA_DATA(attr), NFA_PAYLOAD(attr),
+				&rec->orig, &rec->l4proto);
+			break;
+		case CTA_TUPLE_REPLY:
+			ParseCTTuple((const struct nfattr *)NFA_DATA(attr), NFA_PAYLOAD(attr),
+				&rec->repl, &rec->l4proto);
+			break;
+		case CTA_PROTOINFO:
+			ParseCTProtoInfo((const struct nfattr *)NFA_DATA(attr), NFA_PAYLOAD(attr), rec);
+			break;
+		case CTA_STATUS:
+			if(CTAttrGet(attr, &val, sizeof(val)))
+				rec->status = ntohl(val);
+			break;
+		case CTA_TIMEOUT:
+			if(CTAttrGet(attr, &val, sizeof(val)))
+				rec->timeout = ntohl(val);
+			break;
+		case CTA_MARK:
+			if(CTAttrGet(attr, &val, sizeof(val)))
+				rec->mark = ntohl(val);
+			break;
+		case CTA_ID:
+			if(CTAttrGet(attr, &val, sizeof(val)))
+				rec->id = ntohl(val);
+			break;
+		default:
+			break;
+		}
+	}
+
+	return type;
 }
 
-int IPACM_ConntrackClient::IPAConntrackEventCB
-(
-	 enum nf_conntrack_msg_type type,
-	 struct nf_conntrack *ct,
-	 void *data
-	 )
+/* Decode straight into the pooled event slot and stage it for the cmd
+   queue, nothing is allocated on the heap per event */
+void IPACM_ConntrackClient::PostCTEvent(const struct nlmsghdr *nlh, unsigned int types)
 {
-	#pragma unused (data)
-	ipacm_cmd_q_data evt_data;
 	ipacm_ct_evt_data *ct_data;
-	uint8_t ip_type = 0;
+	int type;
 
-	IPACMDBG("Event callback called with msgtype: %d\n",type);
+	ct_data = (ipacm_ct_evt_data *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_CT);
+	if(ct_data == NULL)
+	{
+		IPACMERR("unable to allocate memory \n");
+		return;
+	}
 
-	/* Retrieve ip type */
-	ip_type = nfct_get_attr_u8(ct, ATTR_REPL_L3PROTO);
+	type = ParseCTRecord(nlh, &ct_data->ct);
+	if((type & types) == 0)
+	{
+		goto IGNORE;
+	}
+
+	IPACMDBG("Event callback called with msgtype: %d\n", type);
+	pInstance->CountFilterEvent(&ct_data->ct);
 
 #ifndef CT_OPT
-	if(AF_INET6 == ip_type)
+	if(AF_INET6 == ct_data->ct.l3proto)
 	{
-		IPACMDBG("Ignoring ipv6(%d) connections\n", ip_type);
+		IPACMDBG("Ignoring ipv6(%d) connections\n", ct_data->ct.l3proto);
 		goto IGNORE;
 	}
-
 #endif
 
-	ct_data = (ipacm_ct_evt_data *)malloc(sizeof(ipacm_ct_evt_data));
-	if(ct_data == NULL)
+	ct_data->type = (enum nf_conntrack_msg_type)type;
+
+	/* posted when the reactor wakeup is done, after coalescing */
+	pInstance->StageCTEvent(ct_data);
+	return;
+
+IGNORE:
+	IPACM_EvtDataPool::release(ct_data);
+	return;
+}
+
+static uint32_t HashCTTuple(const ipacm_ct_record *ct)
+{
+	const uint32_t *words = (const uint32_t *)&ct->orig;
+	uint32_t h = 0x811C9DC5;
+	size_t cnt;
+
+	for(cnt = 0; cnt < sizeof(ipacm_ct_tuple) / sizeof(uint32_t); cnt++)
 	{
-		IPACMERR("unable to allocate memory \n");
-		goto IGNORE;
+		h = (h ^ words[cnt]) * 0x01000193;
 	}
+	h = (h ^ ((uint32_t)ct->l3proto << 8 | ct->l4proto)) * 0x01000193;
+	h ^= h >> 16;
+	return h;
+}
 
-	ct_data->ct = ct;
-	ct_data->type = type;
+static inline bool SameCTFlow(const ipacm_ct_record *a, const ipacm_ct_record *b)
+{
+	return (a->l3proto == b->l3proto && a->l4proto == b->l4proto &&
+		memcmp(&a->orig, &b->orig, sizeof(a->orig)) == 0);
+}
 
-	evt_data.event = IPA_PROCESS_CT_MESSAGE;
-	evt_data.evt_data = (void *)ct_data;
+/* Add an event to the current window. A later event of the same flow
+   supersedes the staged one, except that a flow created and destroyed
+   inside the window is dropped altogether. A staged DESTROY is never
+   superseded by a NEW or UPDATE of a reused tuple, the new event gets its
+   own slot behind it so that nat deletes the old rule first. */
+void IPACM_ConntrackClient::StageCTEvent(ipacm_ct_evt_data *ct_data)
+{
+	ct_stage_slot *slot;
+	uint32_t hash;
+	int cnt, *head;
 
-#ifdef CT_OPT
-	if(AF_INET6 == ip_type)
+	coalesce_in++;
+
+	hash = HashCTTuple(&ct_data->ct);
+	head = &stage_bucket[hash & (CT_COALESCE_BUCKETS - 1)];
+	for(cnt = *head; cnt >= 0; cnt = stage[cnt].next)
 	{
-		evt_data.event = IPA_PROCESS_CT_MESSAGE_V6;
+		slot = &stage[cnt];
+		if(slot->data == NULL || slot->hash != hash || !SameCTFlow(&slot->data->ct, &ct_data->ct))
+		{
+			continue;
+		}
+
+		/* newer slots of a flow sit first in the chain */
+		if(slot->data->type == NFCT_T_DESTROY && ct_data->type != NFCT_T_DESTROY)
+		{
+			break;
+		}
+
+		IPACM_EvtDataPool::release(slot->data);
+		if(slot->created && ct_data->type == NFCT_T_DESTROY)
+		{
+			/* nat never saw the flow, neither event needs to reach it */
+			slot->data = NULL;
+			IPACM_EvtDataPool::release(ct_data);
+			coalesce_cancelled += 2;
+			return;
+		}
+		slot->data = ct_data;
+		coalesce_superseded++;
+		return;
 	}
-#endif
 
-	if(0 != IPACM_EvtDispatcher::PostEvt(&evt_data))
+	if(num_staged >= CT_COALESCE_MAX)
 	{
-		IPACMERR("Error sending Conntrack message to processing thread!\n");
-		free(ct_data);
-		goto IGNORE;
+		FlushCTEvents();
+		head = &stage_bucket[hash & (CT_COALESCE_BUCKETS - 1)];
 	}
 
-/* NFCT_CB_STOLEN means that the conntrack object is not released after the
-	 callback That must be manually done later when the object is no longer needed. */
-	return NFCT_CB_STOLEN;
+	slot = &stage[num_staged];
+	slot->data = ct_data;
+	slot->hash = hash;
+	slot->created = (ct_data->type == NFCT_T_NEW);
+	slot->next = *head;
+	*head = num_staged++;
+}
 
-IGNORE:
-	nfct_destroy(ct);
-	return NFCT_CB_STOLEN;
+/* Post the events left in the window in arrival order of their flows */
+void IPACM_ConntrackClient::FlushCTEvents(void)
+{
+	ipacm_cmd_q_data evt_data;
+	int cnt;
+
+	if(num_staged == 0)
+	{
+		return;
+	}
+
+	for(cnt = 0; cnt < num_staged; cnt++)
+	{
+		if(stage[cnt].data == NULL)
+		{
+			continue;
+		}
 
+		memset(&evt_data, 0, sizeof(evt_data));
+		evt_data.event = IPA_PROCESS_CT_MESSAGE;
+		evt_data.evt_data = (void *)stage[cnt].data;
+#ifdef CT_OPT
+		if(AF_INET6 == stage[cnt].data->ct.l3proto)
+		{
+			evt_data.event = IPA_PROCESS_CT_MESSAGE_V6;
+		}
+#endif
+		if(0 != IPACM_EvtDispatcher::PostEvt(&evt_data))
+		{
+			IPACMERR("Error sending Conntrack message to processing thread!\n");
+			IPACM_EvtDataPool::release(stage[cnt].data);
+		}
+		else
+		{
+			coalesce_posted++;
+		}
+		stage[cnt].data = NULL;
+	}
+
+	num_staged = 0;
+	memset(stage_bucket, 0xff, sizeof(stage_bucket));
+
+	if(coalesce_in - coalesce_logged >= CT_FILTER_STATS_EVENTS)
+	{
+		coalesce_logged = coalesce_in;
+		IPACMDBG_H("conntrack coalescing: %u events in, %u posted, %u superseded, %u cancelled\n",
+			coalesce_in, coalesce_posted, coalesce_superseded, coalesce_cancelled);
+	}
 }
 
-int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Bridge_Addrs
-(
-	 struct nfct_filter *filter
-)
+/* Current address of the bridge interface, 0 when it has none */
+static uint32_t GetBridgeAddr(void)
 {
-	int fd;
+	struct ifreq ifr;
+	uint32_t ipv4_addr;
+	int fd, ret;
+
 	fd = socket(AF_INET, SOCK_DGRAM, 0);
 	if(fd < 0)
 	{
 		PERROR("unable to open socket");
-		return -1;
+		return 0;
 	}
 
-	int ret;
-	uint32_t ipv4_addr;
-	struct ifreq ifr;
-
 	/* retrieve bridge interface ipv4 address */
 	memset(&ifr, 0, sizeof(struct ifreq));
 	ifr.ifr_addr.sa_family = AF_INET;
@@ -197,7 +490,7 @@ int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Bridge_Addrs
 		IPACMERR("interface name overflows: len %zu\n",
 			strlen(IPACM_Iface::ipacmcfg->ipa_virtual_iface_name));
 		close(fd);
-		return -1;
+		return 0;
 	}
 	(void)strlcpy(ifr.ifr_name, IPACM_Iface::ipacmcfg->ipa_virtual_iface_name, sizeof(ifr.ifr_name));
 	IPACMDBG("bridge interface name (%s)\n", ifr.ifr_name);
@@ -207,244 +500,583 @@ int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Bridge_Addrs
 	{
 		IPACMERR("unable to retrieve (%s) interface address\n",ifr.ifr_name);
 		close(fd);
-		return -1;
+		return 0;
 	}
 	IPACMDBG("Interface (%s) address %s\n", ifr.ifr_name, inet_ntoa(((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr));
 	ipv4_addr = ntohl(((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr.s_addr);
 	close(fd);
 
-	/* ignore whatever is destined to or originates from broadcast ip address */
-	struct nfct_filter_ipv4 filter_ipv4;
-
-	filter_ipv4.addr = ipv4_addr;
-	filter_ipv4.mask = 0xffffffff;
+	return ipv4_addr;
+}
 
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_DST_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
+/* Replace the addresses owned by ifname, returns true if the set changed.
+   Caller holds filter_lock. */
+bool IPACM_ConntrackClient::SetFilterAddrs(const char *ifname,
+	const uint32_t *addrs, const bool *dst_only, int num)
+{
+	ct_filter_addr *entry;
+	int cnt, out, matched = 0, owned = 0;
 
-	nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
+	for(cnt = 0; cnt < num_filter_addrs; cnt++)
+	{
+		entry = &filter_addrs[cnt];
+		if(strncmp(entry->ifname, ifname, sizeof(entry->ifname)) != 0)
+		{
+			continue;
+		}
+		owned++;
+		if(owned <= num && entry->addr == addrs[owned - 1] &&
+			 entry->dst_only == dst_only[owned - 1])
+		{
+			matched++;
+		}
+	}
+	if(owned == num && matched == num)
+	{
+		return false;
+	}
 
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_SRC_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
+	/* drop the old addresses of ifname, then append the new ones */
+	for(cnt = 0, out = 0; cnt < num_filter_addrs; cnt++)
+	{
+		if(strncmp(filter_addrs[cnt].ifname, ifname, sizeof(filter_addrs[cnt].ifname)) != 0)
+		{
+			filter_addrs[out++] = filter_addrs[cnt];
+		}
+	}
+	num_filter_addrs = out;
 
-	nfct_filter_add_attr(filter, NFCT_FILTER_SRC_IPV4, &filter_ipv4);
+	for(cnt = 0; cnt < num; cnt++)
+	{
+		if(addrs[cnt] == 0)
+		{
+			continue;
+		}
+		if(num_filter_addrs >= CT_FILTER_MAX_ADDRS)
+		{
+			IPACMERR("conntrack filter full, events for 0x%x stay in user space\n", addrs[cnt]);
+			break;
+		}
+		entry = &filter_addrs[num_filter_addrs++];
+		(void)strlcpy(entry->ifname, ifname, sizeof(entry->ifname));
+		entry->addr = addrs[cnt];
+		entry->dst_only = dst_only[cnt];
+	}
 
-	return 0;
+	return true;
 }
 
-int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Local_Iface
-(
-	 struct nfct_filter *filter,
-	 ipacm_event_iface_up *param
-)
+/* Build a complete socket filter for one protocol from the address set.
+   Caller holds filter_lock. */
+int IPACM_ConntrackClient::BuildFilter(struct nfct_filter *filter, uint8_t l4proto)
 {
+	struct nfct_filter_proto tcp_proto_state;
 	struct nfct_filter_ipv4 filter_ipv4;
+	int cnt;
 
-	filter_ipv4.addr = param->ipv4_addr;
-	filter_ipv4.mask = 0xffffffff;
-
-	/* ignore whatever is destined to local interfaces */
-	IPACMDBG("Ignore connections destinated to interface %s", param->ifname);
-	iptodot("with ipv4 address", param->ipv4_addr);
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_DST_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
+	if(nfct_filter_set_logic(filter, NFCT_FILTER_L4PROTO, NFCT_FILTER_LOGIC_POSITIVE) == -1)
+	{
+		IPACMERR("Unable to set filter logic\n");
+		return -1;
+	}
+	nfct_filter_add_attr_u32(filter, NFCT_FILTER_L4PROTO, l4proto);
 
-	nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
+	if(l4proto == IPPROTO_TCP)
+	{
+		/* only the states the listener acts on */
+		if(nfct_filter_set_logic(filter, NFCT_FILTER_L4PROTO_STATE, NFCT_FILTER_LOGIC_POSITIVE) == -1)
+		{
+			IPACMERR("unable to set filter logic\n");
+			return -1;
+		}
+		tcp_proto_state.proto = IPPROTO_TCP;
+		tcp_proto_state.state = TCP_CONNTRACK_ESTABLISHED;
+		nfct_filter_add_attr(filter, NFCT_FILTER_L4PROTO_STATE, &tcp_proto_state);
+		tcp_proto_state.state = TCP_CONNTRACK_FIN_WAIT;
+		nfct_filter_add_attr(filter, NFCT_FILTER_L4PROTO_STATE, &tcp_proto_state);
+		tcp_proto_state.state = TCP_CONNTRACK_CLOSE;
+		nfct_filter_add_attr(filter, NFCT_FILTER_L4PROTO_STATE, &tcp_proto_state);
+	}
 
-	IPACMDBG("Ignore connections orignated from interface %s", param->ifname);
-	iptodot("with ipv4 address", filter_ipv4.addr);
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_SRC_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
+	if(num_filter_addrs == 0)
+	{
+		return 0;
+	}
 
-	nfct_filter_add_attr(filter, NFCT_FILTER_SRC_IPV4, &filter_ipv4);
+	/* ignore whatever is destined to or originates from the local addresses */
+	if(nfct_filter_set_logic(filter, NFCT_FILTER_DST_IPV4, NFCT_FILTER_LOGIC_NEGATIVE) == -1 ||
+		 nfct_filter_set_logic(filter, NFCT_FILTER_SRC_IPV4, NFCT_FILTER_LOGIC_NEGATIVE) == -1)
+	{
+		IPACMERR("unable to set filter logic\n");
+		return -1;
+	}
+	for(cnt = 0; cnt < num_filter_addrs; cnt++)
+	{
+		/* netfitler expecting in host-byte order */
+		filter_ipv4.addr = filter_addrs[cnt].addr;
+		filter_ipv4.mask = 0xffffffff;
+		nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
+		if(!filter_addrs[cnt].dst_only)
+		{
+			nfct_filter_add_attr(filter, NFCT_FILTER_SRC_IPV4, &filter_ipv4);
+		}
+	}
 
-	/* Retrieve broadcast address */
-	/* Intialize with 255.255.255.255 */
-	uint32_t bc_ip_addr = 0xFFFFFFFF;
+	return 0;
+}
 
-	/* calculate broadcast address from addr and addr_mask */
-	bc_ip_addr = (bc_ip_addr & (~param->addr_mask));
-	bc_ip_addr = (bc_ip_addr | (param->ipv4_addr & param->addr_mask));
+/* Regenerate both socket filters from the address set and swap them in.
+   Attaching replaces the program of a socket in one step, so events are
+   never seen unfiltered in between. Caller holds filter_lock. */
+int IPACM_ConntrackClient::RegenerateFilters(void)
+{
+	struct nfct_filter *tcp, *udp;
+	uint64_t now;
 
-	/* netfitler expecting in host-byte order */
-	filter_ipv4.addr = bc_ip_addr;
-	filter_ipv4.mask = 0xffffffff;
+	tcp = nfct_filter_create();
+	udp = nfct_filter_create();
+	if(tcp == NULL || udp == NULL)
+	{
+		IPACMERR("unable to create conntrack filters\n");
+		goto fail;
+	}
+	if(BuildFilter(tcp, IPPROTO_TCP) != 0 || BuildFilter(udp, IPPROTO_UDP) != 0)
+	{
+		goto fail;
+	}
 
-	iptodot("with broadcast address", filter_ipv4.addr);
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_DST_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
+	if(tcp_hdl != NULL && nfct_filter_attach(nfct_fd(tcp_hdl), tcp) == -1)
+	{
+		PERROR("unable to attach the filter to tcp handle\n");
+		IPACMERR("tcp handle:%pK, fd:%d\n", tcp_hdl, nfct_fd(tcp_hdl));
+		goto fail;
+	}
+	if(udp_hdl != NULL && nfct_filter_attach(nfct_fd(udp_hdl), udp) == -1)
+	{
+		PERROR("unable to attach the filter to udp handle\n");
+		IPACMERR("udp handle:%pK, fd:%d\n", udp_hdl, nfct_fd(udp_hdl));
+		goto fail;
+	}
 
-	nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
+	/* the old filters are no longer referenced by the sockets */
+	if(tcp_filter != NULL)
+	{
+		nfct_filter_destroy(tcp_filter);
+	}
+	if(udp_filter != NULL)
+	{
+		nfct_filter_destroy(udp_filter);
+	}
+	tcp_filter = tcp;
+	udp_filter = udp;
 
+	now = GetTimeUs();
+	filter_gen++;
+	PublishFilterSnap(now);
+	IPACMDBG_H("conntrack filter gen %u: %d addrs\n", filter_gen, num_filter_addrs);
 	return 0;
+
+fail:
+	if(tcp != NULL)
+	{
+		nfct_filter_destroy(tcp);
+	}
+	if(udp != NULL)
+	{
+		nfct_filter_destroy(udp);
+	}
+	return -1;
 }
 
-/* Function which sets up filters to ignore
-		 connections to and from local interfaces */
-int IPACM_ConntrackClient::IPA_Conntrack_Filters_Ignore_Local_Addrs
-(
-	 struct nfct_filter *filter
-)
+static inline uint32_t FilterSnapSlot(uint32_t addr)
 {
-	struct nfct_filter_ipv4 filter_ipv4;
+	return ((addr * 0x9E3779B1) >> 24) & (CT_FILTER_SNAP_SLOTS - 1);
+}
 
-	/* ignore whatever is destined to or originates from broadcast ip address */
-	filter_ipv4.addr = 0xffffffff;
-	filter_ipv4.mask = 0xffffffff;
+/* Rebuild the snapshot the reactor is not reading and make it current.
+   Changes are rare and a lookup is short, a reader still on the older copy
+   two changes later only skews the statistics. Caller holds filter_lock. */
+void IPACM_ConntrackClient::PublishFilterSnap(uint64_t now)
+{
+	ct_filter_snap *snap;
+	uint32_t idx;
+	int cnt, next;
 
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_DST_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
+	next = filter_snap_cur.load(std::memory_order_relaxed) ^ 1;
+	snap = &filter_snap[next];
+	memset(snap, 0, sizeof(ct_filter_snap));
+	snap->gen = filter_gen;
+	snap->start_us = now;
 
-	nfct_filter_add_attr(filter, NFCT_FILTER_DST_IPV4, &filter_ipv4);
+	for(cnt = 0; cnt < num_filter_addrs; cnt++)
+	{
+		idx = FilterSnapSlot(filter_addrs[cnt].addr);
+		while(snap->addr[idx] != 0 && snap->addr[idx] != filter_addrs[cnt].addr)
+		{
+			idx = (idx + 1) & (CT_FILTER_SNAP_SLOTS - 1);
+		}
+		snap->addr[idx] = filter_addrs[cnt].addr;
+		snap->match[idx] |= CT_FILTER_MATCH_DST;
+		if(!filter_addrs[cnt].dst_only)
+		{
+			snap->match[idx] |= CT_FILTER_MATCH_SRC;
+		}
+	}
 
-	nfct_filter_set_logic(filter,
-												NFCT_FILTER_SRC_IPV4,
-												NFCT_FILTER_LOGIC_NEGATIVE);
+	filter_snap_cur.store(next, std::memory_order_release);
+}
 
-	nfct_filter_add_attr(filter, NFCT_FILTER_SRC_IPV4, &filter_ipv4);
+static inline bool FilterSnapMatch(const ct_filter_snap *snap, uint32_t addr, uint8_t match)
+{
+	uint32_t idx;
 
-	return 0;
-} /* IPA_Conntrack_Filters_Ignore_Local_Addrs() */
+	for(idx = FilterSnapSlot(addr); snap->addr[idx] != 0; idx = (idx + 1) & (CT_FILTER_SNAP_SLOTS - 1))
+	{
+		if(snap->addr[idx] == addr)
+		{
+			return (snap->match[idx] & match) != 0;
+		}
+	}
 
-/* Initialize TCP Filter */
-int IPACM_ConntrackClient::IPA_Conntrack_TCP_Filter_Init(void)
+	return false;
+}
+
+/* Keep the address and broadcast address of a LAN interface out of user
+   space. The bridge address is refreshed along with it. */
+void IPACM_ConntrackClient::AddIfaceFilter(const ipacm_event_iface_up *param)
 {
-	int ret = 0;
 	IPACM_ConntrackClient *pClient;
-
-	IPACMDBG("\n");
+	uint32_t addrs[2];
+	bool dst_only[2];
+	bool changed;
 
 	pClient = IPACM_ConntrackClient::GetInstance();
 	if(pClient == NULL)
 	{
-		IPACMERR("unable to get conntrack client instance\n");
-		return -1;
+		IPACMERR("unable to retrieve conntrack client instance\n");
+		return;
 	}
 
-	ret = nfct_filter_set_logic(pClient->tcp_filter,
-															NFCT_FILTER_L4PROTO,
-															NFCT_FILTER_LOGIC_POSITIVE);
-	if(ret == -1)
-	{
-		IPACMERR("Unable to set filter logic\n");
-		return -1;
-	}
+	IPACMDBG("Ignore connections to and from interface %s", param->ifname);
+	iptodot("with ipv4 address", param->ipv4_addr);
 
-	/* set protocol filters as tcp and udp */
-	nfct_filter_add_attr_u32(pClient->tcp_filter, NFCT_FILTER_L4PROTO, IPPROTO_TCP);
+	/* calculate broadcast address from addr and addr_mask */
+	addrs[0] = param->ipv4_addr;
+	dst_only[0] = false;
+	addrs[1] = (0xFFFFFFFF & (~param->addr_mask)) | (param->ipv4_addr & param->addr_mask);
+	dst_only[1] = true;
+	iptodot("with broadcast address", addrs[1]);
 
+	pthread_mutex_lock(&pClient->filter_lock);
+	changed = pClient->SetFilterAddrs(param->ifname, addrs, dst_only, 2);
 
-	struct nfct_filter_proto tcp_proto_state;
-	tcp_proto_state.proto = IPPROTO_TCP;
-	tcp_proto_state.state = TCP_CONNTRACK_ESTABLISHED;
+	addrs[0] = GetBridgeAddr();
+	if(addrs[0] != 0)
+	{
+		changed |= pClient->SetFilterAddrs(IPACM_Iface::ipacmcfg->ipa_virtual_iface_name,
+			addrs, dst_only, 1);
+	}
 
-	ret = nfct_filter_set_logic(pClient->tcp_filter,
-															NFCT_FILTER_L4PROTO_STATE,
-															NFCT_FILTER_LOGIC_POSITIVE);
-	if(ret == -1)
+	if(changed)
 	{
-		IPACMERR("unable to set filter logic\n");
-		return -1;
+		pClient->RegenerateFilters();
 	}
-	nfct_filter_add_attr(pClient->tcp_filter,
-											 NFCT_FILTER_L4PROTO_STATE,
-											 &tcp_proto_state);
+	pthread_mutex_unlock(&pClient->filter_lock);
+}
 
+void IPACM_ConntrackClient::DelIfaceFilter(const char *ifname)
+{
+	IPACM_ConntrackClient *pClient;
 
-	tcp_proto_state.proto = IPPROTO_TCP;
-	tcp_proto_state.state = TCP_CONNTRACK_FIN_WAIT;
-	ret = nfct_filter_set_logic(pClient->tcp_filter,
-															NFCT_FILTER_L4PROTO_STATE,
-															NFCT_FILTER_LOGIC_POSITIVE);
-	if(ret == -1)
+	pClient = IPACM_ConntrackClient::GetInstance();
+	if(pClient == NULL)
 	{
-		IPACMERR("unable to set filter logic\n");
-		return -1;
+		IPACMERR("unable to retrieve conntrack client instance\n");
+		return;
 	}
 
-	nfct_filter_add_attr(pClient->tcp_filter,
-											 NFCT_FILTER_L4PROTO_STATE,
-											 &tcp_proto_state);
+	pthread_mutex_lock(&pClient->filter_lock);
+	if(pClient->SetFilterAddrs(ifname, NULL, NULL, 0))
+	{
+		IPACMDBG_H("Removed conntrack filter addresses of %s\n", ifname);
+		pClient->RegenerateFilters();
+	}
+	pthread_mutex_unlock(&pClient->filter_lock);
+}
 
-	tcp_proto_state.proto = IPPROTO_TCP;
-	tcp_proto_state.state = TCP_CONNTRACK_CLOSE;
-	ret = nfct_filter_set_logic(pClient->tcp_filter,
-															NFCT_FILTER_L4PROTO_STATE,
-															NFCT_FILTER_LOGIC_POSITIVE);
-	if(ret == -1)
+/* Count an event that reached user space, and whether the socket filter
+   should have kept it in the kernel. Reactor thread, lock free. */
+void IPACM_ConntrackClient::CountFilterEvent(const ipacm_ct_record *ct)
+{
+	const ct_filter_snap *snap;
+	uint64_t now;
+
+	snap = &filter_snap[filter_snap_cur.load(std::memory_order_acquire)];
+	if(snap->gen != stat_gen)
 	{
-		IPACMERR("unable to set filter logic\n");
-		return -1;
+		IPACMDBG_H("conntrack filter gen %u passed %u events in %llu ms, %u for filtered addrs\n",
+			stat_gen, filter_events,
+			(unsigned long long)((snap->start_us - filter_start_us) / 1000), filter_leaked);
+		stat_gen = snap->gen;
+		filter_start_us = snap->start_us;
+		filter_events = 0;
+		filter_leaked = 0;
 	}
 
-	nfct_filter_add_attr(pClient->tcp_filter,
-											 NFCT_FILTER_L4PROTO_STATE,
-											 &tcp_proto_state);
+	filter_events++;
+	if(AF_INET == ct->l3proto &&
+		 (FilterSnapMatch(snap, ntohl(ct->orig.dst_ip[0]), CT_FILTER_MATCH_DST) ||
+		  FilterSnapMatch(snap, ntohl(ct->orig.src_ip[0]), CT_FILTER_MATCH_SRC)))
+	{
+		filter_leaked++;
+	}
 
-	return 0;
+	if((filter_events % CT_FILTER_STATS_EVENTS) == 0)
+	{
+		now = GetTimeUs();
+		IPACMDBG_H("conntrack filter gen %u: %u events in %llu ms, %u for filtered addrs\n",
+			stat_gen, filter_events,
+			(unsigned long long)((now - filter_start_us) / 1000), filter_leaked);
+	}
 }
 
-
-/* Initialize UDP Filter */
-int IPACM_ConntrackClient::IPA_Conntrack_UDP_Filter_Init(void)
+/* Create the epoll set, the sweep timerfd and the reactor thread once */
+int IPACM_ConntrackClient::StartReactor(void)
 {
+	IPACM_ConntrackClient *pClient;
+	pthread_t reactor_thread = 0;
 	int ret = 0;
-	IPACM_ConntrackClient *pClient = IPACM_ConntrackClient::GetInstance();
+
+	pClient = IPACM_ConntrackClient::GetInstance();
 	if(pClient == NULL)
 	{
 		IPACMERR("unable to get conntrack client instance\n");
 		return -1;
 	}
 
-	ret = nfct_filter_set_logic(pClient->udp_filter,
-															NFCT_FILTER_L4PROTO,
-															NFCT_FILTER_LOGIC_POSITIVE);
-	if(ret == -1)
+	pthread_mutex_lock(&reactor_lock);
+	if(pClient->reactor_started)
 	{
-		IPACMERR("unable to set filter logic\n");
+		goto done;
+	}
+
+	pClient->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(pClient->epoll_fd < 0)
+	{
+		IPACMERR("unable to create epoll fd: %s\n", strerror(errno));
+		ret = -1;
+		goto done;
+	}
+
+	pClient->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(pClient->timer_fd < 0 || AddToReactor(pClient->timer_fd) != 0)
+	{
+		IPACMERR("unable to create sweep timer: %s\n", strerror(errno));
+		ret = -1;
+		goto fail;
+	}
+
+	if(pthread_create(&reactor_thread, NULL, IPACM_ConntrackClient::ConntrackReactor, NULL) != 0)
+	{
+		IPACMERR("unable to create conntrack reactor thread\n");
+		PERROR("unable to create conntrack reactor\n");
+		ret = -1;
+		goto fail;
+	}
+
+	IPACMDBG("created conntrack reactor thread\n");
+	if(pthread_setname_np(reactor_thread, "ct reactor") != 0)
+	{
+		IPACMERR("unable to set thread name\n");
+	}
+
+	pClient->reactor_started = true;
+	goto done;
+
+fail:
+	if(pClient->timer_fd >= 0)
+	{
+		close(pClient->timer_fd);
+		pClient->timer_fd = -1;
+	}
+	close(pClient->epoll_fd);
+	pClient->epoll_fd = -1;
+done:
+	pthread_mutex_unlock(&reactor_lock);
+	return ret;
+}
+
+int IPACM_ConntrackClient::AddToReactor(int fd)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if(epoll_ctl(pInstance->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	{
+		IPACMERR("unable to add fd %d to reactor: %s\n", fd, strerror(errno));
+		return -1;
 	}
-	/* set protocol filters as tcp and udp */
-	nfct_filter_add_attr_u32(pClient->udp_filter, NFCT_FILTER_L4PROTO, IPPROTO_UDP);
 
 	return 0;
 }
 
-void* IPACM_ConntrackClient::UDPConnTimeoutUpdate(void *ptr)
+/* Event bursts (conntrack dumps, flow floods) overrun the default buffer.
+   ENOBUFS is left enabled so overruns are counted instead of hidden. */
+void IPACM_ConntrackClient::SetCTRcvBuf(int fd)
 {
-	#pragma unused (ptr)
-	NatApp *nat_inst = NULL;
-#ifdef IPACM_DEBUG
-	IPACMDBG("\n");
-#endif
+	int size = CT_REACTOR_RCVBUF;
+
+	if(setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0 &&
+		 setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0)
+	{
+		IPACMERR("unable to set rcvbuf on fd %d: %s\n", fd, strerror(errno));
+	}
+}
+
+/* Re-arm the one shot sweep timer with the current NAT sweep tick */
+void IPACM_ConntrackClient::ArmSweepTimer(void)
+{
+	struct itimerspec its;
+	NatApp *nat_inst;
+	uint32_t tick;
 
 	nat_inst = NatApp::GetInstance();
-	if(nat_inst == NULL)
+	if(nat_inst == NULL || pInstance == NULL || pInstance->timer_fd < 0)
 	{
-		IPACMERR("unable to create nat instance\n");
-		return NULL;
+		IPACMERR("unable to arm sweep timer\n");
+		return;
 	}
 
+	tick = nat_inst->GetSweepTick();
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = tick / 1000;
+	its.it_value.tv_nsec = (tick % 1000) * 1000000;
+	if(timerfd_settime(pInstance->timer_fd, 0, &its, NULL) < 0)
+	{
+		IPACMERR("unable to arm sweep timer: %s\n", strerror(errno));
+	}
+}
+
+/* Read at most CT_REACTOR_DRAIN_BUDGET datagrams so one busy socket
+   cannot starve the other, epoll reports the rest on the next wait */
+void IPACM_ConntrackClient::DrainConnTrack(struct nfct_handle *hdl, unsigned int types,
+	uint32_t *enobufs, const char *name)
+{
+	unsigned char buf[NFNL_BUFFSIZE];
+	struct sockaddr_nl peer;
+	const struct nlmsghdr *nlh;
+	socklen_t addrlen;
+	ssize_t len;
+	int cnt, rem;
+
+	for(cnt = 0; cnt < CT_REACTOR_DRAIN_BUDGET; cnt++)
+	{
+		addrlen = sizeof(peer);
+		len = recvfrom(nfct_fd(hdl), buf, sizeof(buf), MSG_DONTWAIT,
+				(struct sockaddr *)&peer, &addrlen);
+		if(len < 0)
+		{
+			if(errno == ENOBUFS)
+			{
+				/* kernel dropped events, the socket itself stays usable */
+				(*enobufs)++;
+				IPACMERR("%s conntrack socket overrun, total %u\n", name, *enobufs);
+				continue;
+			}
+			if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			{
+				IPACMERR("%s recv (%d)(%s)\n", name, errno, strerror(errno));
+			}
+			return;
+		}
+
+		if(addrlen != sizeof(peer) || peer.nl_pid != 0)
+		{
+			IPACMDBG("ignore %s message not sent by kernel\n", name);
+			continue;
+		}
+
+		/* one datagram may carry several events, decode them in place */
+		rem = (int)len;
+		for(nlh = (const struct nlmsghdr *)buf; NLMSG_OK(nlh, rem); nlh = NLMSG_NEXT(nlh, rem))
+		{
+			if(nlh->nlmsg_type == NLMSG_ERROR || nlh->nlmsg_type == NLMSG_DONE)
+			{
+				continue;
+			}
+			PostCTEvent(nlh, types);
+		}
+	}
+}
+
+/* Reactor thread: conntrack events for both protocols and sweep ticks */
+void* IPACM_ConntrackClient::ConntrackReactor(void *)
+{
+	IPACM_ConntrackClient *pClient = pInstance;
+	struct epoll_event events[CT_REACTOR_MAX_EVENTS];
+	ipacm_cmd_q_data evt_data;
+	uint64_t expirations;
+	int num, cnt, fd;
+
+	IPACMDBG("\n");
+
 	while(1)
 	{
-		nat_inst->UpdateUDPTimeStamp();
-		sleep(UDP_TIMEOUT_UPDATE);
-	} /* end of while(1) loop */
+		num = epoll_wait(pClient->epoll_fd, events, CT_REACTOR_MAX_EVENTS, -1);
+		if(num < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			IPACMERR("epoll_wait failed (%d)(%s)\n", errno, strerror(errno));
+			break;
+		}
 
-#ifdef IPACM_DEBUG
-	IPACMDBG("Returning from %s() %d\n", __FUNCTION__, __LINE__);
-#endif
+		for(cnt = 0; cnt < num; cnt++)
+		{
+			fd = events[cnt].data.fd;
+			if(fd == pClient->timer_fd)
+			{
+				if(read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+				{
+					continue;
+				}
+
+				/* the sweep itself runs on the cmd queue thread, one cache
+				   shard per tick, so it never races with rule add/delete */
+				memset(&evt_data, 0, sizeof(evt_data));
+				evt_data.event = IPA_NAT_TS_SWEEP_EVENT;
+				evt_data.evt_data = NULL;
+				if(IPACM_EvtDispatcher::PostEvt(&evt_data) != IPACM_SUCCESS)
+				{
+					IPACMERR("unable to post timestamp sweep event\n");
+				}
+				ArmSweepTimer();
+			}
+			else if(pClient->tcp_hdl != NULL && fd == nfct_fd(pClient->tcp_hdl))
+			{
+				DrainConnTrack(pClient->tcp_hdl, NFCT_T_ALL, &pClient->enobufs_tcp, "tcp");
+			}
+			else if(pClient->udp_hdl != NULL && fd == nfct_fd(pClient->udp_hdl))
+			{
+				DrainConnTrack(pClient->udp_hdl, NFCT_T_NEW | NFCT_T_DESTROY,
+					&pClient->enobufs_udp, "udp");
+			}
+		}
+
+		/* one wakeup is one coalescing window */
+		pClient->FlushCTEvents();
+	}
 
+	IPACMDBG("Exit from conntrack reactor\n");
 	return NULL;
 }
 
-/* Thread to initialize TCP Conntrack Filters*/
-void* IPACM_ConntrackClient::TCPRegisterWithConnTrack(void *)
+/* Open the TCP conntrack socket and hand it to the reactor */
+int IPACM_ConntrackClient::TCPRegisterWithConnTrack(void)
 {
 	int ret;
 	IPACM_ConntrackClient *pClient;
@@ -456,7 +1088,7 @@ void* IPACM_ConntrackClient::TCPRegisterWithConnTrack(void *)
 	if(pClient == NULL)
 	{
 		IPACMERR("unable to get conntrack client instance\n");
-		return NULL;
+		return -1;
 	}
 
 	subscrips = (NF_NETLINK_CONNTRACK_UPDATE | NF_NETLINK_CONNTRACK_DESTROY);
@@ -467,7 +1099,7 @@ void* IPACM_ConntrackClient::TCPRegisterWithConnTrack(void *)
 #ifdef FEATURE_IPACM_AIDL
 	if (pClient->fd_tcp < 0) {
 		IPACMERR("unable to get conntrack TCP handle due to fd_tcp is invalid \n");
-		return NULL;
+		return -1;
 	} else {
 		pClient->tcp_hdl = nfct_open2(CONNTRACK, subscrips, pClient->fd_tcp);
 	}
@@ -478,75 +1110,34 @@ void* IPACM_ConntrackClient::TCPRegisterWithConnTrack(void *)
 	if(pClient->tcp_hdl == NULL)
 	{
 		PERROR("nfct_open failed on getting tcp_hdl\n");
-		return NULL;
+		return -1;
 	}
 
-	/* Initialize the filter */
-	ret = IPA_Conntrack_TCP_Filter_Init();
+	/* Build and attach the filters for the current address set */
+	pthread_mutex_lock(&pClient->filter_lock);
+	ret = pClient->RegenerateFilters();
+	pthread_mutex_unlock(&pClient->filter_lock);
 	if(ret == -1)
 	{
 		IPACMERR("Unable to initliaze TCP Filter\n");
-		return NULL;
-	}
-
-	/* Attach the filter to net filter handler */
-	ret = nfct_filter_attach(nfct_fd(pClient->tcp_hdl), pClient->tcp_filter);
-	if(ret == -1)
-	{
-		IPACMDBG("unable to attach TCP filter\n");
-		return NULL;
+		return -1;
 	}
 
-	/* Register callback with netfilter handler */
+	/* events are decoded by the reactor, no libnetfilter callback needed */
 	IPACMDBG_H("tcp handle:%pK, fd:%d\n", pClient->tcp_hdl, nfct_fd(pClient->tcp_hdl));
-#ifndef CT_OPT
-	nfct_callback_register(pClient->tcp_hdl,
-			(nf_conntrack_msg_type)	(NFCT_T_UPDATE | NFCT_T_DESTROY | NFCT_T_NEW),
-						IPAConntrackEventCB, NULL);
-#else
-	nfct_callback_register(pClient->tcp_hdl, (nf_conntrack_msg_type) NFCT_T_ALL, IPAConntrackEventCB, NULL);
-#endif
-
-	/* Block to catch events from net filter connection track */
-	/* nfct_catch() receives conntrack events from kernel-space, by default it
-			 blocks waiting for events. */
-	IPACMDBG("Waiting for events\n");
 
-ctcatch:
-	ret = nfct_catch(pClient->tcp_hdl);
-	if((ret == -1) && (errno != ENOMSG) && (errno != ENOBUFS))
+	SetCTRcvBuf(nfct_fd(pClient->tcp_hdl));
+	if(AddToReactor(nfct_fd(pClient->tcp_hdl)) != 0)
 	{
-		IPACMERR("(%d)(%d)(%s)\n", ret, errno, strerror(errno));
-		return NULL;
-	}
-	else
-	{
-		IPACMDBG("ctcatch ret:%d, errno:%d\n", ret, errno);
-		goto ctcatch;
+		return -1;
 	}
 
-	IPACMDBG("Exit from tcp thread\n");
-
-	/* destroy the filter.. this will not detach the filter */
-	nfct_filter_destroy(pClient->tcp_filter);
-	pClient->tcp_filter = NULL;
-
-	/* de-register the callback */
-	nfct_callback_unregister(pClient->tcp_hdl);
-	/* close the handle */
-#ifdef FEATURE_IPACM_AIDL
-	nfct_close2(pClient->tcp_hdl, true);
-#else
-	nfct_close(pClient->tcp_hdl);
-#endif
-	pClient->tcp_hdl = NULL;
-
-	pthread_exit(NULL);
-	return NULL;
+	IPACMDBG("Waiting for events\n");
+	return 0;
 }
 
-/* Thread to initialize UDP Conntrack Filters*/
-void* IPACM_ConntrackClient::UDPRegisterWithConnTrack(void *)
+/* Open the UDP conntrack socket and hand it to the reactor */
+int IPACM_ConntrackClient::UDPRegisterWithConnTrack(void)
 {
 	int ret;
 	IPACM_ConntrackClient *pClient = NULL;
@@ -557,13 +1148,13 @@ void* IPACM_ConntrackClient::UDPRegisterWithConnTrack(void *)
 	if(pClient == NULL)
 	{
 		IPACMERR("unable to retrieve instance of conntrack client\n");
-		return NULL;
+		return -1;
 	}
 
 #ifdef FEATURE_IPACM_AIDL
 	if (pClient->fd_udp < 0) {
 		IPACMERR("unable to get conntrack UDP handle due to fd_udp is invalid \n");
-		return NULL;
+		return -1;
 	} else {
 		pClient->udp_hdl = nfct_open2(CONNTRACK,
 					(NF_NETLINK_CONNTRACK_NEW | NF_NETLINK_CONNTRACK_DESTROY), pClient->fd_udp);
@@ -575,65 +1166,29 @@ void* IPACM_ConntrackClient::UDPRegisterWithConnTrack(void *)
 	if(pClient->udp_hdl == NULL)
 	{
 		PERROR("nfct_open failed on getting udp_hdl\n");
-		return NULL;
+		return -1;
 	}
 
-	/* Initialize Filter */
-	ret = IPA_Conntrack_UDP_Filter_Init();
+	/* Build and attach the filters for the current address set */
+	pthread_mutex_lock(&pClient->filter_lock);
+	ret = pClient->RegenerateFilters();
+	pthread_mutex_unlock(&pClient->filter_lock);
 	if(-1 == ret)
 	{
 		IPACMDBG("Unable to initalize udp filters\n");
-		return NULL;
-	}
-
-	/* Attach the filter to net filter handler */
-	ret = nfct_filter_attach(nfct_fd(pClient->udp_hdl), pClient->udp_filter);
-	if(ret == -1)
-	{
-		IPACMDBG("unable to attach the filter\n");
-		return NULL;
+		return -1;
 	}
 
-	/* Register callback with netfilter handler */
+	/* events are decoded by the reactor, no libnetfilter callback needed */
 	IPACMDBG_H("udp handle:%pK, fd:%d\n", pClient->udp_hdl, nfct_fd(pClient->udp_hdl));
-	nfct_callback_register(pClient->udp_hdl,
-			(nf_conntrack_msg_type)(NFCT_T_NEW | NFCT_T_DESTROY),
-			IPAConntrackEventCB,
-			NULL);
 
-	/* Block to catch events from net filter connection track */
-ctcatch:
-	ret = nfct_catch(pClient->udp_hdl);
-	/* Due to conntrack dump, sequence number might mismatch for initial events. */
-	if((ret == -1) && (errno != ENOMSG) && (errno != EILSEQ) && (errno != ENOBUFS))
-	{
-		IPACMDBG("(%d)(%d)(%s)\n", ret, errno, strerror(errno));
-		return NULL;
-	}
-	else
+	SetCTRcvBuf(nfct_fd(pClient->udp_hdl));
+	if(AddToReactor(nfct_fd(pClient->udp_hdl)) != 0)
 	{
-		IPACMDBG("ctcatch ret:%d, errno:%d\n", ret, errno);
-		goto ctcatch;
+		return -1;
 	}
 
-	IPACMDBG("Exit from udp thread with ret: %d\n", ret);
-
-	/* destroy the filter.. this will not detach the filter */
-	nfct_filter_destroy(pClient->udp_filter);
-	pClient->udp_filter = NULL;
-
-	/* de-register the callback */
-	nfct_callback_unregister(pClient->udp_hdl);
-	/* close the handle */
-#ifdef FEATURE_IPACM_AIDL
-	nfct_close2(pClient->udp_hdl, true);
-#else
-	nfct_close(pClient->udp_hdl);
-#endif
-	pClient->udp_hdl = NULL;
-
-	pthread_exit(NULL);
-	return NULL;
+	return 0;
 }
 
 /* Thread to initialize TCP Conntrack Filters*/
@@ -650,29 +1205,35 @@ void IPACM_ConntrackClient::UNRegisterWithConnTrack(void)
 		return;
 	}
 
+	pthread_mutex_lock(&pClient->filter_lock);
 	/* destroy the TCP filter.. this will not detach the filter */
 	if (pClient->tcp_filter) {
 		nfct_filter_destroy(pClient->tcp_filter);
 		pClient->tcp_filter = NULL;
 	}
 
-	/* de-register the callback */
-	if (pClient->tcp_hdl) {
-		nfct_callback_unregister(pClient->tcp_hdl);
-		/* close the handle */
-		nfct_close(pClient->tcp_hdl);
-		pClient->tcp_hdl = NULL;
-	}
-
 	/* destroy the filter.. this will not detach the filter */
 	if (pClient->udp_filter) {
 		nfct_filter_destroy(pClient->udp_filter);
 		pClient->udp_filter = NULL;
 	}
+	pthread_mutex_unlock(&pClient->filter_lock);
 
-	/* de-register the callback */
+	/* remove the socket from the reactor */
+	if (pClient->tcp_hdl) {
+		if (pClient->epoll_fd >= 0) {
+			epoll_ctl(pClient->epoll_fd, EPOLL_CTL_DEL, nfct_fd(pClient->tcp_hdl), NULL);
+		}
+		/* close the handle */
+		nfct_close(pClient->tcp_hdl);
+		pClient->tcp_hdl = NULL;
+	}
+
+	/* remove the socket from the reactor */
 	if (pClient->udp_hdl) {
-		nfct_callback_unregister(pClient->udp_hdl);
+		if (pClient->epoll_fd >= 0) {
+			epoll_ctl(pClient->epoll_fd, EPOLL_CTL_DEL, nfct_fd(pClient->udp_hdl), NULL);
+		}
 		/* close the handle */
 		nfct_close(pClient->udp_hdl);
 		pClient->udp_hdl = NULL;
@@ -684,95 +1245,3 @@ void IPACM_ConntrackClient::UNRegisterWithConnTrack(void)
 	return;
 }
 
-void IPACM_ConntrackClient::UpdateUDPFilters(void *param, bool isWan)
-{
-	static bool isIgnore = false;
-	int ret = 0;
-	IPACM_ConntrackClient *pClient = NULL;
-
-	pClient = IPACM_ConntrackClient::GetInstance();
-	if(pClient == NULL)
-	{
-		IPACMERR("unable to retrieve conntrack client instance\n");
-		return;
-	}
-
-	if(pClient->udp_filter == NULL)
-	{
-		 return;
-	}
-
-	if(!isWan)
-	{
-		IPA_Conntrack_Filters_Ignore_Local_Iface(pClient->udp_filter,
-																		 (ipacm_event_iface_up *)param);
-
-		if(!isIgnore)
-		{
-			IPA_Conntrack_Filters_Ignore_Bridge_Addrs(pClient->udp_filter);
-			IPA_Conntrack_Filters_Ignore_Local_Addrs(pClient->udp_filter);
-			isIgnore = true;
-		}
-	}
-
-	/* Attach the filter to udp handle */
-	if(pClient->udp_hdl != NULL)
-	{
-		IPACMDBG("attaching the filter to udp handle\n");
-		ret = nfct_filter_attach(nfct_fd(pClient->udp_hdl), pClient->udp_filter);
-		if(ret == -1)
-		{
-			PERROR("unable to attach the filter to udp handle\n");
-			IPACMERR("udp handle:%pK, fd:%d Error: %d\n",pClient->udp_hdl, nfct_fd(pClient->udp_hdl), ret);
-			return;
-		}
-	}
-
-	return;
-}
-
-void IPACM_ConntrackClient::UpdateTCPFilters(void *param, bool isWan)
-{
-	static bool isIgnore = false;
-	int ret = 0;
-	IPACM_ConntrackClient *pClient = NULL;
-
-	pClient = IPACM_ConntrackClient::GetInstance();
-	if(pClient == NULL)
-	{
-		IPACMERR("unable to retrieve conntrack client instance\n");
-		return;
-	}
-
-	if(pClient->tcp_filter == NULL)
-		return;
-
-	if(!isWan)
-	{
-		IPA_Conntrack_Filters_Ignore_Local_Iface(pClient->tcp_filter,
-																	(ipacm_event_iface_up *)param);
-
-		if(!isIgnore)
-		{
-			IPA_Conntrack_Filters_Ignore_Bridge_Addrs(pClient->udp_filter);
-			IPA_Conntrack_Filters_Ignore_Local_Addrs(pClient->udp_filter);
-			isIgnore = true;
-		}
-	}
-
-	/* Attach the filter to tcp handle */
-	if(pClient->tcp_hdl != NULL)
-	{
-		IPACMDBG("attaching the filter to tcp handle\n");
-		ret = nfct_filter_attach(nfct_fd(pClient->tcp_hdl), pClient->tcp_filter);
-		if(ret == -1)
-		{
-			PERROR("unable to attach the filter to tcp handle\n");
-			IPACMERR("tcp handle:%pK, fd:%d Error: %d\n",pClient->tcp_hdl, nfct_fd(pClient->tcp_hdl), ret);
-			return;
-		}
-	}
-
-  return;
-}
-
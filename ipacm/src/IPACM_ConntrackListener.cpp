@@ -63,14 +63,59 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE
 
 #include <sys/ioctl.h>
 #include <net/if.h>
+#include <arpa/inet.h>
+#include <stdio.h>
 
 #include "IPACM_ConntrackListener.h"
 #include "IPACM_ConntrackClient.h"
 #include "IPACM_EvtDispatcher.h"
 #include "IPACM_Iface.h"
+#include "IPACM_IfaceRegistry.h"
 #include "IPACM_Wan.h"
 #pragma clang diagnostic ignored "-Wdeprecated-declarations"
 
+/* Resolved ipv4 neighbors of the kernel in host order, -1 if the table
+   can not be read */
+static int ReadArpAddrs(uint32_t *addrs, int max)
+{
+	char line[256], ip[INET_ADDRSTRLEN];
+	unsigned int hw_type, flags;
+	struct in_addr addr;
+	FILE *fp;
+	int num = 0;
+
+	fp = fopen(IPACM_ARP_FILE, "r");
+	if(fp == NULL)
+	{
+		IPACMERR("unable to open %s\n", IPACM_ARP_FILE);
+		return -1;
+	}
+
+	/* skip the header line */
+	if(fgets(line, sizeof(line), fp) == NULL)
+	{
+		fclose(fp);
+		return 0;
+	}
+
+	while(num < max && fgets(line, sizeof(line), fp) != NULL)
+	{
+		if(sscanf(line, "%15s 0x%x 0x%x", ip, &hw_type, &flags) != 3)
+		{
+			continue;
+		}
+		/* ATF_COM, incomplete entries are not clients */
+		if((flags & 0x2) == 0 || inet_pton(AF_INET, ip, &addr) != 1)
+		{
+			continue;
+		}
+		addrs[num++] = ntohl(addr.s_addr);
+	}
+
+	fclose(fp);
+	return num;
+}
+
 IPACM_ConntrackListener::IPACM_ConntrackListener()
 {
 	 IPACMDBG("\n");
@@ -85,12 +130,48 @@ IPACM_ConntrackListener::IPACM_ConntrackListener()
 	 StaClntCnt = 0;
 	 pNatIfaces = NULL;
 	 ct_entries = NULL;
+	 num_ct_entries = 0;
 	 pConfig = IPACM_Config::GetInstance();;
 
 	 memset(nat_iface_ipv4_addr, 0, sizeof(nat_iface_ipv4_addr));
 	 memset(nonnat_iface_ipv4_addr, 0, sizeof(nonnat_iface_ipv4_addr));
 	 memset(sta_clnt_ipv4_addr, 0, sizeof(sta_clnt_ipv4_addr));
 
+	 /* warm restart, pick up the addresses known to the previous run */
+	 if(nat_inst != NULL)
+	 {
+		 int num_restored = 0, num_arp;
+		 uint32_t *arp_addrs;
+
+		 num_restored += nat_inst->LoadAddrList(NAT_SNAP_NAT_IFACE, nat_iface_ipv4_addr, MAX_IFACE_ADDRESS);
+		 num_restored += nat_inst->LoadAddrList(NAT_SNAP_NONNAT_IFACE, nonnat_iface_ipv4_addr, MAX_IFACE_ADDRESS);
+		 nat_inst->LoadAddrList(NAT_SNAP_STA_CLNT, sta_clnt_ipv4_addr, MAX_STA_CLNT_IFACES);
+
+		 /* a client that left during the restart never gets its DEL event */
+		 arp_addrs = (num_restored > 0) ? (uint32_t *)malloc(sizeof(uint32_t) * IPACM_ARP_MAX_ADDRS) : NULL;
+		 if(arp_addrs != NULL)
+		 {
+			 num_arp = ReadArpAddrs(arp_addrs, IPACM_ARP_MAX_ADDRS);
+			 if(num_arp >= 0)
+			 {
+				 RevalidateAddrList(NAT_SNAP_NAT_IFACE, nat_iface_ipv4_addr, MAX_IFACE_ADDRESS, arp_addrs, num_arp);
+				 RevalidateAddrList(NAT_SNAP_NONNAT_IFACE, nonnat_iface_ipv4_addr, MAX_IFACE_ADDRESS, arp_addrs, num_arp);
+			 }
+			 free(arp_addrs);
+		 }
+		 for(int cnt = 0; cnt < MAX_STA_CLNT_IFACES; cnt++)
+		 {
+			 if(sta_clnt_ipv4_addr[cnt] != 0)
+			 {
+				 StaClntCnt++;
+			 }
+		 }
+	 }
+	 conn_cls = IPACM_ConnClassifier::GetInstance();
+	 conn_cls->SetAddrList(CONN_CLS_LIST_NAT_IFACE, nat_iface_ipv4_addr, MAX_IFACE_ADDRESS);
+	 conn_cls->SetAddrList(CONN_CLS_LIST_NONNAT_IFACE, nonnat_iface_ipv4_addr, MAX_IFACE_ADDRESS);
+	 conn_cls->SetAddrList(CONN_CLS_LIST_STA_CLNT, sta_clnt_ipv4_addr, MAX_STA_CLNT_IFACES);
+
 	 IPACM_EvtDispatcher::registr(IPA_HANDLE_WAN_UP, this);
 	 IPACM_EvtDispatcher::registr(IPA_HANDLE_WAN_DOWN, this);
 	 IPACM_EvtDispatcher::registr(IPA_PROCESS_CT_MESSAGE, this);
@@ -100,19 +181,38 @@ IPACM_ConntrackListener::IPACM_ConntrackListener()
 	 IPACM_EvtDispatcher::registr(IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT, this);
 	 IPACM_EvtDispatcher::registr(IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT, this);
 	 IPACM_EvtDispatcher::registr(IPA_MOVE_NAT_TBL_EVENT, this);
+	 IPACM_EvtDispatcher::registr(IPA_NAT_TS_SWEEP_EVENT, this);
+	 IPACM_EvtDispatcher::registr(IPA_PRIVATE_SUBNET_CHANGE_EVENT, this);
+	 IPACM_EvtDispatcher::registr(IPA_LAN_DELETE_SELF, this);
 
 #ifdef CT_OPT
 	 p_lan2lan = IPACM_LanToLan::getLan2LanInstance();
+	 v6_flows = V6FlowApp::GetInstance();
 #endif
 
 	 /* Initialize the CT cache. */
-	 memset(ct_cache, 0, sizeof(ct_cache));
+	 InitCTCache((pConfig != NULL) ? pConfig->GetNatCtCacheEntries() : MAX_CONNTRACK_ENTRIES);
 }
 
 void IPACM_ConntrackListener::event_callback(ipa_cm_event_id evt,
 						void *data)
 {
 	 ipacm_event_iface_up *wan_down = NULL;
+	 ipacm_event_data_fid *fid = NULL;
+
+	 /* nat timer events carry no payload */
+	 if(evt == IPA_NAT_TS_SWEEP_EVENT)
+	 {
+		 IPACMDBG("Received IPA_NAT_TS_SWEEP_EVENT event\n");
+		 if(nat_inst != NULL)
+		 {
+			 nat_inst->UpdateUDPTimeStamp();
+		 }
+#ifdef CT_OPT
+		 ExpireV6Flows();
+#endif
+		 return;
+	 }
 
 	 if(data == NULL)
 	 {
@@ -146,6 +246,11 @@ void IPACM_ConntrackListener::event_callback(ipa_cm_event_id evt,
 			processCacheConntrack();
 			break;
 
+	 case IPA_PRIVATE_SUBNET_CHANGE_EVENT:
+			IPACMDBG("Received IPA_PRIVATE_SUBNET_CHANGE_EVENT event\n");
+			conn_cls->Rebuild();
+			break;
+
 	 case IPA_HANDLE_WAN_DOWN:
 			IPACMDBG_H("Received IPA_HANDLE_WAN_DOWN event\n");
 			wan_down = (ipacm_event_iface_up *)data;
@@ -155,18 +260,28 @@ void IPACM_ConntrackListener::event_callback(ipa_cm_event_id evt,
 			}
 			break;
 
-	/* if wlan or lan comes up after wan interface, modify
-		 tcp/udp filters to ignore local wlan or lan connections */
+	/* keep connections of local wlan or lan interfaces out of user space,
+		 the filters pick the address up whenever the sockets are opened */
 	 case IPA_HANDLE_WLAN_UP:
 	 case IPA_HANDLE_LAN_UP:
 			IPACMDBG_H("Received event: %d with ifname: %s and address: 0x%x\n",
 							 evt, ((ipacm_event_iface_up *)data)->ifname,
 							 ((ipacm_event_iface_up *)data)->ipv4_addr);
+			IPACM_ConntrackClient::AddIfaceFilter((ipacm_event_iface_up *)data);
 			if(isWanUp())
 			{
 				CreateConnTrackThreads();
-				IPACM_ConntrackClient::UpdateUDPFilters(data, false);
-				IPACM_ConntrackClient::UpdateTCPFilters(data, false);
+			}
+			break;
+
+	 case IPA_LAN_DELETE_SELF:
+			fid = (ipacm_event_data_fid *)data;
+			if(pConfig != NULL && fid->if_index >= 0 &&
+				 fid->if_index < pConfig->ipa_num_ipa_interfaces)
+			{
+				IPACMDBG("Received IPA_LAN_DELETE_SELF event for %s\n",
+					pConfig->iface_table[fid->if_index].iface_name);
+				IPACM_ConntrackClient::DelIfaceFilter(pConfig->iface_table[fid->if_index].iface_name);
 			}
 			break;
 
@@ -177,6 +292,9 @@ void IPACM_ConntrackListener::event_callback(ipa_cm_event_id evt,
 
 	 case IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT:
 		 IPACMDBG("Received IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT event\n");
+#ifdef CT_OPT
+		 HandleV6ClntDiscon((ipacm_event_data_all *)data);
+#endif
 		 HandleNonNatIPAddr(data, false);
 		 break;
 	 case IPA_MOVE_NAT_TBL_EVENT:
@@ -192,7 +310,7 @@ void IPACM_ConntrackListener::event_callback(ipa_cm_event_id evt,
 int IPACM_ConntrackListener::CheckNatIface(
    ipacm_event_data_all *data, bool *NatIface)
 {
-	int fd = 0, len = 0, cnt, i;
+	int len = 0, cnt, i;
 	struct ifreq ifr;
 	*NatIface = false;
 
@@ -239,22 +357,12 @@ int IPACM_ConntrackListener::CheckNatIface(
 		return IPACM_FAILURE;
 	}
 
-	/* Search/Configure linux interface-index and map it to IPA interface-index */
-	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
-	{
-		PERROR("get interface name socket create failed");
-		return IPACM_FAILURE;
-	}
-
 	memset(&ifr, 0, sizeof(struct ifreq));
-	ifr.ifr_ifindex = data->if_index;
-	if (ioctl(fd, SIOCGIFNAME, &ifr) < 0)
+	if (IPACM_IfaceRegistry::GetInstance()->GetName(data->if_index, ifr.ifr_name) != IPACM_SUCCESS)
 	{
-		PERROR("call_ioctl_on_dev: ioctl failed:");
-		close(fd);
+		IPACMERR("no interface name for index %d\n", data->if_index);
 		return IPACM_FAILURE;
 	}
-	close(fd);
 
 	for (i = 0; i < NatIfaceCnt; i++)
 	{
@@ -300,6 +408,7 @@ void IPACM_ConntrackListener::HandleNonNatIPAddr(
 				if (nonnat_iface_ipv4_addr[cnt] == 0)
 				{
 					nonnat_iface_ipv4_addr[cnt] = data->ipv4_addr;
+					UpdateAddrList(CONN_CLS_LIST_NONNAT_IFACE);
 					IPACMDBG("Add ip addr to non nat list (%d) ", cnt);
 					iptodot("with ipv4 address", nonnat_iface_ipv4_addr[cnt]);
 
@@ -320,6 +429,7 @@ void IPACM_ConntrackListener::HandleNonNatIPAddr(
 				IPACMDBG("Reseting ct filters, entry (%d) ", cnt);
 				iptodot("with ipv4 address", nonnat_iface_ipv4_addr[cnt]);
 				nonnat_iface_ipv4_addr[cnt] = 0;
+				UpdateAddrList(CONN_CLS_LIST_NONNAT_IFACE);
 				nat_inst->FlushTempEntries(data->ipv4_addr, false);
 				nat_inst->DelEntriesOnClntDiscon(data->ipv4_addr);
 				return;
@@ -350,6 +460,7 @@ void IPACM_ConntrackListener::HandleNeighIpAddrAddEvt(
 			if (nat_iface_ipv4_addr[j] == 0)
 			{
 				nat_iface_ipv4_addr[j] = data->ipv4_addr;
+				UpdateAddrList(CONN_CLS_LIST_NAT_IFACE);
 				iptodot("Nating connections of addr: ", nat_iface_ipv4_addr[j]);
 				break;
 			}
@@ -384,6 +495,7 @@ void IPACM_ConntrackListener::HandleNeighIpAddrDelEvt(
 			IPACMDBG("Reseting ct nat iface, entry (%d) ", cnt);
 			iptodot("with ipv4 address", nat_iface_ipv4_addr[cnt]);
 			nat_iface_ipv4_addr[cnt] = 0;
+			UpdateAddrList(CONN_CLS_LIST_NAT_IFACE);
 			nat_inst->FlushTempEntries(ipv4_addr, false);
 			nat_inst->DelEntriesOnClntDiscon(ipv4_addr);
 		}
@@ -437,70 +549,52 @@ void IPACM_ConntrackListener::TriggerWANUp(void *in_param)
 	 CreateNatThreads();
 }
 
+/* Both conntrack sockets are served by the conntrack reactor thread */
 int IPACM_ConntrackListener::CreateConnTrackThreads(void)
 {
-	int ret;
-	pthread_t tcp_thread = 0, udp_thread = 0;
+	int ret = 0;
 
 	if(isCTReg == false)
 	{
-		ret = pthread_create(&tcp_thread, NULL, IPACM_ConntrackClient::TCPRegisterWithConnTrack, NULL);
-		if(0 != ret)
+		if(IPACM_ConntrackClient::StartReactor() != 0)
 		{
-			IPACMERR("unable to create TCP conntrack event listner thread\n");
-			PERROR("unable to create TCP conntrack\n");
+			IPACMERR("unable to start conntrack reactor\n");
 			goto error;
 		}
 
-		IPACMDBG("created TCP conntrack event listner thread\n");
-		if(pthread_setname_np(tcp_thread, "tcp ct listener") != 0)
-		{
-			IPACMERR("unable to set thread name\n");
-		}
-
-		ret = pthread_create(&udp_thread, NULL, IPACM_ConntrackClient::UDPRegisterWithConnTrack, NULL);
-		if(0 != ret)
+		if(IPACM_ConntrackClient::TCPRegisterWithConnTrack() != 0)
 		{
-			IPACMERR("unable to create UDP conntrack event listner thread\n");
-			PERROR("unable to create UDP conntrack\n");
-			goto error;
+			IPACMERR("unable to register TCP conntrack events\n");
+			ret = -1;
 		}
 
-		IPACMDBG("created UDP conntrack event listner thread\n");
-		if(pthread_setname_np(udp_thread, "udp ct listener") != 0)
+		if(IPACM_ConntrackClient::UDPRegisterWithConnTrack() != 0)
 		{
-			IPACMERR("unable to set thread name\n");
+			IPACMERR("unable to register UDP conntrack events\n");
+			ret = -1;
 		}
 
 		isCTReg = true;
 	}
 
-	return 0;
+	return ret;
 
 error:
 	return -1;
 }
+/* The timestamp sweep is driven by the reactor's timerfd */
 int IPACM_ConntrackListener::CreateNatThreads(void)
 {
-	int ret;
-	pthread_t udpcto_thread = 0;
-
 	if(isNatThreadStart == false)
 	{
-		ret = pthread_create(&udpcto_thread, NULL, IPACM_ConntrackClient::UDPConnTimeoutUpdate, NULL);
-		if(0 != ret)
+		if(IPACM_ConntrackClient::StartReactor() != 0)
 		{
-			IPACMERR("unable to create udp conn timeout thread\n");
-			PERROR("unable to create udp conn timeout\n");
+			IPACMERR("unable to start conntrack reactor\n");
 			goto error;
 		}
 
-		IPACMDBG("created upd conn timeout thread\n");
-		if(pthread_setname_np(udpcto_thread, "udp conn timeout") != 0)
-		{
-			IPACMERR("unable to set thread name\n");
-		}
-
+		IPACM_ConntrackClient::ArmSweepTimer();
+		IPACMDBG("armed timestamp sweep timer\n");
 		isNatThreadStart = true;
 	}
 	return 0;
@@ -529,52 +623,41 @@ void IPACM_ConntrackListener::TriggerWANDown(uint32_t wan_addr)
 }
 
 
-void ParseCTMessage(struct nf_conntrack *ct)
+void ParseCTMessage(const ipacm_ct_record *ct)
 {
-	 uint32_t status, timeout;
 	 IPACMDBG("Printing conntrack parameters\n");
 
-	 iptodot("ATTR_IPV4_SRC = ATTR_ORIG_IPV4_SRC:", nfct_get_attr_u32(ct, ATTR_ORIG_IPV4_SRC));
-	 iptodot("ATTR_IPV4_DST = ATTR_ORIG_IPV4_DST:", nfct_get_attr_u32(ct, ATTR_ORIG_IPV4_DST));
-	 IPACMDBG("ATTR_PORT_SRC = ATTR_ORIG_PORT_SRC: 0x%x\n", nfct_get_attr_u16(ct, ATTR_ORIG_PORT_SRC));
-	 IPACMDBG("ATTR_PORT_DST = ATTR_ORIG_PORT_DST: 0x%x\n", nfct_get_attr_u16(ct, ATTR_ORIG_PORT_DST));
-
-	 iptodot("ATTR_REPL_IPV4_SRC:", nfct_get_attr_u32(ct, ATTR_REPL_IPV4_SRC));
-	 iptodot("ATTR_REPL_IPV4_DST:", nfct_get_attr_u32(ct, ATTR_REPL_IPV4_DST));
-	 IPACMDBG("ATTR_REPL_PORT_SRC: 0x%x\n", nfct_get_attr_u16(ct, ATTR_REPL_PORT_SRC));
-	 IPACMDBG("ATTR_REPL_PORT_DST: 0x%x\n", nfct_get_attr_u16(ct, ATTR_REPL_PORT_DST));
+	 iptodot("ATTR_IPV4_SRC = ATTR_ORIG_IPV4_SRC:", ct->orig.src_ip[0]);
+	 iptodot("ATTR_IPV4_DST = ATTR_ORIG_IPV4_DST:", ct->orig.dst_ip[0]);
+	 IPACMDBG("ATTR_PORT_SRC = ATTR_ORIG_PORT_SRC: 0x%x\n", ct->orig.src_port);
+	 IPACMDBG("ATTR_PORT_DST = ATTR_ORIG_PORT_DST: 0x%x\n", ct->orig.dst_port);
 
-	 iptodot("ATTR_SNAT_IPV4:", nfct_get_attr_u32(ct, ATTR_SNAT_IPV4));
-	 iptodot("ATTR_DNAT_IPV4:", nfct_get_attr_u32(ct, ATTR_DNAT_IPV4));
-	 IPACMDBG("ATTR_SNAT_PORT: 0x%x\n", nfct_get_attr_u16(ct, ATTR_SNAT_PORT));
-	 IPACMDBG("ATTR_DNAT_PORT: 0x%x\n", nfct_get_attr_u16(ct, ATTR_DNAT_PORT));
+	 iptodot("ATTR_REPL_IPV4_SRC:", ct->repl.src_ip[0]);
+	 iptodot("ATTR_REPL_IPV4_DST:", ct->repl.dst_ip[0]);
+	 IPACMDBG("ATTR_REPL_PORT_SRC: 0x%x\n", ct->repl.src_port);
+	 IPACMDBG("ATTR_REPL_PORT_DST: 0x%x\n", ct->repl.dst_port);
 
-	 IPACMDBG("ATTR_MARK: 0x%x\n", nfct_get_attr_u32(ct, ATTR_MARK));
-	 IPACMDBG("ATTR_USE: 0x%x\n", nfct_get_attr_u32(ct, ATTR_USE));
-	 IPACMDBG("ATTR_ID: 0x%x\n", nfct_get_attr_u32(ct, ATTR_ID));
+	 IPACMDBG("ATTR_MARK: 0x%x\n", ct->mark);
+	 IPACMDBG("ATTR_ID: 0x%x\n", ct->id);
+	 IPACMDBG("ATTR_STATUS: 0x%x\n", ct->status);
+	 IPACMDBG("ATTR_TIMEOUT: 0x%x\n", ct->timeout);
 
-	 status = nfct_get_attr_u32(ct, ATTR_STATUS);
-	 IPACMDBG("ATTR_STATUS: 0x%x\n", status);
-
-	 timeout = nfct_get_attr_u32(ct, ATTR_TIMEOUT);
-	 IPACMDBG("ATTR_TIMEOUT: 0x%x\n", timeout);
-
-	 if(IPS_SRC_NAT & status)
+	 if(IPS_SRC_NAT & ct->status)
 	 {
 			IPACMDBG("IPS_SRC_NAT set\n");
 	 }
 
-	 if(IPS_DST_NAT & status)
+	 if(IPS_DST_NAT & ct->status)
 	 {
 			IPACMDBG("IPS_DST_NAT set\n");
 	 }
 
-	 if(IPS_SRC_NAT_DONE & status)
+	 if(IPS_SRC_NAT_DONE & ct->status)
 	 {
 			IPACMDBG("IPS_SRC_NAT_DONE set\n");
 	 }
 
-	 if(IPS_DST_NAT_DONE & status)
+	 if(IPS_DST_NAT_DONE & ct->status)
 	 {
 			IPACMDBG(" IPS_DST_NAT_DONE set\n");
 	 }
@@ -583,42 +666,28 @@ void ParseCTMessage(struct nf_conntrack *ct)
 	 return;
 }
 
-void ParseCTV6Message(struct nf_conntrack *ct)
+void ParseCTV6Message(const ipacm_ct_record *ct)
 {
-	 uint32_t status, timeout;
-	 struct nfct_attr_grp_ipv6 orig_params;
-	 uint8_t l4proto, tcp_flags, tcp_state;
-
 	 IPACMDBG("Printing conntrack parameters\n");
 
-	 nfct_get_attr_grp(ct, ATTR_GRP_ORIG_IPV6, (void *)&orig_params);
-	 IPACMDBG("Orig src_v6_addr: 0x%08x%08x%08x%08x\n", orig_params.src[0], orig_params.src[1],
-                	orig_params.src[2], orig_params.src[3]);
-	IPACMDBG("Orig dst_v6_addr: 0x%08x%08x%08x%08x\n", orig_params.dst[0], orig_params.dst[1],
-                	orig_params.dst[2], orig_params.dst[3]);
+	 IPACMDBG("Orig src_v6_addr: 0x%08x%08x%08x%08x\n", ct->orig.src_ip[0], ct->orig.src_ip[1],
+                	ct->orig.src_ip[2], ct->orig.src_ip[3]);
+	IPACMDBG("Orig dst_v6_addr: 0x%08x%08x%08x%08x\n", ct->orig.dst_ip[0], ct->orig.dst_ip[1],
+                	ct->orig.dst_ip[2], ct->orig.dst_ip[3]);
 
-	 IPACMDBG("ATTR_PORT_SRC = ATTR_ORIG_PORT_SRC: 0x%x\n", nfct_get_attr_u16(ct, ATTR_ORIG_PORT_SRC));
-	 IPACMDBG("ATTR_PORT_DST = ATTR_ORIG_PORT_DST: 0x%x\n", nfct_get_attr_u16(ct, ATTR_ORIG_PORT_DST));
+	 IPACMDBG("ATTR_PORT_SRC = ATTR_ORIG_PORT_SRC: 0x%x\n", ct->orig.src_port);
+	 IPACMDBG("ATTR_PORT_DST = ATTR_ORIG_PORT_DST: 0x%x\n", ct->orig.dst_port);
 
-	 IPACMDBG("ATTR_MARK: 0x%x\n", nfct_get_attr_u32(ct, ATTR_MARK));
-	 IPACMDBG("ATTR_USE: 0x%x\n", nfct_get_attr_u32(ct, ATTR_USE));
-	 IPACMDBG("ATTR_ID: 0x%x\n", nfct_get_attr_u32(ct, ATTR_ID));
+	 IPACMDBG("ATTR_MARK: 0x%x\n", ct->mark);
+	 IPACMDBG("ATTR_ID: 0x%x\n", ct->id);
+	 IPACMDBG("ATTR_TIMEOUT: 0x%x\n", ct->timeout);
+	 IPACMDBG("ATTR_STATUS: 0x%x\n", ct->status);
 
-	 timeout = nfct_get_attr_u32(ct, ATTR_TIMEOUT);
-	 IPACMDBG("ATTR_TIMEOUT: 0x%x\n", timeout);
-
-	 status = nfct_get_attr_u32(ct, ATTR_STATUS);
-	 IPACMDBG("ATTR_STATUS: 0x%x\n", status);
-
-	 l4proto = nfct_get_attr_u8(ct, ATTR_ORIG_L4PROTO);
-	 IPACMDBG("ATTR_ORIG_L4PROTO: 0x%x\n", l4proto);
-	 if(l4proto == IPPROTO_TCP)
+	 IPACMDBG("ATTR_ORIG_L4PROTO: 0x%x\n", ct->l4proto);
+	 if(ct->l4proto == IPPROTO_TCP)
 	 {
-		tcp_state = nfct_get_attr_u8(ct, ATTR_TCP_STATE);
-		IPACMDBG("ATTR_TCP_STATE: 0x%x\n", tcp_state);
-
-		tcp_flags =  nfct_get_attr_u8(ct, ATTR_TCP_FLAGS_ORIG);
-		IPACMDBG("ATTR_TCP_FLAGS_ORIG: 0x%x\n", tcp_flags);
+		IPACMDBG("ATTR_TCP_STATE: 0x%x\n", ct->tcp_state);
+		IPACMDBG("ATTR_TCP_FLAGS_ORIG: 0x%x\n", ct->tcp_flags);
 	 }
 
 	 IPACMDBG("\n");
@@ -631,16 +700,12 @@ void IPACM_ConntrackListener::ProcessCTV6Message(void *param)
 	ipacm_ct_evt_data *evt_data = (ipacm_ct_evt_data *)param;
 	u_int8_t l4proto = 0;
 	uint32_t status = 0;
-	struct nf_conntrack *ct = evt_data->ct;
+	const ipacm_ct_record *ct = &evt_data->ct;
+	v6_flow_entry flow;
+	bool isNew = true;
 
 #ifdef IPACM_DEBUG
-	 char buf[1024];
-
-	 /* Process message and generate ioctl call to kernel thread */
-	 nfct_snprintf(buf, sizeof(buf), evt_data->ct,
-								 evt_data->type, NFCT_O_PLAIN, NFCT_OF_TIME);
-	 IPACMDBG("%s\n", buf);
-	 IPACMDBG("\n");
+	 IPACMDBG("type %d\n", evt_data->type);
 	 ParseCTV6Message(ct);
 #endif
 
@@ -650,14 +715,14 @@ void IPACM_ConntrackListener::ProcessCTV6Message(void *param)
 		goto IGNORE;
 	}
 
-	status = nfct_get_attr_u32(ct, ATTR_STATUS);
+	status = ct->status;
 	if((IPS_DST_NAT & status) || (IPS_SRC_NAT & status))
 	{
 		IPACMDBG("Either Destination or Source nat flag Set\n");
 		goto IGNORE;
 	}
 
-	l4proto = nfct_get_attr_u8(ct, ATTR_ORIG_L4PROTO);
+	l4proto = ct->l4proto;
 	if(IPPROTO_UDP != l4proto && IPPROTO_TCP != l4proto)
 	{
 		 IPACMDBG("Received unexpected protocl %d conntrack message\n", l4proto);
@@ -665,12 +730,9 @@ void IPACM_ConntrackListener::ProcessCTV6Message(void *param)
 	}
 
 	IPACMDBG("Neither Destination nor Source nat flag Set\n");
-	struct nfct_attr_grp_ipv6 orig_params;
-	nfct_get_attr_grp(ct, ATTR_GRP_ORIG_IPV6, (void *)&orig_params);
-
 	ipacm_event_connection lan2lan_conn;
 	lan2lan_conn.iptype = IPA_IP_v6;
-	memcpy(lan2lan_conn.src_ipv6_addr, orig_params.src,
+	memcpy(lan2lan_conn.src_ipv6_addr, ct->orig.src_ip,
 				 sizeof(lan2lan_conn.src_ipv6_addr));
     IPACMDBG("Before convert, src_v6_addr: 0x%08x%08x%08x%08x\n", lan2lan_conn.src_ipv6_addr[0], lan2lan_conn.src_ipv6_addr[1],
                 	lan2lan_conn.src_ipv6_addr[2], lan2lan_conn.src_ipv6_addr[3]);
@@ -681,7 +743,7 @@ void IPACM_ConntrackListener::ProcessCTV6Message(void *param)
 	IPACMDBG("After convert src_v6_addr: 0x%08x%08x%08x%08x\n", lan2lan_conn.src_ipv6_addr[0], lan2lan_conn.src_ipv6_addr[1],
                 	lan2lan_conn.src_ipv6_addr[2], lan2lan_conn.src_ipv6_addr[3]);
 
-	memcpy(lan2lan_conn.dst_ipv6_addr, orig_params.dst,
+	memcpy(lan2lan_conn.dst_ipv6_addr, ct->orig.dst_ip,
 				 sizeof(lan2lan_conn.dst_ipv6_addr));
 	IPACMDBG("Before convert, dst_ipv6_addr: 0x%08x%08x%08x%08x\n", lan2lan_conn.dst_ipv6_addr[0], lan2lan_conn.dst_ipv6_addr[1],
                 	lan2lan_conn.dst_ipv6_addr[2], lan2lan_conn.dst_ipv6_addr[3]);
@@ -692,26 +754,107 @@ void IPACM_ConntrackListener::ProcessCTV6Message(void *param)
 	IPACMDBG("After convert, dst_ipv6_addr: 0x%08x%08x%08x%08x\n", lan2lan_conn.dst_ipv6_addr[0], lan2lan_conn.dst_ipv6_addr[1],
                 	lan2lan_conn.dst_ipv6_addr[2], lan2lan_conn.dst_ipv6_addr[3]);
 
+	memset(&flow, 0, sizeof(flow));
+	memcpy(flow.src_ip, lan2lan_conn.src_ipv6_addr, sizeof(flow.src_ip));
+	memcpy(flow.dst_ip, lan2lan_conn.dst_ipv6_addr, sizeof(flow.dst_ip));
+	flow.src_port = ntohs(ct->orig.src_port);
+	flow.dst_port = ntohs(ct->orig.dst_port);
+	flow.protocol = l4proto;
+
 	if(((IPPROTO_UDP == l4proto) && (NFCT_T_NEW == evt_data->type)) ||
 		 ((IPPROTO_TCP == l4proto) &&
-			(nfct_get_attr_u8(ct, ATTR_TCP_STATE) == TCP_CONNTRACK_ESTABLISHED))
+			(ct->tcp_state == TCP_CONNTRACK_ESTABLISHED))
 		 )
 	{
-			p_lan2lan->handle_new_connection(&lan2lan_conn);
+			/* established tcp updates repeat, only report the first one. A full
+			   table loses the tracking of the flow, not its offload */
+			if(v6_flows != NULL &&
+				 v6_flows->AddFlow(&flow, ct->timeout, &isNew) < 0)
+			{
+				isNew = true;
+			}
+			if(isNew)
+			{
+				p_lan2lan->handle_new_connection(&lan2lan_conn);
+			}
 	}
 	else if((IPPROTO_UDP == l4proto && NFCT_T_DESTROY == evt_data->type) ||
 					(IPPROTO_TCP == l4proto &&
-					 (nfct_get_attr_u8(ct, ATTR_TCP_STATE) == TCP_CONNTRACK_FIN_WAIT ||
-					  nfct_get_attr_u8(ct, ATTR_TCP_STATE) == TCP_CONNTRACK_CLOSE)))
+					 (ct->tcp_state == TCP_CONNTRACK_FIN_WAIT ||
+					  ct->tcp_state == TCP_CONNTRACK_CLOSE)))
+	{
+			/* only report what was reported as new, tcp closes in two steps */
+			if(v6_flows == NULL || v6_flows->DeleteFlow(&flow) ||
+				 v6_flows->ClaimUntracked())
+			{
+				p_lan2lan->handle_del_connection(&lan2lan_conn);
+			}
+	}
+	else if(v6_flows != NULL)
 	{
-			p_lan2lan->handle_del_connection(&lan2lan_conn);
+			v6_flows->RefreshFlow(&flow, ct->timeout);
 	}
 
 IGNORE:
-	/* Cleanup item that was allocated during the original CT callback */
-	nfct_destroy(ct);
 	return;
 }
+
+/* Report the flows of a disconnected client to lan2lan */
+void IPACM_ConntrackListener::NotifyV6FlowDel(const v6_flow_entry *flows, int num)
+{
+	ipacm_event_connection lan2lan_conn;
+	int cnt;
+
+	if(p_lan2lan == NULL)
+	{
+		return;
+	}
+
+	for(cnt = 0; cnt < num; cnt++)
+	{
+		memset(&lan2lan_conn, 0, sizeof(lan2lan_conn));
+		lan2lan_conn.iptype = IPA_IP_v6;
+		memcpy(lan2lan_conn.src_ipv6_addr, flows[cnt].src_ip, sizeof(lan2lan_conn.src_ipv6_addr));
+		memcpy(lan2lan_conn.dst_ipv6_addr, flows[cnt].dst_ip, sizeof(lan2lan_conn.dst_ipv6_addr));
+		p_lan2lan->handle_del_connection(&lan2lan_conn);
+	}
+}
+
+/* Table side expiry only frees slots, a udp flow past its NEW timeout may
+   still be live and offloaded and lan2lan must keep it. The slots are only
+   taken back when the table runs short. */
+void IPACM_ConntrackListener::ExpireV6Flows(void)
+{
+	int num;
+
+	if(v6_flows == NULL)
+	{
+		return;
+	}
+
+	num = v6_flows->ExpireFlows();
+	if(num > 0)
+	{
+		IPACMDBG_H("Reclaimed %d expired ipv6 flow slots\n", num);
+	}
+}
+
+void IPACM_ConntrackListener::HandleV6ClntDiscon(const ipacm_event_data_all *data)
+{
+	v6_flow_entry removed[V6_FLOW_SWEEP_SHARD_SIZE];
+	int num;
+
+	if(v6_flows == NULL || data == NULL || data->iptype != IPA_IP_v6)
+	{
+		return;
+	}
+
+	do
+	{
+		num = v6_flows->DelFlowsOnClntDiscon(data->ipv6_addr, removed, V6_FLOW_SWEEP_SHARD_SIZE);
+		NotifyV6FlowDel(removed, num);
+	} while(num == V6_FLOW_SWEEP_SHARD_SIZE);
+}
 #endif
 
 void IPACM_ConntrackListener::ProcessCTMessage(void *param)
@@ -721,40 +864,93 @@ void IPACM_ConntrackListener::ProcessCTMessage(void *param)
 	 bool cache_ct = false;
 
 #ifdef IPACM_DEBUG
-	 char buf[1024];
-	 unsigned int out_flags;
-
-	 /* Process message and generate ioctl call to kernel thread */
-	 out_flags = (NFCT_OF_SHOW_LAYER3 | NFCT_OF_TIME | NFCT_OF_ID);
-	 nfct_snprintf(buf, sizeof(buf), evt_data->ct,
-								 evt_data->type, NFCT_O_PLAIN, out_flags);
-	 IPACMDBG_H("%s\n", buf);
-
-	 ParseCTMessage(evt_data->ct);
+	 IPACMDBG_H("type %d l3proto %d l4proto %d id 0x%x\n", evt_data->type,
+			evt_data->ct.l3proto, evt_data->ct.l4proto, evt_data->ct.id);
+	 ParseCTMessage(&evt_data->ct);
 #endif
 
-	 l4proto = nfct_get_attr_u8(evt_data->ct, ATTR_ORIG_L4PROTO);
+	 l4proto = evt_data->ct.l4proto;
 	 if(IPPROTO_UDP != l4proto && IPPROTO_TCP != l4proto)
 	 {
 			IPACMDBG("Received unexpected protocl %d conntrack message\n", l4proto);
 	 }
 	 else
 	 {
-			cache_ct = ProcessTCPorUDPMsg(evt_data->ct, evt_data->type, l4proto);
+			cache_ct = ProcessTCPorUDPMsg(&evt_data->ct, evt_data->type, l4proto);
 	 }
 
-	 /* Cleanup item that was allocated during the original CT callback */
-	 if (!cache_ct)
-		nfct_destroy(evt_data->ct);
-	 else
-	 	CacheORDeleteConntrack(evt_data->ct, evt_data->type, l4proto);
+	 /* the record is carried by value, only keep it if WAN is not up yet */
+	 if (cache_ct)
+	 	CacheORDeleteConntrack(&evt_data->ct, evt_data->type, l4proto);
 	 return;
 }
 
+/* Drop the restored addresses of a list the kernel no longer resolves */
+void IPACM_ConntrackListener::RevalidateAddrList(int snap, uint32_t *addr, int num,
+	const uint32_t *arp, int num_arp)
+{
+	int cnt, idx, dropped = 0;
+
+	for(cnt = 0; cnt < num; cnt++)
+	{
+		if(addr[cnt] == 0)
+		{
+			continue;
+		}
+		for(idx = 0; idx < num_arp && arp[idx] != addr[cnt]; idx++);
+		if(idx == num_arp)
+		{
+			iptodot("Dropping stale restored address", addr[cnt]);
+			addr[cnt] = 0;
+			dropped++;
+		}
+	}
+
+	if(dropped > 0)
+	{
+		IPACMDBG_H("nat snapshot: dropped %d stale addresses of list %d\n", dropped, snap);
+		nat_inst->SaveAddrList(snap, addr, num);
+	}
+}
+
+/* Publish a changed address list to the classifier and the restart snapshot */
+void IPACM_ConntrackListener::UpdateAddrList(int list)
+{
+	uint32_t *addr;
+	int cnt, snap;
+
+	switch(list)
+	{
+	case CONN_CLS_LIST_NAT_IFACE:
+		addr = nat_iface_ipv4_addr;
+		cnt = MAX_IFACE_ADDRESS;
+		snap = NAT_SNAP_NAT_IFACE;
+		break;
+	case CONN_CLS_LIST_NONNAT_IFACE:
+		addr = nonnat_iface_ipv4_addr;
+		cnt = MAX_IFACE_ADDRESS;
+		snap = NAT_SNAP_NONNAT_IFACE;
+		break;
+	case CONN_CLS_LIST_STA_CLNT:
+		addr = sta_clnt_ipv4_addr;
+		cnt = MAX_STA_CLNT_IFACES;
+		snap = NAT_SNAP_STA_CLNT;
+		break;
+	default:
+		return;
+	}
+
+	conn_cls->SetAddrList(list, addr, cnt);
+	if(nat_inst != NULL)
+	{
+		nat_inst->SaveAddrList(snap, addr, cnt);
+	}
+}
+
 bool IPACM_ConntrackListener::AddIface(
    nat_table_entry *rule, bool *isTempEntry)
 {
-	int cnt;
+	uint8_t cls;
 
 	*isTempEntry = false;
 
@@ -769,46 +965,30 @@ bool IPACM_ConntrackListener::AddIface(
 		}
 	}
 
+	cls = conn_cls->Classify(rule->private_ip) | conn_cls->Classify(rule->target_ip);
+
 	/* check whether nat iface or not */
-	for (cnt = 0; cnt < MAX_IFACE_ADDRESS; cnt++)
+	if (cls & CONN_CLS_NAT_IFACE)
 	{
-		if (nat_iface_ipv4_addr[cnt] != 0)
-		{
-			if (rule->private_ip == nat_iface_ipv4_addr[cnt] ||
-				rule->target_ip == nat_iface_ipv4_addr[cnt])
-			{
-				IPACMDBG("matched nat_iface_ipv4_addr entry(%d)\n", cnt);
-				iptodot("AddIface(): Nat entry match with ip addr",
-						nat_iface_ipv4_addr[cnt]);
-				return true;
-			}
-		}
+		IPACMDBG("matched nat_iface_ipv4_addr entry\n");
+		return true;
 	}
 
 	if (backhaul_mode == Q6_WAN)
 	{
 		/* check whether non nat iface or not, on Non Nat iface
 		   add dummy rule by copying public ip to private ip */
-		for (cnt = 0; cnt < MAX_IFACE_ADDRESS; cnt++)
+		if (cls & CONN_CLS_NONNAT_IFACE)
 		{
-			if (nonnat_iface_ipv4_addr[cnt] != 0)
-			{
-				if (rule->private_ip == nonnat_iface_ipv4_addr[cnt] ||
-					rule->target_ip == nonnat_iface_ipv4_addr[cnt])
-				{
-					IPACMDBG("matched non_nat_iface_ipv4_addr entry(%d)\n", cnt);
-					iptodot("AddIface(): Non Nat entry match with ip addr",
-							nonnat_iface_ipv4_addr[cnt]);
-
-					/* Ignoring Dummy NAT entry for non nat ifaces */
-					if (IPACM_Iface::ipacmcfg->GetIPAVer() >= IPA_HW_v5_5) {
-						return false;
-					} else {
-						rule->private_ip = rule->public_ip;
-						rule->private_port = rule->public_port;
-						return true;
-					}
-				}
+			IPACMDBG("matched non_nat_iface_ipv4_addr entry\n");
+
+			/* Ignoring Dummy NAT entry for non nat ifaces */
+			if (IPACM_Iface::ipacmcfg->GetIPAVer() >= IPA_HW_v5_5) {
+				return false;
+			} else {
+				rule->private_ip = rule->public_ip;
+				rule->private_port = rule->public_port;
+				return true;
 			}
 		}
 		IPACMDBG_H("Not mtaching with non-nat ifaces\n");
@@ -816,18 +996,7 @@ bool IPACM_ConntrackListener::AddIface(
 	else
 		IPACMDBG("In STA mode, don't compare against non nat ifaces\n");
 
-	if(pConfig == NULL)
-	{
-		pConfig = IPACM_Config::GetInstance();
-		if(pConfig == NULL)
-		{
-			IPACMERR("Unable to get Config instance\n");
-			return false;
-		}
-	}
-
-	if (pConfig->isPrivateSubnet(rule->private_ip) ||
-		pConfig->isPrivateSubnet(rule->target_ip))
+	if (cls & CONN_CLS_PRIVATE_SUBNET)
 	{
 		IPACMDBG("Matching with Private subnet\n");
 		*isTempEntry = true;
@@ -863,7 +1032,7 @@ void IPACM_ConntrackListener::AddORDeleteNatEntry(const nat_entry_bundle *input)
 
 	if (IPPROTO_TCP == input->rule->protocol)
 	{
-		tcp_state = nfct_get_attr_u8(input->ct, ATTR_TCP_STATE);
+		tcp_state = input->ct->tcp_state;
 		if (TCP_CONNTRACK_ESTABLISHED == tcp_state)
 		{
 			IPACMDBG("TCP state TCP_CONNTRACK_ESTABLISHED(%d)\n", tcp_state);
@@ -878,7 +1047,7 @@ void IPACM_ConntrackListener::AddORDeleteNatEntry(const nat_entry_bundle *input)
 			}
 			else
 			{
-				nat_inst->AddEntry(input->rule);
+				nat_inst->QueueEntry(input->rule, true);
 			}
 		}
 		else if (TCP_CONNTRACK_FIN_WAIT == tcp_state ||
@@ -888,7 +1057,7 @@ void IPACM_ConntrackListener::AddORDeleteNatEntry(const nat_entry_bundle *input)
 			IPACMDBG("TCP state (TCP_CONNTRACK_FIN_WAIT or TCP_CONNTRACK_CLOSE) (%d) "
 					 "or type NFCT_T_DESTROY(%d)\n", tcp_state, input->type);
 
-			nat_inst->DeleteEntry(input->rule);
+			nat_inst->QueueEntry(input->rule, false);
 			nat_inst->DeleteTempEntry(input->rule);
 		}
 		else
@@ -914,13 +1083,13 @@ void IPACM_ConntrackListener::AddORDeleteNatEntry(const nat_entry_bundle *input)
 			}
 			else
 			{
-				nat_inst->AddEntry(input->rule);
+				nat_inst->QueueEntry(input->rule, true);
 			}
 		}
 		else if (NFCT_T_DESTROY == input->type)
 		{
 			IPACMDBG("UDP connection close at time %ld\n", time(NULL));
-			nat_inst->DeleteEntry(input->rule);
+			nat_inst->QueueEntry(input->rule, false);
 			nat_inst->DeleteTempEntry(input->rule);
 		}
 	}
@@ -929,7 +1098,7 @@ void IPACM_ConntrackListener::AddORDeleteNatEntry(const nat_entry_bundle *input)
 }
 
 void IPACM_ConntrackListener::PopulateTCPorUDPEntry(
-	 struct nf_conntrack *ct,
+	 const ipacm_ct_record *ct,
 	 uint32_t status,
 	 nat_table_entry *rule)
 {
@@ -939,23 +1108,23 @@ void IPACM_ConntrackListener::PopulateTCPorUDPEntry(
 		rule->dst_nat = true;
 
 		IPACMDBG("Parse reply tuple\n");
-		rule->target_ip = nfct_get_attr_u32(ct, ATTR_ORIG_IPV4_SRC);
+		rule->target_ip = ct->orig.src_ip[0];
 		rule->target_ip = ntohl(rule->target_ip);
 		iptodot("PopulateTCPorUDPEntry(): target ip", rule->target_ip);
 
 		/* Retriev target/dst port */
-		rule->target_port = nfct_get_attr_u16(ct, ATTR_ORIG_PORT_SRC);
+		rule->target_port = ct->orig.src_port;
 		rule->target_port = ntohs(rule->target_port);
 		if (0 == rule->target_port)
 		{
 			IPACMDBG("unable to retrieve target port\n");
 		}
 
-		rule->public_port = nfct_get_attr_u16(ct, ATTR_ORIG_PORT_DST);
+		rule->public_port = ct->orig.dst_port;
 		rule->public_port = ntohs(rule->public_port);
 
 		/* Retriev src/private ip address */
-		rule->private_ip = nfct_get_attr_u32(ct, ATTR_REPL_IPV4_SRC);
+		rule->private_ip = ct->repl.src_ip[0];
 		rule->private_ip = ntohl(rule->private_ip);
 		iptodot("PopulateTCPorUDPEntry(): private ip", rule->private_ip);
 		if (0 == rule->private_ip)
@@ -964,7 +1133,7 @@ void IPACM_ConntrackListener::PopulateTCPorUDPEntry(
 		}
 
 		/* Retriev src/private port */
-		rule->private_port = nfct_get_attr_u16(ct, ATTR_REPL_PORT_SRC);
+		rule->private_port = ct->repl.src_port;
 		rule->private_port = ntohs(rule->private_port);
 		if (0 == rule->private_port)
 		{
@@ -978,7 +1147,7 @@ void IPACM_ConntrackListener::PopulateTCPorUDPEntry(
 
 		/* Retriev target/dst ip address */
 		IPACMDBG("Parse source tuple\n");
-		rule->target_ip = nfct_get_attr_u32(ct, ATTR_ORIG_IPV4_DST);
+		rule->target_ip = ct->orig.dst_ip[0];
 		rule->target_ip = ntohl(rule->target_ip);
 		iptodot("PopulateTCPorUDPEntry(): target ip", rule->target_ip);
 		if (0 == rule->target_ip)
@@ -986,7 +1155,7 @@ void IPACM_ConntrackListener::PopulateTCPorUDPEntry(
 			IPACMDBG("unable to retrieve target ip address\n");
 		}
 		/* Retriev target/dst port */
-		rule->target_port = nfct_get_attr_u16(ct, ATTR_ORIG_PORT_DST);
+		rule->target_port = ct->orig.dst_port;
 		rule->target_port = ntohs(rule->target_port);
 		if (0 == rule->target_port)
 		{
@@ -994,7 +1163,7 @@ void IPACM_ConntrackListener::PopulateTCPorUDPEntry(
 		}
 
 		/* Retriev public port */
-		rule->public_port = nfct_get_attr_u16(ct, ATTR_REPL_PORT_DST);
+		rule->public_port = ct->repl.dst_port;
 		rule->public_port = ntohs(rule->public_port);
 		if (0 == rule->public_port)
 		{
@@ -1002,7 +1171,7 @@ void IPACM_ConntrackListener::PopulateTCPorUDPEntry(
 		}
 
 		/* Retriev src/private ip address */
-		rule->private_ip = nfct_get_attr_u32(ct, ATTR_ORIG_IPV4_SRC);
+		rule->private_ip = ct->orig.src_ip[0];
 		rule->private_ip = ntohl(rule->private_ip);
 		iptodot("PopulateTCPorUDPEntry(): private ip", rule->private_ip);
 		if (0 == rule->private_ip)
@@ -1011,7 +1180,7 @@ void IPACM_ConntrackListener::PopulateTCPorUDPEntry(
 		}
 
 		/* Retriev src/private port */
-		rule->private_port = nfct_get_attr_u16(ct, ATTR_ORIG_PORT_SRC);
+		rule->private_port = ct->orig.src_port;
 		rule->private_port = ntohs(rule->private_port);
 		if (0 == rule->private_port)
 		{
@@ -1023,7 +1192,7 @@ void IPACM_ConntrackListener::PopulateTCPorUDPEntry(
 }
 
 #ifdef CT_OPT
-void IPACM_ConntrackListener::HandleLan2Lan(struct nf_conntrack *ct,
+void IPACM_ConntrackListener::HandleLan2Lan(const ipacm_ct_record *ct,
 	enum nf_conntrack_msg_type type,
 	 nat_table_entry *rule)
 {
@@ -1036,18 +1205,18 @@ void IPACM_ConntrackListener::HandleLan2Lan(struct nf_conntrack *ct,
 	}
 
 	lan2lan_conn.iptype = IPA_IP_v4;
-	lan2lan_conn.src_ipv4_addr = orig_src_ip;
-	lan2lan_conn.dst_ipv4_addr = orig_dst_ip;
+	lan2lan_conn.src_ipv4_addr = ntohl(ct->orig.src_ip[0]);
+	lan2lan_conn.dst_ipv4_addr = ntohl(ct->orig.dst_ip[0]);
 
 	if (((IPPROTO_UDP == rule->protocol) && (NFCT_T_NEW == type)) ||
-		((IPPROTO_TCP == rule->protocol) && (nfct_get_attr_u8(ct, ATTR_TCP_STATE) == TCP_CONNTRACK_ESTABLISHED)))
+		((IPPROTO_TCP == rule->protocol) && (ct->tcp_state == TCP_CONNTRACK_ESTABLISHED)))
 	{
 		p_lan2lan->handle_new_connection(&lan2lan_conn);
 	}
 	else if ((IPPROTO_UDP == rule->protocol && NFCT_T_DESTROY == type) ||
 			   (IPPROTO_TCP == rule->protocol &&
-				(nfct_get_attr_u8(ct, ATTR_TCP_STATE) == TCP_CONNTRACK_FIN_WAIT ||
-				 nfct_get_attr_u8(ct, ATTR_TCP_STATE) == TCP_CONNTRACK_CLOSE)))
+				(ct->tcp_state == TCP_CONNTRACK_FIN_WAIT ||
+				 ct->tcp_state == TCP_CONNTRACK_CLOSE)))
 	{
 		p_lan2lan->handle_del_connection(&lan2lan_conn);
 	}
@@ -1057,8 +1226,6 @@ void IPACM_ConntrackListener::HandleLan2Lan(struct nf_conntrack *ct,
 void IPACM_ConntrackListener::CheckSTAClient(
    const nat_table_entry *rule, bool *isTempEntry)
 {
-	int nCnt;
-
 	/* Check whether target is in STA client list or not
       if not ignore the connection */
 	 if((backhaul_mode == Q6_WAN) || (StaClntCnt == 0))
@@ -1074,15 +1241,10 @@ void IPACM_ConntrackListener::CheckSTAClient(
 	 }
 
 	 IPACMDBG("StaClntCnt %d\n", StaClntCnt);
-	 for(nCnt = 0; nCnt < StaClntCnt; nCnt++)
+	 if(conn_cls->Classify(rule->target_ip) & CONN_CLS_STA_CLNT)
 	 {
-		IPACMDBG("Comparing trgt_ip 0x%x with sta clnt ip: 0x%x\n",
-			 rule->target_ip, sta_clnt_ipv4_addr[nCnt]);
-		if(rule->target_ip == sta_clnt_ipv4_addr[nCnt])
-		{
-			IPACMDBG("Match index %d\n", nCnt);
-			return;
-		}
+		IPACMDBG("Matched STA client 0x%x\n", rule->target_ip);
+		return;
 	 }
 
 	IPACMDBG_H("Not matching with STA Clnt Ip Addrs 0x%x\n",
@@ -1092,27 +1254,33 @@ void IPACM_ConntrackListener::CheckSTAClient(
 
 /* conntrack send in host order and ipa expects in host order */
 bool IPACM_ConntrackListener::ProcessTCPorUDPMsg(
-	 struct nf_conntrack *ct,
+	 const ipacm_ct_record *ct,
 	 enum nf_conntrack_msg_type type,
 	 u_int8_t l4proto)
 {
 	 nat_table_entry rule;
+	 int verdict;
+
+	IPACMDBG("Received type:%d with proto:%d\n", type, l4proto);
+	verdict = ClassifyTCPorUDPMsg(ct, &rule);
+	return CommitTCPorUDPMsg(ct, type, verdict, &rule);
+}
+
+/* Work out the nat direction of a tcp/udp connection and fill in rule.
+   Only the record and the wan address are read, so the bootstrap dump
+   can classify from several threads. */
+int IPACM_ConntrackListener::ClassifyTCPorUDPMsg(
+	 const ipacm_ct_record *ct,
+	 nat_table_entry *rule)
+{
 	 uint32_t status = 0;
 	 uint32_t orig_src_ip, orig_dst_ip;
-	 bool isAdd = false;
-	 bool cache_ct = false;
-
-	 nat_entry_bundle nat_entry;
-	 nat_entry.isTempEntry = false;
-	 nat_entry.ct = ct;
-	 nat_entry.type = type;
 
-	memset(&rule, 0, sizeof(rule));
-	IPACMDBG("Received type:%d with proto:%d\n", type, l4proto);
-	status = nfct_get_attr_u32(ct, ATTR_STATUS);
+	memset(rule, 0, sizeof(*rule));
+	status = ct->status;
 
 	 /* Retrieve Protocol */
-	 rule.protocol = nfct_get_attr_u8(ct, ATTR_REPL_L4PROTO);
+	 rule->protocol = ct->l4proto;
 
 	 if(IPS_DST_NAT & status)
 	 {
@@ -1125,20 +1293,20 @@ bool IPACM_ConntrackListener::ProcessTCPorUDPMsg(
 	 else
 	 {
 		 IPACMDBG("Neither Destination nor Source nat flag Set\n");
-		 orig_src_ip = nfct_get_attr_u32(ct, ATTR_ORIG_IPV4_SRC);
+		 orig_src_ip = ct->orig.src_ip[0];
 		 orig_src_ip = ntohl(orig_src_ip);
 		 if(orig_src_ip == 0)
 		 {
 			 IPACMERR("unable to retrieve orig src ip address\n");
-			 return cache_ct;
+			 return CT_CLASS_SKIP;
 		 }
 
-		 orig_dst_ip = nfct_get_attr_u32(ct, ATTR_ORIG_IPV4_DST);
+		 orig_dst_ip = ct->orig.dst_ip[0];
 		 orig_dst_ip = ntohl(orig_dst_ip);
 		 if(orig_dst_ip == 0)
 		 {
 			 IPACMERR("unable to retrieve orig dst ip address\n");
-			 return cache_ct;
+			 return CT_CLASS_SKIP;
 		 }
 
 		if(orig_src_ip == wan_ipaddr)
@@ -1155,24 +1323,51 @@ bool IPACM_ConntrackListener::ProcessTCPorUDPMsg(
 		{
 			IPACMDBG_H("Neither orig src ip:0x%x Nor orig Dst IP:0x%x equal to wan ip:0x%x\n",
 					   orig_src_ip, orig_dst_ip, wan_ipaddr);
+			return CT_CLASS_NON_NAT;
+		}
+	}
+
+	PopulateTCPorUDPEntry(ct, status, rule);
+	rule->public_ip = wan_ipaddr;
+	return CT_CLASS_NAT;
+}
 
+/* Apply a classified connection to the nat table, returns true when
+   the record should be cached until WAN comes up */
+bool IPACM_ConntrackListener::CommitTCPorUDPMsg(
+	 const ipacm_ct_record *ct,
+	 enum nf_conntrack_msg_type type,
+	 int verdict,
+	 nat_table_entry *rule)
+{
+	 bool isAdd = false;
+	 bool cache_ct = false;
+
+	 nat_entry_bundle nat_entry;
+	 nat_entry.isTempEntry = false;
+	 nat_entry.ct = ct;
+	 nat_entry.type = type;
+
+	if (verdict == CT_CLASS_SKIP)
+	{
+		return cache_ct;
+	}
+
+	if (verdict == CT_CLASS_NON_NAT)
+	{
 #ifdef CT_OPT
-			HandleLan2Lan(ct, type, &rule);
+		HandleLan2Lan(ct, type, rule);
 #endif
-		 	IPACMDBG("Neither source Nor destination nat.\n");
-			/* If WAN is not up, cache the event. */
-			if(!CtList->isWanUp())
-				cache_ct = true;
-			goto IGNORE;
-		}
+		IPACMDBG("Neither source Nor destination nat.\n");
+		/* If WAN is not up, cache the event. */
+		if(!CtList->isWanUp())
+			cache_ct = true;
+		goto IGNORE;
 	}
 
-	PopulateTCPorUDPEntry(ct, status, &rule);
-	rule.public_ip = wan_ipaddr;
-
-	if (rule.private_ip != wan_ipaddr)
+	if (rule->private_ip != wan_ipaddr)
 	{
-		isAdd = AddIface(&rule, &nat_entry.isTempEntry);
+		isAdd = AddIface(rule, &nat_entry.isTempEntry);
 		if (!isAdd)
 		{
 			goto IGNORE;
@@ -1191,23 +1386,23 @@ bool IPACM_ConntrackListener::ProcessTCPorUDPMsg(
 
 		IPACMDBG("For embedded connections add dummy nat rule\n");
 		IPACMDBG("Change private port %d to %d\n",
-				rule.private_port, rule.public_port);
-		rule.private_port = rule.public_port;
+				rule->private_port, rule->public_port);
+		rule->private_port = rule->public_port;
 	}
 
-	CheckSTAClient(&rule, &nat_entry.isTempEntry);
-	nat_entry.rule = &rule;
+	CheckSTAClient(rule, &nat_entry.isTempEntry);
+	nat_entry.rule = rule;
 	AddORDeleteNatEntry(&nat_entry);
 	return cache_ct;
 
 IGNORE:
 	IPACMDBG_H("ignoring below Nat Entry\n");
-	iptodot("ProcessTCPorUDPMsg(): target ip or dst ip", rule.target_ip);
-	IPACMDBG("target port or dst port: 0x%x Decimal:%d\n", rule.target_port, rule.target_port);
-	iptodot("ProcessTCPorUDPMsg(): private ip or src ip", rule.private_ip);
-	IPACMDBG("private port or src port: 0x%x, Decimal:%d\n", rule.private_port, rule.private_port);
-	IPACMDBG("public port or reply dst port: 0x%x, Decimal:%d\n", rule.public_port, rule.public_port);
-	IPACMDBG("Protocol: %d, destination nat flag: %d\n", rule.protocol, rule.dst_nat);
+	iptodot("ProcessTCPorUDPMsg(): target ip or dst ip", rule->target_ip);
+	IPACMDBG("target port or dst port: 0x%x Decimal:%d\n", rule->target_port, rule->target_port);
+	iptodot("ProcessTCPorUDPMsg(): private ip or src ip", rule->private_ip);
+	IPACMDBG("private port or src port: 0x%x, Decimal:%d\n", rule->private_port, rule->private_port);
+	IPACMDBG("public port or reply dst port: 0x%x, Decimal:%d\n", rule->public_port, rule->public_port);
+	IPACMDBG("Protocol: %d, destination nat flag: %d\n", rule->protocol, rule->dst_nat);
 	return cache_ct;
 }
 
@@ -1236,6 +1431,7 @@ void IPACM_ConntrackListener::HandleSTAClientAddEvt(uint32_t clnt_ip_addr)
 			IPACMDBG("Adding STA client 0x%x at Index: %d\n",
 					clnt_ip_addr, cnt);
 			sta_clnt_ipv4_addr[cnt] = clnt_ip_addr;
+			UpdateAddrList(CONN_CLS_LIST_STA_CLNT);
 			StaClntCnt++;
 			IPACMDBG("STA client cnt %d\n", StaClntCnt);
 			break;
@@ -1260,6 +1456,7 @@ void IPACM_ConntrackListener::HandleSTAClientDelEvt(uint32_t clnt_ip_addr)
 			IPACMDBG("Deleting STA client 0x%x at index: %d\n",
 					clnt_ip_addr, cnt);
 			sta_clnt_ipv4_addr[cnt] = 0;
+			UpdateAddrList(CONN_CLS_LIST_STA_CLNT);
 			nat_inst->DelEntriesOnSTAClntDiscon(clnt_ip_addr);
 			StaClntCnt--;
 			IPACMDBG("STA client cnt %d\n", StaClntCnt);
@@ -1282,95 +1479,118 @@ bool isLocalHostAddr(uint32_t src_ip_addr, uint32_t dst_ip_addr) {
 
 void IPACM_ConntrackListener::readConntrack(int fd) {
 
-	int recv_bytes = -1, index = 0, len =0;
-	char buffer[CT_ENTRIES_BUFFER_SIZE];
-	struct nf_conntrack *ct;
+	int recv_bytes = -1, max = 0;
+	char *buffer;
+	ipacm_ct_evt_data *entries;
+	int type;
+	bool done = false;
 	struct nlmsghdr *nl_header;
-   	struct iovec iov = {
-		.iov_base	= buffer,
-		.iov_len	= CT_ENTRIES_BUFFER_SIZE,
-	};
+	struct iovec iov;
 	struct sockaddr_nl addr;
-	struct msghdr msg = {
-		.msg_name	= &addr,
-		.msg_namelen	= sizeof(struct sockaddr_nl),
-		.msg_iov	= &iov,
-		.msg_iovlen	= 1,
-		.msg_control	= NULL,
-		.msg_controllen	= 0,
-		.msg_flags	= 0,
-	};
-
-	len = MAX_CONNTRACK_ENTRIES * sizeof(ct_entry);
-
-	ct_entries = (ct_entry *) malloc(len);
-	if(ct_entries == NULL)
+	struct msghdr msg;
+
+	if( fd < 0)
 	{
-		IPACMERR("unable to allocate ct_entries memory \n");
+		IPACMDBG_H("Invalid fd %d \n",fd);
 		return;
 	}
-	memset(ct_entries, 0, len);
 
-	if( fd < 0)
+	if(ct_entries != NULL)
 	{
-		IPACMDBG_H("Invalid fd %d \n",fd);
 		free(ct_entries);
+	}
+	num_ct_entries = 0;
+
+	/* a kernel dump chunk is at most 32K, take each one in a single read */
+	buffer = (char *)malloc(CT_DUMP_RECV_BUFFER_SIZE);
+	max = CT_DUMP_INIT_ENTRIES;
+	ct_entries = (ipacm_ct_evt_data *)malloc(max * sizeof(ipacm_ct_evt_data));
+	if(buffer == NULL || ct_entries == NULL)
+	{
+		IPACMERR("unable to allocate ct_entries memory \n");
+		free(buffer);
+		free(ct_entries);
+		ct_entries = NULL;
 		return;
 	}
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = buffer;
+	iov.iov_len = CT_DUMP_RECV_BUFFER_SIZE;
+	msg.msg_name = &addr;
+	msg.msg_namelen = sizeof(struct sockaddr_nl);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
 	IPACMDBG_H("receiving conntrack entries started.\n");
-	len = CT_ENTRIES_BUFFER_SIZE;
-	while (len > 0)
+	while (!done)
 	{
-		memset(buffer, 0, CT_ENTRIES_BUFFER_SIZE);
 		recv_bytes = recvmsg(fd, &msg, 0);
 		if(recv_bytes < 0)
 		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			/* the dump fd has a receive timeout, nothing more is coming */
 			IPACMDBG_H("error in receiving conntrack entries %d%s\n",errno, strerror(errno));
 			break;
 		}
-		else
+		if(recv_bytes == 0)
+		{
+			break;
+		}
+		if(msg.msg_flags & MSG_TRUNC)
+		{
+			IPACMERR("conntrack dump message truncated\n");
+		}
+
+		nl_header = (struct nlmsghdr *)buffer;
+		IPACMDBG("Number of bytes:%d to parse\n", recv_bytes);
+		while(NLMSG_OK(nl_header, recv_bytes))
 		{
-			len -= recv_bytes;
-			nl_header = (struct nlmsghdr *)buffer;
-			IPACMDBG_H("Number of bytes:%d to parse\n", recv_bytes);
-			while(NLMSG_OK(nl_header, recv_bytes) && (index < MAX_CONNTRACK_ENTRIES))
+			if (nl_header->nlmsg_type == NLMSG_DONE)
 			{
-				if (nl_header->nlmsg_type == NLMSG_ERROR)
-				{
-					IPACMDBG_H("Error, recv_bytes is %d\n",recv_bytes);
-					break;
-				}
-				ct = nfct_new();
-				if (ct != NULL)
-				{
-					int parseResult =  nfct_parse_conntrack((nf_conntrack_msg_type) NFCT_T_ALL,nl_header, ct);
-					if(parseResult != NFCT_T_ERROR && parseResult != 0)
-					{
-						ct_entries[index].ct = ct;
-						ct_entries[index++].type = (nf_conntrack_msg_type)parseResult;
-					}
-					else
-					{
-						IPACMDBG_H("error in parsing  %d%s \n", errno, strerror(errno));
-						nfct_destroy(ct);
-					}
-				}
-				else
-				{
-					IPACMDBG_H("ct allocation failed\n");
-				}
-				if (nl_header->nlmsg_type == NLMSG_DONE)
+				IPACMDBG_H("Message is done.\n");
+				done = true;
+				break;
+			}
+			if (nl_header->nlmsg_type == NLMSG_ERROR)
+			{
+				IPACMDBG_H("Error, recv_bytes is %d\n",recv_bytes);
+				done = true;
+				break;
+			}
+
+			if(num_ct_entries == max)
+			{
+				entries = (ipacm_ct_evt_data *)realloc(ct_entries, 2 * max * sizeof(ipacm_ct_evt_data));
+				if(entries == NULL)
 				{
-					IPACMDBG_H("Message is done.\n");
+					IPACMERR("unable to grow ct_entries, keep first %d entries\n", num_ct_entries);
+					done = true;
 					break;
 				}
-				nl_header = NLMSG_NEXT(nl_header, recv_bytes);
+				ct_entries = entries;
+				max *= 2;
 			}
+
+			type = IPACM_ConntrackClient::ParseCTRecord(nl_header, &ct_entries[num_ct_entries].ct);
+			if(type != NFCT_T_UNKNOWN)
+			{
+				ct_entries[num_ct_entries++].type = (nf_conntrack_msg_type)type;
+			}
+			else
+			{
+				IPACMDBG_H("error in parsing type 0x%x\n", nl_header->nlmsg_type);
+			}
+			nl_header = NLMSG_NEXT(nl_header, recv_bytes);
 		}
 	}
+	free(buffer);
 
 	isReadCTDone = true;
-	IPACMDBG_H("receiving conntrack entries ended. No of entries: %d\n", index);
+	IPACMDBG_H("receiving conntrack entries ended. No of entries: %d\n", num_ct_entries);
 	if(isWanUp() && !isProcessCTDone)
 	{
 		IPACMDBG_H("wan is up, process ct entries \n");
@@ -1380,175 +1600,472 @@ void IPACM_ConntrackListener::readConntrack(int fd) {
 	return ;
 }
 
+void IPACM_ConntrackListener::ClassifyDumpEntry(
+	const ipacm_ct_evt_data *entry,
+	ct_dump_class *cls)
+{
+	const ipacm_ct_record *ct = &entry->ct;
+
+	cls->verdict = CT_CLASS_SKIP;
+
+	if(AF_INET6 == ct->l3proto)
+	{
+#ifdef CT_OPT
+		cls->verdict = CT_CLASS_V6;
+#endif
+		return;
+	}
+
+	if((AF_INET == ct->l3proto) && isLocalHostAddr(ct->orig.src_ip[0], ct->orig.dst_ip[0]))
+	{
+		IPACMDBG(" loopback entry \n");
+		return;
+	}
+
+	if(IPPROTO_UDP != ct->l4proto && IPPROTO_TCP != ct->l4proto)
+	{
+		IPACMDBG("Received unexpected protocl %d conntrack message\n", ct->l4proto);
+		return;
+	}
+
+	cls->verdict = ClassifyTCPorUDPMsg(ct, &cls->rule);
+}
+
+void IPACM_ConntrackListener::ClassifyDumpBatches(ct_dump_work *work)
+{
+	int start, end, cnt;
+
+	while((start = work->next.fetch_add(CT_DUMP_WORKER_BATCH)) < work->num_entries)
+	{
+		end = start + CT_DUMP_WORKER_BATCH;
+		if(end > work->num_entries)
+		{
+			end = work->num_entries;
+		}
+		for(cnt = start; cnt < end; cnt++)
+		{
+			work->listener->ClassifyDumpEntry(&work->entries[cnt], &work->classes[cnt]);
+		}
+	}
+}
+
+void* IPACM_ConntrackListener::ClassifyDumpWorker(void *arg)
+{
+	ClassifyDumpBatches((ct_dump_work *)arg);
+	return NULL;
+}
+
+/* Classify the whole dump, large dumps are split in batches pulled by
+   up to CT_DUMP_MAX_WORKERS threads next to the calling one */
+void IPACM_ConntrackListener::ClassifyDump(ct_dump_class *classes)
+{
+	pthread_t workers[CT_DUMP_MAX_WORKERS];
+	ct_dump_work work;
+	long cpus;
+	int num_workers, started = 0, cnt;
+
+	work.listener = this;
+	work.entries = ct_entries;
+	work.classes = classes;
+	work.num_entries = num_ct_entries;
+	work.next = 0;
+
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	num_workers = num_ct_entries / CT_DUMP_WORKER_BATCH - 1;
+	if(num_workers > cpus - 1)
+	{
+		num_workers = cpus - 1;
+	}
+	if(num_workers > CT_DUMP_MAX_WORKERS)
+	{
+		num_workers = CT_DUMP_MAX_WORKERS;
+	}
+
+	for(cnt = 0; cnt < num_workers; cnt++)
+	{
+		if(pthread_create(&workers[started], NULL, ClassifyDumpWorker, &work) != 0)
+		{
+			IPACMERR("unable to create ct classify thread\n");
+			break;
+		}
+		if(pthread_setname_np(workers[started], "ct classify") != 0)
+		{
+			IPACMERR("unable to set thread name\n");
+		}
+		started++;
+	}
+
+	ClassifyDumpBatches(&work);
+
+	for(cnt = 0; cnt < started; cnt++)
+	{
+		pthread_join(workers[cnt], NULL);
+	}
+	IPACMDBG_H("classified %d ct entries on %d threads\n", num_ct_entries, started + 1);
+}
+
 void IPACM_ConntrackListener::processConntrack() {
 
-	uint8_t ip_type;
-	int index = 0;
-	ipacm_ct_evt_data *ct_data;
+	ct_dump_class *classes, serial, *cls;
+	int index, committed = 0;
+
 	IPACMDBG_H("process conntrack started \n");
-	if(ct_entries != NULL)
+	if(ct_entries == NULL)
 	{
-		while(ct_entries[index].ct != NULL)
-		{
-			ip_type = nfct_get_attr_u8(ct_entries[index].ct, ATTR_REPL_L3PROTO);
-			if((AF_INET == ip_type) && isLocalHostAddr(nfct_get_attr_u32(ct_entries[index].ct, ATTR_ORIG_IPV4_SRC),
-					nfct_get_attr_u32(ct_entries[index].ct, ATTR_ORIG_IPV4_DST)))
-			{
-				IPACMDBG_H(" loopback entry \n");
-				goto IGNORE;
-			}
+		IPACMDBG_H("ct entry is null\n");
+		return ;
+	}
 
-#ifndef CT_OPT
-			if(AF_INET6 == ip_type)
-			{
-				IPACMDBG("Ignoring ipv6(%d) connections\n", ip_type);
-				goto IGNORE;
-			}
-#endif
+	classes = (ct_dump_class *)malloc(sizeof(ct_dump_class) * (num_ct_entries + 1));
+	if(classes != NULL)
+	{
+		ClassifyDump(classes);
+	}
+	else
+	{
+		IPACMERR("unable to allocate ct classes memory, classify inline\n");
+	}
 
-			ct_data = (ipacm_ct_evt_data *)malloc(sizeof(ipacm_ct_evt_data));
-			if(ct_data == NULL)
+	/* commit in dump order, the nat table is only touched from here */
+	for(index = 0; index < num_ct_entries; index++)
+	{
+		if(classes != NULL)
+		{
+			cls = &classes[index];
+		}
+		else
+		{
+			cls = &serial;
+			ClassifyDumpEntry(&ct_entries[index], cls);
+		}
+
+		switch(cls->verdict)
+		{
+		case CT_CLASS_NAT:
+		case CT_CLASS_NON_NAT:
+			if(CommitTCPorUDPMsg(&ct_entries[index].ct, ct_entries[index].type,
+					cls->verdict, &cls->rule))
 			{
-				IPACMERR("unable to allocate memory \n");
-				goto IGNORE;
+				CacheORDeleteConntrack(&ct_entries[index].ct, ct_entries[index].type,
+					ct_entries[index].ct.l4proto);
 			}
-
-			ct_data->ct = ct_entries[index].ct;
-			ct_data->type = ct_entries[index].type;
+			committed++;
+			break;
 
 #ifdef CT_OPT
-			if(AF_INET6 == ip_type)
-			{
-				ProcessCTV6Message(ct_data);
-			}
-#else
-				ProcessCTMessage(ct_data);
+		case CT_CLASS_V6:
+			ProcessCTV6Message(&ct_entries[index]);
+			committed++;
+			break;
 #endif
-		index++;
-		free(ct_data);
-		continue;
-IGNORE:
-		nfct_destroy(ct_entries[index].ct);
-		index++;
+
+		default:
+			break;
 		}
 	}
-	else
+	free(classes);
+
+	isProcessCTDone = true;
+	/* the dump is replayed, anything restored it did not report is stale */
+	if(nat_inst != NULL)
 	{
-		IPACMDBG_H("ct entry is null\n");
-		return ;
+		nat_inst->DropUnconfirmed();
 	}
-	isProcessCTDone = true;
 	free(ct_entries);
 	ct_entries = NULL;
-	IPACMDBG_H("process conntrack ended. Number of entries:%d \n", index);
+	IPACMDBG_H("process conntrack ended. Number of entries:%d committed:%d\n",
+		num_ct_entries, committed);
+	num_ct_entries = 0;
 	return;
 }
 
+/* same as nfct_cmp(NFCT_CMP_ORIG | NFCT_CMP_REPL) on the decoded tuples */
+static bool isSameConntrack(const ipacm_ct_record *a, const ipacm_ct_record *b)
+{
+	return a->l3proto == b->l3proto && a->l4proto == b->l4proto &&
+		memcmp(&a->orig, &b->orig, sizeof(a->orig)) == 0 &&
+		memcmp(&a->repl, &b->repl, sizeof(a->repl)) == 0;
+}
+
+static uint32_t HashConntrack(const ipacm_ct_record *ct)
+{
+	const uint32_t *w;
+	uint32_t h = 0x811C9DC5;
+	size_t cnt;
+
+	/* the tuples are whole words, same fields isSameConntrack compares */
+	w = (const uint32_t *)&ct->orig;
+	for(cnt = 0; cnt < sizeof(ct->orig) / sizeof(uint32_t); cnt++)
+	{
+		h = (h ^ w[cnt]) * 0x01000193;
+	}
+	w = (const uint32_t *)&ct->repl;
+	for(cnt = 0; cnt < sizeof(ct->repl) / sizeof(uint32_t); cnt++)
+	{
+		h = (h ^ w[cnt]) * 0x01000193;
+	}
+	h = (h ^ (((uint32_t)ct->l3proto << 8) | ct->l4proto)) * 0x01000193;
+
+	h ^= h >> 16;
+	return h;
+}
+
+void IPACM_ConntrackListener::InitCTCache(int size)
+{
+	uint32_t buckets = 1;
+
+	ct_cache = NULL;
+	ct_cache_bucket = NULL;
+	ct_cache_mask = 0;
+	ct_cache_size = 0;
+	ct_cache_evictions = 0;
+	ct_cache_drops = 0;
+
+	if(size <= 0)
+	{
+		return;
+	}
+
+	while(buckets < (uint32_t)size)
+	{
+		buckets <<= 1;
+	}
+	ct_cache = (ct_entry *)malloc(sizeof(ct_entry) * size);
+	ct_cache_bucket = (int *)malloc(sizeof(int) * buckets);
+	if(ct_cache == NULL || ct_cache_bucket == NULL)
+	{
+		IPACMERR("unable to allocate ct cache of %d entries\n", size);
+		free(ct_cache);
+		free(ct_cache_bucket);
+		ct_cache = NULL;
+		ct_cache_bucket = NULL;
+		return;
+	}
+	ct_cache_mask = buckets - 1;
+	ct_cache_size = size;
+	ResetCTCache();
+	IPACMDBG_H("ct cache: %d entries, %u buckets\n", size, buckets);
+}
+
+/* Empty the cache in one go, every slot goes back on the free list */
+void IPACM_ConntrackListener::ResetCTCache(void)
+{
+	int i;
+
+	ct_cache_cnt = 0;
+	ct_cache_mru = -1;
+	ct_cache_lru = -1;
+	ct_cache_free = -1;
+	if(ct_cache == NULL)
+	{
+		return;
+	}
+
+	memset(ct_cache_bucket, 0xff, sizeof(int) * (ct_cache_mask + 1));
+	memset(ct_cache, 0, sizeof(ct_entry) * ct_cache_size);
+	for(i = ct_cache_size - 1; i >= 0; i--)
+	{
+		ct_cache[i].hnext = ct_cache_free;
+		ct_cache_free = i;
+	}
+}
+
+int IPACM_ConntrackListener::FindCTCache(const ipacm_ct_record *ct, uint32_t hash)
+{
+	int i;
+
+	for(i = ct_cache_bucket[hash & ct_cache_mask]; i >= 0; i = ct_cache[i].hnext)
+	{
+		if(isSameConntrack(&ct_cache[i].ct, ct))
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+void IPACM_ConntrackListener::UnlinkCTCacheLRU(int i)
+{
+	if(ct_cache[i].lprev >= 0)
+	{
+		ct_cache[ct_cache[i].lprev].lnext = ct_cache[i].lnext;
+	}
+	else
+	{
+		ct_cache_mru = ct_cache[i].lnext;
+	}
+	if(ct_cache[i].lnext >= 0)
+	{
+		ct_cache[ct_cache[i].lnext].lprev = ct_cache[i].lprev;
+	}
+	else
+	{
+		ct_cache_lru = ct_cache[i].lprev;
+	}
+}
+
+void IPACM_ConntrackListener::LinkCTCacheMRU(int i)
+{
+	ct_cache[i].lprev = -1;
+	ct_cache[i].lnext = ct_cache_mru;
+	if(ct_cache_mru >= 0)
+	{
+		ct_cache[ct_cache_mru].lprev = i;
+	}
+	else
+	{
+		ct_cache_lru = i;
+	}
+	ct_cache_mru = i;
+}
+
+/* Drop slot i from its bucket and the LRU list and free it */
+void IPACM_ConntrackListener::FreeCTCache(int i)
+{
+	int *link;
+
+	link = &ct_cache_bucket[HashConntrack(&ct_cache[i].ct) & ct_cache_mask];
+	while(*link != i)
+	{
+		link = &ct_cache[*link].hnext;
+	}
+	*link = ct_cache[i].hnext;
+	UnlinkCTCacheLRU(i);
+
+	memset(&ct_cache[i], 0, sizeof(ct_cache[i]));
+	ct_cache[i].hnext = ct_cache_free;
+	ct_cache_free = i;
+	ct_cache_cnt--;
+}
+
+/* Take a slot for a new entry in bucket hash, evicting the least
+   recently used connection when the cache is full */
+int IPACM_ConntrackListener::AllocCTCache(uint32_t hash)
+{
+	int i;
+
+	if(ct_cache_free < 0)
+	{
+		if(ct_cache_lru < 0)
+		{
+			return -1;
+		}
+		ct_cache_evictions++;
+		IPACMDBG("ct cache full, evict entry %d (evictions %u)\n",
+			ct_cache_lru, ct_cache_evictions);
+		FreeCTCache(ct_cache_lru);
+	}
+
+	i = ct_cache_free;
+	ct_cache_free = ct_cache[i].hnext;
+	ct_cache[i].hnext = ct_cache_bucket[hash & ct_cache_mask];
+	ct_cache_bucket[hash & ct_cache_mask] = i;
+	LinkCTCacheMRU(i);
+	ct_cache_cnt++;
+
+	return i;
+}
+
 void IPACM_ConntrackListener::CacheORDeleteConntrack
 (
-	struct nf_conntrack *ct,
+	const ipacm_ct_record *ct,
 	enum nf_conntrack_msg_type type,
 	u_int8_t protocol
 )
 {
 	u_int8_t tcp_state;
-	int i = 0, free_idx = -1;
+	uint32_t hash;
+	int i;
 
 	IPACMDBG("CT entry, type (%d), protocol(%d)\n", type, protocol);
-	/* Check for duplicate entry and in parallel find first free index. */
-	for(; i < MAX_CONNTRACK_ENTRIES; i++)
+	if(ct_cache == NULL)
 	{
-		if (ct_cache[i].ct != NULL)
-		{
-			if (nfct_cmp(ct_cache[i].ct, ct, NFCT_CMP_ORIG | NFCT_CMP_REPL))
-			{
-				/* Duplicate entry. */
-				IPACMDBG("Duplicate CT entry, type (%d), protocol(%d)\n",
-					type, protocol);
-				break;
-			}
-		}
-		else if ((ct_cache[i].ct == NULL) && (free_idx == -1))
-		{
-			/* Cache the first free index. */
-			free_idx = i;
-		}
+		ct_cache_drops++;
+		IPACMDBG("no ct cache, drop entry (drops %u)\n", ct_cache_drops);
+		return;
 	}
 
+	hash = HashConntrack(ct);
+	i = FindCTCache(ct, hash);
+
 	/* Duplicate entry handling. */
-	if (i < MAX_CONNTRACK_ENTRIES)
+	if (i >= 0)
 	{
+		IPACMDBG("Duplicate CT entry, type (%d), protocol(%d)\n",
+			type, protocol);
 		if (IPPROTO_TCP == protocol)
 		{
-			tcp_state = nfct_get_attr_u8(ct, ATTR_TCP_STATE);
+			tcp_state = ct->tcp_state;
 			if (TCP_CONNTRACK_FIN_WAIT == tcp_state ||
 				TCP_CONNTRACK_CLOSE == tcp_state || type == NFCT_T_DESTROY)
 			{
 				IPACMDBG("TCP state (TCP_CONNTRACK_FIN_WAIT or "
 							 "TCP_CONNTRACK_CLOSE) (%d) "
 							 "or type NFCT_T_DESTROY\n", tcp_state);
-				nfct_destroy(ct_cache[i].ct);
-				nfct_destroy(ct);
-				memset(&ct_cache[i], 0, sizeof(ct_cache[i]));
+				FreeCTCache(i);
 				return ;
 			}
 		}
 		if ((IPPROTO_UDP == protocol) && (type == NFCT_T_DESTROY))
 		{
 			IPACMDBG("UDP type NFCT_T_DESTROY\n");
-			nfct_destroy(ct_cache[i].ct);
-			nfct_destroy(ct);
-			memset(&ct_cache[i], 0, sizeof(ct_cache[i]));
+			FreeCTCache(i);
 			return;
 		}
+
+		/* still alive, keep it away from eviction */
+		UnlinkCTCacheLRU(i);
+		LinkCTCacheMRU(i);
+		return;
 	}
-	else if ((i == MAX_CONNTRACK_ENTRIES) &&
-		(type != NFCT_T_DESTROY) && (free_idx != -1))
+
+	if (type == NFCT_T_DESTROY)
 	{
-		if (IPPROTO_TCP == protocol)
-		{
-			tcp_state = nfct_get_attr_u8(ct, ATTR_TCP_STATE);
-			if (TCP_CONNTRACK_ESTABLISHED == tcp_state)
-			{
-				IPACMDBG("TCP state TCP_CONNTRACK_ESTABLISHED\n");
-				/* Cache the entry. */
-				ct_cache[free_idx].ct = ct;
-				ct_cache[free_idx].protocol = protocol;
-				ct_cache[free_idx].type = type;
-				return;
-			}
-		}
-		if (IPPROTO_UDP == protocol)
+		return;
+	}
+
+	if ((IPPROTO_TCP == protocol && TCP_CONNTRACK_ESTABLISHED == ct->tcp_state) ||
+		(IPPROTO_UDP == protocol && NFCT_T_NEW == type))
+	{
+		IPACMDBG("Cache %s connection\n", (IPPROTO_TCP == protocol) ? "TCP" : "UDP");
+		i = AllocCTCache(hash);
+		if (i < 0)
 		{
-			if (NFCT_T_NEW  == type)
-			{
-				IPACMDBG("New UDP connection\n");
-				/* Cache the entry. */
-				ct_cache[free_idx].ct = ct;
-				ct_cache[free_idx].protocol = protocol;
-				ct_cache[free_idx].type = type;
-				return;
-			}
+			ct_cache_drops++;
+			return;
 		}
+		ct_cache[i].ct = *ct;
+		ct_cache[i].protocol = protocol;
+		ct_cache[i].type = type;
+		return;
 	}
-	/* In all other cases, free the conntracy entry. */
-	nfct_destroy(ct);
+
+	/* In all other cases, drop the conntrack entry. */
 	return ;
 }
+
+/* Replay the held connections oldest first now that WAN is up, then
+   empty the cache in one go */
 void IPACM_ConntrackListener::processCacheConntrack(void)
 {
-	int i = 0;
+	int i, cnt = 0;
 
 	IPACMDBG("Entry:\n");
-	for(; i < MAX_CONNTRACK_ENTRIES; i++)
+	if(ct_cache == NULL || ct_cache_cnt == 0)
 	{
-		if (ct_cache[i].ct != NULL)
-		{
-			ProcessTCPorUDPMsg(ct_cache[i].ct, ct_cache[i].type, ct_cache[i].protocol);
-			nfct_destroy(ct_cache[i].ct);
-			memset(&ct_cache[i], 0, sizeof(ct_cache[i]));
-		}
+		return;
 	}
+
+	for(i = ct_cache_lru; i >= 0; i = ct_cache[i].lprev)
+	{
+		ProcessTCPorUDPMsg(&ct_cache[i].ct, ct_cache[i].type, ct_cache[i].protocol);
+		cnt++;
+	}
+	ResetCTCache();
+
+	IPACMDBG_H("ct cache: drained %d entries, evictions %u drops %u\n",
+		cnt, ct_cache_evictions, ct_cache_drops);
 	IPACMDBG("Exit:\n");
 }
 
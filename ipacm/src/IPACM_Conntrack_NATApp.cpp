@@ -38,6 +38,7 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "IPACM_OffloadManager.h"
 #endif
 #include "IPACM_Iface.h"
+#include "IPACM_EvtDispatcher.h"
 
 #define INVALID_IP_ADDR 0x0
 
@@ -60,20 +61,86 @@ NatApp::NatApp()
 	mem_type = NULL;
 
 	cache = NULL;
+	hash_index = NULL;
+	hash_mask = 0;
+	hash_tombstones = 0;
+	free_slots = NULL;
+	num_free_slots = 0;
+	links = NULL;
+	tclnt_head = NULL;
+	rebuild_slots = NULL;
+	memset(pclnt_head, 0xff, sizeof(pclnt_head));
+
+	pflow = NULL;
+	pflow_size = 0;
+	pflow_mask = 0;
+	pflow_phead = NULL;
+	pflow_thead = NULL;
+	pflow_free = NULL;
+	pflow_num_free = 0;
+	pflow_oldest = -1;
+	pflow_newest = -1;
+	pflow_expired = 0;
+	pflow_evicted = 0;
+
+	pending = NULL;
+	num_pending = 0;
+	batch_size = 1;
+	batch_flushes = 0;
+	batch_ops = 0;
+	batch_merged = 0;
+	batch_cancelled = 0;
+
+	sweep_cursor = 0;
+	sweep_period_ms = NAT_SWEEP_DEF_PERIOD_MS;
+	sweep_tick_ms = NAT_SWEEP_DEF_PERIOD_MS;
+	sweep_start_us = 0;
+	sweep_vote_us = 0;
+	sweep_touched = 0;
+	sweep_changed = 0;
+	sweep_passes = 0;
+
+	heat = NULL;
+	sram_hot_flows = 0;
+	place_enabled = false;
+	place_modem_hold = false;
+	place_tier = IPA_NAT_MEM_IN_SRAM;
+	place_votes = 0;
+	place_hot = 0;
+	place_hits = 0;
+	place_misses = 0;
+	place_total_hits = 0;
+	place_total_misses = 0;
+	place_switches = 0;
+	unconfirmed = NULL;
+	num_unconfirmed = 0;
+	tcp_timeout = 0;
+	udp_timeout = 0;
 
 	nat_table_hdl = 0;
 	pub_ip_addr = 0;
+	pub_ip_addr_pre = 0;
 	pub_mux_id = 0;
 
 	curCnt = 0;
 
 	pALGPorts = NULL;
 	nALGPort = 0;
+	conn_cls = NULL;
 
 	ct = NULL;
 	ct_hdl = NULL;
+#ifndef FEATURE_IPACM_AIDL
+	ct_batch_buf = NULL;
+	ct_batch_len = 0;
+	ct_batch_cnt = 0;
+	ct_seq = 0;
+	memset(ct_inflight, 0, sizeof(ct_inflight));
+#endif
+	ct_sends = 0;
+	ct_msgs = 0;
+	ct_nacks = 0;
 
-	memset(temp, 0, sizeof(temp));
 	m_fd_ipa = open(IPA_DEVICE_NAME, O_RDWR);
 	if(m_fd_ipa < 0)
 	{
@@ -92,6 +159,8 @@ int NatApp::Init(void)
 {
 	IPACM_Config *pConfig;
 	int size = 0;
+	uint32_t hash_size = 1;
+	int cnt;
 
 	pConfig = IPACM_Config::GetInstance();
 	if(pConfig == NULL)
@@ -114,6 +183,92 @@ int NatApp::Init(void)
 	IPACMDBG("Allocated %d bytes for config manager nat cache\n", size);
 	memset(cache, 0, size);
 
+	/* keep the index at most half full */
+	while(hash_size < (uint32_t)(2 * max_entries))
+	{
+		hash_size <<= 1;
+	}
+	hash_index = (int *)malloc(sizeof(int) * hash_size);
+	free_slots = (int *)malloc(sizeof(int) * max_entries);
+	links = (nat_cache_link *)malloc(sizeof(nat_cache_link) * max_entries);
+	tclnt_head = (int *)malloc(sizeof(int) * hash_size);
+	heat = (nat_flow_heat *)calloc(max_entries, sizeof(nat_flow_heat));
+	rebuild_slots = (int *)malloc(sizeof(int) * max_entries);
+	if(hash_index == NULL || free_slots == NULL || links == NULL || tclnt_head == NULL ||
+	   heat == NULL || rebuild_slots == NULL)
+	{
+		IPACMERR("Unable to allocate memory for nat cache index\n");
+		goto fail;
+	}
+	hash_mask = hash_size - 1;
+	RebuildIndex();
+	memset(tclnt_head, 0xff, sizeof(int) * hash_size);
+	for(cnt = max_entries - 1; cnt >= 0; cnt--)
+	{
+		free_slots[num_free_slots++] = cnt;
+	}
+	IPACMDBG("Allocated %d entries hash index for nat cache\n", hash_size);
+
+	if(max_entries > 0)
+	{
+		cnt = (max_entries + NAT_SWEEP_SHARD_SIZE - 1) / NAT_SWEEP_SHARD_SIZE;
+		sweep_tick_ms = sweep_period_ms / cnt;
+		if(sweep_tick_ms < NAT_SWEEP_MIN_TICK_MS)
+		{
+			sweep_tick_ms = NAT_SWEEP_MIN_TICK_MS;
+		}
+	}
+
+	pflow_size = pConfig->GetNatPendingFlows();
+	hash_size = 1;
+	while(hash_size < (uint32_t)pflow_size)
+	{
+		hash_size <<= 1;
+	}
+	pflow = (nat_pending_flow *)calloc(pflow_size, sizeof(nat_pending_flow));
+	pflow_phead = (int *)malloc(sizeof(int) * hash_size);
+	pflow_thead = (int *)malloc(sizeof(int) * hash_size);
+	pflow_free = (int *)malloc(sizeof(int) * pflow_size);
+	if(pflow == NULL || pflow_phead == NULL || pflow_thead == NULL || pflow_free == NULL)
+	{
+		IPACMERR("Unable to allocate memory for pending flows\n");
+		goto fail;
+	}
+	pflow_mask = hash_size - 1;
+	memset(pflow_phead, 0xff, sizeof(int) * hash_size);
+	memset(pflow_thead, 0xff, sizeof(int) * hash_size);
+	/* pop slots in ascending order, restore relies on it */
+	for(cnt = pflow_size - 1; cnt >= 0; cnt--)
+	{
+		pflow_free[pflow_num_free++] = cnt;
+	}
+	IPACMDBG_H("Nat pending flows %d, %u buckets\n", pflow_size, hash_size);
+
+	batch_size = pConfig->GetNatBatchSize();
+	if(batch_size > 1)
+	{
+		pending = (nat_pending_op *)malloc(sizeof(nat_pending_op) * batch_size);
+		if(pending == NULL)
+		{
+			IPACMERR("Unable to allocate memory for nat batch\n");
+			goto fail;
+		}
+		/* ops queued by a burst of events are applied as soon as the burst is handled */
+		MessageQueue::setIdleHook(NatApp::FlushOnIdle);
+	}
+	IPACMDBG_H("Nat batch size %d\n", batch_size);
+
+	/* the sweep period is clamped to half the udp timeout, know it before
+	   the first pass rather than after the first timestamp change */
+	Read_TcpUdp_Timeout();
+
+	/* placement only matters when the table is allowed to live in SRAM */
+	sram_hot_flows = pConfig->GetNatSramHotFlows();
+	place_enabled = SRAM_IN_USE();
+	IPACMDBG_H("Nat placement %s, SRAM hot flows %d\n",
+		place_enabled ? "on" : "off", sram_hot_flows);
+
+	conn_cls = IPACM_ConnClassifier::GetInstance();
 	nALGPort = pConfig->GetAlgPortCnt();
 	if(nALGPort > 0)
 	{
@@ -132,6 +287,8 @@ int NatApp::Init(void)
 		{
 			IPACMDBG("%d: Proto[%d], port[%d]\n", cnt, pALGPorts[cnt].protocol, pALGPorts[cnt].port);
 		}
+
+		conn_cls->SetAlgPorts(pALGPorts, nALGPort);
 	}
 	else
 	{
@@ -139,6 +296,11 @@ int NatApp::Init(void)
 		goto fail;
 	}
 
+#if defined(FEATURE_IPACM_RESTART) && defined(FEATURE_IPACM_AIDL)
+	/* restored entries are checked against the offload hal conntrack dump */
+	OpenSnapshot();
+#endif
+
 	return 0;
 
 fail:
@@ -146,10 +308,54 @@ fail:
 	{
 		free(cache);
 	}
+	if(hash_index != NULL)
+	{
+		free(hash_index);
+	}
+	if(free_slots != NULL)
+	{
+		free(free_slots);
+	}
+	if(links != NULL)
+	{
+		free(links);
+	}
+	if(tclnt_head != NULL)
+	{
+		free(tclnt_head);
+	}
+	if(heat != NULL)
+	{
+		free(heat);
+	}
+	if(rebuild_slots != NULL)
+	{
+		free(rebuild_slots);
+	}
+	if(pflow != NULL)
+	{
+		free(pflow);
+	}
+	if(pflow_phead != NULL)
+	{
+		free(pflow_phead);
+	}
+	if(pflow_thead != NULL)
+	{
+		free(pflow_thead);
+	}
+	if(pflow_free != NULL)
+	{
+		free(pflow_free);
+	}
 	if(pALGPorts != NULL)
 	{
 		free(pALGPorts);
 	}
+	if(pending != NULL)
+	{
+		free(pending);
+	}
 	return -1;
 }
 
@@ -169,6 +375,165 @@ NatApp* NatApp::GetInstance()
 	return pInstance;
 }
 
+void NatApp::OpenSnapshot()
+{
+	nat_snap_region regions[NAT_SNAP_REGIONS];
+
+	regions[NAT_SNAP_CACHE].count = max_entries;
+	regions[NAT_SNAP_CACHE].size = sizeof(nat_table_entry);
+	regions[NAT_SNAP_TEMP].count = pflow_size;
+	regions[NAT_SNAP_TEMP].size = sizeof(nat_table_entry);
+	regions[NAT_SNAP_ADDRS].count = NAT_SNAP_ADDR_LISTS;
+	regions[NAT_SNAP_ADDRS].size = sizeof(nat_snap_addr_list);
+	regions[NAT_SNAP_META].count = 1;
+	regions[NAT_SNAP_META].size = sizeof(nat_snap_meta);
+
+	if(snap.Open(IPACM_NAT_SNAPSHOT_FILE, regions, NAT_SNAP_REGIONS))
+	{
+		IPACMERR("nat snapshot unavailable, warm restart disabled\n");
+		return;
+	}
+
+	if(snap.IsRestored())
+	{
+		RestoreSnapshot();
+	}
+}
+
+/* Reload the cache and pending flows of the previous run. The rules are
+   not in hw (ipa_reset cleared it), they are installed by RebuildTable on
+   wan up and dropped by DropUnconfirmed if the conntrack dump does not
+   report them again. */
+void NatApp::RestoreSnapshot()
+{
+	nat_table_entry rule;
+	nat_snap_meta meta;
+	int cnt, slot, temps = 0;
+
+	unconfirmed = (uint8_t *)calloc(max_entries, sizeof(uint8_t));
+	if(unconfirmed == NULL)
+	{
+		IPACMERR("Unable to allocate memory for nat snapshot restore\n");
+		return;
+	}
+
+	if(snap.Load(NAT_SNAP_META, 0, &meta))
+	{
+		pub_ip_addr_pre = meta.pub_ip;
+	}
+
+	for(cnt = 0; cnt < max_entries; cnt++)
+	{
+		if(!snap.Load(NAT_SNAP_CACHE, cnt, &rule) ||
+			 rule.private_ip == 0 || FindEntry(&rule) >= 0)
+		{
+			continue;
+		}
+
+		slot = AllocEntry(&rule);
+		if(slot < 0)
+		{
+			break;
+		}
+		cache[slot].public_ip = rule.public_ip;
+		cache[slot].public_port = rule.public_port;
+		cache[slot].dst_nat = rule.dst_nat;
+		unconfirmed[slot] = 1;
+		num_unconfirmed++;
+	}
+
+	/* slots were handed out again, store them at their new index */
+	for(cnt = 0; cnt < max_entries; cnt++)
+	{
+		SnapSlot(cnt);
+	}
+
+	/* a flow never lands above the record it was read from, so records
+	   not read yet are not overwritten */
+	for(cnt = 0; cnt < pflow_size; cnt++)
+	{
+		if(snap.Load(NAT_SNAP_TEMP, cnt, &rule) &&
+			 FindPendingFlow(&rule) < 0 && AddPendingFlow(&rule) >= 0)
+		{
+			temps++;
+		}
+	}
+	for(cnt = temps; cnt < pflow_size; cnt++)
+	{
+		SnapTemp(cnt);
+	}
+
+	IPACMDBG_H("nat snapshot: restored %d cache entries and %d pending flows\n",
+		num_unconfirmed, temps);
+}
+
+void NatApp::SnapSlot(int slot)
+{
+	snap.Save(NAT_SNAP_CACHE, slot,
+		(cache[slot].private_ip != 0) ? &cache[slot] : NULL);
+}
+
+void NatApp::SnapTemp(int slot)
+{
+	snap.Save(NAT_SNAP_TEMP, slot, pflow[slot].used ? &pflow[slot].rule : NULL);
+}
+
+/* Drop the restored entries the conntrack dump did not report again */
+void NatApp::DropUnconfirmed()
+{
+	int cnt, dropped = 0;
+
+	if(unconfirmed == NULL)
+	{
+		return;
+	}
+
+	for(cnt = 0; cnt < max_entries && num_unconfirmed > 0; cnt++)
+	{
+		if(unconfirmed[cnt])
+		{
+			QueueEntry(&cache[cnt], false);
+			dropped++;
+		}
+	}
+
+	IPACMDBG_H("nat snapshot: dropped %d stale restored entries\n", dropped);
+	free(unconfirmed);
+	unconfirmed = NULL;
+	num_unconfirmed = 0;
+}
+
+void NatApp::SaveAddrList(int list, const uint32_t *addr, int cnt)
+{
+	nat_snap_addr_list rec;
+
+	if(cnt > NAT_SNAP_ADDR_MAX)
+	{
+		cnt = NAT_SNAP_ADDR_MAX;
+	}
+	memset(&rec, 0, sizeof(rec));
+	rec.cnt = cnt;
+	memcpy(rec.addr, addr, sizeof(uint32_t) * cnt);
+	snap.Save(NAT_SNAP_ADDRS, list, &rec);
+}
+
+/* Return the number of addresses restored into addr */
+int NatApp::LoadAddrList(int list, uint32_t *addr, int cnt)
+{
+	nat_snap_addr_list rec;
+
+	if(!snap.Load(NAT_SNAP_ADDRS, list, &rec))
+	{
+		return 0;
+	}
+	if((int)rec.cnt < cnt)
+	{
+		cnt = rec.cnt;
+	}
+	memcpy(addr, rec.addr, sizeof(uint32_t) * cnt);
+	return cnt;
+}
+
 uint32_t NatApp::GenerateMetdata(uint8_t mux_id)
 {
 	return (mux_id << HDR_METADATA_MUX_ID_SHFT) & HDR_METADATA_MUX_ID_BMASK;
@@ -177,9 +542,8 @@ uint32_t NatApp::GenerateMetdata(uint8_t mux_id)
 /* NAT APP related object function definitions */
 int NatApp::AddTable(uint32_t pub_ip, uint8_t mux_id)
 {
+	nat_snap_meta meta;
 	int ret;
-	int cnt = 0;
-	ipa_nat_ipv4_rule nat_rule;
 	IPACMDBG_H("%s() %d\n", __FUNCTION__, __LINE__);
 
 	/* Not reset the cache wait it timeout by destroy event */
@@ -197,6 +561,9 @@ int NatApp::AddTable(uint32_t pub_ip, uint8_t mux_id)
 		IPACMERR("unable to create nat table Error:%d\n", ret);
 		return ret;
 	}
+	/* a new table starts out wherever mem_type prefers, i.e. SRAM */
+	place_tier = place_modem_hold ? IPA_NAT_MEM_IN_DDR : IPA_NAT_MEM_IN_SRAM;
+	place_votes = 0;
 	if(IPACM_Iface::ipacmcfg->GetIPAVer() >= IPA_HW_v4_0) {
 		/* modify PDN 0 so it will hold the mux ID in the src metadata field */
 		ipa_nat_pdn_entry entry;
@@ -212,60 +579,152 @@ int NatApp::AddTable(uint32_t pub_ip, uint8_t mux_id)
 	}
 
 	/* Add back the cached NAT-entry */
-	if (pub_ip == pub_ip_addr_pre)
+	RebuildTable(pub_ip);
+
+	meta.pub_ip = pub_ip;
+	snap.Save(NAT_SNAP_META, 0, &meta);
+
+	pub_ip_addr = pub_ip;
+	pub_mux_id = mux_id;
+	IPACMDBG(" Set pub_mux_id: %d\t", pub_mux_id);
+	return 0;
+}
+
+/* Reinstall the cache into a freshly created table. A single pass over
+   the cache moves the entries to the new public ip (embedded connections
+   bound to the old wan address are dropped) and orders the slots hot
+   flows first, the rules are then added back under one clock vote. */
+void NatApp::RebuildTable(uint32_t pub_ip)
+{
+	ipa_nat_ipv4_rule nat_rule;
+	uint64_t start_us;
+	int cnt, slot, head = 0, tail = max_entries;
+	int restored = 0, rewritten = 0, dropped = 0, failed = 0;
+	bool ip_changed, keep_awake;
+	int ret;
+
+	start_us = GetTimeUs();
+	ip_changed = (pub_ip != pub_ip_addr_pre);
+
+	for(cnt = 0; cnt < max_entries; cnt++)
 	{
-		IPACMDBG("Restore the cache to ipa NAT-table\n");
-		for(cnt = 0; cnt < max_entries; cnt++)
+		if(cache[cnt].private_ip == 0)
+		{
+			continue;
+		}
+
+		if(ip_changed)
 		{
-			if(cache[cnt].private_ip !=0)
+			/* public_ip is not kept for installed rules, an embedded
+			   connection is one bound to the previous wan address */
+			if(cache[cnt].private_ip == pub_ip_addr_pre)
 			{
-				memset(&nat_rule, 0 , sizeof(nat_rule));
-				nat_rule.private_ip = cache[cnt].private_ip;
-				nat_rule.target_ip = cache[cnt].target_ip;
-				nat_rule.target_port = cache[cnt].target_port;
-				nat_rule.private_port = cache[cnt].private_port;
-				nat_rule.public_port = cache[cnt].public_port;
-				nat_rule.protocol = cache[cnt].protocol;
-
-				if(ipa_nat_add_ipv4_rule(nat_table_hdl, &nat_rule, &cache[cnt].rule_hdl) < 0)
-				{
-					IPACMERR("unable to add the rule delete from cache\n");
-					memset(&cache[cnt], 0, sizeof(cache[cnt]));
-					curCnt--;
-					continue;
-				}
-				cache[cnt].enabled = true;
-				/* send connections info to pcie modem only with DL direction */
-				if ((CtList->backhaul_mode == Q6_MHI_WAN) && (cache[cnt].dst_nat == true || cache[cnt].protocol == IPPROTO_TCP))
-				{
-					ret = AddConnection(&cache[cnt]);
-					if(ret > 0)
-					{
-						/* save the rule id for deletion */
-						cache[cnt].rule_id = ret;
-						IPACMDBG_H("rule-id(%d)\n", cache[cnt].rule_id);
-					}
-					else
-					{
-						IPACMERR("unable to add Connection to pcie modem: error:%d\n", ret);
-						cache[cnt].rule_id = 0;
-					}
-				}
+				FreeEntry(cnt);
+				dropped++;
+				continue;
+			}
+			cache[cnt].public_ip = pub_ip;
+			SnapSlot(cnt);
+			rewritten++;
+		}
 
-				IPACMDBG("On wan-iface reset added below rule successfully\n");
-				iptodot("Private IP", nat_rule.private_ip);
-				iptodot("Target IP", nat_rule.target_ip);
-				IPACMDBG("Private Port:%d \t Target Port: %d\t", nat_rule.private_port, nat_rule.target_port);
-				IPACMDBG("Public Port:%d\n", nat_rule.public_port);
-				IPACMDBG("protocol: %d\n", nat_rule.protocol);
+		if(heat[cnt].hot)
+		{
+			rebuild_slots[head++] = cnt;
+		}
+		else
+		{
+			rebuild_slots[--tail] = cnt;
+		}
+	}
+
+	if(head == 0 && tail == max_entries)
+	{
+		return;
+	}
+
+	keep_awake = ( SRAM_IN_USE() && ipa_nat_is_sram_supported() );
+	if ( keep_awake )
+	{
+		IPACMDBG("Voting clock on\n");
+
+		if ( ipa_nat_vote_clock(IPA_APP_CLK_VOTE) != 0 )
+		{
+			IPACMERR("Voting clock on failed\n");
+			keep_awake = false;
+		}
+	}
+
+	IPACMDBG("Restore the cache to ipa NAT-table\n");
+	for(cnt = 0; cnt < max_entries; cnt++)
+	{
+		/* hot flows were stored from the front, the rest from the back */
+		if(cnt == head)
+		{
+			cnt = tail;
+			if(cnt >= max_entries)
+			{
+				break;
+			}
+		}
+		slot = rebuild_slots[cnt];
+
+		memset(&nat_rule, 0 , sizeof(nat_rule));
+		nat_rule.private_ip = cache[slot].private_ip;
+		nat_rule.target_ip = cache[slot].target_ip;
+		nat_rule.target_port = cache[slot].target_port;
+		nat_rule.private_port = cache[slot].private_port;
+		nat_rule.public_port = cache[slot].public_port;
+		nat_rule.protocol = cache[slot].protocol;
+
+		if(ipa_nat_add_ipv4_rule(nat_table_hdl, &nat_rule, &cache[slot].rule_hdl) < 0)
+		{
+			IPACMERR("unable to add the rule delete from cache\n");
+			FreeEntry(slot);
+			failed++;
+			continue;
+		}
+		cache[slot].enabled = true;
+		cache[slot].timestamp = 0;
+		restored++;
+		/* send connections info to pcie modem only with DL direction */
+		if ((CtList->backhaul_mode == Q6_MHI_WAN) && (cache[slot].dst_nat == true || cache[slot].protocol == IPPROTO_TCP))
+		{
+			ret = AddConnection(&cache[slot]);
+			if(ret > 0)
+			{
+				/* save the rule id for deletion */
+				cache[slot].rule_id = ret;
+				IPACMDBG_H("rule-id(%d)\n", cache[slot].rule_id);
+			}
+			else
+			{
+				IPACMERR("unable to add Connection to pcie modem: error:%d\n", ret);
+				cache[slot].rule_id = 0;
 			}
 		}
+
+		IPACMDBG("On wan-iface reset added below rule successfully\n");
+		iptodot("Private IP", nat_rule.private_ip);
+		iptodot("Target IP", nat_rule.target_ip);
+		IPACMDBG("Private Port:%d \t Target Port: %d\t", nat_rule.private_port, nat_rule.target_port);
+		IPACMDBG("Public Port:%d\n", nat_rule.public_port);
+		IPACMDBG("protocol: %d\n", nat_rule.protocol);
 	}
 
-	pub_ip_addr = pub_ip;
-	pub_mux_id = mux_id;
-	IPACMDBG(" Set pub_mux_id: %d\t", pub_mux_id);
-	return 0;
+	if ( keep_awake )
+	{
+		IPACMDBG("Voting clock off\n");
+
+		if ( ipa_nat_vote_clock(IPA_APP_CLK_DEVOTE) != 0 )
+		{
+			IPACMERR("Voting clock off failed\n");
+		}
+	}
+
+	IPACMDBG_H("nat rebuild: %d restored (%d hot), %d moved to new ip, %d dropped, %d failed in %llu us\n",
+		restored, head, rewritten, dropped, failed,
+		(unsigned long long)(GetTimeUs() - start_us));
 }
 
 void NatApp::Reset()
@@ -283,6 +742,9 @@ int NatApp::DeleteTable(uint32_t pub_ip)
 
 	CHK_TBL_HDL();
 
+	/* apply queued rules first so they are cached for the restore */
+	FlushBatch();
+
 	if(pub_ip_addr != pub_ip)
 	{
 		IPACMDBG("Public ip address is not matching\n");
@@ -335,27 +797,186 @@ int NatApp::MoveTable(bool to_ddr)
 		ret = ipa_nat_switch_to(IPA_NAT_MEM_IN_DDR, false);
 	}
 
+	/* the modem lock overrides placement until it is released, after
+	   that the next passes decide again starting from DDR */
+	place_modem_hold = to_ddr;
+	place_tier = IPA_NAT_MEM_IN_DDR;
+	place_votes = 0;
+
 	return ret;
 }
 
+/* Return the cache slot holding the 5-tuple of rule, -1 if not cached */
+int NatApp::FindEntry(const nat_table_entry *rule)
+{
+	return NatIndexFind(hash_index, hash_mask, cache, rule);
+}
+
+/* Take a free cache slot for the 5-tuple of rule and index it,
+   the caller fills in the remaining fields */
+int NatApp::AllocEntry(const nat_table_entry *rule)
+{
+	int slot;
+
+	if(num_free_slots == 0)
+	{
+		return -1;
+	}
+	slot = free_slots[--num_free_slots];
+
+	memset(&cache[slot], 0, sizeof(cache[slot]));
+	memset(&heat[slot], 0, sizeof(heat[slot]));
+	cache[slot].private_ip = rule->private_ip;
+	cache[slot].target_ip = rule->target_ip;
+	cache[slot].private_port = rule->private_port;
+	cache[slot].target_port = rule->target_port;
+	cache[slot].protocol = rule->protocol;
+
+	if(NatIndexInsert(hash_index, hash_mask, rule, slot))
+	{
+		hash_tombstones--;
+	}
+	LinkEntry(slot);
+	curCnt++;
+
+	return slot;
+}
+
+/* Drop cache slot from the index and return it to the free list */
+void NatApp::FreeEntry(int slot)
+{
+	if(NatIndexRemove(hash_index, hash_mask, &cache[slot], slot))
+	{
+		hash_tombstones++;
+	}
+	else
+	{
+		IPACMERR("cache entry %d missing from index\n", slot);
+	}
+
+	UnlinkEntry(slot);
+	memset(&cache[slot], 0, sizeof(cache[slot]));
+	SnapSlot(slot);
+	if(unconfirmed != NULL && unconfirmed[slot])
+	{
+		unconfirmed[slot] = 0;
+		num_unconfirmed--;
+	}
+	free_slots[num_free_slots++] = slot;
+	curCnt--;
+
+	/* too many tombstones make misses walk long probe chains */
+	if(hash_tombstones > (int)((hash_mask + 1) / 4))
+	{
+		RebuildIndex();
+	}
+}
+
+void NatApp::RebuildIndex()
+{
+	int cnt;
+
+	memset(hash_index, 0xff, sizeof(int) * (hash_mask + 1));
+	hash_tombstones = 0;
+
+	for(cnt = 0; cnt < max_entries; cnt++)
+	{
+		if(cache[cnt].private_ip == 0 &&
+			 cache[cnt].target_ip == 0 &&
+			 cache[cnt].private_port == 0  &&
+			 cache[cnt].target_port == 0 &&
+			 cache[cnt].protocol == 0)
+		{
+			continue;
+		}
+		NatIndexInsert(hash_index, hash_mask, &cache[cnt], cnt);
+	}
+}
+
+uint32_t NatApp::HashIp(uint32_t ip)
+{
+	ip ^= ip >> 16;
+	ip *= 0x85EBCA6B;
+	ip ^= ip >> 13;
+	ip *= 0xC2B2AE35;
+	ip ^= ip >> 16;
+	return ip;
+}
+
+/* Put cache slot at the head of its private ip and target ip chains */
+void NatApp::LinkEntry(int slot)
+{
+	int *head;
+
+	head = &pclnt_head[HashIp(cache[slot].private_ip) & (NAT_CLNT_BUCKETS - 1)];
+	links[slot].pprev = -1;
+	links[slot].pnext = *head;
+	if(*head >= 0)
+	{
+		links[*head].pprev = slot;
+	}
+	*head = slot;
+
+	head = &tclnt_head[HashIp(cache[slot].target_ip) & hash_mask];
+	links[slot].tprev = -1;
+	links[slot].tnext = *head;
+	if(*head >= 0)
+	{
+		links[*head].tprev = slot;
+	}
+	*head = slot;
+}
+
+void NatApp::UnlinkEntry(int slot)
+{
+	nat_cache_link *link = &links[slot];
+
+	if(link->pprev >= 0)
+	{
+		links[link->pprev].pnext = link->pnext;
+	}
+	else
+	{
+		pclnt_head[HashIp(cache[slot].private_ip) & (NAT_CLNT_BUCKETS - 1)] = link->pnext;
+	}
+	if(link->pnext >= 0)
+	{
+		links[link->pnext].pprev = link->pprev;
+	}
+
+	if(link->tprev >= 0)
+	{
+		links[link->tprev].tnext = link->tnext;
+	}
+	else
+	{
+		tclnt_head[HashIp(cache[slot].target_ip) & hash_mask] = link->tnext;
+	}
+	if(link->tnext >= 0)
+	{
+		links[link->tnext].tprev = link->tprev;
+	}
+}
+
 /* Check for duplicate entries */
 bool NatApp::ChkForDup(const nat_table_entry *rule)
 {
-	int cnt = 0;
+	int slot;
+
 	IPACMDBG("%s() %d\n", __FUNCTION__, __LINE__);
 
-	for(; cnt < max_entries; cnt++)
+	slot = FindEntry(rule);
+	if(slot >= 0)
 	{
-		if(cache[cnt].private_ip == rule->private_ip &&
-			 cache[cnt].target_ip == rule->target_ip &&
-			 cache[cnt].private_port ==  rule->private_port  &&
-			 cache[cnt].target_port == rule->target_port &&
-			 cache[cnt].protocol == rule->protocol)
+		/* seen again since the restart, keep the restored entry */
+		if(unconfirmed != NULL && unconfirmed[slot])
 		{
-			log_nat(rule->protocol,rule->private_ip,rule->target_ip,rule->private_port,\
-			rule->target_port,"Duplicate Rule\n");
-			return true;
+			unconfirmed[slot] = 0;
+			num_unconfirmed--;
 		}
+		log_nat(rule->protocol,rule->private_ip,rule->target_ip,rule->private_port,\
+		rule->target_port,"Duplicate Rule\n");
+		return true;
 	}
 
 	return false;
@@ -371,50 +992,42 @@ int NatApp::DeleteEntry(const nat_table_entry *rule)
 	log_nat(rule->protocol,rule->private_ip,rule->target_ip,rule->private_port,\
 	rule->target_port,"for deletion\n");
 
+	cnt = FindEntry(rule);
+	if(cnt < 0)
+	{
+		return 0;
+	}
 
-	for(; cnt < max_entries; cnt++)
+	if(cache[cnt].enabled == true)
 	{
-		if(cache[cnt].private_ip == rule->private_ip &&
-			 cache[cnt].target_ip == rule->target_ip &&
-			 cache[cnt].private_port ==  rule->private_port  &&
-			 cache[cnt].target_port == rule->target_port &&
-			 cache[cnt].protocol == rule->protocol)
+		/* send connections del info to pcie modem first */
+		if ((CtList->backhaul_mode == Q6_MHI_WAN) && (cache[cnt].dst_nat == true || cache[cnt].protocol == IPPROTO_TCP) && (cache[cnt].rule_id > 0))
 		{
-
-			if(cache[cnt].enabled == true)
+			ret = DelConnection(cache[cnt].rule_id);
+			if(ret)
 			{
-				/* send connections del info to pcie modem first */
-				if ((CtList->backhaul_mode == Q6_MHI_WAN) && (cache[cnt].dst_nat == true || cache[cnt].protocol == IPPROTO_TCP) && (cache[cnt].rule_id > 0))
-				{
-					ret = DelConnection(cache[cnt].rule_id);
-					if(ret)
-					{
-						IPACMERR("unable to del Connection to pcie modem: %d\n", ret);
-					}
-					else
-					{
-						/* save the rule id for deletion */
-						cache[cnt].rule_id = 0;
-					}
-				}
-
-				if(ipa_nat_del_ipv4_rule(nat_table_hdl, cache[cnt].rule_hdl) < 0)
-				{
-					IPACMERR("%s() %d deletion failed\n", __FUNCTION__, __LINE__);
-				}
-
-				IPACMDBG_H("Deleted Nat entry(%d) Successfully\n", cnt);
+				IPACMERR("unable to del Connection to pcie modem: %d\n", ret);
 			}
 			else
 			{
-				IPACMDBG_H("Deleted Nat entry(%d) only from cache\n", cnt);
+				/* save the rule id for deletion */
+				cache[cnt].rule_id = 0;
 			}
+		}
 
-			memset(&cache[cnt], 0, sizeof(cache[cnt]));
-			curCnt--;
-			break;
+		if(ipa_nat_del_ipv4_rule(nat_table_hdl, cache[cnt].rule_hdl) < 0)
+		{
+			IPACMERR("%s() %d deletion failed\n", __FUNCTION__, __LINE__);
 		}
+
+		IPACMDBG_H("Deleted Nat entry(%d) Successfully\n", cnt);
 	}
+	else
+	{
+		IPACMDBG_H("Deleted Nat entry(%d) only from cache\n", cnt);
+	}
+
+	FreeEntry(cnt);
 
 	return 0;
 }
@@ -425,6 +1038,8 @@ int NatApp::AddEntry(const nat_table_entry *rule)
 	int cnt = 0;
 	ipa_nat_ipv4_rule nat_rule;
 	int ret = 0;
+	uint32_t rule_hdl = 0;
+	bool enabled = false;
 
 	IPACMDBG("%s() %d\n", __FUNCTION__, __LINE__);
 
@@ -450,19 +1065,7 @@ int NatApp::AddEntry(const nat_table_entry *rule)
 
 	if(!ChkForDup(rule))
 	{
-		for(; cnt < max_entries; cnt++)
-		{
-			if(cache[cnt].private_ip == 0 &&
-				 cache[cnt].target_ip == 0 &&
-				 cache[cnt].private_port == 0  &&
-				 cache[cnt].target_port == 0 &&
-				 cache[cnt].protocol == 0)
-			{
-				break;
-			}
-		}
-
-		if(max_entries == cnt)
+		if(num_free_slots == 0)
 		{
 			IPACMERR("Error: Unable to add, reached maximum rules\n");
 			return -1;
@@ -481,45 +1084,44 @@ int NatApp::AddEntry(const nat_table_entry *rule)
 				 isPwrSaveIf(rule->target_ip))
 			{
 				IPACMDBG("Device is Power Save mode: Dont insert into nat table but cache\n");
-				cache[cnt].enabled = false;
-				cache[cnt].rule_hdl = 0;
+				enabled = false;
+				rule_hdl = 0;
 			}
 			else
 			{
 
-				if(ipa_nat_add_ipv4_rule(nat_table_hdl, &nat_rule, &cache[cnt].rule_hdl) < 0)
+				if(ipa_nat_add_ipv4_rule(nat_table_hdl, &nat_rule, &rule_hdl) < 0)
 				{
 					IPACMERR("unable to add the rule\n");
 					return -1;
 				}
-
-				cache[cnt].enabled = true;
-				/* send connections info to pcie modem only with DL direction */
-				if ((CtList->backhaul_mode == Q6_MHI_WAN) && (rule->dst_nat == true || rule->protocol == IPPROTO_TCP))
-				{
-					ret = AddConnection(rule);
-					if(ret > 0)
-					{
-						/* save the rule id for deletion */
-						cache[cnt].rule_id = ret;
-						IPACMDBG_H("rule-id(%d)\n", cache[cnt].rule_id);
-					}
-					else
-					{
-						IPACMERR("unable to add Connection to pcie modem: error:%d\n", ret);
-						cache[cnt].rule_id = 0;
-					}
-				}
+				enabled = true;
 			}
-			cache[cnt].private_ip = rule->private_ip;
-			cache[cnt].target_ip = rule->target_ip;
-			cache[cnt].target_port = rule->target_port;
-			cache[cnt].private_port = rule->private_port;
-			cache[cnt].protocol = rule->protocol;
+
+			cnt = AllocEntry(rule);
+			cache[cnt].enabled = enabled;
+			cache[cnt].rule_hdl = rule_hdl;
 			cache[cnt].timestamp = 0;
 			cache[cnt].public_port = rule->public_port;
 			cache[cnt].dst_nat = rule->dst_nat;
-			curCnt++;
+			SnapSlot(cnt);
+
+			/* send connections info to pcie modem only with DL direction */
+			if (enabled && (CtList->backhaul_mode == Q6_MHI_WAN) && (rule->dst_nat == true || rule->protocol == IPPROTO_TCP))
+			{
+				ret = AddConnection(rule);
+				if(ret > 0)
+				{
+					/* save the rule id for deletion */
+					cache[cnt].rule_id = ret;
+					IPACMDBG_H("rule-id(%d)\n", cache[cnt].rule_id);
+				}
+				else
+				{
+					IPACMERR("unable to add Connection to pcie modem: error:%d\n", ret);
+					cache[cnt].rule_id = 0;
+				}
+			}
 		}
 
 	}
@@ -541,6 +1143,121 @@ int NatApp::AddEntry(const nat_table_entry *rule)
 	return 0;
 }
 
+/* Queue a rule add/delete, applied in arrival order on the next flush */
+int NatApp::QueueEntry(const nat_table_entry *rule, bool add)
+{
+	int cnt;
+
+	if(batch_size <= 1)
+	{
+		return add ? AddEntry(rule) : DeleteEntry(rule);
+	}
+
+	/* coalesce against the latest queued op on the same tuple */
+	for(cnt = num_pending - 1; cnt >= 0; cnt--)
+	{
+		if(!SameTuple(&pending[cnt].rule, rule))
+		{
+			continue;
+		}
+
+		if(pending[cnt].add == add)
+		{
+			/* repeated add or delete is a no-op once the first one is applied */
+			batch_merged++;
+			return 0;
+		}
+
+		if(pending[cnt].add && FindEntry(rule) < 0)
+		{
+			/* connection closed before its rule was ever installed */
+			memmove(&pending[cnt], &pending[cnt + 1],
+				sizeof(nat_pending_op) * (num_pending - cnt - 1));
+			num_pending--;
+			batch_cancelled++;
+			log_nat(rule->protocol,rule->private_ip,rule->target_ip,rule->private_port,\
+			rule->target_port,"cancelled in batch\n");
+			return 0;
+		}
+		break;
+	}
+
+	memcpy(&pending[num_pending].rule, rule, sizeof(nat_table_entry));
+	pending[num_pending].add = add;
+	num_pending++;
+
+	if(num_pending >= batch_size)
+	{
+		FlushBatch();
+	}
+
+	return 0;
+}
+
+/* Apply all queued rules under a single clock vote */
+void NatApp::FlushBatch()
+{
+	int cnt, num;
+	bool keep_awake;
+
+	if(num_pending == 0)
+	{
+		return;
+	}
+
+	/* ipa_nat_drv has no multi rule call, keep the hw awake across the batch */
+	keep_awake = ( nat_table_hdl && SRAM_IN_USE() && ipa_nat_is_sram_supported() );
+
+	if ( keep_awake )
+	{
+		IPACMDBG("Voting clock on\n");
+
+		if ( ipa_nat_vote_clock(IPA_APP_CLK_VOTE) != 0 )
+		{
+			IPACMERR("Voting clock on failed\n");
+			keep_awake = false;
+		}
+	}
+
+	num = num_pending;
+	num_pending = 0;
+	for(cnt = 0; cnt < num; cnt++)
+	{
+		if(pending[cnt].add)
+		{
+			AddEntry(&pending[cnt].rule);
+		}
+		else
+		{
+			DeleteEntry(&pending[cnt].rule);
+		}
+	}
+
+	if ( keep_awake )
+	{
+		IPACMDBG("Voting clock off\n");
+
+		if ( ipa_nat_vote_clock(IPA_APP_CLK_DEVOTE) != 0 )
+		{
+			IPACMERR("Voting clock off failed\n");
+		}
+	}
+
+	batch_flushes++;
+	batch_ops += num;
+	IPACMDBG_H("Flushed %d nat ops, total flushes:%u ops:%u merged:%u cancelled:%u\n",
+		num, batch_flushes, batch_ops, batch_merged, batch_cancelled);
+}
+
+/* Cmd queue idle hook, nothing else is left to merge or cancel against */
+void NatApp::FlushOnIdle(void)
+{
+	if(pInstance != NULL)
+	{
+		pInstance->FlushBatch();
+	}
+}
+
 /* Add new entry to the nat table on new connection, return rule-id */
 int NatApp::AddConnection(const nat_table_entry *rule)
 {
@@ -671,18 +1388,21 @@ fail:
 	return res;
 }
 
+/* Queue a conntrack timeout refresh, sent with the rest of the shard */
 void NatApp::UpdateCTUdpTs(nat_table_entry *rule, uint32_t new_ts)
 {
 #ifdef FEATURE_IPACM_AIDL
 	IOffloadManager::ConntrackTimeoutUpdater::natTimeoutUpdate_t entry;
 	IPACM_OffloadManager* OffloadMng;
+#else
+	struct nlmsghdr *nlh;
+	nat_ct_inflight *inflight;
 #endif
 	iptodot("Private IP:", rule->private_ip);
 	iptodot("Target IP:",  rule->target_ip);
 	IPACMDBG("Private Port: %d, Target Port: %d\n", rule->private_port, rule->target_port);
 
 #ifndef FEATURE_IPACM_AIDL
-	int ret;
 	if(!ct_hdl)
 	{
 		ct_hdl = nfct_open(CONNTRACK, 0);
@@ -703,6 +1423,16 @@ void NatApp::UpdateCTUdpTs(nat_table_entry *rule, uint32_t new_ts)
 		}
 	}
 
+	if(!ct_batch_buf)
+	{
+		ct_batch_buf = (char *)malloc(NAT_CT_BATCH_MAX * NAT_CT_MSG_SIZE);
+		if(!ct_batch_buf)
+		{
+			IPACMERR("unable to allocate conntrack update batch\n");
+			return;
+		}
+	}
+
 	nfct_set_attr_u8(ct, ATTR_L3PROTO, AF_INET);
 	if(rule->protocol == IPPROTO_UDP)
 	{
@@ -744,16 +1474,25 @@ void NatApp::UpdateCTUdpTs(nat_table_entry *rule, uint32_t new_ts)
 	IPACMDBG("updating %d connection with time: %d\n",
 					 rule->protocol, nfct_get_attr_u32(ct, ATTR_TIMEOUT));
 
-	ret = nfct_query(ct_hdl, NFCT_Q_UPDATE, ct);
-	if(ret == -1)
+	/* append the update request to the batch, acks are matched by seq */
+	nlh = (struct nlmsghdr *)(ct_batch_buf + ct_batch_len);
+	if(nfct_build_query(nfct_subsys_ct(ct_hdl), NFCT_Q_UPDATE, ct, nlh, NAT_CT_MSG_SIZE) < 0)
 	{
-		IPACMERR("unable to update time stamp");
-		DeleteEntry(rule);
+		IPACMERR("unable to build time stamp update\n");
+		return;
 	}
-	else
+	nlh->nlmsg_seq = ++ct_seq;
+	ct_batch_len += NLMSG_ALIGN(nlh->nlmsg_len);
+	ct_batch_cnt++;
+
+	inflight = &ct_inflight[ct_seq % NAT_CT_INFLIGHT_MAX];
+	inflight->seq = ct_seq;
+	memcpy(&inflight->rule, rule, sizeof(nat_table_entry));
+
+	rule->timestamp = new_ts;
+	if(ct_batch_cnt >= NAT_CT_BATCH_MAX)
 	{
-		rule->timestamp = new_ts;
-		IPACMDBG("Updated time stamp successfully\n");
+		SendCTUpdates();
 	}
 #else
 	if(rule->protocol == IPPROTO_UDP)
@@ -791,41 +1530,171 @@ void NatApp::UpdateCTUdpTs(nat_table_entry *rule, uint32_t new_ts)
 	if (OffloadMng->touInstance == NULL) {
 		IPACMERR("OffloadMng->touInstance is NULL, can't forward to framework!\n");
 	} else {
-		OffloadMng->touInstance->updateTimeout(entry);
-		IPACMDBG("Updated time stamp successfully\n");
+		ct_updates.push_back(entry);
 		rule->timestamp = new_ts;
 	}
 #endif
 	return;
 }
 
+/* Send all queued timeout updates, one sendmsg for the netlink batch */
+void NatApp::SendCTUpdates()
+{
+#ifdef FEATURE_IPACM_AIDL
+	IPACM_OffloadManager* OffloadMng;
+
+	if(ct_updates.empty())
+	{
+		return;
+	}
+
+	OffloadMng = IPACM_OffloadManager::GetInstance();
+	if (OffloadMng->touInstance == NULL) {
+		IPACMERR("OffloadMng->touInstance is NULL, can't forward to framework!\n");
+	} else {
+		OffloadMng->touInstance->updateTimeouts(ct_updates);
+		ct_sends++;
+		ct_msgs += ct_updates.size();
+		IPACMDBG("Forwarded %zu time stamp updates\n", ct_updates.size());
+	}
+	ct_updates.clear();
+#else
+	struct sockaddr_nl nladdr;
+	struct iovec iov;
+	struct msghdr msg;
+
+	if(ct_batch_cnt == 0)
+	{
+		return;
+	}
+
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	iov.iov_base = ct_batch_buf;
+	iov.iov_len = ct_batch_len;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &nladdr;
+	msg.msg_namelen = sizeof(nladdr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	if(sendmsg(nfct_fd(ct_hdl), &msg, 0) < 0)
+	{
+		IPACMERR("unable to send %d time stamp updates: %s\n", ct_batch_cnt, strerror(errno));
+	}
+	else
+	{
+		ct_sends++;
+		ct_msgs += ct_batch_cnt;
+		IPACMDBG("Sent %d time stamp updates\n", ct_batch_cnt);
+	}
+
+	ct_batch_len = 0;
+	ct_batch_cnt = 0;
+#endif
+}
+
+/* Drain acks of earlier batches, drop the entries conntrack rejected */
+void NatApp::ProcessCTAcks()
+{
+#ifndef FEATURE_IPACM_AIDL
+	char buf[NAT_CT_BATCH_MAX * NAT_CT_MSG_SIZE];
+	struct nlmsghdr *nlh;
+	struct nlmsgerr *err;
+	nat_ct_inflight *inflight;
+	int len;
+
+	if(!ct_hdl)
+	{
+		return;
+	}
+
+	while((len = recv(nfct_fd(ct_hdl), buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+	{
+		for(nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len))
+		{
+			if(nlh->nlmsg_type != NLMSG_ERROR)
+			{
+				continue;
+			}
+
+			err = (struct nlmsgerr *)NLMSG_DATA(nlh);
+			if(err->error == 0)
+			{
+				continue;
+			}
+
+			/* slot reused by a newer update, the entry was refreshed since */
+			inflight = &ct_inflight[nlh->nlmsg_seq % NAT_CT_INFLIGHT_MAX];
+			if(inflight->seq != nlh->nlmsg_seq)
+			{
+				continue;
+			}
+
+			IPACMERR("unable to update time stamp, error %d\n", err->error);
+			ct_nacks++;
+			/* behind any op still queued for the same tuple */
+			QueueEntry(&inflight->rule, false);
+			inflight->seq = 0;
+		}
+	}
+#endif
+}
+
+/* Sweep one shard of the cache, called on the cmd queue thread every
+   sweep tick. The clock is only voted while an active shard is queried. */
 void NatApp::UpdateUDPTimeStamp()
 {
-	int cnt;
+	int cnt, end;
 	uint32_t ts;
 	bool read_to = false;
-	bool keep_awake;
+	bool need_vote, voted = false;
+	uint64_t vote_start = 0;
 
-	keep_awake = ( max_entries && SRAM_IN_USE() && ipa_nat_is_sram_supported() );
+	if(max_entries == 0)
+	{
+		return;
+	}
 
-	if ( keep_awake )
+	ProcessCTAcks();
+
+	if(sweep_cursor == 0)
 	{
-		IPACMDBG("Voting clock on\n");
+		sweep_start_us = GetTimeUs();
+		sweep_vote_us = 0;
+		sweep_touched = 0;
+		sweep_changed = 0;
+	}
 
-		if ( ipa_nat_vote_clock(IPA_APP_CLK_VOTE) != 0 )
-		{
-			IPACMERR("Voting clock on failed\n");
-			return;
-		}
+	end = sweep_cursor + NAT_SWEEP_SHARD_SIZE;
+	if(end > max_entries)
+	{
+		end = max_entries;
 	}
 
-	for(cnt = 0; cnt < max_entries; cnt++)
+	need_vote = ( SRAM_IN_USE() && ipa_nat_is_sram_supported() );
+
+	for(cnt = sweep_cursor; cnt < end; cnt++)
 	{
 		ts = 0;
 		if(cache[cnt].enabled == true &&
 		   (cache[cnt].private_ip != cache[cnt].public_ip))
 		{
+			if(need_vote && !voted)
+			{
+				IPACMDBG("Voting clock on\n");
+
+				if ( ipa_nat_vote_clock(IPA_APP_CLK_VOTE) != 0 )
+				{
+					IPACMERR("Voting clock on failed\n");
+					break;
+				}
+				voted = true;
+				vote_start = GetTimeUs();
+			}
+
 			IPACMDBG("\n");
+			sweep_touched++;
 			if(ipa_nat_query_timestamp(nat_table_hdl, cache[cnt].rule_hdl, &ts) < 0)
 			{
 				IPACMERR("unable to retrieve timeout for rule hanle: %d\n", cache[cnt].rule_hdl);
@@ -836,9 +1705,12 @@ void NatApp::UpdateUDPTimeStamp()
 			{
 				IPACMDBG("No Change in Time Stamp: cahce:%d, ipahw:%d\n",
 								                  cache[cnt].timestamp, ts);
+				ScoreFlow(cnt, false);
 				continue;
 			}
 
+			ScoreFlow(cnt, true);
+			sweep_changed++;
 			if (read_to == false) {
 				read_to = true;
 				Read_TcpUdp_Timeout();
@@ -849,7 +1721,7 @@ void NatApp::UpdateUDPTimeStamp()
 
 	} /* end of for loop */
 
-	if ( keep_awake )
+	if ( voted )
 	{
 		IPACMDBG("Voting clock off\n");
 
@@ -857,22 +1729,172 @@ void NatApp::UpdateUDPTimeStamp()
 		{
 			IPACMERR("Voting clock off failed\n");
 		}
+		sweep_vote_us += GetTimeUs() - vote_start;
+	}
+
+	SendCTUpdates();
+
+	sweep_cursor = end;
+	if(sweep_cursor >= max_entries)
+	{
+		EndSweepPass();
 	}
 }
 
-bool NatApp::isAlgPort(uint8_t proto, uint16_t port)
+/* Adapt the full pass period to how many timestamps moved */
+void NatApp::EndSweepPass()
 {
-	int cnt;
-	for(cnt = 0; cnt < nALGPort; cnt++)
+	uint32_t max_period = NAT_SWEEP_MAX_PERIOD_MS;
+	int num_shards;
+
+	sweep_cursor = 0;
+	sweep_passes++;
+
+	/* never let an idle hw flow outlive its kernel conntrack entry */
+	if(udp_timeout > 0 && udp_timeout * 1000 / 2 < max_period)
 	{
-		if(proto == pALGPorts[cnt].protocol &&
-			 port == pALGPorts[cnt].port)
+		max_period = udp_timeout * 1000 / 2;
+		if(max_period < NAT_SWEEP_MIN_PERIOD_MS)
 		{
-			return true;
+			max_period = NAT_SWEEP_MIN_PERIOD_MS;
 		}
 	}
 
-	return false;
+	if(sweep_changed == 0)
+	{
+		sweep_period_ms *= 2;
+	}
+	else if(sweep_changed * 4 >= sweep_touched)
+	{
+		sweep_period_ms /= 2;
+	}
+
+	if(sweep_period_ms > max_period)
+	{
+		sweep_period_ms = max_period;
+	}
+	if(sweep_period_ms < NAT_SWEEP_MIN_PERIOD_MS)
+	{
+		sweep_period_ms = NAT_SWEEP_MIN_PERIOD_MS;
+	}
+
+	num_shards = (max_entries + NAT_SWEEP_SHARD_SIZE - 1) / NAT_SWEEP_SHARD_SIZE;
+	sweep_tick_ms = (sweep_period_ms / num_shards > NAT_SWEEP_MIN_TICK_MS) ?
+		sweep_period_ms / num_shards : NAT_SWEEP_MIN_TICK_MS;
+
+	IPACMDBG_H("ts sweep %u: %llu ms, touched %u, changed %u, clock voted %llu ms, next period %u ms\n",
+		sweep_passes, (unsigned long long)((GetTimeUs() - sweep_start_us) / 1000),
+		sweep_touched, sweep_changed, (unsigned long long)(sweep_vote_us / 1000),
+		sweep_period_ms);
+	IPACMDBG_H("ct timeout updates: %u sends, %u msgs, %u rejected\n",
+		ct_sends, ct_msgs, ct_nacks);
+
+	ExpirePendingFlows(GetTimeUs());
+	IPACMDBG_H("pending flows: %d of %d used, %u expired, %u evicted\n",
+		pflow_size - pflow_num_free, pflow_size, pflow_expired, pflow_evicted);
+
+	PlaceTable();
+}
+
+/* Decay the flow score once per pass and credit it when the hw timestamp
+   moved. A flow with traffic counts as a hit if it was already hot, i.e.
+   already part of the set the table is placed for. */
+void NatApp::ScoreFlow(int slot, bool active)
+{
+	nat_flow_heat *flow = &heat[slot];
+	int score = flow->score - flow->score / 4;
+
+	if(active)
+	{
+		if(flow->hot)
+		{
+			place_hits++;
+		}
+		else
+		{
+			place_misses++;
+		}
+		score += NAT_HEAT_HIT;
+	}
+
+	flow->score = (score > UINT8_MAX) ? UINT8_MAX : score;
+	if(flow->score >= NAT_HEAT_HOT)
+	{
+		flow->hot = true;
+	}
+	else if(flow->score < NAT_HEAT_COLD)
+	{
+		flow->hot = false;
+	}
+
+	if(flow->hot)
+	{
+		place_hot++;
+	}
+}
+
+/* ipa_nat_drv places the whole table, not single rules. Keep it in SRAM
+   while the hot set is non empty and fits sram_hot_flows, park it in DDR
+   when the hot set overflows or goes idle. The tier only changes after
+   NAT_PLACE_HYST_PASSES passes in a row asked for it. */
+void NatApp::PlaceTable()
+{
+	enum ipa3_nat_mem_in want;
+	uint32_t active = place_hits + place_misses;
+
+	place_total_hits += place_hits;
+	place_total_misses += place_misses;
+
+	IPACMDBG_H("placement: tier %s, hot %u, hits %u/%u (%u%%), total %llu/%llu, switches %u\n",
+		(place_tier == IPA_NAT_MEM_IN_DDR) ? "DDR" : "SRAM", place_hot,
+		place_hits, active, active ? place_hits * 100 / active : 0,
+		(unsigned long long)place_total_hits,
+		(unsigned long long)(place_total_hits + place_total_misses), place_switches);
+
+	if(!place_enabled || place_modem_hold || nat_table_hdl == 0 ||
+	   !ipa_nat_is_sram_supported())
+	{
+		place_votes = 0;
+		goto reset;
+	}
+
+	want = (place_hot > 0 && place_hot <= (uint32_t)sram_hot_flows) ?
+		IPA_NAT_MEM_IN_SRAM : IPA_NAT_MEM_IN_DDR;
+	if(want == place_tier)
+	{
+		place_votes = 0;
+	}
+	else if(++place_votes >= NAT_PLACE_HYST_PASSES)
+	{
+		place_votes = 0;
+		/* hold DDR so the driver does not pull the table back by itself */
+		if(ipa_nat_switch_to(want, want == IPA_NAT_MEM_IN_DDR) != 0)
+		{
+			IPACMERR("unable to move nat table to %s\n",
+				(want == IPA_NAT_MEM_IN_DDR) ? "DDR" : "SRAM");
+			goto reset;
+		}
+		place_tier = want;
+		place_switches++;
+		IPACMDBG_H("moved nat table to %s, hot flows %u\n",
+			(want == IPA_NAT_MEM_IN_DDR) ? "DDR" : "SRAM", place_hot);
+	}
+
+reset:
+	place_hot = 0;
+	place_hits = 0;
+	place_misses = 0;
+}
+
+/* Delay between two shards, read when the reactor re-arms its sweep timerfd */
+uint32_t NatApp::GetSweepTick()
+{
+	return sweep_tick_ms;
+}
+
+bool NatApp::isAlgPort(uint8_t proto, uint16_t port)
+{
+	return conn_cls->isAlgPort(proto, port);
 }
 
 bool NatApp::isPwrSaveIf(uint32_t ip_addr)
@@ -893,7 +1915,7 @@ bool NatApp::isPwrSaveIf(uint32_t ip_addr)
 
 int NatApp::UpdatePwrSaveIf(uint32_t client_lan_ip)
 {
-	int cnt, ret;
+	int cnt, next, ret;
 	IPACMDBG_H("Received IP address: 0x%x\n", client_lan_ip);
 
 	if(client_lan_ip == INVALID_IP_ADDR)
@@ -902,6 +1924,8 @@ int NatApp::UpdatePwrSaveIf(uint32_t client_lan_ip)
 		return -1;
 	}
 
+	FlushBatch();
+
 	/* check for duplicate events */
 	for(cnt = 0; cnt < IPA_MAX_NUM_WIFI_CLIENTS; cnt++)
 	{
@@ -921,8 +1945,9 @@ int NatApp::UpdatePwrSaveIf(uint32_t client_lan_ip)
 		}
 	}
 
-	for(cnt = 0; cnt < max_entries; cnt++)
+	for(cnt = pclnt_head[HashIp(client_lan_ip) & (NAT_CLNT_BUCKETS - 1)]; cnt >= 0; cnt = next)
 	{
+		next = links[cnt].pnext;
 		if(cache[cnt].private_ip == client_lan_ip &&
 			 cache[cnt].enabled == true)
 		{
@@ -957,7 +1982,7 @@ int NatApp::UpdatePwrSaveIf(uint32_t client_lan_ip)
 
 int NatApp::ResetPwrSaveIf(uint32_t client_lan_ip)
 {
-	int cnt, ret;
+	int cnt, next, ret;
 	ipa_nat_ipv4_rule nat_rule;
 
 	IPACMDBG_H("Received ip address: 0x%x\n", client_lan_ip);
@@ -968,6 +1993,8 @@ int NatApp::ResetPwrSaveIf(uint32_t client_lan_ip)
 		return -1;
 	}
 
+	FlushBatch();
+
 	for(cnt = 0; cnt < IPA_MAX_NUM_WIFI_CLIENTS; cnt++)
 	{
 		if(PwrSaveIfs[cnt] == client_lan_ip)
@@ -977,8 +2004,9 @@ int NatApp::ResetPwrSaveIf(uint32_t client_lan_ip)
 		}
 	}
 
-	for(cnt = 0; cnt < max_entries; cnt++)
+	for(cnt = pclnt_head[HashIp(client_lan_ip) & (NAT_CLNT_BUCKETS - 1)]; cnt >= 0; cnt = next)
 	{
+		next = links[cnt].pnext;
 		IPACMDBG("cache (%d): enable %d, ip 0x%x\n", cnt, cache[cnt].enabled, cache[cnt].private_ip);
 
 		if(cache[cnt].private_ip == client_lan_ip &&
@@ -995,8 +2023,7 @@ int NatApp::ResetPwrSaveIf(uint32_t client_lan_ip)
 			if(ipa_nat_add_ipv4_rule(nat_table_hdl, &nat_rule, &cache[cnt].rule_hdl) < 0)
 			{
 				IPACMERR("unable to add the rule delete from cache\n");
-				memset(&cache[cnt], 0, sizeof(cache[cnt]));
-				curCnt--;
+				FreeEntry(cnt);
 				continue;
 			}
 			cache[cnt].enabled = true;
@@ -1040,16 +2067,161 @@ uint32_t NatApp::GetTableHdl(uint32_t in_ip_addr)
 	return -1;
 }
 
-void NatApp::AddTempEntry(const nat_table_entry *new_entry)
+int NatApp::FindPendingFlow(const nat_table_entry *rule)
 {
 	int cnt;
 
+	for(cnt = pflow_phead[HashIp(rule->private_ip) & pflow_mask]; cnt >= 0;
+		cnt = pflow[cnt].link.pnext)
+	{
+		if(SameTuple(&pflow[cnt].rule, rule))
+		{
+			return cnt;
+		}
+	}
+
+	return -1;
+}
+
+/* Store a flow at the newest end of the age list. A full table first
+   drops the flows past their age, then the oldest one. */
+int NatApp::AddPendingFlow(const nat_table_entry *rule)
+{
+	nat_pending_flow *flow;
+	uint64_t now = GetTimeUs();
+	int slot, *head;
+
+	if(pflow_num_free == 0)
+	{
+		ExpirePendingFlows(now);
+	}
+	if(pflow_num_free == 0 && pflow_oldest >= 0)
+	{
+		IPACMDBG("pending flows full, evict the oldest\n");
+		FreePendingFlow(pflow_oldest);
+		pflow_evicted++;
+	}
+	if(pflow_num_free == 0)
+	{
+		return -1;
+	}
+
+	slot = pflow_free[--pflow_num_free];
+	flow = &pflow[slot];
+	memcpy(&flow->rule, rule, sizeof(nat_table_entry));
+	flow->added_us = now;
+	flow->used = true;
+
+	head = &pflow_phead[HashIp(rule->private_ip) & pflow_mask];
+	flow->link.pprev = -1;
+	flow->link.pnext = *head;
+	if(*head >= 0)
+	{
+		pflow[*head].link.pprev = slot;
+	}
+	*head = slot;
+
+	head = &pflow_thead[HashIp(rule->target_ip) & pflow_mask];
+	flow->link.tprev = -1;
+	flow->link.tnext = *head;
+	if(*head >= 0)
+	{
+		pflow[*head].link.tprev = slot;
+	}
+	*head = slot;
+
+	flow->anext = -1;
+	flow->aprev = pflow_newest;
+	if(pflow_newest >= 0)
+	{
+		pflow[pflow_newest].anext = slot;
+	}
+	else
+	{
+		pflow_oldest = slot;
+	}
+	pflow_newest = slot;
+
+	SnapTemp(slot);
+	return slot;
+}
+
+void NatApp::FreePendingFlow(int slot)
+{
+	nat_pending_flow *flow = &pflow[slot];
+
+	if(flow->link.pprev >= 0)
+	{
+		pflow[flow->link.pprev].link.pnext = flow->link.pnext;
+	}
+	else
+	{
+		pflow_phead[HashIp(flow->rule.private_ip) & pflow_mask] = flow->link.pnext;
+	}
+	if(flow->link.pnext >= 0)
+	{
+		pflow[flow->link.pnext].link.pprev = flow->link.pprev;
+	}
+
+	if(flow->link.tprev >= 0)
+	{
+		pflow[flow->link.tprev].link.tnext = flow->link.tnext;
+	}
+	else
+	{
+		pflow_thead[HashIp(flow->rule.target_ip) & pflow_mask] = flow->link.tnext;
+	}
+	if(flow->link.tnext >= 0)
+	{
+		pflow[flow->link.tnext].link.tprev = flow->link.tprev;
+	}
+
+	if(flow->aprev >= 0)
+	{
+		pflow[flow->aprev].anext = flow->anext;
+	}
+	else
+	{
+		pflow_oldest = flow->anext;
+	}
+	if(flow->anext >= 0)
+	{
+		pflow[flow->anext].aprev = flow->aprev;
+	}
+	else
+	{
+		pflow_newest = flow->aprev;
+	}
+
+	memset(flow, 0, sizeof(nat_pending_flow));
+	pflow_free[pflow_num_free++] = slot;
+	SnapTemp(slot);
+}
+
+/* Drop the flows whose client was not resolved within the max age */
+void NatApp::ExpirePendingFlows(uint64_t now)
+{
+	while(pflow_oldest >= 0 &&
+		now - pflow[pflow_oldest].added_us > (uint64_t)NAT_PFLOW_MAX_AGE_MS * 1000)
+	{
+		IPACMDBG("Expire pending flow\n");
+		iptodot("Private IP", pflow[pflow_oldest].rule.private_ip);
+		iptodot("Target IP", pflow[pflow_oldest].rule.target_ip);
+		FreePendingFlow(pflow_oldest);
+		pflow_expired++;
+	}
+}
+
+void NatApp::AddTempEntry(const nat_table_entry *new_entry)
+{
 	IPACMDBG("Received below Temp Nat entry\n");
 	iptodot("Private IP", new_entry->private_ip);
 	iptodot("Target IP", new_entry->target_ip);
 	IPACMDBG("Private Port: %d\t Target Port: %d\t", new_entry->private_port, new_entry->target_port);
 	IPACMDBG("protocolcol: %d\n", new_entry->protocol);
 
+	FlushBatch();
+
 	if(isAlgPort(new_entry->protocol, new_entry->private_port) ||
 		 isAlgPort(new_entry->protocol, new_entry->target_port))
 	{
@@ -1062,37 +2234,25 @@ void NatApp::AddTempEntry(const nat_table_entry *new_entry)
 		return;
 	}
 
-	for(cnt=0; cnt<MAX_TEMP_ENTRIES; cnt++)
+	if(FindPendingFlow(new_entry) >= 0)
 	{
-		if(temp[cnt].private_ip == new_entry->private_ip &&
-			 temp[cnt].target_ip == new_entry->target_ip &&
-			 temp[cnt].private_port ==  new_entry->private_port  &&
-			 temp[cnt].target_port == new_entry->target_port &&
-			 temp[cnt].protocol == new_entry->protocol)
-		{
-			IPACMDBG("Received duplicate Temp entry\n");
-			return;
-		}
+		IPACMDBG("Received duplicate Temp entry\n");
+		return;
 	}
 
-	for(cnt=0; cnt<MAX_TEMP_ENTRIES; cnt++)
+	if(AddPendingFlow(new_entry) < 0)
 	{
-		if(temp[cnt].private_ip == 0 &&
-			 temp[cnt].target_ip == 0)
-		{
-			memcpy(&temp[cnt], new_entry, sizeof(nat_table_entry));
-			IPACMDBG("Added Temp Entry\n");
-			return;
-		}
+		IPACMERR("Unable to add temp entry\n");
+		return;
 	}
 
-	IPACMDBG("Unable to add temp entry, cache full\n");
+	IPACMDBG("Added Temp Entry\n");
 	return;
 }
 
 void NatApp::DeleteTempEntry(const nat_table_entry *entry)
 {
-	int cnt;
+	int slot;
 
 	IPACMDBG("Received below nat entry\n");
 	iptodot("Private IP", entry->private_ip);
@@ -1100,51 +2260,62 @@ void NatApp::DeleteTempEntry(const nat_table_entry *entry)
 	IPACMDBG("Private Port: %d\t Target Port: %d\n", entry->private_port, entry->target_port);
 	IPACMDBG("protocol: %d\n", entry->protocol);
 
-	for(cnt=0; cnt<MAX_TEMP_ENTRIES; cnt++)
+	slot = FindPendingFlow(entry);
+	if(slot < 0)
 	{
-		if(temp[cnt].private_ip == entry->private_ip &&
-			 temp[cnt].target_ip == entry->target_ip &&
-			 temp[cnt].private_port ==  entry->private_port  &&
-			 temp[cnt].target_port == entry->target_port &&
-			 temp[cnt].protocol == entry->protocol)
-		{
-			memset(&temp[cnt], 0, sizeof(nat_table_entry));
-			IPACMDBG("Delete Temp Entry\n");
-			return;
-		}
+		IPACMDBG("No Such Temp Entry exists\n");
+		return;
 	}
 
-	IPACMDBG("No Such Temp Entry exists\n");
+	FreePendingFlow(slot);
+	IPACMDBG("Delete Temp Entry\n");
 	return;
 }
 
+/* Install or drop the pending flows of one client. Only the private ip
+   and target ip chains of its bucket are walked. */
 void NatApp::FlushTempEntries(uint32_t ip_addr, bool isAdd,
 		bool isDummy)
 {
-	int cnt;
+	nat_table_entry rule;
+	uint32_t bucket;
+	int cnt, next, pass;
 	int ret;
 
 	IPACMDBG_H("Received below with isAdd:%d ", isAdd);
 	iptodot("IP Address: ", ip_addr);
 
-	for(cnt=0; cnt<MAX_TEMP_ENTRIES; cnt++)
+	FlushBatch();
+
+	bucket = HashIp(ip_addr) & pflow_mask;
+	for(pass = 0; pass < 2; pass++)
 	{
-		if(temp[cnt].private_ip == ip_addr ||
-			 temp[cnt].target_ip == ip_addr)
+		for(cnt = (pass == 0) ? pflow_phead[bucket] : pflow_thead[bucket]; cnt >= 0; cnt = next)
 		{
+			next = (pass == 0) ? pflow[cnt].link.pnext : pflow[cnt].link.tnext;
+
+			/* the target ip pass skips flows the private ip pass kept */
+			if((pass == 0 && pflow[cnt].rule.private_ip != ip_addr) ||
+				 (pass == 1 && (pflow[cnt].rule.target_ip != ip_addr ||
+					pflow[cnt].rule.private_ip == ip_addr)))
+			{
+				continue;
+			}
+
 			if(isAdd)
 			{
-				if(temp[cnt].public_ip == pub_ip_addr)
+				if(pflow[cnt].rule.public_ip == pub_ip_addr)
 				{
+					memcpy(&rule, &pflow[cnt].rule, sizeof(nat_table_entry));
 					if (isDummy) {
 						/* To avoild DL expections for non IPA path */
-						temp[cnt].private_ip = temp[cnt].public_ip;
-						temp[cnt].private_port = temp[cnt].public_port;
+						rule.private_ip = rule.public_ip;
+						rule.private_port = rule.public_port;
 						IPACMDBG("Flushing dummy temp rule");
-						iptodot("Private IP", temp[cnt].private_ip);
+						iptodot("Private IP", rule.private_ip);
 					}
 
-					ret = AddEntry(&temp[cnt]);
+					ret = AddEntry(&rule);
 					if(ret)
 					{
 						IPACMERR("unable to add temp entry: %d\n", ret);
@@ -1152,7 +2323,7 @@ void NatApp::FlushTempEntries(uint32_t ip_addr, bool isAdd,
 					}
 				}
 			}
-			memset(&temp[cnt], 0, sizeof(nat_table_entry));
+			FreePendingFlow(cnt);
 		}
 	}
 
@@ -1161,7 +2332,7 @@ void NatApp::FlushTempEntries(uint32_t ip_addr, bool isAdd,
 
 int NatApp::DelEntriesOnClntDiscon(uint32_t ip_addr)
 {
-	int cnt, tmp = 0, ret;
+	int cnt, next, tmp = 0, ret;
 	IPACMDBG_H("Received IP address: 0x%x\n", ip_addr);
 
 	if(ip_addr == INVALID_IP_ADDR)
@@ -1170,6 +2341,8 @@ int NatApp::DelEntriesOnClntDiscon(uint32_t ip_addr)
 		return -1;
 	}
 
+	FlushBatch();
+
 	for(cnt = 0; cnt < IPA_MAX_NUM_WIFI_CLIENTS; cnt++)
 	{
 		if(PwrSaveIfs[cnt] == ip_addr)
@@ -1180,8 +2353,9 @@ int NatApp::DelEntriesOnClntDiscon(uint32_t ip_addr)
 		}
 	}
 
-	for(cnt = 0; cnt < max_entries; cnt++)
+	for(cnt = pclnt_head[HashIp(ip_addr) & (NAT_CLNT_BUCKETS - 1)]; cnt >= 0; cnt = next)
 	{
+		next = links[cnt].pnext;
 		if(cache[cnt].private_ip == ip_addr)
 		{
 			if(cache[cnt].enabled == true)
@@ -1223,7 +2397,7 @@ int NatApp::DelEntriesOnClntDiscon(uint32_t ip_addr)
 
 int NatApp::DelEntriesOnSTAClntDiscon(uint32_t ip_addr)
 {
-	int cnt, tmp = curCnt, ret;
+	int cnt, next, tmp = curCnt, ret;
 	IPACMDBG_H("Received IP address: 0x%x\n", ip_addr);
 
 	if(ip_addr == INVALID_IP_ADDR)
@@ -1232,9 +2406,12 @@ int NatApp::DelEntriesOnSTAClntDiscon(uint32_t ip_addr)
 		return -1;
 	}
 
+	FlushBatch();
 
-	for(cnt = 0; cnt < max_entries; cnt++)
+
+	for(cnt = tclnt_head[HashIp(ip_addr) & hash_mask]; cnt >= 0; cnt = next)
 	{
+		next = links[cnt].tnext;
 		if(cache[cnt].target_ip == ip_addr)
 		{
 			if(cache[cnt].enabled == true)
@@ -1261,8 +2438,7 @@ int NatApp::DelEntriesOnSTAClntDiscon(uint32_t ip_addr)
 				}
 			}
 
-			memset(&cache[cnt], 0, sizeof(cache[cnt]));
-			curCnt--;
+			FreeEntry(cnt);
 		}
 	}
 
@@ -1284,21 +2460,12 @@ void NatApp::CacheEntry(const nat_table_entry *rule)
 		return;
 	}
 
+	FlushBatch();
+
 	if(!ChkForDup(rule))
 	{
-		for(cnt=0; cnt < max_entries; cnt++)
-		{
-			if(cache[cnt].private_ip == 0 &&
-				 cache[cnt].target_ip == 0 &&
-				 cache[cnt].private_port == 0  &&
-				 cache[cnt].target_port == 0 &&
-				 cache[cnt].protocol == 0)
-			{
-				break;
-			}
-		}
-
-		if(max_entries == cnt)
+		cnt = AllocEntry(rule);
+		if(cnt < 0)
 		{
 			IPACMERR("Error: Unable to add, reached maximum rules\n");
 			return;
@@ -1307,18 +2474,12 @@ void NatApp::CacheEntry(const nat_table_entry *rule)
 		{
 			cache[cnt].enabled = false;
 			cache[cnt].rule_hdl = 0;
-			cache[cnt].private_ip = rule->private_ip;
-			cache[cnt].target_ip = rule->target_ip;
-			cache[cnt].target_port = rule->target_port;
-			cache[cnt].private_port = rule->private_port;
-			cache[cnt].protocol = rule->protocol;
 			cache[cnt].timestamp = 0;
 			cache[cnt].public_port = rule->public_port;
 			cache[cnt].public_ip = rule->public_ip;
 			cache[cnt].dst_nat = rule->dst_nat;
-			curCnt++;
+			SnapSlot(cnt);
 		}
-
 	}
 	else
 	{
@@ -0,0 +1,426 @@
+/*
+Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause-Clear
+*/
+/*!
+	@file
+	IPACM_Conntrack_V6Flow.cpp
+
+	@brief
+	This file implements the IPv6 routed flow table functionality
+
+	@Author
+
+*/
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "IPACM_Conntrack_V6Flow.h"
+#include "IPACM_Config.h"
+#include "IPACM_Log.h"
+
+static inline bool SameAddr(const uint32_t *a, const uint32_t *b)
+{
+	return (a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && a[3] == b[3]);
+}
+
+V6FlowApp *V6FlowApp::pInstance = NULL;
+
+V6FlowApp::V6FlowApp()
+{
+	flows = NULL;
+	links = NULL;
+	max_entries = 0;
+	curCnt = 0;
+
+	hash_head = NULL;
+	src_head = NULL;
+	dst_head = NULL;
+	hash_mask = 0;
+
+	free_slots = NULL;
+	num_free_slots = 0;
+
+	sweep_cursor = 0;
+
+	stat_adds = 0;
+	stat_dels = 0;
+	stat_refreshes = 0;
+	stat_expired = 0;
+	stat_drops = 0;
+	num_untracked = 0;
+}
+
+int V6FlowApp::Init(void)
+{
+	IPACM_Config *pConfig;
+	uint32_t hash_size = 1;
+	int cnt;
+
+	pConfig = IPACM_Config::GetInstance();
+	if(pConfig == NULL)
+	{
+		IPACMERR("Unable to get Config instance\n");
+		return -1;
+	}
+
+	/* sized like the ipv4 nat cache */
+	max_entries = pConfig->GetNatMaxEntries();
+	if(max_entries <= 0)
+	{
+		IPACMERR("Invalid ipv6 flow table size %d\n", max_entries);
+		return -1;
+	}
+
+	while(hash_size < (uint32_t)max_entries)
+	{
+		hash_size <<= 1;
+	}
+
+	flows = (v6_flow_entry *)calloc(max_entries, sizeof(v6_flow_entry));
+	links = (v6_flow_link *)calloc(max_entries, sizeof(v6_flow_link));
+	free_slots = (int *)malloc(sizeof(int) * max_entries);
+	hash_head = (int *)malloc(sizeof(int) * hash_size);
+	src_head = (int *)malloc(sizeof(int) * hash_size);
+	dst_head = (int *)malloc(sizeof(int) * hash_size);
+	if(flows == NULL || links == NULL || free_slots == NULL ||
+	   hash_head == NULL || src_head == NULL || dst_head == NULL)
+	{
+		IPACMERR("Unable to allocate memory for ipv6 flow table\n");
+		goto fail;
+	}
+
+	hash_mask = hash_size - 1;
+	memset(hash_head, 0xff, sizeof(int) * hash_size);
+	memset(src_head, 0xff, sizeof(int) * hash_size);
+	memset(dst_head, 0xff, sizeof(int) * hash_size);
+	for(cnt = max_entries - 1; cnt >= 0; cnt--)
+	{
+		free_slots[num_free_slots++] = cnt;
+	}
+
+	IPACMDBG_H("Allocated ipv6 flow table, %d entries %u buckets\n", max_entries, hash_size);
+	return 0;
+
+fail:
+	free(flows);
+	free(links);
+	free(free_slots);
+	free(hash_head);
+	free(src_head);
+	free(dst_head);
+	return -1;
+}
+
+V6FlowApp* V6FlowApp::GetInstance()
+{
+	if(pInstance == NULL)
+	{
+		pInstance = new V6FlowApp();
+
+		if(pInstance->Init())
+		{
+			delete pInstance;
+			pInstance = NULL;
+		}
+	}
+
+	return pInstance;
+}
+
+uint32_t V6FlowApp::HashAddr(const uint32_t *addr)
+{
+	uint32_t h = addr[0] ^ (addr[1] * 0x9E3779B1) ^ (addr[2] * 0x85EBCA6B) ^ (addr[3] * 0xC2B2AE35);
+
+	h ^= h >> 16;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35;
+	h ^= h >> 16;
+	return h;
+}
+
+uint32_t V6FlowApp::HashTuple(const v6_flow_entry *flow)
+{
+	uint32_t h;
+
+	h = HashAddr(flow->src_ip) * 31 + HashAddr(flow->dst_ip);
+	h ^= ((uint32_t)flow->src_port << 16) | flow->dst_port;
+	h ^= (uint32_t)flow->protocol << 8;
+	h ^= h >> 16;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+	return h;
+}
+
+int V6FlowApp::FindFlow(const v6_flow_entry *flow)
+{
+	int cnt;
+
+	for(cnt = hash_head[HashTuple(flow) & hash_mask]; cnt >= 0; cnt = links[cnt].hnext)
+	{
+		if(SameTuple(&flows[cnt], flow))
+		{
+			return cnt;
+		}
+	}
+
+	return -1;
+}
+
+/* Put slot on its tuple chain and at the head of both client chains */
+void V6FlowApp::LinkFlow(int slot)
+{
+	v6_flow_link *link = &links[slot];
+	int *head;
+
+	head = &hash_head[HashTuple(&flows[slot]) & hash_mask];
+	link->hnext = *head;
+	*head = slot;
+
+	head = &src_head[HashAddr(flows[slot].src_ip) & hash_mask];
+	link->sprev = -1;
+	link->snext = *head;
+	if(*head >= 0)
+	{
+		links[*head].sprev = slot;
+	}
+	*head = slot;
+
+	head = &dst_head[HashAddr(flows[slot].dst_ip) & hash_mask];
+	link->dprev = -1;
+	link->dnext = *head;
+	if(*head >= 0)
+	{
+		links[*head].dprev = slot;
+	}
+	*head = slot;
+
+	link->used = true;
+}
+
+void V6FlowApp::UnlinkFlow(int slot)
+{
+	v6_flow_link *link = &links[slot];
+	int *prev;
+
+	/* tuple chains are short, walk to the predecessor */
+	for(prev = &hash_head[HashTuple(&flows[slot]) & hash_mask]; *prev >= 0;
+		prev = &links[*prev].hnext)
+	{
+		if(*prev == slot)
+		{
+			*prev = link->hnext;
+			break;
+		}
+	}
+
+	if(link->sprev >= 0)
+	{
+		links[link->sprev].snext = link->snext;
+	}
+	else
+	{
+		src_head[HashAddr(flows[slot].src_ip) & hash_mask] = link->snext;
+	}
+	if(link->snext >= 0)
+	{
+		links[link->snext].sprev = link->sprev;
+	}
+
+	if(link->dprev >= 0)
+	{
+		links[link->dprev].dnext = link->dnext;
+	}
+	else
+	{
+		dst_head[HashAddr(flows[slot].dst_ip) & hash_mask] = link->dnext;
+	}
+	if(link->dnext >= 0)
+	{
+		links[link->dnext].dprev = link->dprev;
+	}
+
+	link->used = false;
+}
+
+void V6FlowApp::FreeFlow(int slot)
+{
+	UnlinkFlow(slot);
+	memset(&flows[slot], 0, sizeof(v6_flow_entry));
+	free_slots[num_free_slots++] = slot;
+	curCnt--;
+}
+
+int V6FlowApp::AddFlow(const v6_flow_entry *flow, uint32_t timeout, bool *isNew)
+{
+	uint64_t now = GetTimeUs();
+	int slot;
+
+	*isNew = false;
+	if(timeout == 0)
+	{
+		timeout = V6_FLOW_DEF_TIMEOUT_S;
+	}
+
+	slot = FindFlow(flow);
+	if(slot >= 0)
+	{
+		flows[slot].expire_us = now + (uint64_t)timeout * 1000000;
+		flows[slot].refreshes++;
+		stat_refreshes++;
+		return slot;
+	}
+
+	if(num_free_slots == 0)
+	{
+		IPACMDBG("ipv6 flow table full (%d entries)\n", curCnt);
+		stat_drops++;
+		num_untracked++;
+		return -1;
+	}
+
+	slot = free_slots[--num_free_slots];
+	memcpy(&flows[slot], flow, sizeof(v6_flow_entry));
+	flows[slot].added_us = now;
+	flows[slot].expire_us = now + (uint64_t)timeout * 1000000;
+	flows[slot].refreshes = 0;
+	LinkFlow(slot);
+	curCnt++;
+	stat_adds++;
+	*isNew = true;
+
+	IPACMDBG("Added ipv6 flow at %d, proto %d ports %d -> %d, count %d\n",
+		slot, flow->protocol, flow->src_port, flow->dst_port, curCnt);
+	return slot;
+}
+
+/* Push the flow lifetime out to the timeout carried by a conntrack update */
+bool V6FlowApp::RefreshFlow(const v6_flow_entry *flow, uint32_t timeout)
+{
+	int slot;
+
+	slot = FindFlow(flow);
+	if(slot < 0)
+	{
+		return false;
+	}
+
+	if(timeout == 0)
+	{
+		timeout = V6_FLOW_DEF_TIMEOUT_S;
+	}
+	flows[slot].expire_us = GetTimeUs() + (uint64_t)timeout * 1000000;
+	flows[slot].refreshes++;
+	stat_refreshes++;
+	return true;
+}
+
+bool V6FlowApp::DeleteFlow(const v6_flow_entry *flow)
+{
+	int slot;
+
+	slot = FindFlow(flow);
+	if(slot < 0)
+	{
+		IPACMDBG("No such ipv6 flow\n");
+		return false;
+	}
+
+	IPACMDBG("Delete ipv6 flow at %d after %u refreshes\n", slot, flows[slot].refreshes);
+	FreeFlow(slot);
+	stat_dels++;
+	return true;
+}
+
+bool V6FlowApp::ClaimUntracked(void)
+{
+	if(num_untracked == 0)
+	{
+		return false;
+	}
+	num_untracked--;
+	return true;
+}
+
+/* Remove up to max flows from or to addr. Only the two client chains of
+   its bucket are walked. */
+int V6FlowApp::DelFlowsOnClntDiscon(const uint32_t *addr, v6_flow_entry *out, int max)
+{
+	uint32_t bucket;
+	int cnt, next, num = 0;
+
+	bucket = HashAddr(addr) & hash_mask;
+
+	for(cnt = src_head[bucket]; cnt >= 0 && num < max; cnt = next)
+	{
+		next = links[cnt].snext;
+		if(SameAddr(flows[cnt].src_ip, addr))
+		{
+			memcpy(&out[num++], &flows[cnt], sizeof(v6_flow_entry));
+			FreeFlow(cnt);
+			stat_dels++;
+		}
+	}
+
+	for(cnt = dst_head[bucket]; cnt >= 0 && num < max; cnt = next)
+	{
+		next = links[cnt].dnext;
+		if(SameAddr(flows[cnt].dst_ip, addr))
+		{
+			memcpy(&out[num++], &flows[cnt], sizeof(v6_flow_entry));
+			FreeFlow(cnt);
+			stat_dels++;
+		}
+	}
+
+	IPACMDBG_H("Deleted %d ipv6 flows on client disconnect, %d left\n", num, curCnt);
+	return num;
+}
+
+/* Check one shard of slots and reclaim the flows past their conntrack
+   timeout, the cursor wraps so the whole table is covered over time.
+   Nothing is reclaimed while enough slots are free, an expired flow stays
+   matchable so its DESTROY still finds it. */
+int V6FlowApp::ExpireFlows(void)
+{
+	uint64_t now;
+	int end, num = 0;
+
+	if(curCnt == 0 || num_free_slots >= max_entries / V6_FLOW_RECLAIM_DIV)
+	{
+		return 0;
+	}
+
+	now = GetTimeUs();
+	end = sweep_cursor + V6_FLOW_SWEEP_SHARD_SIZE;
+	if(end > max_entries)
+	{
+		end = max_entries;
+	}
+
+	for(; sweep_cursor < end; sweep_cursor++)
+	{
+		if(links[sweep_cursor].used && flows[sweep_cursor].expire_us < now)
+		{
+			FreeFlow(sweep_cursor);
+			stat_expired++;
+			num++;
+		}
+	}
+
+	if(sweep_cursor >= max_entries)
+	{
+		sweep_cursor = 0;
+		PrintStats();
+	}
+
+	return num;
+}
+
+void V6FlowApp::PrintStats()
+{
+	IPACMDBG_H("ipv6 flows: %d of %d used, %u added, %u deleted, %u refreshed, %u expired, %u dropped\n",
+		curCnt, max_entries, stat_adds, stat_dels, stat_refreshes, stat_expired, stat_drops);
+}
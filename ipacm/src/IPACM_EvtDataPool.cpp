@@ -0,0 +1,184 @@
+/*
+Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause-Clear
+*/
+/*!
+	@file
+	IPACM_EvtDataPool.cpp
+
+	@brief
+	This file implements the IPACM event payload pool functionality
+
+	@Author
+
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "IPACM_EvtDataPool.h"
+#include "IPACM_CmdQueue.h"
+#include "IPACM_Log.h"
+
+/* number of preallocated payloads per type */
+static const struct
+{
+	size_t size;
+	uint32_t count;
+	const char *name;
+} evt_pool_cfg[IPACM_EVT_DATA_MAX] =
+{
+	{ sizeof(ipacm_event_data_fid),    64,  "fid" },
+	{ sizeof(ipacm_event_data_mac),    64,  "mac" },
+	{ sizeof(ipacm_event_data_iptype), 16,  "iptype" },
+	{ sizeof(ipacm_event_data_addr),   64,  "addr" },
+	{ sizeof(ipacm_event_data_all),    128, "all" },
+	{ sizeof(ipacm_ct_evt_data),       IPA_CMD_QUEUE_RING_SIZE, "ct" },
+};
+
+ipacm_evt_pool IPACM_EvtDataPool::pools[IPACM_EVT_DATA_MAX];
+pthread_once_t IPACM_EvtDataPool::init_once = PTHREAD_ONCE_INIT;
+
+void IPACM_EvtDataPool::init(void)
+{
+	ipacm_evt_pool *pool;
+	ipacm_evt_pool_elem *elem;
+	size_t elem_size;
+	int i;
+	uint32_t j;
+
+	for(i = 0; i < IPACM_EVT_DATA_MAX; i++)
+	{
+		pool = &pools[i];
+		memset(pool, 0, sizeof(*pool));
+		pthread_mutex_init(&pool->lock, NULL);
+
+		/* keep every element pointer aligned */
+		elem_size = evt_pool_cfg[i].size;
+		if(elem_size < sizeof(ipacm_evt_pool_elem))
+		{
+			elem_size = sizeof(ipacm_evt_pool_elem);
+		}
+		elem_size = (elem_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+
+		pool->arena = (uint8_t *)malloc(elem_size * evt_pool_cfg[i].count);
+		if(pool->arena == NULL)
+		{
+			IPACMERR("unable to allocate %s event pool, fall back to malloc\n", evt_pool_cfg[i].name);
+			continue;
+		}
+		pool->elem_size = elem_size;
+		pool->num_elems = evt_pool_cfg[i].count;
+
+		for(j = pool->num_elems; j > 0; j--)
+		{
+			elem = (ipacm_evt_pool_elem *)(pool->arena + (j - 1) * elem_size);
+			elem->next = pool->free_list;
+			pool->free_list = elem;
+		}
+	}
+}
+
+void* IPACM_EvtDataPool::alloc(ipacm_evt_data_type type)
+{
+	ipacm_evt_pool *pool;
+	ipacm_evt_pool_elem *elem;
+
+	if(type >= IPACM_EVT_DATA_MAX)
+	{
+		IPACMERR("invalid event data type %d\n", type);
+		return NULL;
+	}
+
+	pthread_once(&init_once, init);
+	pool = &pools[type];
+
+	pthread_mutex_lock(&pool->lock);
+	elem = pool->free_list;
+	if(elem != NULL)
+	{
+		pool->free_list = elem->next;
+		pool->in_use++;
+		if(pool->in_use > pool->high_water)
+		{
+			pool->high_water = pool->in_use;
+		}
+	}
+	else
+	{
+		pool->num_fallback++;
+	}
+	pool->num_alloc++;
+	pthread_mutex_unlock(&pool->lock);
+
+	if(elem == NULL)
+	{
+		/* pool exhausted, release() frees it again */
+		IPACMDBG("%s event pool exhausted\n", evt_pool_cfg[type].name);
+		return malloc(evt_pool_cfg[type].size);
+	}
+
+	return (void *)elem;
+}
+
+int IPACM_EvtDataPool::find_pool(void *ptr)
+{
+	uint8_t *p = (uint8_t *)ptr;
+	int i;
+
+	for(i = 0; i < IPACM_EVT_DATA_MAX; i++)
+	{
+		if(pools[i].arena != NULL && p >= pools[i].arena &&
+			p < pools[i].arena + pools[i].elem_size * pools[i].num_elems)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+void IPACM_EvtDataPool::release(void *ptr)
+{
+	ipacm_evt_pool *pool;
+	ipacm_evt_pool_elem *elem;
+	int i;
+
+	if(ptr == NULL)
+	{
+		return;
+	}
+
+	pthread_once(&init_once, init);
+	i = find_pool(ptr);
+	if(i < 0)
+	{
+		free(ptr);
+		return;
+	}
+
+	pool = &pools[i];
+	elem = (ipacm_evt_pool_elem *)ptr;
+
+	pthread_mutex_lock(&pool->lock);
+	elem->next = pool->free_list;
+	pool->free_list = elem;
+	pool->in_use--;
+	pool->num_free++;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void IPACM_EvtDataPool::dump_stats(void)
+{
+	ipacm_evt_pool *pool;
+	int i;
+
+	pthread_once(&init_once, init);
+	for(i = 0; i < IPACM_EVT_DATA_MAX; i++)
+	{
+		pool = &pools[i];
+		pthread_mutex_lock(&pool->lock);
+		IPACMDBG("event pool %s: size %d alloc %d free %d in use %d high water %d fallback %d\n",
+			evt_pool_cfg[i].name, pool->num_elems, pool->num_alloc, pool->num_free,
+			pool->in_use, pool->high_water, pool->num_fallback);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
@@ -42,12 +42,13 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <IPACM_Neighbor.h>
 #include "IPACM_CmdQueue.h"
 #include "IPACM_Defs.h"
+#include "IPACM_EvtDataPool.h"
 
 
-extern pthread_mutex_t mutex;
-extern pthread_cond_t  cond_var;
-
-cmd_evts *IPACM_EvtDispatcher::head = NULL;
+cmd_evts IPACM_EvtDispatcher::listeners[IPACM_EVENT_MAX];
+int IPACM_EvtDispatcher::dispatch_depth = 0;
+int IPACM_EvtDispatcher::dirty[IPACM_EVENT_MAX];
+int IPACM_EvtDispatcher::num_dirty = 0;
 extern uint32_t ipacm_event_stats[IPACM_EVENT_MAX];
 
 int IPACM_EvtDispatcher::PostEvt
@@ -55,7 +56,7 @@ int IPACM_EvtDispatcher::PostEvt
 	 ipacm_cmd_q_data *data
 )
 {
-	Message *item = NULL;
+	cmd_t item;
 	MessageQueue *MsgQueue = NULL;
 
 	if(data->event < IPA_EXTERNAL_EVENT_MAX)
@@ -74,140 +75,147 @@ int IPACM_EvtDispatcher::PostEvt
 		return IPACM_FAILURE;
 	}
 
-	item = new Message();
-	if(item == NULL)
-	{
-		IPACMERR("unable to create new message item\n");
-		return IPACM_FAILURE;
-	}
-
-	item->evt.callback_ptr = IPACM_EvtDispatcher::ProcessEvt;
-	memcpy(&item->evt.data, data, sizeof(ipacm_cmd_q_data));
-
-	if(pthread_mutex_lock(&mutex) != 0)
-	{
-		IPACMERR("unable to lock the mutex\n");
-		return IPACM_FAILURE;
-	}
+	item.callback_ptr = IPACM_EvtDispatcher::ProcessEvt;
+	memcpy(&item.data, data, sizeof(ipacm_cmd_q_data));
 
 	IPACMDBG("Enqueing item\n");
-	MsgQueue->enqueue(item);
-	IPACMDBG("Enqueued item %pK\n", item);
-
-	if(pthread_cond_signal(&cond_var) != 0)
-	{
-		IPACMDBG("unable to lock the mutex\n");
-		/* Release the mutex before you return failure */
-		if(pthread_mutex_unlock(&mutex) != 0)
-		{
-			IPACMERR("unable to unlock the mutex\n");
-			return IPACM_FAILURE;
-		}
-		return IPACM_FAILURE;
-	}
-
-	if(pthread_mutex_unlock(&mutex) != 0)
+	if(MsgQueue->enqueue(&item) != IPACM_SUCCESS)
 	{
-		IPACMERR("unable to unlock the mutex\n");
+		IPACMERR("unable to enqueue event %d\n", data->event);
 		return IPACM_FAILURE;
 	}
+	IPACMDBG("Enqueued event %d\n", data->event);
 
 	return IPACM_SUCCESS;
 }
 
 void IPACM_EvtDispatcher::ProcessEvt(ipacm_cmd_q_data *data)
 {
+	cmd_evts *evts;
+	IPACM_Listener *obj;
+	int i;
 
-	cmd_evts *tmp = head, tmp1;
+	if(data->event >= IPACM_EVENT_MAX)
+	{
+		IPACMERR("invalid event %d\n", data->event);
+		goto free_data;
+	}
 
-	if(head == NULL)
+	evts = &listeners[data->event];
+	if(evts->num == 0)
 	{
-		IPACMDBG("Queue is empty\n");
+		IPACMDBG("No listener for event %d\n", data->event);
 	}
 
-	while(tmp != NULL)
+	/* callbacks may register or de-register listeners, so re-read the
+	   table on every iteration. De-registered slots are set to NULL and
+	   only removed once the outermost dispatch is done. */
+	dispatch_depth++;
+	for(i = 0; i < evts->num; i++)
 	{
-	        memcpy(&tmp1, tmp, sizeof(tmp1));
-		if(data->event == tmp1.event)
+		obj = evts->obj[i];
+		if(obj != NULL)
 		{
 			ipacm_event_stats[data->event]++;
-			tmp1.obj->event_callback(data->event, data->evt_data);
+			obj->event_callback(data->event, data->evt_data);
 			IPACMDBG(" Find matched registered events\n");
 		}
-	        tmp = tmp1.next;
+	}
+	dispatch_depth--;
+
+	if(dispatch_depth == 0)
+	{
+		for(i = 0; i < num_dirty; i++)
+		{
+			compact(&listeners[dirty[i]]);
+		}
+		num_dirty = 0;
 	}
 
 	IPACMDBG(" Finished process events\n");
-			
+
+free_data:
 	if(data->evt_data != NULL)
 	{
 		IPACMDBG("free the event:%d data: %pK\n", data->event, data->evt_data);
-		free(data->evt_data);
+		IPACM_EvtDataPool::release(data->evt_data);
 	}
 	return;
 }
 
-int IPACM_EvtDispatcher::registr(ipa_cm_event_id event, IPACM_Listener *obj)
+void IPACM_EvtDispatcher::compact(cmd_evts *evts)
 {
-	cmd_evts *tmp = head,*nw;
+	int i, j = 0;
 
-	nw = (cmd_evts *)malloc(sizeof(cmd_evts));
-	if(nw != NULL)
+	for(i = 0; i < evts->num; i++)
 	{
-		nw->event = event;
-		nw->obj = obj;
-		nw->next = NULL;
+		if(evts->obj[i] != NULL)
+		{
+			evts->obj[j++] = evts->obj[i];
+		}
 	}
-	else
+	evts->num = j;
+	evts->has_holes = false;
+}
+
+int IPACM_EvtDispatcher::registr(ipa_cm_event_id event, IPACM_Listener *obj)
+{
+	cmd_evts *evts;
+	IPACM_Listener **nw;
+	int size;
+
+	if(event >= IPACM_EVENT_MAX || obj == NULL)
 	{
+		IPACMERR("invalid registration for event %d\n", event);
 		return IPACM_FAILURE;
 	}
 
-	if(head == NULL)
+	evts = &listeners[event];
+	if(evts->num == evts->size)
 	{
-		head = nw;
-	}
-	else
-	{
-		while(tmp->next)
+		size = (evts->size == 0) ? IPA_EVT_LISTENER_INIT_SIZE : 2 * evts->size;
+		if(size > UINT16_MAX)
+		{
+			IPACMERR("too many listeners for event %d\n", event);
+			return IPACM_FAILURE;
+		}
+		nw = (IPACM_Listener **)realloc(evts->obj, size * sizeof(IPACM_Listener *));
+		if(nw == NULL)
 		{
-			tmp = tmp->next;
+			return IPACM_FAILURE;
 		}
-		tmp->next = nw;
+		evts->obj = nw;
+		evts->size = size;
 	}
+	evts->obj[evts->num++] = obj;
+
 	return IPACM_SUCCESS;
 }
 
 
 int IPACM_EvtDispatcher::deregistr(IPACM_Listener *param)
 {
-	cmd_evts *tmp = head,*tmp1,*prev = head;
+	cmd_evts *evts;
+	int i, j;
 
-	while(tmp != NULL)
+	for(i = 0; i < IPACM_EVENT_MAX; i++)
 	{
-		if(tmp->obj == param)
+		evts = &listeners[i];
+		for(j = 0; j < evts->num; j++)
 		{
-			tmp1 = tmp;
-			if(tmp == head)
+			if(evts->obj[j] == param)
 			{
-				head = head->next;
+				evts->obj[j] = NULL;
+				if(!evts->has_holes && dispatch_depth > 0)
+				{
+					dirty[num_dirty++] = i;
+				}
+				evts->has_holes = true;
 			}
-			else if(tmp->next == NULL)
-			{
-				prev->next = NULL;
-			}
-			else
-			{
-				prev->next = tmp->next;
-			}
-
-			tmp = tmp->next;
-			free(tmp1);
 		}
-		else
+		if(evts->has_holes && dispatch_depth == 0)
 		{
-			prev = tmp;
-			tmp = tmp->next;
+			compact(evts);
 		}
 	}
 	return IPACM_SUCCESS;
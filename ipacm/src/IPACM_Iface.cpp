@@ -78,6 +78,7 @@ typedef uint32_t in_addr_t;
 #endif
 #include <IPACM_Netlink.h>
 #include <IPACM_Iface.h>
+#include <IPACM_IfaceRegistry.h>
 #include <IPACM_Lan.h>
 #include <IPACM_Wan.h>
 #include <IPACM_Wlan.h>
@@ -418,67 +419,21 @@ int IPACM_Iface::iface_ipa_index_query
 	 int interface_index
 )
 {
-	int fd;
-	int link = INVALID_IFACE;
-	int i = 0;
-	struct ifreq ifr;
-
+	int link;
 
 	if(IPACM_Iface::ipacmcfg->iface_table == NULL)
 	{
 		IPACMERR("Iface table in IPACM_Config is not available.\n");
-		return link;
+		return INVALID_IFACE;
 	}
 
-	/* Search known linux interface-index and map to IPA interface-index*/
-	for (i = 0; i < IPACM_Iface::ipacmcfg->ipa_num_ipa_interfaces; i++)
+	/* the registry maps the linux interface-index to IPA interface-index */
+	link = IPACM_IfaceRegistry::GetInstance()->GetIpaIndex(interface_index);
+	if(link != INVALID_IFACE)
 	{
-		if (interface_index == IPACM_Iface::ipacmcfg->iface_table[i].netlink_interface_index)
-		{
-			link = i;
-			IPACMDBG("Interface (%s) found: linux(%d) ipa(%d) \n",
-							 IPACM_Iface::ipacmcfg->iface_table[i].iface_name,
-							 IPACM_Iface::ipacmcfg->iface_table[i].netlink_interface_index,
-							 link);
-			return link;
-			break;
-		}
-	}
-
-	/* Search/Configure linux interface-index and map it to IPA interface-index */
-	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
-	{
-		PERROR("get interface name socket create failed");
-		return IPACM_FAILURE;
-	}
-
-	memset(&ifr, 0, sizeof(struct ifreq));
-
-	ifr.ifr_ifindex = interface_index;
-	IPACMDBG_H("Interface index %d\n", interface_index);
-
-	if (ioctl(fd, SIOCGIFNAME, &ifr) < 0)
-	{
-		PERROR("call_ioctl_on_dev: ioctl failed:");
-		close(fd);
-		return IPACM_FAILURE;
-	}
-	close(fd);
-
-	IPACMDBG_H("Received interface name %s\n", ifr.ifr_name);
-	for (i = 0; i < IPACM_Iface::ipacmcfg->ipa_num_ipa_interfaces; i++)
-	{
-		if (strncmp(ifr.ifr_name,
-								IPACM_Iface::ipacmcfg->iface_table[i].iface_name,
-								sizeof(IPACM_Iface::ipacmcfg->iface_table[i].iface_name)) == 0)
-		{
-			IPACMDBG_H("Interface (%s) linux(%d) mapped to ipa(%d) \n", ifr.ifr_name,
-							 IPACM_Iface::ipacmcfg->iface_table[i].netlink_interface_index, i);
-
-			link = i;
-			IPACM_Iface::ipacmcfg->iface_table[i].netlink_interface_index = interface_index;
-			break;
-		}
+		IPACMDBG("Interface (%s) found: linux(%d) ipa(%d) \n",
+						 IPACM_Iface::ipacmcfg->iface_table[link].iface_name,
+						 interface_index, link);
 	}
 
 	return link;
@@ -490,7 +445,6 @@ void IPACM_Iface::iface_addr_query
 	 int interface_index
 )
 {
-	int fd;
 	struct ifreq ifr;
 	struct ifaddrs *myaddrs, *ifa;
 	ipacm_cmd_q_data evt_data;
@@ -498,25 +452,13 @@ void IPACM_Iface::iface_addr_query
 	struct in_addr iface_ipv4;
 
 	/* use linux interface-index to find interface name */
-	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
-	{
-		PERROR("get interface name socket create failed");
-		return ;
-	}
-
 	memset(&ifr, 0, sizeof(struct ifreq));
-
-	ifr.ifr_ifindex = interface_index;
-	IPACMDBG_H("Interface index %d\n", interface_index);
-
-	if (ioctl(fd, SIOCGIFNAME, &ifr) < 0)
+	if (IPACM_IfaceRegistry::GetInstance()->GetName(interface_index, ifr.ifr_name) != IPACM_SUCCESS)
 	{
-		PERROR("call_ioctl_on_dev: ioctl failed:");
-		close(fd);
+		IPACMERR("no interface name for index %d\n", interface_index);
 		return ;
 	}
 	IPACMDBG_H("Interface index %d name: %s\n", interface_index,ifr.ifr_name);
-	close(fd);
 
 	/* query ipv4/v6 address */
     if(getifaddrs(&myaddrs) != 0)
@@ -52,6 +52,8 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <IPACM_Lan.h>
 #include <IPACM_Wan.h>
 #include <IPACM_Iface.h>
+#include <IPACM_IfaceRegistry.h>
+#include <IPACM_ConnClassifier.h>
 #include <IPACM_Log.h>
 
 iface_instances *IPACM_IfaceManager::head = NULL;
@@ -86,6 +88,9 @@ void IPACM_IfaceManager::event_callback(ipa_cm_event_id event, void *param)
 		case IPA_CFG_CHANGE_EVENT:
 				IPACMDBG_H(" RESET IPACM_cfg \n");
 				IPACM_Iface::ipacmcfg->Init();
+				IPACM_IfaceRegistry::GetInstance()->Reindex();
+				/* the private subnets were reloaded with the config */
+				IPACM_ConnClassifier::GetInstance()->Rebuild();
 			break;
 		case IPA_BRIDGE_LINK_UP_EVENT:
 			IPACMDBG_H(" Save the bridge0 mac info in IPACM_cfg \n");
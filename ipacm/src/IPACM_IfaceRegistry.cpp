@@ -0,0 +1,319 @@
+/*
+Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause-Clear
+*/
+/*!
+	@file
+	IPACM_IfaceRegistry.cpp
+
+	@brief
+	This file implements the IPACM interface registry functionality
+
+	@Author
+
+*/
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include "IPACM_IfaceRegistry.h"
+#include "IPACM_Config.h"
+#include "IPACM_Iface.h"
+#include "IPACM_Log.h"
+
+IPACM_IfaceRegistry *IPACM_IfaceRegistry::pInstance = NULL;
+
+IPACM_IfaceRegistry::IPACM_IfaceRegistry()
+{
+	pthread_rwlock_init(&lock, NULL);
+	memset(slots, 0, sizeof(slots));
+	num_entries = 0;
+	hits = 0;
+	misses = 0;
+}
+
+IPACM_IfaceRegistry* IPACM_IfaceRegistry::GetInstance()
+{
+	if(pInstance == NULL)
+	{
+		pInstance = new IPACM_IfaceRegistry();
+	}
+
+	return pInstance;
+}
+
+static inline uint32_t HashIfindex(int ifindex)
+{
+	return ((uint32_t)ifindex * 0x9E3779B1) >> 24;
+}
+
+/* Slot holding ifindex, or -1. Caller holds the lock. */
+int IPACM_IfaceRegistry::FindSlot(int ifindex)
+{
+	uint32_t idx;
+	int cnt;
+
+	idx = HashIfindex(ifindex) & (IFACE_REG_SLOTS - 1);
+	for(cnt = 0; cnt < IFACE_REG_SLOTS && slots[idx].ifindex != 0; cnt++)
+	{
+		if(slots[idx].ifindex == ifindex)
+		{
+			return idx;
+		}
+		idx = (idx + 1) & (IFACE_REG_SLOTS - 1);
+	}
+
+	return -1;
+}
+
+/* Map the entry name onto the iface table. Caller holds the write lock. */
+void IPACM_IfaceRegistry::Resolve(iface_reg_entry *entry)
+{
+	IPACM_Config *cfg = IPACM_Iface::ipacmcfg;
+	int i;
+
+	entry->ipa_index = INVALID_IFACE;
+	entry->category = UNKNOWN_IF;
+
+	if(cfg == NULL || cfg->iface_table == NULL)
+	{
+		return;
+	}
+
+	for(i = 0; i < cfg->ipa_num_ipa_interfaces; i++)
+	{
+		if(strncmp(entry->name, cfg->iface_table[i].iface_name,
+			sizeof(cfg->iface_table[i].iface_name)) == 0)
+		{
+			entry->ipa_index = i;
+			entry->category = cfg->iface_table[i].if_cat;
+			cfg->iface_table[i].netlink_interface_index = entry->ifindex;
+			IPACMDBG_H("Interface (%s) linux(%d) mapped to ipa(%d)\n",
+				entry->name, entry->ifindex, i);
+			return;
+		}
+	}
+}
+
+/* Add or rename ifindex. Caller holds the write lock. */
+void IPACM_IfaceRegistry::Insert(int ifindex, const char *name)
+{
+	iface_reg_entry *entry;
+	uint32_t idx;
+	int slot;
+
+	slot = FindSlot(ifindex);
+	if(slot >= 0)
+	{
+		entry = &slots[slot];
+		entry->gone = false;
+		if(strncmp(entry->name, name, sizeof(entry->name)) == 0)
+		{
+			return;
+		}
+	}
+	else
+	{
+		if(num_entries >= IFACE_REG_SLOTS * 3 / 4)
+		{
+			Purge();
+		}
+		if(num_entries >= IFACE_REG_SLOTS - 1)
+		{
+			IPACMERR("interface registry full, %s(%d) not cached\n", name, ifindex);
+			return;
+		}
+		idx = HashIfindex(ifindex) & (IFACE_REG_SLOTS - 1);
+		while(slots[idx].ifindex != 0)
+		{
+			idx = (idx + 1) & (IFACE_REG_SLOTS - 1);
+		}
+		entry = &slots[idx];
+		entry->ifindex = ifindex;
+		num_entries++;
+	}
+
+	(void)strlcpy(entry->name, name, sizeof(entry->name));
+	Resolve(entry);
+	IPACMDBG("interface registry: %s(%d) ipa(%d) cat %d, %d entries\n",
+		entry->name, ifindex, entry->ipa_index, entry->category, num_entries);
+}
+
+/* Remove ifindex and shift the following probe run back so that lookups
+   never need tombstones. Caller holds the write lock. */
+void IPACM_IfaceRegistry::Remove(int ifindex)
+{
+	uint32_t hole, idx, home;
+	int slot;
+
+	slot = FindSlot(ifindex);
+	if(slot < 0)
+	{
+		return;
+	}
+
+	hole = slot;
+	idx = (hole + 1) & (IFACE_REG_SLOTS - 1);
+	while(slots[idx].ifindex != 0)
+	{
+		home = HashIfindex(slots[idx].ifindex) & (IFACE_REG_SLOTS - 1);
+		/* move the entry if the hole lies on its probe path */
+		if(((idx - home) & (IFACE_REG_SLOTS - 1)) >= ((idx - hole) & (IFACE_REG_SLOTS - 1)))
+		{
+			slots[hole] = slots[idx];
+			hole = idx;
+		}
+		idx = (idx + 1) & (IFACE_REG_SLOTS - 1);
+	}
+	memset(&slots[hole], 0, sizeof(slots[hole]));
+	num_entries--;
+}
+
+/* Drop the deleted links. Caller holds the write lock. */
+void IPACM_IfaceRegistry::Purge()
+{
+	int cnt, num = 0;
+
+	/* a backward shift may move a later entry into cnt, check it again */
+	for(cnt = 0; cnt < IFACE_REG_SLOTS; )
+	{
+		if(slots[cnt].ifindex != 0 && slots[cnt].gone)
+		{
+			Remove(slots[cnt].ifindex);
+			num++;
+			continue;
+		}
+		cnt++;
+	}
+
+	IPACMDBG_H("interface registry: purged %d deleted links, %d entries\n", num, num_entries);
+}
+
+/* Cache an ifindex no link event announced yet */
+bool IPACM_IfaceRegistry::Fill(int ifindex)
+{
+	struct ifreq ifr;
+	int fd;
+
+	if((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+	{
+		IPACMERR("get interface name socket create failed \n");
+		return false;
+	}
+
+	memset(&ifr, 0, sizeof(struct ifreq));
+	ifr.ifr_ifindex = ifindex;
+	if(ioctl(fd, SIOCGIFNAME, &ifr) < 0)
+	{
+		IPACMERR("call_ioctl_on_dev: ioctl failed, interface index %d\n", ifindex);
+		close(fd);
+		return false;
+	}
+	close(fd);
+
+	pthread_rwlock_wrlock(&lock);
+	misses++;
+	Insert(ifindex, ifr.ifr_name);
+	pthread_rwlock_unlock(&lock);
+	return true;
+}
+
+void IPACM_IfaceRegistry::LinkAdd(int ifindex, const char *name)
+{
+	if(ifindex <= 0 || name == NULL || name[0] == '\0')
+	{
+		return;
+	}
+
+	pthread_rwlock_wrlock(&lock);
+	Insert(ifindex, name);
+	pthread_rwlock_unlock(&lock);
+}
+
+void IPACM_IfaceRegistry::LinkDel(int ifindex)
+{
+	int slot;
+
+	pthread_rwlock_wrlock(&lock);
+	slot = FindSlot(ifindex);
+	if(slot >= 0)
+	{
+		slots[slot].gone = true;
+	}
+	IPACMDBG("interface registry: deleted %d, %d entries, %u hits %u misses\n",
+		ifindex, num_entries, hits, misses);
+	pthread_rwlock_unlock(&lock);
+}
+
+void IPACM_IfaceRegistry::Reindex()
+{
+	int cnt;
+
+	pthread_rwlock_wrlock(&lock);
+	for(cnt = 0; cnt < IFACE_REG_SLOTS; cnt++)
+	{
+		if(slots[cnt].ifindex != 0)
+		{
+			Resolve(&slots[cnt]);
+		}
+	}
+	pthread_rwlock_unlock(&lock);
+}
+
+bool IPACM_IfaceRegistry::Lookup(int ifindex, iface_reg_entry *entry)
+{
+	int slot, retry;
+
+	if(ifindex <= 0)
+	{
+		return false;
+	}
+
+	for(retry = 0; retry < 2; retry++)
+	{
+		pthread_rwlock_rdlock(&lock);
+		slot = FindSlot(ifindex);
+		if(slot >= 0)
+		{
+			memcpy(entry, &slots[slot], sizeof(iface_reg_entry));
+			__atomic_fetch_add(&hits, 1, __ATOMIC_RELAXED);
+			pthread_rwlock_unlock(&lock);
+			return true;
+		}
+		pthread_rwlock_unlock(&lock);
+
+		if(retry == 0 && !Fill(ifindex))
+		{
+			break;
+		}
+	}
+
+	return false;
+}
+
+int IPACM_IfaceRegistry::GetName(int ifindex, char *name)
+{
+	iface_reg_entry entry;
+
+	if(!Lookup(ifindex, &entry))
+	{
+		return IPACM_FAILURE;
+	}
+
+	(void)strlcpy(name, entry.name, IF_NAME_LEN);
+	return IPACM_SUCCESS;
+}
+
+int IPACM_IfaceRegistry::GetIpaIndex(int ifindex)
+{
+	iface_reg_entry entry;
+
+	if(!Lookup(ifindex, &entry))
+	{
+		return INVALID_IFACE;
+	}
+
+	return entry.ipa_index;
+}
@@ -101,6 +101,7 @@ typedef uint32_t in_addr_t;
 
 #include "IPACM_CmdQueue.h"
 #include "IPACM_EvtDispatcher.h"
+#include "IPACM_EvtDataPool.h"
 #include "IPACM_Defs.h"
 #include "IPACM_Neighbor.h"
 #include "IPACM_IfaceManager.h"
@@ -187,6 +188,17 @@ void* netlink_start(void *param)
 		return NULL;
 	}
 
+	/* the listener is subscribed, replay what the kernel already has */
+	if (ipa_nl_prime_state() != IPACM_SUCCESS)
+	{
+		IPACMERR("Failed to prime startup state, wait for netlink events\n");
+	}
+
+	if (ipa_nl_listener_start(&sk_fdset) != IPACM_SUCCESS)
+	{
+		IPACMERR("Failed to start NL listener\n");
+	}
+
 	return NULL;
 }
 
@@ -399,7 +411,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("AP Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-                        data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+                        data_fid = (ipacm_event_data_fid *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_FID);
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_wlan data_fid\n");
@@ -416,7 +428,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("AP Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-                        data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+                        data_fid = (ipacm_event_data_fid *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_FID);
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_wlan data_fid\n");
@@ -432,7 +444,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("STA Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-			data = (ipacm_event_data_mac *)malloc(sizeof(ipacm_event_data_mac));
+			data = (ipacm_event_data_mac *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_MAC);
 			if(data == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_wlan data_fid\n");
@@ -452,7 +464,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("STA Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-                        data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+                        data_fid = (ipacm_event_data_fid *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_FID);
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_wlan data_fid\n");
@@ -469,7 +481,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-		        data = (ipacm_event_data_mac *)malloc(sizeof(ipacm_event_data_mac));
+		        data = (ipacm_event_data_mac *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_MAC);
 		        if (data == NULL)
 		        {
 		    	        IPACMERR("unable to allocate memory for event_wlan data\n");
@@ -541,7 +553,7 @@ void* ipa_driver_msg_notifier(void *param)
 			evt_data.evt_data = data_ex;
 
 			/* Construct new_neighbor msg with netdev device internally */
-			new_neigh_data = (ipacm_event_data_all*)malloc(sizeof(ipacm_event_data_all));
+			new_neigh_data = (ipacm_event_data_all *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ALL);
 			if(new_neigh_data == NULL)
 			{
 				IPACMERR("Failed to allocate memory.\n");
@@ -579,7 +591,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-		        data = (ipacm_event_data_mac *)malloc(sizeof(ipacm_event_data_mac));
+		        data = (ipacm_event_data_mac *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_MAC);
 		        if (data == NULL)
 		        {
 		    	        IPACMERR("unable to allocate memory for event_wlan data\n");
@@ -599,7 +611,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-		        data = (ipacm_event_data_mac *)malloc(sizeof(ipacm_event_data_mac));
+		        data = (ipacm_event_data_mac *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_MAC);
 		        if (data == NULL)
 		        {
 		    	        IPACMERR("unable to allocate memory for event_wlan data\n");
@@ -619,7 +631,7 @@ void* ipa_driver_msg_notifier(void *param)
 			IPACMDBG_H("Mac Address %02x:%02x:%02x:%02x:%02x:%02x\n",
 							 event_wlan->mac_addr[0], event_wlan->mac_addr[1], event_wlan->mac_addr[2],
 							 event_wlan->mac_addr[3], event_wlan->mac_addr[4], event_wlan->mac_addr[5]);
-		        data = (ipacm_event_data_mac *)malloc(sizeof(ipacm_event_data_mac));
+		        data = (ipacm_event_data_mac *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_MAC);
 		        if (data == NULL)
 		        {
 		    	       IPACMERR("unable to allocate memory for event_wlan data\n");
@@ -636,7 +648,7 @@ void* ipa_driver_msg_notifier(void *param)
 		case ECM_CONNECT:
 			memcpy(&event_ecm, buffer + sizeof(struct ipa_msg_meta), sizeof(struct ipa_ecm_msg));
 			IPACMDBG_H("Received ECM_CONNECT name: %s\n",event_ecm.name);
-			data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+			data_fid = (ipacm_event_data_fid *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_FID);
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_ecm data_fid\n");
@@ -650,7 +662,7 @@ void* ipa_driver_msg_notifier(void *param)
 		case ECM_DISCONNECT:
 			memcpy(&event_ecm, buffer + sizeof(struct ipa_msg_meta), sizeof(struct ipa_ecm_msg));
 			IPACMDBG_H("Received ECM_DISCONNECT name: %s\n",event_ecm.name);
-			data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+			data_fid = (ipacm_event_data_fid *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_FID);
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_ecm data_fid\n");
@@ -664,7 +676,7 @@ void* ipa_driver_msg_notifier(void *param)
 		case WAN_UPSTREAM_ROUTE_ADD:
 			memcpy(&event_wan, buffer + sizeof(struct ipa_msg_meta), sizeof(struct ipa_wan_msg));
 			IPACMDBG_H("Received WAN_UPSTREAM_ROUTE_ADD name: %s, tethered name: %s\n", event_wan.upstream_ifname, event_wan.tethered_ifname);
-			data_iptype = (ipacm_event_data_iptype *)malloc(sizeof(ipacm_event_data_iptype));
+			data_iptype = (ipacm_event_data_iptype *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_IPTYPE);
 			if(data_iptype == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_ecm data_iptype\n");
@@ -691,7 +703,7 @@ void* ipa_driver_msg_notifier(void *param)
 		case WAN_UPSTREAM_ROUTE_DEL:
 			memcpy(&event_wan, buffer + sizeof(struct ipa_msg_meta), sizeof(struct ipa_wan_msg));
 			IPACMDBG_H("Received WAN_UPSTREAM_ROUTE_DEL name: %s, tethered name: %s\n", event_wan.upstream_ifname, event_wan.tethered_ifname);
-			data_iptype = (ipacm_event_data_iptype *)malloc(sizeof(ipacm_event_data_iptype));
+			data_iptype = (ipacm_event_data_iptype *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_IPTYPE);
 			if(data_iptype == NULL)
 			{
 				IPACMERR("unable to allocate memory for event_ecm data_iptype\n");
@@ -710,7 +722,7 @@ void* ipa_driver_msg_notifier(void *param)
 		case WAN_EMBMS_CONNECT:
 			memcpy(&event_wan, buffer + sizeof(struct ipa_msg_meta), sizeof(struct ipa_wan_msg));
 			IPACMDBG("Received WAN_EMBMS_CONNECT name: %s\n",event_wan.upstream_ifname);
-			data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+			data_fid = (ipacm_event_data_fid *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_FID);
 			if(data_fid == NULL)
 			{
 				IPACMERR("unable to allocate memory for event data_fid\n");
@@ -0,0 +1,198 @@
+/*
+Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause-Clear
+*/
+/*!
+	@file
+	IPACM_NatSnapshot.cpp
+
+	@brief
+	This file implements the NAT cache warm restart snapshot functionality
+
+	@Author
+
+*/
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "IPACM_NatSnapshot.h"
+#include "IPACM_Defs.h"
+#include "IPACM_Log.h"
+
+/* every record is a checksum word followed by the payload, 4 byte aligned */
+#define NAT_SNAP_REC_HDR         sizeof(uint32_t)
+#define NAT_SNAP_REC_STRIDE(sz)  (NAT_SNAP_REC_HDR + (((sz) + 3) & ~(size_t)3))
+
+IPACM_NatSnapshot::IPACM_NatSnapshot()
+{
+	base = NULL;
+	len = 0;
+	restored = false;
+	memset(&layout, 0, sizeof(layout));
+	memset(offset, 0, sizeof(offset));
+}
+
+IPACM_NatSnapshot::~IPACM_NatSnapshot()
+{
+	Close();
+}
+
+/* FNV-1a, never 0 so that 0 can mark an empty record */
+uint32_t IPACM_NatSnapshot::Checksum(const void *data, size_t size)
+{
+	const uint8_t *p = (const uint8_t *)data;
+	uint32_t h = 0x811C9DC5;
+	size_t cnt;
+
+	for(cnt = 0; cnt < size; cnt++)
+	{
+		h ^= p[cnt];
+		h *= 0x01000193;
+	}
+
+	return (h == 0) ? 1 : h;
+}
+
+int IPACM_NatSnapshot::Open(const char *file, const nat_snap_region *regions, int num_regions)
+{
+	nat_snap_hdr *hdr;
+	struct stat st;
+	void *addr;
+	int fd, cnt;
+
+	if(base != NULL)
+	{
+		IPACMERR("nat snapshot already open\n");
+		return IPACM_FAILURE;
+	}
+	if(num_regions <= 0 || num_regions > NAT_SNAP_MAX_REGIONS)
+	{
+		IPACMERR("invalid nat snapshot region count %d\n", num_regions);
+		return IPACM_FAILURE;
+	}
+
+	memset(&layout, 0, sizeof(layout));
+	layout.magic = NAT_SNAP_MAGIC;
+	layout.version = NAT_SNAP_VERSION;
+	layout.num_regions = num_regions;
+	len = sizeof(nat_snap_hdr);
+	for(cnt = 0; cnt < num_regions; cnt++)
+	{
+		layout.region[cnt] = regions[cnt];
+		offset[cnt] = len;
+		len += NAT_SNAP_REC_STRIDE(regions[cnt].size) * regions[cnt].count;
+	}
+	layout.checksum = Checksum(&layout, offsetof(nat_snap_hdr, checksum));
+
+	fd = open(file, O_RDWR | O_CREAT | O_CLOEXEC, 0660);
+	if(fd < 0)
+	{
+		IPACMERR("unable to open nat snapshot %s (%d)\n", file, errno);
+		return IPACM_FAILURE;
+	}
+
+	restored = (fstat(fd, &st) == 0 && st.st_size == (off_t)len);
+	if(!restored && ftruncate(fd, len) < 0)
+	{
+		IPACMERR("unable to size nat snapshot %s (%d)\n", file, errno);
+		close(fd);
+		return IPACM_FAILURE;
+	}
+
+	addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	/* the mapping keeps the file referenced */
+	close(fd);
+	if(addr == MAP_FAILED)
+	{
+		IPACMERR("unable to map nat snapshot %s (%d)\n", file, errno);
+		return IPACM_FAILURE;
+	}
+	base = (uint8_t *)addr;
+
+	hdr = (nat_snap_hdr *)base;
+	if(restored && memcmp(hdr, &layout, sizeof(layout)) != 0)
+	{
+		IPACMDBG_H("nat snapshot version %u does not match layout, discard it\n", hdr->version);
+		restored = false;
+	}
+	if(!restored)
+	{
+		memset(base, 0, len);
+		memcpy(hdr, &layout, sizeof(layout));
+	}
+
+	IPACMDBG_H("nat snapshot %s mapped, %zu bytes, %s\n", file, len,
+		restored ? "restored" : "empty");
+	return IPACM_SUCCESS;
+}
+
+void IPACM_NatSnapshot::Close()
+{
+	if(base != NULL)
+	{
+		munmap(base, len);
+		base = NULL;
+	}
+	restored = false;
+}
+
+uint8_t* IPACM_NatSnapshot::RecPtr(int region, uint32_t idx)
+{
+	if(base == NULL || region < 0 || region >= (int)layout.num_regions ||
+	   idx >= layout.region[region].count)
+	{
+		return NULL;
+	}
+
+	return base + offset[region] + NAT_SNAP_REC_STRIDE(layout.region[region].size) * idx;
+}
+
+void IPACM_NatSnapshot::Save(int region, uint32_t idx, const void *rec)
+{
+	uint8_t *ptr;
+	uint32_t *sum;
+	uint32_t size;
+
+	ptr = RecPtr(region, idx);
+	if(ptr == NULL)
+	{
+		return;
+	}
+	sum = (uint32_t *)ptr;
+	size = layout.region[region].size;
+
+	/* invalidate first, a crash between the two stores loses the record
+	   instead of leaving a mix of old and new contents */
+	*sum = 0;
+	if(rec == NULL)
+	{
+		return;
+	}
+	memcpy(ptr + NAT_SNAP_REC_HDR, rec, size);
+	*sum = Checksum(rec, size);
+}
+
+bool IPACM_NatSnapshot::Load(int region, uint32_t idx, void *rec)
+{
+	uint8_t *ptr;
+	uint32_t sum, size;
+
+	ptr = RecPtr(region, idx);
+	if(ptr == NULL)
+	{
+		return false;
+	}
+	sum = *(uint32_t *)ptr;
+	size = layout.region[region].size;
+
+	if(sum == 0 || sum != Checksum(ptr + NAT_SNAP_REC_HDR, size))
+	{
+		return false;
+	}
+	memcpy(rec, ptr + NAT_SNAP_REC_HDR, size);
+	return true;
+}
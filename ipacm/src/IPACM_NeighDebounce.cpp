@@ -0,0 +1,205 @@
+/*
+Copyright (c) 2025 Qualcomm Innovation Center, Inc. All rights reserved.
+
+SPDX-License-Identifier: BSD-3-Clause-Clear
+*/
+/*!
+	@file
+	IPACM_NeighDebounce.cpp
+
+	@brief
+	This file implements the IPACM neighbor event debouncer functionality
+
+	@Author
+
+*/
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <linux/neighbour.h>
+#include "IPACM_NeighDebounce.h"
+#include "IPACM_Log.h"
+
+static uint8_t ReachClass(uint16_t state)
+{
+	if(state & (NUD_REACHABLE | NUD_STALE | NUD_DELAY | NUD_PROBE | NUD_PERMANENT | NUD_NOARP))
+	{
+		return NEIGH_DB_REACH_VALID;
+	}
+	if(state & NUD_INCOMPLETE)
+	{
+		return NEIGH_DB_REACH_PEND;
+	}
+	if(state & NUD_FAILED)
+	{
+		return NEIGH_DB_REACH_FAILED;
+	}
+
+	return NEIGH_DB_REACH_NONE;
+}
+
+IPACM_NeighDebounce *IPACM_NeighDebounce::pInstance = NULL;
+
+IPACM_NeighDebounce::IPACM_NeighDebounce()
+{
+	memset(slots, 0, sizeof(slots));
+	num_entries = 0;
+	forwarded = 0;
+	suppressed = 0;
+	untracked = 0;
+}
+
+IPACM_NeighDebounce* IPACM_NeighDebounce::GetInstance()
+{
+	if(pInstance == NULL)
+	{
+		pInstance = new IPACM_NeighDebounce();
+	}
+
+	return pInstance;
+}
+
+uint32_t IPACM_NeighDebounce::Hash(int ifindex, const uint32_t *ip)
+{
+	uint32_t h = ip[0] ^ (ip[1] * 0x9E3779B1) ^ (ip[2] * 0x85EBCA6B) ^ (ip[3] * 0xC2B2AE35);
+
+	h ^= (uint32_t)ifindex * 0x27D4EB2F;
+	h ^= h >> 16;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+	return h;
+}
+
+int IPACM_NeighDebounce::FindSlot(int ifindex, int family, const uint32_t *ip)
+{
+	uint32_t idx;
+	int cnt;
+
+	idx = Hash(ifindex, ip) & (NEIGH_DB_SLOTS - 1);
+	for(cnt = 0; cnt < NEIGH_DB_SLOTS && slots[idx].ifindex != 0; cnt++)
+	{
+		if(slots[idx].ifindex == ifindex && slots[idx].family == family &&
+			memcmp(slots[idx].ip, ip, sizeof(slots[idx].ip)) == 0)
+		{
+			return idx;
+		}
+		idx = (idx + 1) & (NEIGH_DB_SLOTS - 1);
+	}
+
+	return -1;
+}
+
+/* Clear slot and shift the following probe run back so that lookups
+   never need tombstones */
+void IPACM_NeighDebounce::RemoveSlot(int slot)
+{
+	uint32_t hole, idx, home;
+
+	hole = slot;
+	idx = (hole + 1) & (NEIGH_DB_SLOTS - 1);
+	while(slots[idx].ifindex != 0)
+	{
+		home = Hash(slots[idx].ifindex, slots[idx].ip) & (NEIGH_DB_SLOTS - 1);
+		if(((idx - home) & (NEIGH_DB_SLOTS - 1)) >= ((idx - hole) & (NEIGH_DB_SLOTS - 1)))
+		{
+			slots[hole] = slots[idx];
+			hole = idx;
+		}
+		idx = (idx + 1) & (NEIGH_DB_SLOTS - 1);
+	}
+	memset(&slots[hole], 0, sizeof(slots[hole]));
+	num_entries--;
+}
+
+bool IPACM_NeighDebounce::Forward(int ifindex, int family, const uint32_t *ip,
+	const uint8_t *mac, uint16_t state)
+{
+	neigh_db_entry *entry;
+	uint64_t now = GetTimeUs();
+	uint8_t reach = ReachClass(state);
+	uint32_t idx;
+	int slot;
+
+	slot = FindSlot(ifindex, family, ip);
+	if(slot >= 0)
+	{
+		entry = &slots[slot];
+		if(entry->reach == reach &&
+			memcmp(entry->mac, mac, sizeof(entry->mac)) == 0 &&
+			now - entry->fwd_us < (uint64_t)NEIGH_DB_REFRESH_MS * 1000)
+		{
+			suppressed++;
+			return false;
+		}
+	}
+	else
+	{
+		/* keep the table at most 3/4 full, past that just forward */
+		if(num_entries >= NEIGH_DB_SLOTS * 3 / 4)
+		{
+			untracked++;
+			forwarded++;
+			return true;
+		}
+		idx = Hash(ifindex, ip) & (NEIGH_DB_SLOTS - 1);
+		while(slots[idx].ifindex != 0)
+		{
+			idx = (idx + 1) & (NEIGH_DB_SLOTS - 1);
+		}
+		entry = &slots[idx];
+		entry->ifindex = ifindex;
+		entry->family = family;
+		memcpy(entry->ip, ip, sizeof(entry->ip));
+		num_entries++;
+	}
+
+	memcpy(entry->mac, mac, sizeof(entry->mac));
+	entry->reach = reach;
+	entry->fwd_us = now;
+	forwarded++;
+	return true;
+}
+
+void IPACM_NeighDebounce::Forget(int ifindex, int family, const uint32_t *ip)
+{
+	int slot;
+
+	slot = FindSlot(ifindex, family, ip);
+	if(slot >= 0)
+	{
+		RemoveSlot(slot);
+	}
+}
+
+void IPACM_NeighDebounce::FlushIface(int ifindex)
+{
+	int cnt, num = 0;
+
+	if(num_entries == 0)
+	{
+		return;
+	}
+
+	/* a backward shift may move a later entry into cnt, check it again */
+	for(cnt = 0; cnt < NEIGH_DB_SLOTS; )
+	{
+		if(slots[cnt].ifindex == ifindex)
+		{
+			RemoveSlot(cnt);
+			num++;
+			continue;
+		}
+		cnt++;
+	}
+
+	if(num > 0)
+	{
+		IPACMDBG("flushed %d neighbors of interface %d, %d left\n", num, ifindex, num_entries);
+	}
+}
+
+void IPACM_NeighDebounce::PrintStats()
+{
+	IPACMDBG_H("neighbor debounce: %d tracked, %u forwarded, %u suppressed, %u untracked\n",
+		num_entries, forwarded, suppressed, untracked);
+}
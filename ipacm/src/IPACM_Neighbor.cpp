@@ -37,31 +37,421 @@ IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 	Skylar Chang
 
 */
-
 #include <sys/ioctl.h>
 #include <IPACM_Neighbor.h>
 #include <IPACM_EvtDispatcher.h>
 #include "IPACM_Defs.h"
 #include "IPACM_Log.h"
+#include "IPACM_EvtDataPool.h"
+
 
+static time_t GetTimeSec()
+{
+	return (time_t)(GetTimeUs() / 1000000);
+}
 
 IPACM_Neighbor::IPACM_Neighbor()
 {
+	uint32_t hash_size = 1;
+	int i;
+
 	num_neighbor_client = 0;
-	circular_index = 0;
-	memset(neighbor_client, 0, IPA_MAX_NUM_NEIGHBOR_CLIENTS * sizeof(ipa_neighbor_client));
+	max_neighbor_client = IPACM_Iface::ipacmcfg->GetNeighborClients();
+	lru_head = -1;
+	lru_tail = -1;
+	num_evicted = 0;
+	num_aged = 0;
+
+	while(hash_size < (uint32_t)max_neighbor_client)
+	{
+		hash_size <<= 1;
+	}
+	hash_mask = hash_size - 1;
+
+	neighbor_client = (ipa_neighbor_client *)calloc(max_neighbor_client, sizeof(ipa_neighbor_client));
+	hash_head = (int *)malloc(sizeof(int) * hash_size);
+	free_client = (int *)malloc(sizeof(int) * max_neighbor_client);
+	if (neighbor_client == NULL || hash_head == NULL || free_client == NULL)
+	{
+		IPACMERR("Unable to allocate neighbor client table\n");
+		free(neighbor_client);
+		free(hash_head);
+		free(free_client);
+		neighbor_client = NULL;
+		hash_head = NULL;
+		free_client = NULL;
+		max_neighbor_client = 0;
+		hash_mask = 0;
+	}
+	else
+	{
+		memset(hash_head, 0xff, sizeof(int) * hash_size);
+	}
+
+	num_free_client = 0;
+	for (i = max_neighbor_client - 1; i >= 0; i--)
+	{
+		free_client[num_free_client++] = i;
+	}
+	IPACMDBG_H("Neighbor client table: %d entries %u buckets\n", max_neighbor_client, hash_size);
+
 	IPACM_EvtDispatcher::registr(IPA_WLAN_CLIENT_ADD_EVENT_EX, this);
 	IPACM_EvtDispatcher::registr(IPA_NEW_NEIGH_EVENT, this);
 	IPACM_EvtDispatcher::registr(IPA_DEL_NEIGH_EVENT, this);
 	return;
 }
 
+uint32_t IPACM_Neighbor::HashMac(const uint8_t *mac)
+{
+	uint32_t h;
+
+	/* the low bytes vary the most, the OUI is shared by many clients */
+	h = ((uint32_t)mac[2] << 24) | ((uint32_t)mac[3] << 16) | ((uint32_t)mac[4] << 8) | mac[5];
+	h ^= ((uint32_t)mac[0] << 8) | mac[1];
+	h ^= h >> 16;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+	return h;
+}
+
+int IPACM_Neighbor::FindClient(const uint8_t *mac)
+{
+	int i;
+
+	if (neighbor_client == NULL)
+	{
+		return -1;
+	}
+
+	for (i = hash_head[HashMac(mac) & hash_mask]; i >= 0; i = neighbor_client[i].hnext)
+	{
+		if (memcmp(neighbor_client[i].mac_addr, mac, sizeof(neighbor_client[i].mac_addr)) == 0)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/* Move idx to the head of the last seen list */
+void IPACM_Neighbor::TouchClient(int idx)
+{
+	ipa_neighbor_client *client = &neighbor_client[idx];
+
+	client->last_seen = GetTimeSec();
+	if (lru_head == idx)
+	{
+		return;
+	}
+
+	/* unlink, a new entry is on no list yet */
+	if (client->lprev >= 0)
+	{
+		neighbor_client[client->lprev].lnext = client->lnext;
+		if (client->lnext >= 0)
+		{
+			neighbor_client[client->lnext].lprev = client->lprev;
+		}
+		else
+		{
+			lru_tail = client->lprev;
+		}
+	}
+
+	client->lprev = -1;
+	client->lnext = lru_head;
+	if (lru_head >= 0)
+	{
+		neighbor_client[lru_head].lprev = idx;
+	}
+	lru_head = idx;
+	if (lru_tail < 0)
+	{
+		lru_tail = idx;
+	}
+}
+
+void IPACM_Neighbor::DelClient(int idx)
+{
+	ipa_neighbor_client *client = &neighbor_client[idx];
+	int *prev;
+
+	for (prev = &hash_head[HashMac(client->mac_addr) & hash_mask]; *prev >= 0;
+		prev = &neighbor_client[*prev].hnext)
+	{
+		if (*prev == idx)
+		{
+			*prev = client->hnext;
+			break;
+		}
+	}
+
+	if (client->lprev >= 0)
+	{
+		neighbor_client[client->lprev].lnext = client->lnext;
+	}
+	else
+	{
+		lru_head = client->lnext;
+	}
+	if (client->lnext >= 0)
+	{
+		neighbor_client[client->lnext].lprev = client->lprev;
+	}
+	else
+	{
+		lru_tail = client->lprev;
+	}
+
+	memset(client, 0, sizeof(ipa_neighbor_client));
+	free_client[num_free_client++] = idx;
+	num_neighbor_client--;
+}
+
+/* Drop the clients not seen for IPA_NEIGHBOR_MAX_AGE_S, oldest first */
+void IPACM_Neighbor::ExpireClients(time_t now)
+{
+	while (lru_tail >= 0 && now - neighbor_client[lru_tail].last_seen > IPA_NEIGHBOR_MAX_AGE_S)
+	{
+		LogClient("Age out", lru_tail);
+		DelClient(lru_tail);
+		num_aged++;
+	}
+}
+
+int IPACM_Neighbor::AddClient(const uint8_t *mac, int if_index, int ipa_if_num, const char *iface_name)
+{
+	ipa_neighbor_client *client;
+	int idx, *head;
+
+	if (neighbor_client == NULL)
+	{
+		return -1;
+	}
+
+	if (num_free_client == 0)
+	{
+		ExpireClients(GetTimeSec());
+	}
+	if (num_free_client == 0)
+	{
+		IPACMERR("error:  neighbor client oversize! evict least recently seen %d-st entry ! \n", lru_tail);
+		LogClient("Evict", lru_tail);
+		DelClient(lru_tail);
+		num_evicted++;
+	}
+
+	idx = free_client[--num_free_client];
+	client = &neighbor_client[idx];
+	memcpy(client->mac_addr, mac, sizeof(client->mac_addr));
+	client->iface_index = if_index;
+	/* cache the network interface client associated */
+	client->ipa_if_num = ipa_if_num;
+	strlcpy(client->iface_name, iface_name, sizeof(client->iface_name));
+	client->used = true;
+
+	head = &hash_head[HashMac(mac) & hash_mask];
+	client->hnext = *head;
+	*head = idx;
+	client->lprev = -1;
+	client->lnext = -1;
+	TouchClient(idx);
+	num_neighbor_client++;
+
+	IPACMDBG_H("Cache client MAC %02x:%02x:%02x:%02x:%02x:%02x\n, total client: %d, %u evicted %u aged\n",
+				mac[0], mac[1], mac[2], mac[3], mac[4], mac[5],
+				num_neighbor_client, num_evicted, num_aged);
+	return idx;
+}
+
+/* Add or refresh addr, the newest address is kept last */
+void IPACM_Neighbor::AddV4Addr(int idx, uint32_t addr)
+{
+	ipa_neighbor_client *client = &neighbor_client[idx];
+
+	DelV4Addr(idx, addr);
+	/* full, forget the oldest address */
+	if (client->num_v4_addr == IPA_NEIGHBOR_MAX_V4_ADDR)
+	{
+		DelV4Addr(idx, client->v4_addr[0]);
+	}
+	client->v4_addr[client->num_v4_addr] = addr;
+	client->v4_seen[client->num_v4_addr] = GetTimeSec();
+	client->num_v4_addr++;
+}
+
+void IPACM_Neighbor::DelV4Addr(int idx, uint32_t addr)
+{
+	ipa_neighbor_client *client = &neighbor_client[idx];
+	int i;
+
+	for (i = 0; i < client->num_v4_addr; i++)
+	{
+		if (client->v4_addr[i] == addr)
+		{
+			memmove(&client->v4_addr[i], &client->v4_addr[i + 1],
+				sizeof(client->v4_addr[0]) * (client->num_v4_addr - i - 1));
+			memmove(&client->v4_seen[i], &client->v4_seen[i + 1],
+				sizeof(client->v4_seen[0]) * (client->num_v4_addr - i - 1));
+			client->num_v4_addr--;
+			return;
+		}
+	}
+}
+
+void IPACM_Neighbor::AddV6Addr(int idx, const uint32_t *addr)
+{
+	ipa_neighbor_client *client = &neighbor_client[idx];
+
+	DelV6Addr(idx, addr);
+	/* full, forget the oldest address */
+	if (client->num_v6_addr == IPA_NEIGHBOR_MAX_V6_ADDR)
+	{
+		DelV6Addr(idx, client->v6_addr[0]);
+	}
+	memcpy(client->v6_addr[client->num_v6_addr], addr, sizeof(client->v6_addr[0]));
+	client->v6_seen[client->num_v6_addr] = GetTimeSec();
+	client->num_v6_addr++;
+}
+
+void IPACM_Neighbor::DelV6Addr(int idx, const uint32_t *addr)
+{
+	ipa_neighbor_client *client = &neighbor_client[idx];
+	uint32_t key[4];
+	int i;
+
+	/* addr may point into the array being shifted */
+	memcpy(key, addr, sizeof(key));
+	for (i = 0; i < client->num_v6_addr; i++)
+	{
+		if (memcmp(client->v6_addr[i], key, sizeof(client->v6_addr[i])) == 0)
+		{
+			memmove(client->v6_addr[i], client->v6_addr[i + 1],
+				sizeof(client->v6_addr[0]) * (client->num_v6_addr - i - 1));
+			memmove(&client->v6_seen[i], &client->v6_seen[i + 1],
+				sizeof(client->v6_seen[0]) * (client->num_v6_addr - i - 1));
+			client->num_v6_addr--;
+			return;
+		}
+	}
+}
+
+/* Forget the addresses not seen for IPA_NEIGHBOR_ADDR_AGE_S, they are
+   kept in last seen order so the stale ones are a prefix */
+void IPACM_Neighbor::ExpireClientAddrs(int idx, time_t now)
+{
+	ipa_neighbor_client *client = &neighbor_client[idx];
+	int num;
+
+	for (num = 0; num < client->num_v4_addr && now - client->v4_seen[num] > IPA_NEIGHBOR_ADDR_AGE_S; num++);
+	if (num > 0)
+	{
+		client->num_v4_addr -= num;
+		memmove(&client->v4_addr[0], &client->v4_addr[num], sizeof(client->v4_addr[0]) * client->num_v4_addr);
+		memmove(&client->v4_seen[0], &client->v4_seen[num], sizeof(client->v4_seen[0]) * client->num_v4_addr);
+		IPACMDBG_H("Aged out %d ipv4 addrs of %d-st client\n", num, idx);
+	}
+
+	for (num = 0; num < client->num_v6_addr && now - client->v6_seen[num] > IPA_NEIGHBOR_ADDR_AGE_S; num++);
+	if (num > 0)
+	{
+		client->num_v6_addr -= num;
+		memmove(client->v6_addr[0], client->v6_addr[num], sizeof(client->v6_addr[0]) * client->num_v6_addr);
+		memmove(&client->v6_seen[0], &client->v6_seen[num], sizeof(client->v6_seen[0]) * client->num_v6_addr);
+		IPACMDBG_H("Aged out %d ipv6 addrs of %d-st client\n", num, idx);
+	}
+}
+
+static int PostNeighAddr(const ipa_neighbor_client *client, ipa_ip_type iptype,
+	uint32_t v4_addr, const uint32_t *v6_addr, ipa_cm_event_id event)
+{
+	ipacm_event_data_all *data_all;
+	ipacm_cmd_q_data evt_data;
+
+	data_all = (ipacm_event_data_all *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ALL);
+	if (data_all == NULL)
+	{
+		IPACMERR("Unable to allocate memory\n");
+		return IPACM_FAILURE;
+	}
+	memset(data_all, 0, sizeof(ipacm_event_data_all));
+	data_all->iptype = iptype;
+	if (iptype == IPA_IP_v4)
+	{
+		data_all->ipv4_addr = v4_addr; //use previous ipv4 address
+	}
+	else
+	{
+		memcpy(data_all->ipv6_addr, v6_addr, sizeof(data_all->ipv6_addr));
+	}
+	data_all->if_index = client->iface_index;
+	memcpy(data_all->mac_addr, client->mac_addr, sizeof(data_all->mac_addr));
+	strlcpy(data_all->iface_name, client->iface_name, sizeof(data_all->iface_name));
+
+	evt_data.event = event;
+	evt_data.evt_data = (void *)data_all;
+	IPACM_EvtDispatcher::PostEvt(&evt_data);
+	IPACMDBG_H("Posted event %d with %s for ipv%d client re-connect\n",
+		evt_data.event, data_all->iface_name, (iptype == IPA_IP_v4) ? 4 : 6);
+	return IPACM_SUCCESS;
+}
+
+/* Replay the cached addresses of the client with event. An add only
+   carries what the iface keeps per client, the newest ipv4 address and the
+   newest IPV6_NUM_ADDR ipv6 ones, so stale addresses cannot take the slots
+   of the current ones. A delete carries them all. */
+void IPACM_Neighbor::PostClientAddrs(int idx, ipa_cm_event_id event)
+{
+	ipa_neighbor_client *client = &neighbor_client[idx];
+	int i, num_v4, num_v6;
+
+	ExpireClientAddrs(idx, GetTimeSec());
+
+	num_v4 = client->num_v4_addr;
+	num_v6 = client->num_v6_addr;
+	if (event == IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT)
+	{
+		num_v4 = (num_v4 > 1) ? 1 : num_v4;
+		num_v6 = (num_v6 > IPV6_NUM_ADDR) ? IPV6_NUM_ADDR : num_v6;
+	}
+
+	for (i = client->num_v4_addr - 1; i >= client->num_v4_addr - num_v4; i--)
+	{
+		if (PostNeighAddr(client, IPA_IP_v4, client->v4_addr[i], NULL, event) != IPACM_SUCCESS)
+		{
+			return;
+		}
+	}
+	for (i = client->num_v6_addr - 1; i >= client->num_v6_addr - num_v6; i--)
+	{
+		if (PostNeighAddr(client, IPA_IP_v6, 0, client->v6_addr[i], event) != IPACM_SUCCESS)
+		{
+			return;
+		}
+	}
+}
+
+void IPACM_Neighbor::LogClient(const char *msg, int idx)
+{
+	IPACMDBG_H("%s %d-st Cached client-MAC %02x:%02x:%02x:%02x:%02x:%02x\n, %d v4 %d v6 addrs, total client: %d\n",
+				msg, idx,
+				neighbor_client[idx].mac_addr[0],
+				neighbor_client[idx].mac_addr[1],
+				neighbor_client[idx].mac_addr[2],
+				neighbor_client[idx].mac_addr[3],
+				neighbor_client[idx].mac_addr[4],
+				neighbor_client[idx].mac_addr[5],
+				neighbor_client[idx].num_v4_addr,
+				neighbor_client[idx].num_v6_addr,
+				num_neighbor_client);
+}
+
 void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 {
 	ipacm_event_data_all *data_all = NULL;
 	int i, ipa_interface_index;
 	ipacm_cmd_q_data evt_data;
-	int num_neighbor_client_temp = num_neighbor_client;
 
 	IPACMDBG("Recieved event %d\n", event);
 
@@ -96,62 +486,31 @@ void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 				}
 			}
 
-			for (i = 0; i < num_neighbor_client_temp; i++)
+			/* find the client */
+			i = FindClient(client_mac_addr);
+			if (i >= 0)
 			{
-				/* find the client */
-				if (memcmp(neighbor_client[i].mac_addr, client_mac_addr, sizeof(neighbor_client[i].mac_addr)) == 0)
+				/* check if iface is not bridge interface*/
+				if (strcmp(IPACM_Iface::ipacmcfg->ipa_virtual_iface_name, IPACM_Iface::ipacmcfg->iface_table[ipa_interface_index].iface_name) != 0)
 				{
-					/* check if iface is not bridge interface*/
-					if (strcmp(IPACM_Iface::ipacmcfg->ipa_virtual_iface_name, IPACM_Iface::ipacmcfg->iface_table[ipa_interface_index].iface_name) != 0)
+					/* use previous ipv4 first */
+					if(data->if_index != neighbor_client[i].iface_index)
 					{
-						/* use previous ipv4 first */
-						if(data->if_index != neighbor_client[i].iface_index)
-						{
-							IPACMERR("update new kernel iface index \n");
-							neighbor_client[i].iface_index = data->if_index;
-						}
-
-						/* check if client associated with previous network interface */
-						if(ipa_interface_index != neighbor_client[i].ipa_if_num)
-						{
-							IPACMERR("client associate to different AP \n");
-							return;
-						}
+						IPACMERR("update new kernel iface index \n");
+						neighbor_client[i].iface_index = data->if_index;
+					}
 
-						if (neighbor_client[i].v4_addr != 0) /* not 0.0.0.0 */
-						{
-							evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
-							data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
-							if (data_all == NULL)
-							{
-								IPACMERR("Unable to allocate memory\n");
-								return;
-							}
-							memset(data_all,0,sizeof(ipacm_event_data_all));
-							data_all->iptype = IPA_IP_v4;
-							data_all->if_index = neighbor_client[i].iface_index;
-							data_all->ipv4_addr = neighbor_client[i].v4_addr; //use previous ipv4 address
-							memcpy(data_all->mac_addr,
-									neighbor_client[i].mac_addr,
-												sizeof(data_all->mac_addr));
-							memcpy(data_all->iface_name, neighbor_client[i].iface_name,
-								sizeof(data_all->iface_name));
-							evt_data.evt_data = (void *)data_all;
-							IPACM_EvtDispatcher::PostEvt(&evt_data);
-							/* ask for replaced iface name*/
-							ipa_interface_index = IPACM_Iface::iface_ipa_index_query(data_all->if_index);
-							/* check for failure return */
-							if (IPACM_FAILURE == ipa_interface_index) {
-								IPACMERR("not supported iface id: %d\n", data_all->if_index);
-							} else {
-								IPACMDBG_H("Posted event %d, with %s for ipv4 client re-connect\n",
-									evt_data.event,
-									data_all->iface_name);
-							}
-						}
+					/* check if client associated with previous network interface */
+					if(ipa_interface_index != neighbor_client[i].ipa_if_num)
+					{
+						IPACMERR("client associate to different AP \n");
+						return;
 					}
-					break;
 				}
+
+				TouchClient(i);
+				/* re-learn the cached addresses right away */
+				PostClientAddrs(i, IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT);
 			}
 		}
 		break;
@@ -176,405 +535,173 @@ void IPACM_Neighbor::event_callback(ipa_cm_event_id event, void *param)
 				break;
 			}
 #endif
-			if (data->iptype == IPA_IP_v4)
+			bool has_v4 = (data->iptype == IPA_IP_v4 && data->ipv4_addr != 0);
+			bool has_v6 = (data->iptype != IPA_IP_v4 &&
+				(data->ipv6_addr[0] || data->ipv6_addr[1] || data->ipv6_addr[2] || data->ipv6_addr[3]));
+
+			if (data->iptype == IPA_IP_v4 && !has_v4)
+			{
+				/* 0.0.0.0 */
+				break;
+			}
+
+			if (has_v4)
 			{
-				if (data->ipv4_addr != 0) /* not 0.0.0.0 */
+				IPACMDBG("Got Neighbor event with ipv4 address: 0x%x \n", data->ipv4_addr);
+				/* check if ipv4 address is link local(169.254.xxx.xxx) */
+				if ((data->ipv4_addr & IPV4_ADDR_LINKLOCAL_MASK) == IPV4_ADDR_LINKLOCAL)
 				{
-					IPACMDBG("Got Neighbor event with ipv4 address: 0x%x \n", data->ipv4_addr);
-					/* check if ipv4 address is link local(169.254.xxx.xxx) */
-					if ((data->ipv4_addr & IPV4_ADDR_LINKLOCAL_MASK) == IPV4_ADDR_LINKLOCAL)
+					IPACMDBG_H("This is link local ipv4 address: 0x%x : ignore this NEIGH_EVENT\n", data->ipv4_addr);
+					return;
+				}
+			}
+
+			if (has_v4 || has_v6)
+			{
+				IPACMDBG("Got Neighbor event with ipv%d address \n", has_v4 ? 4 : 6);
+				i = FindClient(data->mac_addr);
+
+				/* check if iface is bridge interface */
+				if (strcmp(IPACM_Iface::ipacmcfg->ipa_virtual_iface_name, data->iface_name) == 0)
+				{
+					/* only clients seen on their own iface can be resolved */
+					if (i < 0)
 					{
-						IPACMDBG_H("This is link local ipv4 address: 0x%x : ignore this NEIGH_EVENT\n", data->ipv4_addr);
-						return;
+						break;
 					}
-					/* check if iface is bridge interface */
-					if (strcmp(IPACM_Iface::ipacmcfg->ipa_virtual_iface_name, data->iface_name) == 0)
+					data->if_index = neighbor_client[i].iface_index;
+					strlcpy(data->iface_name, neighbor_client[i].iface_name, sizeof(data->iface_name));
+					/* construct IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT command and insert to command-queue */
+					if (event == IPA_NEW_NEIGH_EVENT)
 					{
-						/* search if seen this client or not */
-						for (i = 0; i < num_neighbor_client_temp; i++)
-						{
-							if (memcmp(neighbor_client[i].mac_addr, data->mac_addr, sizeof(neighbor_client[i].mac_addr)) == 0)
-							{
-								data->if_index = neighbor_client[i].iface_index;
-								strlcpy(data->iface_name, neighbor_client[i].iface_name, sizeof(data->iface_name));
-								neighbor_client[i].v4_addr = data->ipv4_addr; // cache client's previous ipv4 address
-								/* construct IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT command and insert to command-queue */
-								if (event == IPA_NEW_NEIGH_EVENT)
-									evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
-								else
-									/* not to clean-up the client mac cache on bridge0 delneigh */
-									evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
-								data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
-								if (data_all == NULL)
-								{
-									IPACMERR("Unable to allocate memory\n");
-									return;
-								}
-								memcpy(data_all, data, sizeof(ipacm_event_data_all));
-								evt_data.evt_data = (void *)data_all;
-								IPACM_EvtDispatcher::PostEvt(&evt_data);
-
-								/* ask for replaced iface name*/
-								ipa_interface_index = IPACM_Iface::iface_ipa_index_query(data_all->if_index);
-								/* check for failure return */
-								if (IPACM_FAILURE == ipa_interface_index) {
-									IPACMERR("not supported iface id: %d\n", data_all->if_index);
-								} else {
-									IPACMDBG_H("Posted event %d,\
-										with %s for ipv4\n",
-										evt_data.event,
-										data->iface_name);
-								}
-								break;
-							}
-						}
+						evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
+						/* cache client's address */
+						if (has_v4)
+							AddV4Addr(i, data->ipv4_addr);
+						else
+							AddV6Addr(i, data->ipv6_addr);
+						TouchClient(i);
 					}
 					else
 					{
-						/* construct IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT command and insert to command-queue */
-						if (event == IPA_NEW_NEIGH_EVENT)
-						{
-							evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
-							/* Also save to cache for ipv4 */
-							/*searh if seen this client or not*/
-							for (i = 0; i < num_neighbor_client_temp; i++)
-							{
-								/* find the client */
-								if (memcmp(neighbor_client[i].mac_addr, data->mac_addr, sizeof(neighbor_client[i].mac_addr)) == 0)
-								{
-									/* update the network interface client associated */
-									neighbor_client[i].ipa_if_num = ipa_interface_index;
-									neighbor_client[i].v4_addr = data->ipv4_addr; // cache client's previous ipv4 address
-									strlcpy(neighbor_client[i].iface_name, data->iface_name, sizeof(neighbor_client[i].iface_name));
-									neighbor_client[i].iface_index = data->if_index;
-									IPACMDBG_H("update cache %d-entry, with %s iface, ipv4 address: 0x%x\n",
-										i, data->iface_name, data->ipv4_addr);
-									break;
-								}
-							}
-							/* not find client */
-							if (i == num_neighbor_client_temp)
-							{
-								if (num_neighbor_client_temp < IPA_MAX_NUM_NEIGHBOR_CLIENTS)
-								{
-									memcpy(neighbor_client[num_neighbor_client_temp].mac_addr,
-												data->mac_addr,
-												sizeof(data->mac_addr));
-									neighbor_client[num_neighbor_client_temp].iface_index = data->if_index;
-									/* cache the network interface client associated */
-									neighbor_client[num_neighbor_client_temp].ipa_if_num = ipa_interface_index;
-									neighbor_client[num_neighbor_client_temp].v4_addr = data->ipv4_addr;
-									strlcpy(neighbor_client[num_neighbor_client_temp].iface_name,
-										data->iface_name, sizeof(neighbor_client[num_neighbor_client_temp].iface_name));
-									num_neighbor_client++;
-									IPACMDBG_H("Cache client MAC %02x:%02x:%02x:%02x:%02x:%02x\n, total client: %d\n",
-												neighbor_client[num_neighbor_client_temp].mac_addr[0],
-												neighbor_client[num_neighbor_client_temp].mac_addr[1],
-												neighbor_client[num_neighbor_client_temp].mac_addr[2],
-												neighbor_client[num_neighbor_client_temp].mac_addr[3],
-												neighbor_client[num_neighbor_client_temp].mac_addr[4],
-												neighbor_client[num_neighbor_client_temp].mac_addr[5],
-												num_neighbor_client);
-								}
-								else
-								{
-
-									IPACMERR("error:  neighbor client oversize! recycle %d-st entry ! \n", circular_index);
-									memcpy(neighbor_client[circular_index].mac_addr,
-												data->mac_addr,
-												sizeof(data->mac_addr));
-									neighbor_client[circular_index].iface_index = data->if_index;
-									/* cache the network interface client associated */
-									neighbor_client[circular_index].ipa_if_num = ipa_interface_index;
-									neighbor_client[circular_index].v4_addr = 0;
-									strlcpy(neighbor_client[circular_index].iface_name,
-										data->iface_name, sizeof(neighbor_client[circular_index].iface_name));
-									IPACMDBG_H("Copy wlan-iface client MAC %02x:%02x:%02x:%02x:%02x:%02x\n, total client: %d, circular %d\n",
-													neighbor_client[circular_index].mac_addr[0],
-													neighbor_client[circular_index].mac_addr[1],
-													neighbor_client[circular_index].mac_addr[2],
-													neighbor_client[circular_index].mac_addr[3],
-													neighbor_client[circular_index].mac_addr[4],
-													neighbor_client[circular_index].mac_addr[5],
-													num_neighbor_client,
-													circular_index);
-									circular_index = (circular_index + 1) % IPA_MAX_NUM_NEIGHBOR_CLIENTS;
-								}
-							}
-						}
+						/* not to clean-up the client mac cache on bridge0 delneigh,
+						   only the address so a reconnect does not replay it */
+						evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
+						if (has_v4)
+							DelV4Addr(i, data->ipv4_addr);
 						else
-						{
-							evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
-							/*search if seen this client or not*/
-							for (i = 0; i < num_neighbor_client_temp; i++)
-							{
-								/* find the client */
-								if (memcmp(neighbor_client[i].mac_addr, data->mac_addr, sizeof(neighbor_client[i].mac_addr)) == 0)
-								{
-									IPACMDBG_H("Clean %d-st Cached client-MAC %02x:%02x:%02x:%02x:%02x:%02x\n, total client: %d\n",
-												i,
-												neighbor_client[i].mac_addr[0],
-												neighbor_client[i].mac_addr[1],
-												neighbor_client[i].mac_addr[2],
-												neighbor_client[i].mac_addr[3],
-												neighbor_client[i].mac_addr[4],
-												neighbor_client[i].mac_addr[5],
-												num_neighbor_client);
-
-									memset(neighbor_client[i].mac_addr, 0, sizeof(neighbor_client[i].mac_addr));
-									neighbor_client[i].iface_index = 0;
-									neighbor_client[i].v4_addr = 0;
-									neighbor_client[i].ipa_if_num = 0;
-									memset(neighbor_client[i].iface_name, 0, sizeof(neighbor_client[i].iface_name));
-									for (; i < num_neighbor_client_temp - 1; i++)
-									{
-										memcpy(neighbor_client[i].mac_addr,
-													neighbor_client[i + 1].mac_addr,
-													sizeof(neighbor_client[i].mac_addr));
-										neighbor_client[i].iface_index = neighbor_client[i + 1].iface_index;
-										neighbor_client[i].v4_addr = neighbor_client[i + 1].v4_addr;
-										neighbor_client[i].ipa_if_num = neighbor_client[i + 1].ipa_if_num;
-										strlcpy(neighbor_client[i].iface_name, neighbor_client[i + 1].iface_name,
-											sizeof(neighbor_client[i].iface_name));
-									}
-									num_neighbor_client--;
-									IPACMDBG_H(" total number of left cased clients: %d\n", num_neighbor_client);
-									break;
-								}
-							}
-							/* not find client, no need clean-up */
-						}
-
-						data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
-						if (data_all == NULL)
-						{
-							IPACMERR("Unable to allocate memory\n");
-							return;
-						}
-						memcpy(data_all, data, sizeof(ipacm_event_data_all));
-						evt_data.evt_data = (void *)data_all;
-						IPACM_EvtDispatcher::PostEvt(&evt_data);
-						IPACMDBG_H("Posted event %d with %s for ipv4\n",
-							evt_data.event, data->iface_name);
+							DelV6Addr(i, data->ipv6_addr);
 					}
 				}
-			}
-			else
-			{   //ipv6 starts
-
-				if ((data->ipv6_addr[0]) || (data->ipv6_addr[1]) || (data->ipv6_addr[2]) || (data->ipv6_addr[3]))
+				else if (event == IPA_NEW_NEIGH_EVENT)
 				{
-					IPACMDBG("Got New_Neighbor event with ipv6 address \n");
-					/* check if iface is bridge  interface */
-					if (strcmp(IPACM_Iface::ipacmcfg->ipa_virtual_iface_name, data->iface_name) == 0)
+					evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
+					if (i < 0)
 					{
-						/* search if seen this client or not*/
-						for (i = 0; i < num_neighbor_client_temp; i++)
-						{
-							if (memcmp(neighbor_client[i].mac_addr, data->mac_addr, sizeof(neighbor_client[i].mac_addr)) == 0)
-							{
-								data->if_index = neighbor_client[i].iface_index;
-								strlcpy(data->iface_name, neighbor_client[i].iface_name, sizeof(data->iface_name));
-								/* construct IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT command and insert to command-queue */
-								if (event == IPA_NEW_NEIGH_EVENT)
-									evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
-								else
-									evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
-								data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
-								if (data_all == NULL)
-								{
-									IPACMERR("Unable to allocate memory\n");
-									return;
-								}
-								memcpy(data_all, data, sizeof(ipacm_event_data_all));
-								evt_data.evt_data = (void *)data_all;
-								IPACM_EvtDispatcher::PostEvt(&evt_data);
-								/* ask for replaced iface name*/
-								ipa_interface_index = IPACM_Iface::iface_ipa_index_query(data_all->if_index);
-								/* check for failure return */
-								if (IPACM_FAILURE == ipa_interface_index) {
-									IPACMERR("not supported iface id: %d\n", data_all->if_index);
-								} else {
-									IPACMDBG_H("Posted event %d,\
-										with %s for ipv6\n",
-										evt_data.event,
-										data->iface_name);
-								}
-								break;
-							};
-						}
+						i = AddClient(data->mac_addr, data->if_index, ipa_interface_index, data->iface_name);
 					}
 					else
 					{
-						/* construct IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT command and insert to command-queue */
-						if (event == IPA_NEW_NEIGH_EVENT)
-							evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
+						/* update the network interface client associated */
+						neighbor_client[i].ipa_if_num = ipa_interface_index;
+						strlcpy(neighbor_client[i].iface_name, data->iface_name, sizeof(neighbor_client[i].iface_name));
+						neighbor_client[i].iface_index = data->if_index;
+						TouchClient(i);
+					}
+					if (i >= 0)
+					{
+						/* cache client's address */
+						if (has_v4)
+							AddV4Addr(i, data->ipv4_addr);
 						else
-							evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
-						data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
-						if (data_all == NULL)
-						{
-							IPACMERR("Unable to allocate memory\n");
-							return;
-						}
-						memcpy(data_all, data, sizeof(ipacm_event_data_all));
-						evt_data.evt_data = (void *)data_all;
-						IPACM_EvtDispatcher::PostEvt(&evt_data);
-						IPACMDBG_H("Posted event %d with %s for ipv6\n",
-							evt_data.event, data->iface_name);
+							AddV6Addr(i, data->ipv6_addr);
+						IPACMDBG_H("update cache %d-entry, with %s iface, %d v4 %d v6 addrs\n",
+							i, data->iface_name, neighbor_client[i].num_v4_addr, neighbor_client[i].num_v6_addr);
 					}
 				}
 				else
 				{
-					IPACMDBG(" Got Neighbor event with no ipv6/ipv4 address \n");
-					/*no ipv6 in data searh if seen this client or not*/
-					for (i = 0; i < num_neighbor_client_temp; i++)
+					evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
+					if (i >= 0)
 					{
-						/* find the client */
-						if (memcmp(neighbor_client[i].mac_addr, data->mac_addr, sizeof(neighbor_client[i].mac_addr)) == 0)
+						if (has_v4)
+							DelV4Addr(i, data->ipv4_addr);
+						else
+							DelV6Addr(i, data->ipv6_addr);
+						/* the client is forgotten with its last address */
+						if (neighbor_client[i].num_v4_addr == 0 && neighbor_client[i].num_v6_addr == 0)
 						{
-							IPACMDBG_H(" find %d-st client, MAC %02x:%02x:%02x:%02x:%02x:%02x\n, total client: %d\n",
-												i,
-												neighbor_client[i].mac_addr[0],
-												neighbor_client[i].mac_addr[1],
-												neighbor_client[i].mac_addr[2],
-												neighbor_client[i].mac_addr[3],
-												neighbor_client[i].mac_addr[4],
-												neighbor_client[i].mac_addr[5],
-												num_neighbor_client);
-							/* check if iface is not bridge interface*/
-							if (strcmp(IPACM_Iface::ipacmcfg->ipa_virtual_iface_name, data->iface_name) != 0)
-							{
-								/* use previous ipv4 first */
-								if(data->if_index != neighbor_client[i].iface_index)
-								{
-									IPACMDBG_H("update new kernel iface index \n");
-									neighbor_client[i].iface_index = data->if_index;
-									strlcpy(neighbor_client[i].iface_name, data->iface_name, sizeof(neighbor_client[i].iface_name));
-								}
-
-								/* check if client associated with previous network interface */
-								if(ipa_interface_index != neighbor_client[i].ipa_if_num)
-								{
-									IPACMDBG_H("client associate to different AP \n");
-								}
-
-								if (neighbor_client[i].v4_addr != 0) /* not 0.0.0.0 */
-								{
-									/* construct IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT command and insert to command-queue */
-									if (event == IPA_NEW_NEIGH_EVENT)
-										evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT;
-									else
-										evt_data.event = IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT;
-									data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
-									if (data_all == NULL)
-									{
-										IPACMERR("Unable to allocate memory\n");
-										return;
-									}
-									data_all->iptype = IPA_IP_v4;
-									data_all->if_index = neighbor_client[i].iface_index;
-									data_all->ipv4_addr = neighbor_client[i].v4_addr; //use previous ipv4 address
-									memcpy(data_all->mac_addr, neighbor_client[i].mac_addr,
-										sizeof(data_all->mac_addr));
-									strlcpy(data_all->iface_name, neighbor_client[i].iface_name, sizeof(data_all->iface_name));
-									evt_data.evt_data = (void *)data_all;
-									IPACM_EvtDispatcher::PostEvt(&evt_data);
-									IPACMDBG_H("Posted event %d with %s for ipv4\n",
-										evt_data.event, data_all->iface_name);
-								}
-							}
-							/* delete cache neighbor entry */
-							if (event == IPA_DEL_NEIGH_EVENT)
-							{
-								IPACMDBG_H("Clean %d-st Cached client-MAC %02x:%02x:%02x:%02x:%02x:%02x\n, total client: %d\n",
-									i,
-									neighbor_client[i].mac_addr[0],
-									neighbor_client[i].mac_addr[1],
-									neighbor_client[i].mac_addr[2],
-									neighbor_client[i].mac_addr[3],
-									neighbor_client[i].mac_addr[4],
-									neighbor_client[i].mac_addr[5],
-									num_neighbor_client);
-
-								memset(neighbor_client[i].mac_addr, 0, sizeof(neighbor_client[i].mac_addr));
-								neighbor_client[i].iface_index = 0;
-								neighbor_client[i].v4_addr = 0;
-								neighbor_client[i].ipa_if_num = 0;
-								memset(neighbor_client[i].iface_name, 0, sizeof(neighbor_client[i].iface_name));
-								for(; i < num_neighbor_client_temp - 1; i++)
-								{
-									memcpy(neighbor_client[i].mac_addr,
-										neighbor_client[i + 1].mac_addr,
-										sizeof(neighbor_client[i].mac_addr));
-									neighbor_client[i].iface_index = neighbor_client[i + 1].iface_index;
-									neighbor_client[i].v4_addr = neighbor_client[i + 1].v4_addr;
-									neighbor_client[i].ipa_if_num = neighbor_client[i + 1].ipa_if_num;
-									strlcpy(neighbor_client[i].iface_name, neighbor_client[i + 1].iface_name,
-										sizeof(neighbor_client[i].iface_name));
-								}
-								num_neighbor_client--;
-								IPACMDBG_H(" total number of left cased clients: %d\n", num_neighbor_client);
-							}
-							break;
+							LogClient("Clean", i);
+							DelClient(i);
+							IPACMDBG_H(" total number of left cased clients: %d\n", num_neighbor_client);
 						}
 					}
-					/* not find client */
-					if ((i == num_neighbor_client_temp) && (event == IPA_NEW_NEIGH_EVENT))
+					/* not find client, no need clean-up */
+				}
+
+				data_all = (ipacm_event_data_all *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ALL);
+				if (data_all == NULL)
+				{
+					IPACMERR("Unable to allocate memory\n");
+					return;
+				}
+				memcpy(data_all, data, sizeof(ipacm_event_data_all));
+				evt_data.evt_data = (void *)data_all;
+				IPACM_EvtDispatcher::PostEvt(&evt_data);
+				IPACMDBG_H("Posted event %d with %s for ipv%d\n",
+					evt_data.event, data->iface_name, has_v4 ? 4 : 6);
+			}
+			else
+			{
+				IPACMDBG(" Got Neighbor event with no ipv6/ipv4 address \n");
+				/*no ipv6 in data searh if seen this client or not*/
+				i = FindClient(data->mac_addr);
+				if (i >= 0)
+				{
+					LogClient("Find", i);
+					/* check if iface is not bridge interface*/
+					if (strcmp(IPACM_Iface::ipacmcfg->ipa_virtual_iface_name, data->iface_name) != 0)
 					{
-						/* check if iface is not bridge interface*/
-						if (strcmp(IPACM_Iface::ipacmcfg->ipa_virtual_iface_name, data->iface_name) != 0)
+						/* use previous ipv4 first */
+						if(data->if_index != neighbor_client[i].iface_index)
 						{
-							if (num_neighbor_client_temp < IPA_MAX_NUM_NEIGHBOR_CLIENTS)
-							{
-								memcpy(neighbor_client[num_neighbor_client_temp].mac_addr,
-											data->mac_addr,
-											sizeof(data->mac_addr));
-								neighbor_client[num_neighbor_client_temp].iface_index = data->if_index;
-								/* cache the network interface client associated */
-								neighbor_client[num_neighbor_client_temp].ipa_if_num = ipa_interface_index;
-								neighbor_client[num_neighbor_client_temp].v4_addr = 0;
-								strlcpy(neighbor_client[num_neighbor_client_temp].iface_name, data->iface_name,
-									sizeof(neighbor_client[num_neighbor_client_temp].iface_name));
-								num_neighbor_client++;
-								IPACMDBG_H("Copy client MAC %02x:%02x:%02x:%02x:%02x:%02x\n, total client: %d\n",
-												neighbor_client[num_neighbor_client_temp].mac_addr[0],
-												neighbor_client[num_neighbor_client_temp].mac_addr[1],
-												neighbor_client[num_neighbor_client_temp].mac_addr[2],
-												neighbor_client[num_neighbor_client_temp].mac_addr[3],
-												neighbor_client[num_neighbor_client_temp].mac_addr[4],
-												neighbor_client[num_neighbor_client_temp].mac_addr[5],
-												num_neighbor_client);
-								return;
-							}
-							else
-							{
-								IPACMERR("error:  neighbor client oversize! recycle %d-st entry ! \n", circular_index);
-								memcpy(neighbor_client[circular_index].mac_addr,
-											data->mac_addr,
-											sizeof(data->mac_addr));
-								neighbor_client[circular_index].iface_index = data->if_index;
-								/* cache the network interface client associated */
-								neighbor_client[circular_index].ipa_if_num = ipa_interface_index;
-								neighbor_client[circular_index].v4_addr = 0;
-								strlcpy(neighbor_client[circular_index].iface_name, data->iface_name,
-									sizeof(neighbor_client[circular_index].iface_name));
-								IPACMDBG_H("Copy wlan-iface client MAC %02x:%02x:%02x:%02x:%02x:%02x\n, total client: %d, circular %d\n",
-												neighbor_client[circular_index].mac_addr[0],
-												neighbor_client[circular_index].mac_addr[1],
-												neighbor_client[circular_index].mac_addr[2],
-												neighbor_client[circular_index].mac_addr[3],
-												neighbor_client[circular_index].mac_addr[4],
-												neighbor_client[circular_index].mac_addr[5],
-												num_neighbor_client,
-												circular_index);
-								circular_index = (circular_index + 1) % IPA_MAX_NUM_NEIGHBOR_CLIENTS;
-								return;
-							}
+							IPACMDBG_H("update new kernel iface index \n");
+							neighbor_client[i].iface_index = data->if_index;
+							strlcpy(neighbor_client[i].iface_name, data->iface_name, sizeof(neighbor_client[i].iface_name));
 						}
+
+						/* check if client associated with previous network interface */
+						if(ipa_interface_index != neighbor_client[i].ipa_if_num)
+						{
+							IPACMDBG_H("client associate to different AP \n");
+						}
+
+						/* construct IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT command and insert to command-queue */
+						PostClientAddrs(i, (event == IPA_NEW_NEIGH_EVENT) ?
+							IPA_NEIGH_CLIENT_IP_ADDR_ADD_EVENT : IPA_NEIGH_CLIENT_IP_ADDR_DEL_EVENT);
+					}
+					/* delete cache neighbor entry */
+					if (event == IPA_DEL_NEIGH_EVENT)
+					{
+						LogClient("Clean", i);
+						DelClient(i);
+						IPACMDBG_H(" total number of left cased clients: %d\n", num_neighbor_client);
+					}
+					else
+					{
+						TouchClient(i);
 					}
 				}
-			} //ipv6 ends
+				/* not find client */
+				else if (event == IPA_NEW_NEIGH_EVENT)
+				{
+					/* check if iface is not bridge interface*/
+					if (strcmp(IPACM_Iface::ipacmcfg->ipa_virtual_iface_name, data->iface_name) != 0)
+					{
+						AddClient(data->mac_addr, data->if_index, ipa_interface_index, data->iface_name);
+					}
+				}
+			}
 		}
 		break;
 	}
@@ -82,6 +82,9 @@ typedef uint32_t in_addr_t;
 #include "IPACM_Defs.h"
 #include "IPACM_Netlink.h"
 #include "IPACM_EvtDispatcher.h"
+#include "IPACM_EvtDataPool.h"
+#include "IPACM_IfaceRegistry.h"
+#include "IPACM_NeighDebounce.h"
 #include "IPACM_Log.h"
 
 int ipa_get_if_name(char *if_name, int if_index);
@@ -208,6 +211,32 @@ static int ipa_nl_open_socket
 	return IPACM_SUCCESS;
 }
 
+/* Receive arena reused for every read on the listener thread: the
+   mmsghdr array, one iovec, peer address and buffer per datagram, and the
+   decoded message. */
+typedef struct
+{
+	struct mmsghdr      msgs[IPA_NL_RECV_BATCH];
+	struct iovec        iov[IPA_NL_RECV_BATCH];
+	struct sockaddr_nl  addr[IPA_NL_RECV_BATCH];
+	char                buf[IPA_NL_RECV_BATCH][IPA_NL_MSG_MAX_LEN];
+	ipa_nl_msg_t        nlmsg;
+	bool                ready;
+} ipa_nl_recv_arena_t;
+
+typedef struct
+{
+	uint64_t bytes;
+	uint32_t datagrams;
+	uint32_t msgs;
+	uint32_t decode_fail;
+	uint32_t truncated;
+	uint32_t enobufs;
+} ipa_nl_recv_stats_t;
+
+static ipa_nl_recv_arena_t ipa_nl_arena;
+static ipa_nl_recv_stats_t ipa_nl_stats;
+
 /* Add fd to fdmap array and store read handler function ptr (up to MAX_NUM_OF_FD).*/
 static int ipa_nl_addfd_map
 (
@@ -218,16 +247,12 @@ static int ipa_nl_addfd_map
 {
 	if(info->num_fd < MAX_NUM_OF_FD)
 	{
-		FD_SET(fd, &info->fdset);
-
 		/* Add fd to fdmap array and store read handler function ptr */
 		info->sk_fds[info->num_fd].sk_fd = fd;
 		info->sk_fds[info->num_fd].read_func = read_f;
 
 		/* Increment number of fds stored in fdmap */
 		info->num_fd++;
-		if(info->max_fd < fd)
-			info->max_fd = fd;
 	}
 	else
 	{
@@ -238,219 +263,144 @@ static int ipa_nl_addfd_map
 }
 
 /*  start socket listener */
-static int ipa_nl_sock_listener_start
+int ipa_nl_listener_start
 (
 	 ipa_nl_sk_fd_set_info_t *sk_fd_set
 	 )
 {
-	int i, ret;
+	struct epoll_event ev, events[MAX_NUM_OF_FD];
+	int i, num, idx;
 
-	while(true)
+	sk_fd_set->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(sk_fd_set->epoll_fd < 0)
+	{
+		IPACMERR("ipa_nl epoll create failed (%d)(%s)\n", errno, strerror(errno));
+		return IPACM_FAILURE;
+	}
+
+	/* the fd set is fixed once the listener runs */
+	for(i = 0; i < sk_fd_set->num_fd; i++)
 	{
-	    for(i = 0; i < sk_fd_set->num_fd; i++ )
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.u32 = i;
+		if(epoll_ctl(sk_fd_set->epoll_fd, EPOLL_CTL_ADD, sk_fd_set->sk_fds[i].sk_fd, &ev) < 0)
 		{
-			FD_SET(sk_fd_set->sk_fds[i].sk_fd, &(sk_fd_set->fdset));
+			IPACMERR("ipa_nl cannot add fd=%d (%d)(%s)\n",
+							 sk_fd_set->sk_fds[i].sk_fd, errno, strerror(errno));
+			close(sk_fd_set->epoll_fd);
+			sk_fd_set->epoll_fd = -1;
+			return IPACM_FAILURE;
 		}
+	}
 
-		if((ret = select(sk_fd_set->max_fd + 1, &(sk_fd_set->fdset), NULL, NULL, NULL)) < 0)
+	while(true)
+	{
+		num = epoll_wait(sk_fd_set->epoll_fd, events, MAX_NUM_OF_FD, -1);
+		if(num < 0)
 		{
-			IPACMERR("ipa_nl select failed\n");
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			IPACMERR("ipa_nl epoll_wait failed (%d)(%s)\n", errno, strerror(errno));
+			break;
 		}
-		else
+
+		for(i = 0; i < num; i++)
 		{
-			for(i = 0; i < sk_fd_set->num_fd; i++)
+			idx = events[i].data.u32;
+			if(sk_fd_set->sk_fds[idx].read_func)
 			{
-
-				if(FD_ISSET(sk_fd_set->sk_fds[i].sk_fd, &(sk_fd_set->fdset)))
+				if(IPACM_SUCCESS != ((sk_fd_set->sk_fds[idx].read_func)(sk_fd_set->sk_fds[idx].sk_fd)))
 				{
-
-					if(sk_fd_set->sk_fds[i].read_func)
-					{
-						if(IPACM_SUCCESS != ((sk_fd_set->sk_fds[i].read_func)(sk_fd_set->sk_fds[i].sk_fd)))
-						{
-							IPACMERR("Error on read callback[%d] fd=%d\n",
-											 i,
-											 sk_fd_set->sk_fds[i].sk_fd);
-						}
-						FD_CLR(sk_fd_set->sk_fds[i].sk_fd, &(sk_fd_set->fdset));
-					}
-					else
-					{
-						IPACMERR("No read function\n");
-					}
+					IPACMERR("Error on read callback[%d] fd=%d\n",
+									 idx,
+									 sk_fd_set->sk_fds[idx].sk_fd);
 				}
-
-			} /* end of for loop*/
-		} /* end of else */
+			}
+			else
+			{
+				IPACMERR("No read function\n");
+			}
+		} /* end of for loop*/
 	} /* end of while */
 
-	return IPACM_SUCCESS;
+	close(sk_fd_set->epoll_fd);
+	sk_fd_set->epoll_fd = -1;
+	return IPACM_FAILURE;
 }
 
-/* allocate memory for ipa_nl__msg */
-static struct msghdr* ipa_nl_alloc_msg
+/* point every mmsghdr of the arena at its own buffer and address */
+static void ipa_nl_arena_init
 (
-	 uint32_t msglen
+	 ipa_nl_recv_arena_t *arena
 	 )
 {
-	unsigned char *buf = NULL;
-	struct sockaddr_nl *nladdr = NULL;
-	struct iovec *iov = NULL;
-	struct msghdr *msgh = NULL;
-
-	if(IPA_NL_MSG_MAX_LEN < msglen)
-	{
-		IPACMERR("Netlink message exceeds maximum length\n");
-		return NULL;
-	}
-
-	msgh = (struct msghdr *)malloc(sizeof(struct msghdr));
-	if(msgh == NULL)
-	{
-		IPACMERR("Failed malloc for msghdr\n");
-		return NULL;
-	}
-
-	nladdr = (struct sockaddr_nl *)malloc(sizeof(struct sockaddr_nl));
-	if(nladdr == NULL)
-	{
-		IPACMERR("Failed malloc for sockaddr\n");
-		free(msgh);
-		return NULL;
-	}
+	int i;
 
-	iov = (struct iovec *)malloc(sizeof(struct iovec));
-	if(iov == NULL)
+	memset(arena->msgs, 0, sizeof(arena->msgs));
+	for(i = 0; i < IPA_NL_RECV_BATCH; i++)
 	{
-		PERROR("Failed malloc for iovec");
-		free(nladdr);
-		free(msgh);
-		return NULL;
+		arena->iov[i].iov_base = arena->buf[i];
+		arena->iov[i].iov_len = IPA_NL_MSG_MAX_LEN;
+		arena->msgs[i].msg_hdr.msg_name = &arena->addr[i];
+		arena->msgs[i].msg_hdr.msg_iov = &arena->iov[i];
+		arena->msgs[i].msg_hdr.msg_iovlen = 1;
 	}
-
-	buf = (unsigned char *)malloc(msglen);
-	if(buf == NULL)
-	{
-		IPACMERR("Failed malloc for mglen\n");
-		free(iov);
-		free(nladdr);
-		free(msgh);
-		return NULL;
-	}
-
-	memset(nladdr, 0, sizeof(struct sockaddr_nl));
-	nladdr->nl_family = AF_NETLINK;
-
-	memset(msgh, 0x0, sizeof(struct msghdr));
-	msgh->msg_name = nladdr;
-	msgh->msg_namelen = sizeof(struct sockaddr_nl);
-	msgh->msg_iov = iov;
-	msgh->msg_iovlen = 1;
-
-	memset(iov, 0x0, sizeof(struct iovec));
-	iov->iov_base = buf;
-	iov->iov_len = msglen;
-
-	return msgh;
+	arena->ready = true;
 }
 
-/* release IPA message */
-static void ipa_nl_release_msg
-(
-	 struct msghdr *msgh
-	 )
+static void ipa_nl_log_stats(void)
 {
-	unsigned char *buf = NULL;
-	struct sockaddr_nl *nladdr = NULL;
-	struct iovec *iov = NULL;
-
-	if(NULL == msgh)
-	{
-		return;
-	}
-
-	nladdr = (struct sockaddr_nl *)msgh->msg_name;
-	iov = msgh->msg_iov;
-	if(msgh->msg_iov)
-	{
-		buf = (unsigned char *)msgh->msg_iov->iov_base;
-	}
-
-	if(buf)
-	{
-	free(buf);
-	}
-	if(iov)
-	{
-	free(iov);
-	}
-	if(nladdr)
-	{
-	free(nladdr);
-	}
-	if(msgh)
-	{
-	free(msgh);
-	}
-	return;
+	IPACMDBG_H("netlink: %u msgs in %u datagrams, %llu bytes, %u decode failures, %u truncated, %u ENOBUFS\n",
+		ipa_nl_stats.msgs, ipa_nl_stats.datagrams, (unsigned long long)ipa_nl_stats.bytes,
+		ipa_nl_stats.decode_fail, ipa_nl_stats.truncated, ipa_nl_stats.enobufs);
+	IPACM_NeighDebounce::GetInstance()->PrintStats();
 }
 
-/* receive and process nl message */
+/* receive one batch of nl messages, returns the datagram count, 0 once
+   the socket is drained or -1 on error */
 static int ipa_nl_recv
 (
-	 int              fd,
-	 struct msghdr **msg_pptr,
-	 unsigned int  *msglen_ptr
+	 int fd,
+	 ipa_nl_recv_arena_t *arena
 	 )
 {
-	struct msghdr *msgh = NULL;
-	int rmsgl;
-
-	msgh = ipa_nl_alloc_msg(IPA_NL_MSG_MAX_LEN);
-	if(NULL == msgh)
-	{
-		IPACMERR("Failed to allocate NL message\n");
-		goto error;
-	}
-
-
-	/* Receive message over the socket */
-	rmsgl = recvmsg(fd, msgh, 0);
+	int i, num;
 
-	/* Verify that something was read */
-	if(rmsgl <= 0)
+	if(!arena->ready)
 	{
-		PERROR("NL recv error");
-		goto error;
+		ipa_nl_arena_init(arena);
 	}
 
-	/* Verify that NL address length in the received message is expected value */
-	if(sizeof(struct sockaddr_nl) != msgh->msg_namelen)
+	/* recvmmsg overwrites the lengths, reset them for this batch */
+	for(i = 0; i < IPA_NL_RECV_BATCH; i++)
 	{
-		IPACMERR("rcvd msg with namelen != sizeof sockaddr_nl\n");
-		goto error;
+		arena->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_nl);
+		arena->msgs[i].msg_hdr.msg_flags = 0;
 	}
 
-	/* Verify that message was not truncated. This should not occur */
-	if(msgh->msg_flags & MSG_TRUNC)
+	num = recvmmsg(fd, arena->msgs, IPA_NL_RECV_BATCH, MSG_DONTWAIT, NULL);
+	if(num < 0)
 	{
-		IPACMERR("Rcvd msg truncated!\n");
-		goto error;
+		if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		{
+			return 0;
+		}
+		if(errno == ENOBUFS)
+		{
+			/* kernel dropped messages, the socket itself stays usable */
+			ipa_nl_stats.enobufs++;
+			IPACMERR("NL socket overrun, total %u\n", ipa_nl_stats.enobufs);
+			ipa_nl_log_stats();
+			return 0;
+		}
+		PERROR("NL recv error");
+		return -1;
 	}
 
-	*msg_pptr    = msgh;
-	*msglen_ptr = rmsgl;
-
-	return IPACM_SUCCESS;
-
-/* An error occurred while receiving the message. Free all memory before
-				 returning. */
-error:
-	ipa_nl_release_msg(msgh);
-	*msg_pptr    = NULL;
-	*msglen_ptr  = 0;
-
-	return IPACM_FAILURE;
+	return num;
 }
 
 /* decode the rtm netlink message */
@@ -461,13 +411,26 @@ static int ipa_nl_decode_rtm_link
 	 ipa_nl_link_info_t      *link_info
 )
 {
-	#pragma unused (buflen)
-	struct rtattr;
 	/* NL message header */
 	struct nlmsghdr *nlh = (struct nlmsghdr *)buffer;
+	struct rtattr *rtah = NULL;
 
 	/* Extract the header data */
 	link_info->metainfo = *(struct ifinfomsg *)NLMSG_DATA(nlh);
+	link_info->name[0] = '\0';
+	buflen = IFLA_PAYLOAD(nlh);
+
+	/* Only the interface name is of interest */
+	rtah = IFLA_RTA(NLMSG_DATA(nlh));
+	while(RTA_OK(rtah, buflen))
+	{
+		if(rtah->rta_type == IFLA_IFNAME)
+		{
+			(void)strlcpy(link_info->name, (char *)RTA_DATA(rtah), sizeof(link_info->name));
+			break;
+		}
+		rtah = RTA_NEXT(rtah, buflen);
+	}
 
 	return IPACM_SUCCESS;
 }
@@ -635,6 +598,46 @@ static int ipa_nl_decode_rtm_route
 	return IPACM_SUCCESS;
 }
 
+/* Pass a neighbor update through the debouncer, returns false for a
+   RTM_NEWNEIGH that changes neither the binding nor the reachability.
+   A forwarded update that is not posted after all must be forgotten
+   again, or its retries are suppressed for NEIGH_DB_REFRESH_MS. */
+static bool ipa_nl_neigh_changed
+(
+	 ipa_nl_neigh_info_t *neigh_info,
+	 bool add
+	 )
+{
+	uint32_t ip[4];
+	int family = neigh_info->attr_info.local_addr.ss_family;
+
+	/* bridge fdb updates carry the bridge mac, always report them */
+	if(neigh_info->metainfo.ndm_family == AF_BRIDGE ||
+		 (family != AF_INET && family != AF_INET6))
+	{
+		return true;
+	}
+
+	memset(ip, 0, sizeof(ip));
+	if(family == AF_INET6)
+	{
+		IPACM_EVENT_COPY_ADDR_v6(ip, neigh_info->attr_info.local_addr);
+	}
+	else
+	{
+		IPACM_EVENT_COPY_ADDR_v4(ip[0], neigh_info->attr_info.local_addr);
+	}
+
+	if(!add)
+	{
+		IPACM_NeighDebounce::GetInstance()->Forget(neigh_info->metainfo.ndm_ifindex, family, ip);
+		return true;
+	}
+
+	return IPACM_NeighDebounce::GetInstance()->Forward(neigh_info->metainfo.ndm_ifindex, family, ip,
+		(const uint8_t *)neigh_info->attr_info.lladdr_hwaddr.sa_data, neigh_info->metainfo.ndm_state);
+}
+
 /* decode the ipa nl-message */
 static int ipa_nl_decode_nlmsg
 (
@@ -676,6 +679,12 @@ static int ipa_nl_decode_nlmsg
 				IPACMDBG("RTM_NEWLINK, ifi_flags:%d\n", msg_ptr->nl_link_info.metainfo.ifi_flags);
 				IPACMDBG("RTM_NEWLINK, ifi_index:%d\n", msg_ptr->nl_link_info.metainfo.ifi_index);
 				IPACMDBG("RTM_NEWLINK, family:%d\n", msg_ptr->nl_link_info.metainfo.ifi_family);
+				IPACM_IfaceRegistry::GetInstance()->LinkAdd(msg_ptr->nl_link_info.metainfo.ifi_index,
+					msg_ptr->nl_link_info.name);
+				if(IFF_UP & msg_ptr->nl_link_info.metainfo.ifi_change)
+				{
+					IPACM_NeighDebounce::GetInstance()->FlushIface(msg_ptr->nl_link_info.metainfo.ifi_index);
+				}
 				/* RTM_NEWLINK event with AF_BRIDGE family should be ignored in Android
 				   but this should be processed in case of MDM for Ehernet interface.
 				*/
@@ -696,7 +705,7 @@ static int ipa_nl_decode_nlmsg
 						return IPACM_FAILURE;
 					}
 
-					data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+					data_fid = (ipacm_event_data_fid *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_FID);
 					if(data_fid == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_fid\n");
@@ -734,7 +743,7 @@ static int ipa_nl_decode_nlmsg
                    (msg_ptr->nl_link_info.metainfo.ifi_flags & IFF_LOWER_UP))
                 {
 
-					data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+					data_fid = (ipacm_event_data_fid *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_FID);
 					if(data_fid == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_fid\n");
@@ -767,7 +776,7 @@ static int ipa_nl_decode_nlmsg
                 }
                 else if (!(msg_ptr->nl_link_info.metainfo.ifi_flags & IFF_LOWER_UP))
 				{
-					data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+					data_fid = (ipacm_event_data_fid *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_FID);
 					if(data_fid == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_fid\n");
@@ -833,7 +842,7 @@ static int ipa_nl_decode_nlmsg
 
 				/* post link down to command queue */
 				evt_data.event = IPA_LINK_DOWN_EVENT;
-				data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+				data_fid = (ipacm_event_data_fid *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_FID);
 				if(data_fid == NULL)
 				{
 					IPACMERR("unable to allocate memory for event data_fid\n");
@@ -846,6 +855,12 @@ static int ipa_nl_decode_nlmsg
 								 data_fid->if_index);
 				evt_data.evt_data = data_fid;
 				IPACM_EvtDispatcher::PostEvt(&evt_data);
+				/* a bridge port leaving its bridge is reported as AF_BRIDGE dellink */
+				if(msg_ptr->nl_link_info.metainfo.ifi_family != AF_BRIDGE)
+				{
+					IPACM_IfaceRegistry::GetInstance()->LinkDel(msg_ptr->nl_link_info.metainfo.ifi_index);
+					IPACM_NeighDebounce::GetInstance()->FlushIface(msg_ptr->nl_link_info.metainfo.ifi_index);
+				}
 				/* finish command queue */
 			}
 			break;
@@ -859,6 +874,8 @@ static int ipa_nl_decode_nlmsg
 			}
 			else
 			{
+				/* the iface may only now be handled by ipacm, report its neighbors again */
+				IPACM_NeighDebounce::GetInstance()->FlushIface(msg_ptr->nl_addr_info.metainfo.ifa_index);
 				ret_val = ipa_get_if_name(dev_name, msg_ptr->nl_addr_info.metainfo.ifa_index);
 				if(ret_val != IPACM_SUCCESS)
 				{
@@ -866,7 +883,7 @@ static int ipa_nl_decode_nlmsg
 				}
 				IPACMDBG("Interface %s \n", dev_name);
 
-				data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+				data_addr = (ipacm_event_data_addr *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ADDR);
 				if(data_addr == NULL)
 				{
 					IPACMERR("unable to allocate memory for event data_addr\n");
@@ -931,7 +948,7 @@ static int ipa_nl_decode_nlmsg
 				}
 				IPACMDBG("Interface %s \n", dev_name);
 
-				data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+				data_addr = (ipacm_event_data_addr *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ADDR);
 				if(data_addr == NULL)
 				{
 					IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1022,7 +1039,7 @@ static int ipa_nl_decode_nlmsg
 					temp = (-1);
 
 					evt_data.event = IPA_ROUTE_ADD_EVENT;
-					data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+					data_addr = (ipacm_event_data_addr *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ADDR);
 					if(data_addr == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1055,7 +1072,7 @@ static int ipa_nl_decode_nlmsg
 					if(AF_INET6 == msg_ptr->nl_route_info.metainfo.rtm_family)
 					{
 						/* insert to command queue */
-						data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+						data_addr = (ipacm_event_data_addr *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ADDR);
 						if(data_addr == NULL)
 						{
 							IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1110,7 +1127,7 @@ static int ipa_nl_decode_nlmsg
 						IPACM_NL_REPORT_ADDR( "dstIP:", msg_ptr->nl_route_info.attr_info.dst_addr );
 
 						/* insert to command queue */
-						data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+						data_addr = (ipacm_event_data_addr *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ADDR);
 						if(data_addr == NULL)
 						{
 							IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1163,7 +1180,7 @@ static int ipa_nl_decode_nlmsg
 									 dev_name);
 
 					/* insert to command queue */
-					data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+					data_addr = (ipacm_event_data_addr *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ADDR);
 					if(data_addr == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1222,7 +1239,7 @@ static int ipa_nl_decode_nlmsg
 									 dev_name);
 
 					/* insert to command queue */
-					data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+					data_addr = (ipacm_event_data_addr *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ADDR);
 					if(data_addr == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1283,7 +1300,7 @@ static int ipa_nl_decode_nlmsg
 					IPACMDBG("dev %s\n", dev_name);
 
 					/* insert to command queue */
-					data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+					data_addr = (ipacm_event_data_addr *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ADDR);
 					if(data_addr == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1317,7 +1334,7 @@ static int ipa_nl_decode_nlmsg
 					}
 
 					/* insert to command queue */
-					data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+					data_addr = (ipacm_event_data_addr *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ADDR);
 					if(data_addr == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1404,7 +1421,7 @@ static int ipa_nl_decode_nlmsg
 									 dev_name);
 
 					/* insert to command queue */
-					data_addr = (ipacm_event_data_addr *)malloc(sizeof(ipacm_event_data_addr));
+					data_addr = (ipacm_event_data_addr *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ADDR);
 					if(data_addr == NULL)
 					{
 						IPACMERR("unable to allocate memory for event data_addr\n");
@@ -1476,10 +1493,19 @@ static int ipa_nl_decode_nlmsg
 				return IPACM_FAILURE;
 			}
 
+			if(!ipa_nl_neigh_changed(&msg_ptr->nl_neigh_info, true))
+			{
+				IPACMDBG("neighbor on index %d unchanged, state 0x%x\n",
+								 msg_ptr->nl_neigh_info.metainfo.ndm_ifindex,
+								 msg_ptr->nl_neigh_info.metainfo.ndm_state);
+				break;
+			}
+
 			ret_val = ipa_get_if_name(dev_name, msg_ptr->nl_neigh_info.metainfo.ndm_ifindex);
 			if(ret_val != IPACM_SUCCESS)
 			{
 				IPACMERR("Error while getting interface index\n");
+				ipa_nl_neigh_changed(&msg_ptr->nl_neigh_info, false);
 				return IPACM_FAILURE;
 			}
 			else
@@ -1488,10 +1514,11 @@ static int ipa_nl_decode_nlmsg
 			}
 
 			/* insert to command queue */
-		    data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+		    data_all = (ipacm_event_data_all *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ALL);
 		    if(data_all == NULL)
 			{
 		    	IPACMERR("unable to allocate memory for event data_all\n");
+				ipa_nl_neigh_changed(&msg_ptr->nl_neigh_info, false);
 						return IPACM_FAILURE;
 			}
 
@@ -1553,7 +1580,13 @@ static int ipa_nl_decode_nlmsg
 		    				 msg_ptr->nl_neigh_info.attr_info.local_addr.ss_family);
 			}
 		    evt_data.evt_data = data_all;
-					IPACM_EvtDispatcher::PostEvt(&evt_data);
+			if(IPACM_EvtDispatcher::PostEvt(&evt_data) != IPACM_SUCCESS)
+			{
+				IPACMERR("unable to post neighbor event\n");
+				IPACM_EvtDataPool::release(data_all);
+				ipa_nl_neigh_changed(&msg_ptr->nl_neigh_info, false);
+				return IPACM_FAILURE;
+			}
 					/* finish command queue */
 			break;
 
@@ -1563,6 +1596,7 @@ static int ipa_nl_decode_nlmsg
 				IPACMERR("Failed to decode rtm neighbor message\n");
 				return IPACM_FAILURE;
 			}
+			ipa_nl_neigh_changed(&msg_ptr->nl_neigh_info, false);
 
 			ret_val = ipa_get_if_name(dev_name, msg_ptr->nl_neigh_info.metainfo.ndm_ifindex);
 			if(ret_val != IPACM_SUCCESS)
@@ -1576,7 +1610,7 @@ static int ipa_nl_decode_nlmsg
 			}
 
 				/* insert to command queue */
-				data_all = (ipacm_event_data_all *)malloc(sizeof(ipacm_event_data_all));
+				data_all = (ipacm_event_data_all *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_ALL);
 				if(data_all == NULL)
 				{
 					IPACMERR("unable to allocate memory for event data_all\n");
@@ -1645,63 +1679,76 @@ static int ipa_nl_decode_nlmsg
 /*  Virtual function registered to receive incoming messages over the NETLINK routing socket*/
 int ipa_nl_recv_msg(int fd)
 {
-	struct msghdr *msghdr = NULL;
-	struct iovec *iov = NULL;
-	unsigned int msglen = 0;
-	ipa_nl_msg_t *nlmsg = NULL;
-
-	nlmsg = (ipa_nl_msg_t *)malloc(sizeof(ipa_nl_msg_t));
-	if(NULL == nlmsg)
-	{
-		IPACMERR("Failed alloc of nlmsg \n");
-		goto error;
-	}
-	else
+	ipa_nl_recv_arena_t *arena = &ipa_nl_arena;
+	struct msghdr *msgh;
+	struct nlmsghdr *nlh;
+	uint32_t msgs_before;
+	int batch, num, i, rem;
+
+	msgs_before = ipa_nl_stats.msgs;
+	for(batch = 0; batch < IPA_NL_RECV_BUDGET; batch++)
 	{
-		if(IPACM_SUCCESS != ipa_nl_recv(fd, &msghdr, &msglen))
+		num = ipa_nl_recv(fd, arena);
+		if(num < 0)
 		{
 			IPACMERR("Failed to receive nl message \n");
-			goto error;
+			return IPACM_FAILURE;
 		}
 
-		if(msghdr== NULL)
+		for(i = 0; i < num; i++)
 		{
-			IPACMERR(" failed to get msghdr\n");
-			goto error;
-		}
+			msgh = &arena->msgs[i].msg_hdr;
 
-		iov = msghdr->msg_iov;
+			/* Verify that NL address length in the received message is expected value */
+			if(sizeof(struct sockaddr_nl) != msgh->msg_namelen)
+			{
+				IPACMERR("rcvd msg with namelen != sizeof sockaddr_nl\n");
+				continue;
+			}
 
-		memset(nlmsg, 0, sizeof(ipa_nl_msg_t));
-		if(IPACM_SUCCESS != ipa_nl_decode_nlmsg((char *)iov->iov_base, msglen, nlmsg))
-		{
-			IPACMERR("Failed to decode nl message \n");
-			goto error;
-		}
-		/* Release NetLink message buffer */
-		if(msghdr)
-		{
-			ipa_nl_release_msg(msghdr);
+			/* Verify that message was not truncated. This should not occur */
+			if(msgh->msg_flags & MSG_TRUNC)
+			{
+				ipa_nl_stats.truncated++;
+				IPACMERR("Rcvd msg truncated!\n");
+				continue;
+			}
+
+			ipa_nl_stats.datagrams++;
+			ipa_nl_stats.bytes += arena->msgs[i].msg_len;
+
+			/* decode every message of the datagram on its own, a message
+			   that fails only drops itself */
+			rem = arena->msgs[i].msg_len;
+			for(nlh = (struct nlmsghdr *)arena->buf[i]; NLMSG_OK(nlh, rem); nlh = NLMSG_NEXT(nlh, rem))
+			{
+				if(nlh->nlmsg_type == NLMSG_DONE || nlh->nlmsg_type == NLMSG_ERROR)
+				{
+					continue;
+				}
+
+				ipa_nl_stats.msgs++;
+				memset(&arena->nlmsg, 0, sizeof(ipa_nl_msg_t));
+				if(IPACM_SUCCESS != ipa_nl_decode_nlmsg((char *)nlh, nlh->nlmsg_len, &arena->nlmsg))
+				{
+					ipa_nl_stats.decode_fail++;
+					IPACMERR("Failed to decode nl message type %d\n", nlh->nlmsg_type);
+				}
+			}
 		}
-		if(nlmsg)
+
+		if(num < IPA_NL_RECV_BATCH)
 		{
-			free(nlmsg);
+			break;
 		}
 	}
 
-	return IPACM_SUCCESS;
-
-error:
-	if(msghdr)
-	{
-		ipa_nl_release_msg(msghdr);
-	}
-	if(nlmsg)
+	if(ipa_nl_stats.msgs / IPA_NL_STATS_MSGS != msgs_before / IPA_NL_STATS_MSGS)
 	{
-		free(nlmsg);
+		ipa_nl_log_stats();
 	}
 
-	return IPACM_FAILURE;
+	return IPACM_SUCCESS;
 }
 
 /*  get ipa interface name */
@@ -1711,30 +1758,15 @@ int ipa_get_if_name
 	 int if_index
 	 )
 {
-	int fd;
-	struct ifreq ifr;
-
-	if((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
-	{
-		IPACMERR("get interface name socket create failed \n");
-		return IPACM_FAILURE;
-	}
-
-	memset(&ifr, 0, sizeof(struct ifreq));
-	ifr.ifr_ifindex = if_index;
 	IPACMDBG("Interface index %d\n", if_index);
 
-	if(ioctl(fd, SIOCGIFNAME, &ifr) < 0)
+	if(IPACM_IfaceRegistry::GetInstance()->GetName(if_index, if_name) != IPACM_SUCCESS)
 	{
-		IPACMERR("call_ioctl_on_dev: ioctl failed:\n");
-		close(fd);
+		IPACMERR("no interface name for index %d\n", if_index);
 		return IPACM_FAILURE;
 	}
 
-	(void)strlcpy(if_name, ifr.ifr_name, sizeof(ifr.ifr_name));
-	IPACMDBG("interface name %s\n", ifr.ifr_name);
-	close(fd);
-
+	IPACMDBG("interface name %s\n", if_name);
 	return IPACM_SUCCESS;
 }
 
@@ -1772,11 +1804,173 @@ int ipa_nl_listener_init
 		return IPACM_FAILURE;
 	}
 
-	/* Start the socket listener thread */
-	if(ipa_nl_sock_listener_start(sk_fdset) != IPACM_SUCCESS)
+	return IPACM_SUCCESS;
+}
+
+/* Issue one dump request and decode the replies until NLMSG_DONE */
+static int ipa_nl_dump
+(
+	 int fd,
+	 uint16_t type,
+	 uint8_t family,
+	 uint32_t seq,
+	 char *buf,
+	 ipa_nl_msg_t *nlmsg
+	 )
+{
+	struct
 	{
-		IPACMERR("Failed to start NL listener\n");
+		struct nlmsghdr  nlh;
+		struct ifinfomsg ifm;   /* family first, like every rtnetlink header */
+	} req;
+	struct sockaddr_nl peer;
+	struct nlmsghdr *nlh;
+	struct ifinfomsg *ifm;
+	socklen_t addrlen;
+	int len, num = 0;
+
+	memset(&req, 0, sizeof(req));
+	req.nlh.nlmsg_len = sizeof(req);
+	req.nlh.nlmsg_type = type;
+	req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nlh.nlmsg_seq = seq;
+	req.ifm.ifi_family = family;
+
+	if(send(fd, &req, sizeof(req), 0) < 0)
+	{
+		IPACMERR("dump request %d failed (%d)(%s)\n", type, errno, strerror(errno));
+		return -1;
+	}
+
+	while(true)
+	{
+		addrlen = sizeof(peer);
+		len = recvfrom(fd, buf, IPA_NL_DUMP_BUF_LEN, 0, (struct sockaddr *)&peer, &addrlen);
+		if(len < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			IPACMERR("dump %d recv failed (%d)(%s)\n", type, errno, strerror(errno));
+			return num;
+		}
+
+		for(nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len))
+		{
+			if(nlh->nlmsg_seq != seq || peer.nl_pid != 0)
+			{
+				continue;
+			}
+			if(nlh->nlmsg_type == NLMSG_DONE)
+			{
+				return num;
+			}
+			if(nlh->nlmsg_type == NLMSG_ERROR)
+			{
+				IPACMERR("dump %d failed in kernel (%d)\n", type,
+								 ((struct nlmsgerr *)NLMSG_DATA(nlh))->error);
+				return num;
+			}
+			if(nlh->nlmsg_flags & NLM_F_DUMP_INTR)
+			{
+				IPACMDBG_H("dump %d interrupted by a change, the event follows\n", type);
+			}
+
+			/* report a link that is already up like a link coming up */
+			if(nlh->nlmsg_type == RTM_NEWLINK)
+			{
+				ifm = (struct ifinfomsg *)NLMSG_DATA(nlh);
+				if(ifm->ifi_flags & IFF_UP)
+				{
+					ifm->ifi_change |= IFF_UP;
+				}
+			}
+
+			memset(nlmsg, 0, sizeof(ipa_nl_msg_t));
+			if(IPACM_SUCCESS != ipa_nl_decode_nlmsg((char *)nlh, nlh->nlmsg_len, nlmsg))
+			{
+				ipa_nl_stats.decode_fail++;
+			}
+			num++;
+		}
 	}
+}
+
+/* Dump the links, addresses, routes and neighbors present at startup and
+   post them in that order, as if each had just been reported. Runs on the
+   netlink thread once its socket is subscribed, so a change racing the
+   dump is delivered as a live event afterwards. */
+int ipa_nl_prime_state(void)
+{
+	static const struct
+	{
+		uint16_t type;
+		uint8_t family;
+		const char *name;
+	} dumps[] =
+	{
+		{ RTM_GETLINK,  AF_UNSPEC, "links" },
+		{ RTM_GETADDR,  AF_INET,   "ipv4 addrs" },
+		{ RTM_GETADDR,  AF_INET6,  "ipv6 addrs" },
+		{ RTM_GETROUTE, AF_INET,   "ipv4 routes" },
+		{ RTM_GETROUTE, AF_INET6,  "ipv6 routes" },
+		{ RTM_GETNEIGH, AF_INET,   "ipv4 neighbors" },
+		{ RTM_GETNEIGH, AF_INET6,  "ipv6 neighbors" },
+	};
+	struct sockaddr_nl local;
+	struct timeval tv;
+	struct timespec start, end;
+	char *buf;
+	int fd, i, num, total = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	buf = (char *)malloc(IPA_NL_DUMP_BUF_LEN);
+	if(buf == NULL)
+	{
+		IPACMERR("unable to allocate netlink dump buffer\n");
+		return IPACM_FAILURE;
+	}
+
+	if((fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE)) < 0)
+	{
+		IPACMERR("cannot open netlink dump socket\n");
+		free(buf);
+		return IPACM_FAILURE;
+	}
+
+	/* the kernel picks the port id, the listener socket owns the pid */
+	memset(&local, 0, sizeof(local));
+	local.nl_family = AF_NETLINK;
+	tv.tv_sec = IPA_NL_DUMP_TIMEOUT_S;
+	tv.tv_usec = 0;
+	if(bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0 ||
+		 setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+	{
+		IPACMERR("netlink dump socket setup failed (%d)(%s)\n", errno, strerror(errno));
+		close(fd);
+		free(buf);
+		return IPACM_FAILURE;
+	}
+
+	for(i = 0; i < (int)(sizeof(dumps) / sizeof(dumps[0])); i++)
+	{
+		num = ipa_nl_dump(fd, dumps[i].type, dumps[i].family, i + 1, buf, &ipa_nl_arena.nlmsg);
+		if(num < 0)
+		{
+			continue;
+		}
+		IPACMDBG_H("startup dump: %d %s\n", num, dumps[i].name);
+		total += num;
+	}
+
+	close(fd);
+	free(buf);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	IPACMDBG_H("startup state primed from %d netlink messages in %ld ms\n", total,
+		(long)((end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000));
 
 	return IPACM_SUCCESS;
 }
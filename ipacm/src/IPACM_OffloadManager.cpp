@@ -51,6 +51,7 @@ SPDX-License-Identifier: BSD-3-Clause-Clear
 #include "IPACM_ConntrackListener.h"
 #include "IPACM_Iface.h"
 #include "IPACM_Config.h"
+#include "IPACM_EvtDataPool.h"
 #include <unistd.h>
 
 const char *IPACM_OffloadManager::DEVICE_NAME = "/dev/wwan_ioctl";
@@ -752,7 +753,7 @@ int IPACM_OffloadManager::post_route_evt(enum ipa_ip_type iptype, int index, ipa
 	ipacm_cmd_q_data evt;
 	ipacm_event_data_iptype *evt_data_route;
 
-	evt_data_route = (ipacm_event_data_iptype*)malloc(sizeof(ipacm_event_data_iptype));
+	evt_data_route = (ipacm_event_data_iptype *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_IPTYPE);
 	if(evt_data_route == NULL)
 	{
 		IPACMERR("Failed to allocate memory.\n");
@@ -944,7 +945,7 @@ int IPACM_OffloadManager::push_iface_up(const char * if_name, bool upstream)
 
 	if(strncmp(if_name, "rmnet_data", 10) == 0 && upstream)
 	{
-		data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+		data_fid = (ipacm_event_data_fid *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_FID);
 		if(data_fid == NULL)
 		{
 			IPACMERR("unable to allocate memory for event data_fid\n");
@@ -960,7 +961,7 @@ int IPACM_OffloadManager::push_iface_up(const char * if_name, bool upstream)
 
 	if(strncmp(if_name, "rndis", 5) == 0 && !upstream)
 	{
-		data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+		data_fid = (ipacm_event_data_fid *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_FID);
 		if(data_fid == NULL)
 		{
 			IPACMERR("unable to allocate memory for event data_fid\n");
@@ -976,7 +977,7 @@ int IPACM_OffloadManager::push_iface_up(const char * if_name, bool upstream)
 
 	if((strncmp(if_name, "softap", 6) == 0 || strncmp(if_name, "wlan", 4) == 0 ) && !upstream)
 	{
-		data_fid = (ipacm_event_data_fid *)malloc(sizeof(ipacm_event_data_fid));
+		data_fid = (ipacm_event_data_fid *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_FID);
 		if(data_fid == NULL)
 		{
 			IPACMERR("unable to allocate memory for event data_fid\n");
@@ -992,7 +993,7 @@ int IPACM_OffloadManager::push_iface_up(const char * if_name, bool upstream)
 
 	if(strncmp(if_name, "wlan", 4) == 0 && upstream)
 	{
-		data = (ipacm_event_data_mac *)malloc(sizeof(ipacm_event_data_mac));
+		data = (ipacm_event_data_mac *)IPACM_EvtDataPool::alloc(IPACM_EVT_DATA_MAC);
 		if(data == NULL)
 		{
 			IPACMERR("unable to allocate memory for event_wlan data\n");
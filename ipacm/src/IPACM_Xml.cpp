@@ -95,6 +95,12 @@ static int32_t IPACM_util_icmp_string
 	 const char* str
 );
 
+static bool IPACM_read_int_element
+(
+	 xmlNode* element,
+	 int *value
+);
+
 static int ipacm_cfg_xml_parse_tree
 (
 	 xmlNode* xml_node,
@@ -165,6 +171,36 @@ static int32_t IPACM_util_icmp_string
 	return ret;
 }
 
+/* read an integer leaf element, returns false if absent or too long */
+static bool IPACM_read_int_element
+(
+	 xmlNode* element,
+	 int *value
+)
+{
+	char content_buf[MAX_XML_STR_LEN];
+	char *content;
+	uint32_t str_size;
+
+	content = IPACM_read_content_element(element);
+	if (content == NULL)
+	{
+		return false;
+	}
+
+	str_size = strlen(content);
+	if (str_size >= MAX_XML_STR_LEN)
+	{
+		IPACMERR("content str_size %d greater than max %d\n", str_size, MAX_XML_STR_LEN);
+		return false;
+	}
+
+	memset(content_buf, 0, sizeof(content_buf));
+	memcpy(content_buf, (void *)content, str_size);
+	*value = atoi(content_buf);
+	return true;
+}
+
 /* This function read IPACM XML and populate the IPA CM Cfg */
 int ipacm_read_cfg_xml(char *xml_file, IPACM_conf_t *config)
 {
@@ -508,6 +544,41 @@ static int ipacm_cfg_xml_parse_tree
 						IPACMDBG_H("Nat Table Max Entries %d\n", config->nat_max_entries);
 					}
 				}
+				else if (IPACM_util_icmp_string((char*)xml_node->name, NAT_BatchSize_TAG) == 0)
+				{
+					if (IPACM_read_int_element(xml_node, &config->nat_batch_size))
+					{
+						IPACMDBG_H("Nat batch size %d\n", config->nat_batch_size);
+					}
+				}
+				else if (IPACM_util_icmp_string((char*)xml_node->name, NAT_SramHotFlows_TAG) == 0)
+				{
+					if (IPACM_read_int_element(xml_node, &config->nat_sram_hot_flows))
+					{
+						IPACMDBG_H("Nat SRAM hot flows %d\n", config->nat_sram_hot_flows);
+					}
+				}
+				else if (IPACM_util_icmp_string((char*)xml_node->name, NAT_CtCacheEntries_TAG) == 0)
+				{
+					if (IPACM_read_int_element(xml_node, &config->nat_ct_cache_entries))
+					{
+						IPACMDBG_H("Nat ct cache entries %d\n", config->nat_ct_cache_entries);
+					}
+				}
+				else if (IPACM_util_icmp_string((char*)xml_node->name, NAT_PendingFlows_TAG) == 0)
+				{
+					if (IPACM_read_int_element(xml_node, &config->nat_pending_flows))
+					{
+						IPACMDBG_H("Nat pending flows %d\n", config->nat_pending_flows);
+					}
+				}
+				else if (IPACM_util_icmp_string((char*)xml_node->name, NeighborClients_TAG) == 0)
+				{
+					if (IPACM_read_int_element(xml_node, &config->neighbor_clients))
+					{
+						IPACMDBG_H("Neighbor clients %d\n", config->neighbor_clients);
+					}
+				}
 				else if (IPACM_util_icmp_string((char*)xml_node->name, NAT_TableType_TAG) == 0)
 				{
 					config->nat_table_memtype = DDR_TABLETYPE_TAG;